@@ -22,24 +22,42 @@
 * OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "dbmd_atmos_parse.h"
+#include "dbmd_checksum.h"
+
+/* Multi-byte fields are loaded with a single little-endian word load where the
+ * host byte order allows it */
+#if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) || defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+#define DBMD_LITTLE_ENDIAN 1
+#endif
 
 /* Global Defines */
-#define DOLBYATMOS_METD_SEG        0x09
-#define DOLBYATMOS_SUP_METD_SEG    0x0a
-#define DASMS_SYNC                 0xf8726fbd
 #define DBMD_PARSER_VERSION	0x01000007	/* Parser is consistent with spec version 1.0.0.7 */
 
-/* DBMD segment payload sizes (not including seg ID, size and checksum) */
-#define DOLBY_ATMOS_SEG_SZ      248
+/* Incremental parser states */
+#define CHUNK_VERSION           0
+#define CHUNK_SEGMENT_HEADER    1
+#define CHUNK_SEGMENT           2
+
+/* Names of the warp_mode, binaural_render_mode and trim configuration values,
+ *  as written on the command line */
+const char *dbmd_warp_mode_names[5] = { "normal", "warping", "pl2x", "loro", "not-indicated" };
+const char *dbmd_binaural_mode_names[5] = { "bypass", "near", "far", "mid", "not-indicated" };
+const char *dbmd_trim_config_names[NUM_TRIM_CONFIGS] = { "2.0", "5.1", "7.1", "2.1.2", "5.1.2", "7.1.2", "2.1.4", "5.1.4", "7.1.4" };
 
 /* Local function prototypes */
 int parse_dolbyatmos_metadata(int seg_size, unsigned char **p_buf, DBMetadata *output);
 int parse_dolbyatmos_splml_metadata(int seg_size, unsigned char **p_buf, DBMetadata *output);
 int check_version(int version);
-int calc_checksum(int seg_size, char *buf);
-int unpack(int nbytes, unsigned char **p_bufptr);
+static int segment_checksum_ok(const char *dbmd_chunk, const DBMDSegment *segment);
+static unsigned int unpack8(unsigned char **p_bufptr);
+static unsigned int unpack16(unsigned char **p_bufptr);
+static unsigned int unpack32(unsigned char **p_bufptr);
+static void skip(int nbytes, unsigned char **p_bufptr);
+static int needs_payload(const DBMDChunkParser *parser);
 
 /*******************************************************************************************
 int parse_dbmd_metadata(...)
@@ -48,74 +66,323 @@ int parse_dbmd_metadata(...)
 -Inputs:
 	char *dbmd_chunk	-	Pointer to dbmd chunk buffer
 	int dbmd_size		-	Size of buffer
+	DBMetadata *output	-	Receives the metadata; its object table must have been
+							set up with dbmd_objects_init() or zeroed
 ********************************************************************************************/
 int parse_dbmd_metadata(char *dbmd_chunk, int dbmd_size, DBMetadata *output)
 {	
-	int version;			/* DBMD Version Number */
-	int segment_id;			/* Metadata Segment ID */
-	int segment_size;		/* Metadata Segment Size */
+	DBMDChunkParser parser;	/* Incremental parser */
 	int error;				/* Error Code */
-	unsigned char *p_buf;	/* Metadata Buffer Pointer */
-	
-	/* Initialize pointer to start of metadata chunk */
-	p_buf = (unsigned char *)dbmd_chunk;
-	
+
+    /* Clear output data structure before parsing */
+	output->DolbyAtmosSeg.segment_exists = 0;
+	output->DolbyAtmosSupSeg.segment_exists = 0;
+
+	/* Decode the segments in chunk order, whatever their number */
+	dbmd_chunk_init(&parser, (dbmd_size > 0) ? (uint64_t)dbmd_size : 0, DBMD_CHUNK_DECODE);
+	do
+	{
+		error = dbmd_chunk_step(&parser, (const unsigned char *)dbmd_chunk + parser.offset, output, NULL);
+	} while (error == DBMD_CHUNK_MORE);
+
+	return error;
+}
+
+/*******************************************************************************************
+void dbmd_chunk_init(...)
+-Purpose:
+	Starts an incremental parse of a dbmd chunk. The first step needs the chunk
+	version.
+-Inputs:
+	DBMDChunkParser *parser		-	Parser state
+	uint64_t size				-	Size of the dbmd chunk
+	int flags					-	DBMD_CHUNK_DECODE to decode the segments,
+									DBMD_INDEX_VERIFY to verify every segment checksum
+********************************************************************************************/
+void dbmd_chunk_init(DBMDChunkParser *parser, uint64_t size, int flags)
+{
+	parser->state = CHUNK_VERSION;
+	parser->flags = flags;
+	parser->decode_id = 0;
+	parser->error = DB_ERR_OK;
+	parser->size = size;
+	parser->pos = DBMD_VERSION_SZ;
+	parser->segment_id = 0;
+	parser->segment_size = 0;
+	parser->offset = 0;
+	parser->len = (size < DBMD_VERSION_SZ) ? (size_t)size : DBMD_VERSION_SZ;
+}
+
+/*******************************************************************************************
+int dbmd_chunk_step(...)
+-Purpose:
+	Runs one step of an incremental parse. Every segment header is checked
+	against the chunk size before its payload is asked for. As with the
+	segment index, the structure of the whole chunk is checked before a decode
+	error is reported, and decoding stops at the first one.
+-Inputs:
+	DBMDChunkParser *parser		-	Parser state
+	const unsigned char *data	-	The parser->len bytes at parser->offset
+	DBMetadata *output			-	Receives the decoded fields, with DBMD_CHUNK_DECODE
+	DBMDSegmentIndex *index		-	Receives the segments found, or NULL
+-Returns:
+	int							-	DBMD_CHUNK_MORE if the bytes given by parser->offset
+									and parser->len are needed next, otherwise the
+									error code of the parse
+********************************************************************************************/
+int dbmd_chunk_step(DBMDChunkParser *parser, const unsigned char *data, DBMetadata *output, DBMDSegmentIndex *index)
+{
+	unsigned char *p_buf = (unsigned char *)data;
+	DBMDSegment segment;
+	DBMDSegment *entry;
+	unsigned int version;
+
+	switch (parser->state)
+	{
+	case CHUNK_VERSION:
+		if (parser->size < DBMD_VERSION_SZ)
+			return DB_ERR_SEGOVERRUN;
+
+		version = unpack32(&p_buf);
+		if (index)
+		{
+			index->version = version;
+			index->num_segments = 0;
+		}
+
+		/* Verify that we understand this version of the
+			Dolby Audio Metadata Chunk */
+		if (check_version((int)version))
+			return DB_ERR_NEWERVERSION;
+		break;
+
+	case CHUNK_SEGMENT_HEADER:
+		/* Signals end of dbmd chunk */
+		if (data[0] == 0)
+			return parser->error;
+
+		/* Unpack metadata segment size, the segment must fit in the chunk */
+		if (parser->len < DBMD_SEG_HEADER_SZ)
+			return DB_ERR_SEGOVERRUN;
+		parser->segment_id = data[0];
+		p_buf = (unsigned char *)data + 1;
+		parser->segment_size = (int)unpack16(&p_buf);
+		if (parser->pos + DBMD_SEG_HEADER_SZ + parser->segment_size + DBMD_SEG_CHECKSUM_SZ > parser->size)
+			return DB_ERR_SEGOVERRUN;
+
+		if (index)
+		{
+			if (index->num_segments == MAX_DBMD_SEGMENTS)
+				return DB_ERR_TOOMANYSEGS;
+			entry = &index->segments[index->num_segments++];
+			entry->id = parser->segment_id;
+			entry->offset = (int)(parser->pos + DBMD_SEG_HEADER_SZ);
+			entry->size = parser->segment_size;
+			entry->checksum_status = DBMD_CHECKSUM_UNCHECKED;
+		}
+
+		/* Read the payload and checksum only if they are needed */
+		if (needs_payload(parser))
+		{
+			parser->state = CHUNK_SEGMENT;
+			parser->offset = parser->pos + DBMD_SEG_HEADER_SZ;
+			parser->len = (size_t)parser->segment_size + DBMD_SEG_CHECKSUM_SZ;
+			return DBMD_CHUNK_MORE;
+		}
+		parser->pos += DBMD_SEG_HEADER_SZ + parser->segment_size + DBMD_SEG_CHECKSUM_SZ;
+		break;
+
+	case CHUNK_SEGMENT:
+		/* The payload is given on its own, so it is at offset 0 */
+		segment.id = parser->segment_id;
+		segment.offset = 0;
+		segment.size = parser->segment_size;
+		if (data[segment.size] == calc_checksum(segment.size, (char *)data))
+			segment.checksum_status = DBMD_CHECKSUM_OK;
+		else
+			segment.checksum_status = DBMD_CHECKSUM_BAD;
+		if (index)
+			index->segments[index->num_segments - 1].checksum_status = segment.checksum_status;
+
+		if ( (parser->flags & DBMD_CHUNK_DECODE) && !parser->error && (!parser->decode_id || (segment.id == parser->decode_id)) )
+			parser->error = parse_dbmd_segment((const char *)data, &segment, output);
+		parser->pos += DBMD_SEG_HEADER_SZ + parser->segment_size + DBMD_SEG_CHECKSUM_SZ;
+		break;
+
+	default:
+		return DB_ERR_SEGOVERRUN;
+	}
+
+	/* read the next segment header, which may be cut short by the end of the chunk */
+	if (parser->pos >= parser->size)
+		return parser->error;
+	parser->state = CHUNK_SEGMENT_HEADER;
+	parser->offset = parser->pos;
+	parser->len = (parser->size - parser->pos < DBMD_SEG_HEADER_SZ) ? (size_t)(parser->size - parser->pos) : DBMD_SEG_HEADER_SZ;
+	return DBMD_CHUNK_MORE;
+}
+
+/*******************************************************************************************
+static int needs_payload(...)
+-Purpose:
+	Tests whether the payload of the current segment has to be read: to verify
+	every checksum, or to decode a segment of a type the parser uses
+********************************************************************************************/
+static int needs_payload(const DBMDChunkParser *parser)
+{
+	if (parser->flags & DBMD_INDEX_VERIFY)
+		return 1;
+	if ( !(parser->flags & DBMD_CHUNK_DECODE) || parser->error )
+		return 0;
+	if ( parser->decode_id && (parser->segment_id != parser->decode_id) )
+		return 0;
+
+	return (parser->segment_id == DOLBYATMOS_METD_SEG) || (parser->segment_id == DOLBYATMOS_SUP_METD_SEG);
+}
+
+/*******************************************************************************************
+int index_dbmd_segments(...)
+-Purpose:
+	Walks the Dolby Audio Metadata Chunk once and records the ID, payload offset and
+	size of every metadata segment without decoding any segment fields. Segment
+	checksums are only computed if requested.
+-Inputs:
+	const char *dbmd_chunk		-	Pointer to dbmd chunk buffer
+	int dbmd_size				-	Size of buffer
+	int flags					-	DBMD_INDEX_VERIFY to verify segment checksums
+	DBMDSegmentIndex *index		-	Receives the segments
+-Returns:
+	int							-	error code
+********************************************************************************************/
+int index_dbmd_segments(const char *dbmd_chunk, int dbmd_size, int flags, DBMDSegmentIndex *index)
+{
+	const unsigned char *buf = (const unsigned char *)dbmd_chunk;
+	unsigned char *p_buf = (unsigned char *)dbmd_chunk;
+	DBMDSegment *segment;
+	int segment_id;
+	int segment_size;
+	int pos;
+
+	index->version = 0;
+	index->num_segments = 0;
+
+	if (dbmd_size < DBMD_VERSION_SZ)
+		return DB_ERR_SEGOVERRUN;
+
 	/* Unpack version number */
-	version = unpack(4, &p_buf);
+	index->version = unpack32(&p_buf);
 
 	/* Verify that we understand this version of the
 		Dolby Audio Metadata Chunk */
-	if( check_version(version) )
+	if( check_version((int)index->version) )
 		return DB_ERR_NEWERVERSION;
 
-    /* Clear output data structure before parsing */
-	output->DolbyAtmosSeg.segment_exists = 0;
-	output->DolbyAtmosSupSeg.segment_exists = 0;
-
-	while(1)
+	for (pos = DBMD_VERSION_SZ; pos < dbmd_size; pos += DBMD_SEG_HEADER_SZ + segment_size + DBMD_SEG_CHECKSUM_SZ)
 	{
 		/* Unpack next metadata segment id */
-		segment_id = unpack(1, &p_buf);
-
-		if(segment_id == 0)	/* Signals end of dbmd chunk */
+		segment_id = buf[pos];
+		if (segment_id == 0)	/* Signals end of dbmd chunk */
 			break;
-		else
+
+		/* Unpack metadata segment size, the segment must fit in the chunk */
+		if (pos + DBMD_SEG_HEADER_SZ > dbmd_size)
+			return DB_ERR_SEGOVERRUN;
+		p_buf = (unsigned char *)dbmd_chunk + pos + 1;
+		segment_size = (int)unpack16(&p_buf);
+		if (pos + DBMD_SEG_HEADER_SZ + segment_size + DBMD_SEG_CHECKSUM_SZ > dbmd_size)
+			return DB_ERR_SEGOVERRUN;
+
+		if (index->num_segments == MAX_DBMD_SEGMENTS)
+			return DB_ERR_TOOMANYSEGS;
+
+		segment = &index->segments[index->num_segments++];
+		segment->id = segment_id;
+		segment->offset = pos + DBMD_SEG_HEADER_SZ;
+		segment->size = segment_size;
+		segment->checksum_status = DBMD_CHECKSUM_UNCHECKED;
+
+		if (flags & DBMD_INDEX_VERIFY)
 		{
-			/* Unpack metadata segment size */
-			segment_size = unpack(2, &p_buf);
+			if (buf[segment->offset + segment_size] == calc_checksum(segment_size, (char *)dbmd_chunk + segment->offset))
+				segment->checksum_status = DBMD_CHECKSUM_OK;
+			else
+				segment->checksum_status = DBMD_CHECKSUM_BAD;
+		}
+	}
 
-			switch(segment_id)
-			{
-				case DOLBYATMOS_METD_SEG: /* Dolby Atmos Metadata */
+	return DB_ERR_OK;
+}
 
-					/* Unpack Dolby Atmos Supplemental metadata segment */
-					output->DolbyAtmosSeg.segment_exists = 1;
-					if ( (error = parse_dolbyatmos_metadata(segment_size, &p_buf, output)) )
-						return error;
+/*******************************************************************************************
+const DBMDSegment *find_dbmd_segment(...)
+-Purpose:
+	Looks up the first metadata segment with the given ID
+-Inputs:
+	const DBMDSegmentIndex *index	-	Segment index
+	int segment_id					-	Metadata segment ID
+-Returns:
+	const DBMDSegment *				-	segment, NULL if the chunk has none with this ID
+********************************************************************************************/
+const DBMDSegment *find_dbmd_segment(const DBMDSegmentIndex *index, int segment_id)
+{
+	int i;
 
-					break;
+	for (i = 0; i < index->num_segments; i++)
+	{
+		if (index->segments[i].id == segment_id)
+			return &index->segments[i];
+	}
 
-				case DOLBYATMOS_SUP_METD_SEG: /* Dolby Atmos Supplemental Metadata */
+	return NULL;
+}
 
-					/* Unpack Dolby Atmos Supplemental metadata segment */
-					output->DolbyAtmosSupSeg.segment_exists = 1;
-					if ( (error = parse_dolbyatmos_splml_metadata(segment_size, &p_buf, output)) )
-						return error;
+/*******************************************************************************************
+int parse_dbmd_segment(...)
+-Purpose:
+	Decodes a single indexed metadata segment. Segments of types the parser does
+	not use are left alone.
+-Inputs:
+	const char *dbmd_chunk		-	Pointer to dbmd chunk buffer
+	const DBMDSegment *segment	-	Segment found by index_dbmd_segments()
+	DBMetadata *output			-	Receives the decoded fields
+-Returns:
+	int							-	error code
+********************************************************************************************/
+int parse_dbmd_segment(const char *dbmd_chunk, const DBMDSegment *segment, DBMetadata *output)
+{
+	unsigned char *p_buf = (unsigned char *)dbmd_chunk + segment->offset;
 
-					break;
+	switch(segment->id)
+	{
+		case DOLBYATMOS_METD_SEG: /* Dolby Atmos Metadata */
 
-				default:	/* All other segment types */
+			/* Unpack Dolby Atmos metadata segment */
+			output->DolbyAtmosSeg.segment_exists = 1;
 
-					/* Advance beyond this segment and checksum*/
-					unpack((segment_size + 1), &p_buf);
-					break;
-			}			
+			/* If unsupported segment size */
+			if (segment->size != DOLBY_ATMOS_SEG_SZ)
+				return DB_ERR_DASEGSZ;
 
-		}
+			/* Verify segment checksum before continuing */
+			if (!segment_checksum_ok(dbmd_chunk, segment))
+				return DB_ERR_DACHECKSUM;
 
-	}	/* while(1) */
+			return parse_dolbyatmos_metadata(segment->size, &p_buf, output);
 
-	return DB_ERR_OK;
+		case DOLBYATMOS_SUP_METD_SEG: /* Dolby Atmos Supplemental Metadata */
+
+			/* Unpack Dolby Atmos Supplemental metadata segment */
+			output->DolbyAtmosSupSeg.segment_exists = 1;
+
+			/* Verify segment checksum before continuing */
+			if (!segment_checksum_ok(dbmd_chunk, segment))
+				return DB_ERR_DASCHECKSUM;
+
+			return parse_dolbyatmos_splml_metadata(segment->size, &p_buf, output);
+
+		default:	/* All other segment types */
+			return DB_ERR_OK;
+	}
 }
 
 /*******************************************************************************************
@@ -129,58 +396,48 @@ unsigned char **p_buf	-	Address of metadata buffer pointer
 int parse_dolbyatmos_metadata(int seg_size, unsigned char **p_buf, DBMetadata *output)
 {
 	/* Metadata segment words */
-	int temp_int, i;
+	int temp_int;
 	int read_count = 0;
 	DolbyAtmosSegment *dams;
 
-	/* If unsupported segment size */
-	if (seg_size != DOLBY_ATMOS_SEG_SZ)
-		return DB_ERR_DASEGSZ;
-
-	/* Verify segment checksum before continuing */
-	if ((*p_buf)[seg_size] != calc_checksum(seg_size, (char *)*p_buf))
-		return DB_ERR_DACHECKSUM;
-
 	/* setup pointer */
 	dams = &output->DolbyAtmosSeg;
 
 	/* Skip past unneeded fields */
-	unpack(32, p_buf);
+	skip(32, p_buf);
 	read_count = read_count + 32; /* update read_count */
 
 	/* content_information() */
 	/* content_creation_tool */
-	for (i = 0; i < ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN; i++)
-	{
-		dams->content_creation_tool[i] = (char)unpack(1, p_buf);
-		read_count = read_count + 1; /* update read_count */
-	}
+	memcpy(dams->content_creation_tool, *p_buf, ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN);
+	skip(ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN, p_buf);
+	read_count = read_count + ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN; /* update read_count */
 	dams->content_creation_tool[ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN] = 0; /* null terminate string */
 
 	/* content_creation_tool_version */
-	dams->content_creation_tool_version.major = unpack(1, p_buf); /* major */
-	dams->content_creation_tool_version.minor = unpack(1, p_buf); /* minor */
-	dams->content_creation_tool_version.micro = unpack(1, p_buf); /* micro */
+	dams->content_creation_tool_version.major = unpack8(p_buf); /* major */
+	dams->content_creation_tool_version.minor = unpack8(p_buf); /* minor */
+	dams->content_creation_tool_version.micro = unpack8(p_buf); /* micro */
 	read_count = read_count + 1 + 1 + 1; /* update read_count */
 
 	/* Skip past unneeded fields */
-	unpack(53, p_buf);
+	skip(53, p_buf);
 	read_count = read_count + 53; /* update read_count */
 
 	/* additional_rendering_metadata() */
-	temp_int = unpack(1, p_buf); /* bed_distribution, reserved, warp_mode */
-	unpack(15, p_buf); /* reserved */
+	temp_int = unpack8(p_buf); /* bed_distribution, reserved, warp_mode */
+	skip(15, p_buf); /* reserved */
 	read_count = read_count + 1 + 15; /* update read_count */
 
 	/* warp_mode */
 	dams->warp_mode = temp_int & 0x7;
 
 	/* Skip past unneeded fields */
-	unpack(80, p_buf);
+	skip(80, p_buf);
 	read_count = read_count + 80; /* update read_count */
 
 	/* Unpack any remaining segment bytes, including the checksum */
-	unpack((seg_size - read_count + 1), p_buf);
+	skip((seg_size - read_count + 1), p_buf);
 
 	return 0;
 }
@@ -198,20 +455,25 @@ int parse_dolbyatmos_splml_metadata(int seg_size, unsigned char **p_buf, DBMetad
 {
 	/* Metadata segment words */
 	unsigned int read_count = 0;
-	int sync, object_count;
+	unsigned int sync;
+	unsigned int object_count;
+	unsigned int mode;
 	int auto_trim;
-	int cfg, obj, temp_int;
+	int cfg, error;
+	unsigned int obj;
 	DolbyAtmosSupplementalSegment *dasms;
 
-	/* Verify segment checksum before continuing */
-	if ((*p_buf)[seg_size] != calc_checksum(seg_size, (char *)*p_buf))
-		return DB_ERR_DASCHECKSUM;
-
 	/* setup pointer */
 	dasms = &output->DolbyAtmosSupSeg;
 
+	/* the sync word and object_count must lie within the segment */
+	if (seg_size < 6)
+	{
+		return DB_ERR_SEGOVERRUN;
+	}
+
 	/* check sync */
-	sync = unpack(4, p_buf);
+	sync = unpack32(p_buf);
 	read_count = read_count + 4; /* update read_count */
 	if (sync != DASMS_SYNC)
 	{
@@ -219,52 +481,132 @@ int parse_dolbyatmos_splml_metadata(int seg_size, unsigned char **p_buf, DBMetad
 	}
 
 	/* parse object_count */
-	object_count = unpack(2, p_buf);
+	object_count = unpack16(p_buf);
 	read_count = read_count + 2; /* update read_count */
-	if (object_count > MAX_OBJECT_COUNT)
+
+	/* the per-object bytes must lie within the segment */
+	if (read_count + 1 + NUM_TRIM_CONFIGS * 15 + 2 * object_count > (unsigned int)seg_size)
 	{
-		return DB_ERR_TOOMANYOBJS;
+		return DB_ERR_SEGOVERRUN;
+	}
+	if ( (error = dbmd_objects_reserve(&dasms->objects, object_count)) )
+	{
+		return error;
 	}
 	dasms->object_count = object_count;
 	
 	/* parse trim metadata */
-	unpack(1, p_buf); /* reserved */
+	skip(1, p_buf); /* reserved */
 	read_count = read_count + 1; /* update read_count */
 
 	for (cfg = 0; cfg < NUM_TRIM_CONFIGS; cfg++)
 	{
 		/* auto_trim */
-		auto_trim = unpack(1, p_buf) & 0x01; /* reserved + auto_trim */
+		auto_trim = unpack8(p_buf) & 0x01; /* reserved + auto_trim */
 		read_count = read_count + 1; /* update read_count */
 		dasms->trims[cfg].auto_trim = auto_trim;
 
 		/* Skip past unneeded fields */
-		unpack(14, p_buf);
+		skip(14, p_buf);
 		read_count = read_count + 14; /* update read_count */
 	}
 
-	/* Skip past unneeded fields */
-	for (obj = 0; obj < object_count; obj++)
-	{
-		unpack(1, p_buf);
-		read_count = read_count + 1; /* update read_count */
-	}
+	/* object flags */
+	memcpy(dasms->objects.flags, *p_buf, object_count);
+	skip(object_count, p_buf);
+	read_count = read_count + object_count; /* update read_count */
 
-	/* headphone metadata */
+	/* headphone metadata, counting the objects per binaural render mode */
+	memset(dasms->mode_histogram, 0, sizeof(dasms->mode_histogram));
 	for (obj = 0; obj < object_count; obj++)
 	{
-		temp_int = unpack(1, p_buf);
-		read_count = read_count + 1; /* update read_count */
-		dasms->binaural_render_mode[obj] = temp_int & 0x7;
+		mode = unpack8(p_buf) & 0x7;
+		dasms->objects.binaural_render_mode[obj] = (unsigned char)mode;
+		dasms->mode_histogram[mode]++;
 	}
+	read_count = read_count + object_count; /* update read_count */
 
 	/* Unpack any remaining segment bytes, including the checksum */
-	unpack((seg_size - read_count + 1), p_buf);
+	skip((seg_size - read_count + 1), p_buf);
 
 	return 0;
 }
 
 
+/*******************************************************************************************
+void dbmd_objects_init(...)
+-Purpose:
+	Sets up an object table. With arrays supplied, the table holds at most
+	capacity objects; without (NULL, 0), the parser allocates the arrays.
+-Inputs:
+	DBMDObjectTable *objects		-	Object table
+	unsigned char *flags			-	Array for the object flags, or NULL
+	unsigned char *binaural_render_mode	-	Array for the binaural render modes, or NULL
+	unsigned int capacity			-	Number of entries of each array
+********************************************************************************************/
+void dbmd_objects_init(DBMDObjectTable *objects, unsigned char *flags, unsigned char *binaural_render_mode, unsigned int capacity)
+{
+	objects->flags = flags;
+	objects->binaural_render_mode = binaural_render_mode;
+	objects->capacity = (flags && binaural_render_mode) ? capacity : 0;
+	objects->allocated = 0;
+}
+
+/*******************************************************************************************
+int dbmd_objects_reserve(...)
+-Purpose:
+	Makes sure an object table holds count objects. Arrays allocated by the parser
+	are grown, to at least twice their size to amortize the growth over many
+	files; caller-supplied arrays are never replaced.
+-Inputs:
+	DBMDObjectTable *objects	-	Object table
+	unsigned int count			-	Number of objects
+-Returns:
+	int							-	DB_ERR_OK, DB_ERR_TOOMANYOBJS if supplied arrays are
+									too small or DB_ERR_NOMEMORY
+********************************************************************************************/
+int dbmd_objects_reserve(DBMDObjectTable *objects, unsigned int count)
+{
+	unsigned char *block;
+	unsigned int capacity;
+
+	if (count <= objects->capacity)
+		return DB_ERR_OK;
+	if ( objects->flags && !objects->allocated )
+		return DB_ERR_TOOMANYOBJS;
+
+	/* both arrays share one allocation */
+	capacity = (objects->capacity * 2 > count) ? objects->capacity * 2 : count;
+	if (capacity < 128)
+		capacity = 128;
+	block = (unsigned char *)malloc(2 * (size_t)capacity);
+	if (!block)
+		return DB_ERR_NOMEMORY;
+
+	dbmd_objects_free(objects);
+	objects->flags = block;
+	objects->binaural_render_mode = block + capacity;
+	objects->capacity = capacity;
+	objects->allocated = 1;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+void dbmd_objects_free(...)
+-Purpose:
+	Releases the arrays of an object table allocated by the parser, leaving an
+	empty table that allocates again on next use
+-Inputs:
+	DBMDObjectTable *objects	-	Object table
+********************************************************************************************/
+void dbmd_objects_free(DBMDObjectTable *objects)
+{
+	if (objects->allocated)
+		free(objects->flags);
+	dbmd_objects_init(objects, NULL, NULL, 0);
+}
+
 /*******************************************************************************************
 int check_version(...)
 -Purpose:
@@ -303,42 +645,97 @@ int calc_checksum(...)
 ********************************************************************************************/
 int calc_checksum(int seg_size, char *buf)
 {
-	char data;
-    int j;
+	/* initialize the checksum to the metadata segment size and add the metadata
+	   segment payload including unused bits */
+	unsigned int sum = (unsigned int)seg_size + dbmd_byte_sum((const unsigned char *)buf, seg_size);
 
-	/* initialize the checksum to the metadata segment size */
-	unsigned char sum = seg_size;
+	/* take the 2's complement of the running checksum */
+	return (int)((~sum + 1) & 0xFF);
+}
 
-	/* perform checksum on the metadata segment payload including unused bits */
-	for (j = 0; j < seg_size; j++)
-	{
-		data = *buf++;
-		sum = (sum + data) & 0xFF;
-	}
+/*******************************************************************************************
+static int segment_checksum_ok(...)
+-Purpose:
+	Tests the checksum of an indexed segment, using the result recorded by the
+	index if it was verified there
+********************************************************************************************/
+static int segment_checksum_ok(const char *dbmd_chunk, const DBMDSegment *segment)
+{
+	const unsigned char *buf = (const unsigned char *)dbmd_chunk;
 
-	/* take the 2's complement of the running checksum */
-	sum = ((~sum) + 1) & 0xFF;
+	if (segment->checksum_status != DBMD_CHECKSUM_UNCHECKED)
+		return (segment->checksum_status == DBMD_CHECKSUM_OK);
 
-	return sum;
+	return (buf[segment->offset + segment->size] == calc_checksum(segment->size, (char *)dbmd_chunk + segment->offset));
 }
 
 /*******************************************************************************************
-int unpack(...)
+static unsigned int unpack8(...)
 -Purpose:
-	Unpacks the requested number of bytes from the input buffer and advances the
-	buffer pointer.  The unpacked bytes are formed into a data word nbytes wide.
+	Unpacks one byte from the input buffer and advances the buffer pointer
 -Inputs:	
-	int nbytes					-	Number of bytes to unpack
 	unsigned char **p_bufptr	-	Address of metadata buffer pointer
 ********************************************************************************************/
-int unpack(int nbytes, unsigned char **p_bufptr)
+static unsigned int unpack8(unsigned char **p_bufptr)
 {
-	unsigned int data = 0;
-    int i;
+	return *(*p_bufptr)++;
+}
 
-	/* Unpack data values, LSB->MSB ordering */
-	for(i = 0; i < nbytes; i++)
-		data += (*(*p_bufptr)++) << (i * 8);
+/*******************************************************************************************
+static unsigned int unpack16(...)
+-Purpose:
+	Unpacks a 16-bit little-endian word from the input buffer and advances the
+	buffer pointer
+-Inputs:	
+	unsigned char **p_bufptr	-	Address of metadata buffer pointer
+********************************************************************************************/
+static unsigned int unpack16(unsigned char **p_bufptr)
+{
+	const unsigned char *p = *p_bufptr;
+	uint16_t data;
+
+#ifdef DBMD_LITTLE_ENDIAN
+	memcpy(&data, p, 2);
+#else
+	data = (uint16_t)(p[0] | (p[1] << 8));
+#endif
+	*p_bufptr += 2;
 
-	return(data);
+	return data;
+}
+
+/*******************************************************************************************
+static unsigned int unpack32(...)
+-Purpose:
+	Unpacks a 32-bit little-endian word from the input buffer and advances the
+	buffer pointer
+-Inputs:	
+	unsigned char **p_bufptr	-	Address of metadata buffer pointer
+********************************************************************************************/
+static unsigned int unpack32(unsigned char **p_bufptr)
+{
+	const unsigned char *p = *p_bufptr;
+	uint32_t data;
+
+#ifdef DBMD_LITTLE_ENDIAN
+	memcpy(&data, p, 4);
+#else
+	data = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+#endif
+	*p_bufptr += 4;
+
+	return data;
+}
+
+/*******************************************************************************************
+static void skip(...)
+-Purpose:
+	Advances the buffer pointer past fields that are not needed
+-Inputs:	
+	int nbytes					-	Number of bytes to skip
+	unsigned char **p_bufptr	-	Address of metadata buffer pointer
+********************************************************************************************/
+static void skip(int nbytes, unsigned char **p_bufptr)
+{
+	*p_bufptr += nbytes;
 }
@@ -22,20 +22,60 @@
 * OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
+#ifndef DBMD_ATMOS_PARSE_H
+#define DBMD_ATMOS_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
 /* This defines the Metadata as parsed from the wave 
  *  metadata chunk
  */
-#define MAX_OBJECT_COUNT 128
+#define MAX_OBJECT_COUNT 65535        /* object_count is a 16-bit field */
+#define NUM_BINAURAL_RENDER_MODES 8    /* binaural_render_mode is a 3-bit field */
 #define NUM_TRIM_CONFIGS 9
+#define MAX_DBMD_SEGMENTS 64
+#define MAX_DBMD_SEGMENT_SIZE 65535   /* segment payload size is a 16-bit field */
+
+/* Metadata segment IDs */
+#define DOLBYATMOS_METD_SEG        0x09
+#define DOLBYATMOS_SUP_METD_SEG    0x0a
+#define DASMS_SYNC                 0xf8726fbd
+
+/* DBMD segment payload sizes (not including seg ID, size and checksum) */
+#define DOLBY_ATMOS_SEG_SZ      248
+
+/* DBMD chunk layout: version, then segments of ID, size, payload and checksum */
+#define DBMD_VERSION_SZ         4
+#define DBMD_SEG_HEADER_SZ      3
+#define DBMD_SEG_CHECKSUM_SZ    1
 
 enum {
     DB_ERR_OK = 0,
     DB_ERR_NEWERVERSION = -1, /* Can't understand Metadata because its a newer version */
 	DB_ERR_BADDASMSSYNC = -9, /* Bad DASMS Sync value */
-	DB_ERR_TOOMANYOBJS = -10, /* Too many objects */
+	DB_ERR_TOOMANYOBJS = -10, /* More objects than the caller-supplied object table holds */
 	DB_ERR_DASEGSZ = -11,     /* Unsupored segment size for Dolby Atmos Segment */
 	DB_ERR_DACHECKSUM = -12,  /* Bad checksum for Dolby Atmos Segment */
-	DB_ERR_DASCHECKSUM = -13  /* Bad checksum for Dolby Atmos Supplemental Segment */
+	DB_ERR_DASCHECKSUM = -13, /* Bad checksum for Dolby Atmos Supplemental Segment */
+	DB_ERR_SEGOVERRUN = -14,  /* Metadata segment extends beyond the dbmd chunk */
+	DB_ERR_TOOMANYSEGS = -15, /* More than MAX_DBMD_SEGMENTS metadata segments */
+	DB_ERR_PATCHFIELD = -16,  /* Edited segment or object not present in the dbmd chunk */
+	DB_ERR_AXMLSYNTAX = -17,  /* ADM XML chunk ends within a tag, comment or CDATA section */
+
+	/* WAV file errors */
+	DB_ERR_FILEOPEN = -20,    /* Unable to open input file */
+	DB_ERR_FILEREAD = -21,    /* Unexpected end of file or read failure */
+	DB_ERR_NOTRIFF = -22,     /* File does not begin with RIFF/RF64/BW64 */
+	DB_ERR_NOTWAVE = -23,     /* RIFF form type is not WAVE */
+	DB_ERR_CHUNKSIZE = -24,   /* Subchunk with a size of zero */
+	DB_ERR_DS64SIZE = -25,    /* ds64 chunk too small */
+	DB_ERR_DBMDSIZE = -26,    /* dbmd chunk too large to be parsed */
+	DB_ERR_MISSINGCHUNK = -27, /* Required subchunk(s) not found */
+	DB_ERR_NOTSUPPORTED = -28, /* I/O mode not supported on this platform */
+	DB_ERR_NOTSEEKABLE = -29,  /* Input is a pipe or other non-seekable file */
+	DB_ERR_NOMEMORY = -30,     /* Out of memory */
+	DB_ERR_FILEWRITE = -31     /* Unable to write to the file or journal */
 };
 
 typedef enum
@@ -82,11 +122,26 @@ typedef enum
 	ATMOS_DBMD_BINAURAL_RENDER_MODE_NOT_INDICATED = 0x04
 } atmos_dbmd_binaural_render_mode;
 
+/* Per-object metadata of the Dolby Atmos Supplemental segment, one array per
+ *  field. The arrays are either supplied by the caller with dbmd_objects_init(),
+ *  and a segment with more objects than they hold fails to decode, or, if none
+ *  are supplied, allocated by the parser and grown as needed. Allocated arrays
+ *  are reused for the following segments and released with dbmd_objects_free().
+ */
+typedef struct
+{
+	unsigned char *flags;                /* Object byte preceding the headphone metadata */
+	unsigned char *binaural_render_mode; /* atmos_dbmd_binaural_render_mode of each object */
+	unsigned int capacity;               /* Number of objects the arrays hold */
+	int allocated;                       /* Set if the arrays were allocated by the parser */
+} DBMDObjectTable;
+
 typedef struct
 {
 	unsigned int segment_exists; 
 	unsigned int object_count;
-	atmos_dbmd_binaural_render_mode binaural_render_mode[MAX_OBJECT_COUNT];
+	DBMDObjectTable objects;
+	unsigned int mode_histogram[NUM_BINAURAL_RENDER_MODES]; /* Number of objects per binaural render mode */
 	struct trim_mode trims[NUM_TRIM_CONFIGS];
 } DolbyAtmosSupplementalSegment;
 
@@ -96,4 +151,72 @@ typedef struct
 	DolbyAtmosSupplementalSegment DolbyAtmosSupSeg;
 } DBMetadata;
 
+/* Location of a metadata segment within the dbmd chunk, as found by
+ *  index_dbmd_segments() without decoding any of its fields
+ */
+#define DBMD_INDEX_VERIFY 0x01 /* index_dbmd_segments() flag: verify segment checksums */
+
+typedef enum
+{
+	DBMD_CHECKSUM_UNCHECKED = 0,
+	DBMD_CHECKSUM_OK = 1,
+	DBMD_CHECKSUM_BAD = 2
+} dbmd_checksum_status;
+
+typedef struct
+{
+	int id;                              /* Metadata segment ID */
+	int offset;                          /* Offset of the segment payload within the dbmd chunk */
+	int size;                            /* Size of the segment payload */
+	dbmd_checksum_status checksum_status;
+} DBMDSegment;
+
+typedef struct
+{
+	unsigned int version;                        /* dbmd chunk version */
+	int num_segments;                            /* Number of segments found */
+	DBMDSegment segments[MAX_DBMD_SEGMENTS];     /* Segments in chunk order */
+} DBMDSegmentIndex;
+
+/* Incremental dbmd chunk parser. The chunk is visited one segment at a time:
+ *  each call of dbmd_chunk_step() is given the bytes the previous step asked
+ *  for in offset and len, relative to the start of the chunk, so a chunk of
+ *  any size is parsed without being held in memory. A step never asks for
+ *  more than DBMD_CHUNK_MAX_READ bytes, the payload and checksum of the
+ *  largest segment, and only asks for the payloads it decodes or verifies.
+ */
+#define DBMD_CHUNK_MORE 1         /* dbmd_chunk_step() result: the bytes at offset are needed */
+#define DBMD_CHUNK_DECODE 0x02    /* dbmd_chunk_init() flag: decode the segments into the metadata */
+#define DBMD_CHUNK_MAX_READ (MAX_DBMD_SEGMENT_SIZE + 1)
+
+typedef struct
+{
+	int state;              /* Parser state */
+	int flags;              /* DBMD_INDEX_VERIFY and DBMD_CHUNK_DECODE */
+	int decode_id;          /* With DBMD_CHUNK_DECODE, only decode segments with this ID, 0 for all */
+	int error;              /* First decode error, reported once the whole chunk has been checked */
+	uint64_t size;          /* Size of the dbmd chunk */
+	uint64_t pos;           /* Offset of the current segment header */
+	int segment_id;         /* ID of the current segment */
+	int segment_size;       /* Payload size of the current segment */
+	uint64_t offset;        /* Offset of the bytes needed by the next step */
+	size_t len;             /* Number of bytes needed by the next step */
+} DBMDChunkParser;
+
 int parse_dbmd_metadata(char *dbmd_chunk, int dbmd_size, DBMetadata *output);
+void dbmd_chunk_init(DBMDChunkParser *parser, uint64_t size, int flags);
+int dbmd_chunk_step(DBMDChunkParser *parser, const unsigned char *data, DBMetadata *output, DBMDSegmentIndex *index);
+int index_dbmd_segments(const char *dbmd_chunk, int dbmd_size, int flags, DBMDSegmentIndex *index);
+const DBMDSegment *find_dbmd_segment(const DBMDSegmentIndex *index, int segment_id);
+int parse_dbmd_segment(const char *dbmd_chunk, const DBMDSegment *segment, DBMetadata *output);
+
+void dbmd_objects_init(DBMDObjectTable *objects, unsigned char *flags, unsigned char *binaural_render_mode, unsigned int capacity);
+int dbmd_objects_reserve(DBMDObjectTable *objects, unsigned int count);
+void dbmd_objects_free(DBMDObjectTable *objects);
+
+/* Value names accepted by the patch and query expressions, indexed by field value */
+extern const char *dbmd_warp_mode_names[5];
+extern const char *dbmd_binaural_mode_names[5];
+extern const char *dbmd_trim_config_names[NUM_TRIM_CONFIGS];
+
+#endif /* DBMD_ATMOS_PARSE_H */
@@ -0,0 +1,434 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <string.h>
+#include <stdint.h>
+
+#include "dbmd_axml.h"
+
+/* Scanner states */
+#define AXML_TEXT 0     /* Between tags */
+#define AXML_OPEN 1     /* After a <, until the tag is told apart from a comment or CDATA section */
+#define AXML_TAG 2      /* Within a tag */
+#define AXML_COMMENT 3  /* Within a comment, up to --> */
+#define AXML_CDATA 4    /* Within a CDATA section, up to ]]> */
+
+/* Local function prototypes */
+static int open_state(DBMDAxmlScanner *scanner, char c);
+static const char *tag_end(DBMDAxmlScanner *scanner, const char *p, const char *end);
+static const char *section_end(DBMDAxmlScanner *scanner, const char *p, const char *end, const char *close);
+static void tag_append(DBMDAxmlScanner *scanner, const char *p, size_t len);
+static void tail_append(char *tail, const char *p, size_t len);
+static void count_tag(DBMDAxmlScanner *scanner);
+static int find_attribute(const char *attrs, size_t len, const char *name, const char **value, size_t *value_len);
+static int name_is(const char *s, size_t len, const char *name);
+static int is_space(char c);
+
+/*******************************************************************************************
+void dbmd_axml_init(...)
+-Purpose:
+	Starts the scan of an axml chunk, clearing the summary
+-Inputs:
+	DBMDAxmlScanner *scanner	-	Scanner state
+	DBMDAxmlSummary *summary	-	Receives the element counts
+********************************************************************************************/
+void dbmd_axml_init(DBMDAxmlScanner *scanner, DBMDAxmlSummary *summary)
+{
+	memset(summary, 0, sizeof(DBMDAxmlSummary));
+
+	scanner->state = AXML_TEXT;
+	scanner->quote = 0;
+	scanner->tail[0] = 0;
+	scanner->tail[1] = 0;
+	scanner->tag_len = 0;
+	scanner->summary = summary;
+}
+
+/*******************************************************************************************
+void dbmd_axml_feed(...)
+-Purpose:
+	Scans the next window of the axml chunk. The window is not referenced once
+	the call returns, so its buffer may be reused for the next one.
+-Inputs:
+	DBMDAxmlScanner *scanner	-	Scanner state
+	const char *data			-	Bytes of the chunk following those already fed
+	size_t len					-	Number of bytes
+********************************************************************************************/
+void dbmd_axml_feed(DBMDAxmlScanner *scanner, const char *data, size_t len)
+{
+	const char *p = data;
+	const char *end = data + len;
+	const char *q;
+
+	while (p < end)
+	{
+		switch (scanner->state)
+		{
+		case AXML_TEXT:
+			if ( !(q = memchr(p, '<', (size_t)(end - p))) )
+				return;
+			p = q + 1;
+			scanner->tag_len = 0;
+			scanner->quote = 0;
+			scanner->state = AXML_OPEN;
+			break;
+
+		case AXML_OPEN:
+			/* a byte that does not continue <!-- or <![CDATA[ is left to the tag */
+			if ( (scanner->state = open_state(scanner, *p)) != AXML_TAG )
+				tag_append(scanner, p++, 1);
+			break;
+
+		case AXML_TAG:
+			q = tag_end(scanner, p, end);
+			tag_append(scanner, p, (size_t)(q - p));
+			if (q == end)
+				return;
+			count_tag(scanner);
+			p = q + 1;
+			scanner->state = AXML_TEXT;
+			break;
+
+		case AXML_COMMENT:
+			p = section_end(scanner, p, end, "--");
+			break;
+
+		case AXML_CDATA:
+			p = section_end(scanner, p, end, "]]");
+			break;
+		}
+	}
+}
+
+/*******************************************************************************************
+int dbmd_axml_finish(...)
+-Purpose:
+	Ends the scan once the whole chunk has been fed
+-Inputs:
+	DBMDAxmlScanner *scanner	-	Scanner state
+-Returns:
+	int							-	DB_ERR_AXMLSYNTAX if the chunk ends within a tag,
+									comment or CDATA section, otherwise DB_ERR_OK
+********************************************************************************************/
+int dbmd_axml_finish(DBMDAxmlScanner *scanner)
+{
+	scanner->summary->error = (scanner->state == AXML_TEXT) ? DB_ERR_OK : DB_ERR_AXMLSYNTAX;
+	scanner->summary->scanned = 1;
+
+	return scanner->summary->error;
+}
+
+/*******************************************************************************************
+int dbmd_axml_matches(...)
+-Purpose:
+	Checks the ADM XML against the Dolby Atmos Supplemental Metadata. The
+	supplemental segment has an entry for every bed channel and object, so one
+	per track, and its object count must equal the number of audioTrackUID
+	elements.
+-Inputs:
+	const DBMDAxmlSummary *summary	-	Summary of the axml chunk
+	const DBMetadata *metadata		-	Metadata parsed from the dbmd chunk
+-Returns:
+	int								-	1 if the counts agree, 0 if they differ, -1 if
+										the chunk was not scanned or has no
+										supplemental segment
+********************************************************************************************/
+int dbmd_axml_matches(const DBMDAxmlSummary *summary, const DBMetadata *metadata)
+{
+	if ( !summary->scanned || (summary->error != DB_ERR_OK) || !metadata->DolbyAtmosSupSeg.segment_exists )
+		return -1;
+
+	return summary->track_uids == metadata->DolbyAtmosSupSeg.object_count;
+}
+
+/*******************************************************************************************
+static int open_state(...)
+-Purpose:
+	Tells the state following a < and the bytes held so far given the next byte
+********************************************************************************************/
+static int open_state(DBMDAxmlScanner *scanner, char c)
+{
+	static const char comment[] = "!--";
+	static const char cdata[] = "![CDATA[";
+	size_t n = scanner->tag_len;
+
+	if ( (n < sizeof(comment) - 1) && !memcmp(scanner->tag, comment, n) && (c == comment[n]) )
+	{
+		if (n + 1 < sizeof(comment) - 1)
+			return AXML_OPEN;
+		scanner->tail[0] = 0;
+		scanner->tail[1] = 0;
+		return AXML_COMMENT;
+	}
+	if ( (n < sizeof(cdata) - 1) && !memcmp(scanner->tag, cdata, n) && (c == cdata[n]) )
+	{
+		if (n + 1 < sizeof(cdata) - 1)
+			return AXML_OPEN;
+		scanner->tail[0] = 0;
+		scanner->tail[1] = 0;
+		return AXML_CDATA;
+	}
+
+	return AXML_TAG;
+}
+
+/*******************************************************************************************
+static const char *tag_end(...)
+-Purpose:
+	Finds the > ending the current tag, skipping quoted attribute values, which
+	may contain it
+-Returns:
+	const char *	-	pointer to the >, or end if the tag goes on past the window
+********************************************************************************************/
+static const char *tag_end(DBMDAxmlScanner *scanner, const char *p, const char *end)
+{
+	const char *q;
+
+	while (p < end)
+	{
+		if (scanner->quote)
+		{
+			if ( !(q = memchr(p, scanner->quote, (size_t)(end - p))) )
+				return end;
+			scanner->quote = 0;
+			p = q + 1;
+		}
+		else if (*p == '>')
+		{
+			return p;
+		}
+		else
+		{
+			if ( (*p == '"') || (*p == '\'') )
+				scanner->quote = *p;
+			p++;
+		}
+	}
+
+	return end;
+}
+
+/*******************************************************************************************
+static const char *section_end(...)
+-Purpose:
+	Skips a comment or CDATA section up to the > following the two bytes in
+	close, which may have been in the previous window
+-Returns:
+	const char *	-	pointer to the byte following the section, or end
+********************************************************************************************/
+static const char *section_end(DBMDAxmlScanner *scanner, const char *p, const char *end, const char *close)
+{
+	const char *q;
+
+	while ( (q = memchr(p, '>', (size_t)(end - p))) )
+	{
+		tail_append(scanner->tail, p, (size_t)(q - p));
+		if ( (scanner->tail[0] == close[0]) && (scanner->tail[1] == close[1]) )
+		{
+			scanner->state = AXML_TEXT;
+			return q + 1;
+		}
+		tail_append(scanner->tail, q, 1);
+		p = q + 1;
+	}
+	tail_append(scanner->tail, p, (size_t)(end - p));
+
+	return end;
+}
+
+/*******************************************************************************************
+static void tag_append(...)
+-Purpose:
+	Adds bytes of the current tag to those held, up to DBMD_AXML_TAG_MAX
+********************************************************************************************/
+static void tag_append(DBMDAxmlScanner *scanner, const char *p, size_t len)
+{
+	if (len > DBMD_AXML_TAG_MAX - scanner->tag_len)
+		len = DBMD_AXML_TAG_MAX - scanner->tag_len;
+	memcpy(scanner->tag + scanner->tag_len, p, len);
+	scanner->tag_len += len;
+}
+
+/*******************************************************************************************
+static void tail_append(...)
+-Purpose:
+	Keeps the last two bytes skipped in a comment or CDATA section
+********************************************************************************************/
+static void tail_append(char *tail, const char *p, size_t len)
+{
+	if (len >= 2)
+	{
+		tail[0] = p[len - 2];
+		tail[1] = p[len - 1];
+	}
+	else if (len == 1)
+	{
+		tail[0] = tail[1];
+		tail[1] = p[0];
+	}
+}
+
+/*******************************************************************************************
+static void count_tag(...)
+-Purpose:
+	Counts the element opened by the tag just ended. End tags, declarations and
+	processing instructions are ignored, and a namespace prefix is dropped from
+	the element name.
+********************************************************************************************/
+static void count_tag(DBMDAxmlScanner *scanner)
+{
+	DBMDAxmlSummary *summary = scanner->summary;
+	const char *tag = scanner->tag;
+	const char *name;
+	const char *value;
+	size_t len = scanner->tag_len;
+	size_t value_len;
+	size_t n = 0;
+	size_t i;
+
+	if ( !len || (tag[0] == '/') || (tag[0] == '?') || (tag[0] == '!') )
+		return;
+	summary->elements++;
+
+	while ( (n < len) && !is_space(tag[n]) && (tag[n] != '/') )
+		n++;
+	name = tag;
+	for (i = 0; i < n; i++)
+	{
+		if (tag[i] == ':')
+			name = tag + i + 1;
+	}
+	i = n - (size_t)(name - tag);
+
+	/* most elements of a long programme are blocks */
+	if (name_is(name, i, "audioBlockFormat"))
+	{
+		summary->block_formats++;
+	}
+	else if (name_is(name, i, "audioChannelFormat"))
+	{
+		summary->channel_formats++;
+	}
+	else if (name_is(name, i, "audioTrackUID"))
+	{
+		summary->track_uids++;
+	}
+	else if (name_is(name, i, "audioObject"))
+	{
+		summary->objects++;
+	}
+	else if (name_is(name, i, "audioPackFormat"))
+	{
+		summary->pack_formats++;
+		if (find_attribute(tag + n, len - n, "typeDefinition", &value, &value_len))
+		{
+			if (name_is(value, value_len, "Objects"))
+				summary->object_packs++;
+			else if (name_is(value, value_len, "DirectSpeakers"))
+				summary->bed_packs++;
+		}
+		else if (find_attribute(tag + n, len - n, "typeLabel", &value, &value_len))
+		{
+			if (name_is(value, value_len, "0003"))
+				summary->object_packs++;
+			else if (name_is(value, value_len, "0001"))
+				summary->bed_packs++;
+		}
+	}
+	else if (name_is(name, i, "audioContent"))
+	{
+		summary->contents++;
+	}
+	else if (name_is(name, i, "audioProgramme"))
+	{
+		summary->programmes++;
+	}
+}
+
+/*******************************************************************************************
+static int find_attribute(...)
+-Purpose:
+	Finds the value of an attribute in the attribute list of a tag. An attribute
+	cut off by the end of the bytes held is not found.
+********************************************************************************************/
+static int find_attribute(const char *attrs, size_t len, const char *name, const char **value, size_t *value_len)
+{
+	const char *q;
+	size_t start;
+	size_t name_end;
+	size_t i = 0;
+	char quote;
+
+	while (i < len)
+	{
+		while ( (i < len) && (is_space(attrs[i]) || (attrs[i] == '/')) )
+			i++;
+		start = i;
+		while ( (i < len) && (attrs[i] != '=') && !is_space(attrs[i]) )
+			i++;
+		name_end = i;
+		while ( (i < len) && is_space(attrs[i]) )
+			i++;
+		if ( (i >= len) || (attrs[i++] != '=') )
+			return 0;
+		while ( (i < len) && is_space(attrs[i]) )
+			i++;
+		if ( (i >= len) || ((attrs[i] != '"') && (attrs[i] != '\'')) )
+			return 0;
+		quote = attrs[i++];
+		if ( !(q = memchr(attrs + i, quote, len - i)) )
+			return 0;
+
+		if (name_is(attrs + start, name_end - start, name))
+		{
+			*value = attrs + i;
+			*value_len = (size_t)(q - (attrs + i));
+			return 1;
+		}
+		i = (size_t)(q - attrs) + 1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int name_is(...)
+-Purpose:
+	Compares a name that is not null terminated with a whole string
+********************************************************************************************/
+static int name_is(const char *s, size_t len, const char *name)
+{
+	return (strlen(name) == len) && !memcmp(s, name, len);
+}
+
+/*******************************************************************************************
+static int is_space(...)
+-Purpose:
+	Tests for XML white space
+********************************************************************************************/
+static int is_space(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_AXML_H
+#define DBMD_AXML_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dbmd_atmos_parse.h"
+
+/* This defines the streaming scanner of the ADM XML (axml) chunk. The chunk
+ *  is fed to the scanner in windows of any size, in order, and is never held
+ *  in memory as a whole or built into a document tree: the scanner only counts
+ *  the ADM elements it meets, giving a summary that can be checked against the
+ *  dbmd chunk. Text between tags is skipped with memchr(), and quoted
+ *  attribute values likewise, so the cost is mostly that of the tags
+ *  themselves. A tag that spans two windows is carried over, and only its
+ *  first DBMD_AXML_TAG_MAX bytes are looked at, which always hold the
+ *  element name and usually all of its attributes.
+ */
+#define DBMD_AXML_TAG_MAX 256   /* Bytes of each tag looked at */
+
+typedef struct
+{
+	int scanned;                    /* Set once the axml chunk has been scanned */
+	int error;                      /* Error code of the scan */
+	uint64_t size;                  /* Size of the axml chunk */
+	unsigned long elements;         /* Number of elements */
+	unsigned long programmes;       /* Number of audioProgramme elements */
+	unsigned long contents;         /* Number of audioContent elements */
+	unsigned long objects;          /* Number of audioObject elements */
+	unsigned long pack_formats;     /* Number of audioPackFormat elements */
+	unsigned long object_packs;     /* Of which of type Objects */
+	unsigned long bed_packs;        /* Of which of type DirectSpeakers */
+	unsigned long channel_formats;  /* Number of audioChannelFormat elements */
+	unsigned long block_formats;    /* Number of audioBlockFormat elements */
+	unsigned long track_uids;       /* Number of audioTrackUID elements, one per track */
+} DBMDAxmlSummary;
+
+typedef struct
+{
+	int state;                      /* Scanner state */
+	char quote;                     /* Quote of the attribute value being skipped, or 0 */
+	char tail[2];                   /* Last two bytes of the comment or CDATA section being skipped */
+	size_t tag_len;                 /* Number of bytes of the current tag held */
+	char tag[DBMD_AXML_TAG_MAX];    /* Start of the current tag, without the < */
+	DBMDAxmlSummary *summary;       /* Receives the counts */
+} DBMDAxmlScanner;
+
+void dbmd_axml_init(DBMDAxmlScanner *scanner, DBMDAxmlSummary *summary);
+void dbmd_axml_feed(DBMDAxmlScanner *scanner, const char *data, size_t len);
+int dbmd_axml_finish(DBMDAxmlScanner *scanner);
+int dbmd_axml_matches(const DBMDAxmlSummary *summary, const DBMetadata *metadata);
+
+#endif /* DBMD_AXML_H */
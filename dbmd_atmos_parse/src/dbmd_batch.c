@@ -0,0 +1,812 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include "dbmd_batch.h"
+#include "dbmd_uring.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_output.h"
+
+#ifndef S_ISDIR
+#define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+#endif
+
+/* Number of results a worker may run ahead of the writer, per worker */
+#define RESULT_WINDOW_PER_JOB 64
+
+/* Maximum length of a line in a file list */
+#define MAX_PATH_LINE 4096
+
+/* Result of a single file, rendered by a worker and emitted by the writer */
+typedef struct
+{
+	DBMDOutput output;        /* Rendered result */
+	int error;                /* Error code of the scan */
+	unsigned long read_count; /* Number of reads issued by the scan */
+	uint64_t bytes_read;      /* Number of bytes fetched by the scan */
+	int cached;               /* Set if the result was answered from the cache */
+	int done;                 /* Set once the result is ready to be written */
+} DBMDBatchResult;
+
+/* State shared between the writer and the worker threads */
+typedef struct
+{
+	const DBMDPathList *list;
+	const DBMDBatchConfig *config;
+	DBMDBatchResult *results;
+	size_t next_file;   /* Next file to hand out to a worker */
+	size_t next_write;  /* Next file to be written */
+	size_t window;      /* Maximum distance between next_file and next_write */
+#ifndef WIN32
+	pthread_mutex_t lock;
+	pthread_cond_t result_ready;
+	pthread_cond_t window_open;
+#endif
+} DBMDBatch;
+
+/* Worker thread and its parse context */
+typedef struct
+{
+	DBMDBatch *batch;
+	DBMDContext ctx;
+#ifndef WIN32
+	pthread_t thread;
+#endif
+} DBMDBatchWorker;
+
+/* Local function prototypes */
+static int pathlist_append(DBMDPathList *list, const char *path);
+static int pathlist_add_dir(DBMDPathList *list, const char *dir);
+static int compare_names(const void *a, const void *b);
+static void scan_one(DBMDBatch *batch, DBMDContext *ctx, size_t index);
+static int scan_cached(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, int *cached, const DBMDMemoEntry **entry);
+static int parse_file(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, const DBMDMemoEntry **entry);
+static int parse_scanned(DBMDMemo *memo, DBMDContext *ctx, const DBMDMemoEntry **entry);
+static int parse_fd(const DBMDBatchConfig *config, DBMDContext *ctx, int fd, const DBMDMemoEntry **entry);
+static int index_file(DBMDContext *ctx, const char *path);
+static int get_num_jobs(const DBMDBatchConfig *config, size_t num_files);
+
+/*******************************************************************************************
+void dbmd_pathlist_init(...)
+-Purpose:
+	Initializes an empty path list
+-Inputs:
+	DBMDPathList *list	-	Path list
+********************************************************************************************/
+void dbmd_pathlist_init(DBMDPathList *list)
+{
+	list->paths = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+/*******************************************************************************************
+int dbmd_pathlist_add(...)
+-Purpose:
+	Adds a path to the list. Directories are searched recursively, in name order,
+	for files with a .wav extension; any other path is added as given.
+-Inputs:
+	DBMDPathList *list	-	Path list
+	const char *path	-	File or directory name
+-Returns:
+	int					-	0 on success, -1 if out of memory
+********************************************************************************************/
+int dbmd_pathlist_add(DBMDPathList *list, const char *path)
+{
+	struct stat st;
+
+	if ( (stat(path, &st) == 0) && S_ISDIR(st.st_mode) )
+		return pathlist_add_dir(list, path);
+
+	return pathlist_append(list, path);
+}
+
+/*******************************************************************************************
+int dbmd_pathlist_read(...)
+-Purpose:
+	Adds every path listed in a text file, one per line
+-Inputs:
+	DBMDPathList *list	-	Path list
+	FILE *fp			-	File list stream, e.g. stdin
+-Returns:
+	int					-	0 on success, -1 if out of memory
+********************************************************************************************/
+int dbmd_pathlist_read(DBMDPathList *list, FILE *fp)
+{
+	char line[MAX_PATH_LINE];
+	size_t len;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		/* strip line ending */
+		len = strlen(line);
+		while ( (len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')) )
+			line[--len] = 0;
+
+		if (len == 0)
+			continue;
+
+		if (dbmd_pathlist_add(list, line))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+void dbmd_pathlist_free(...)
+-Purpose:
+	Releases the memory held by the path list
+-Inputs:
+	DBMDPathList *list	-	Path list
+********************************************************************************************/
+void dbmd_pathlist_free(DBMDPathList *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; i++)
+		free(list->paths[i]);
+	free(list->paths);
+	dbmd_pathlist_init(list);
+}
+
+/*******************************************************************************************
+static int pathlist_append(...)
+-Purpose:
+	Appends a copy of the path to the list
+********************************************************************************************/
+static int pathlist_append(DBMDPathList *list, const char *path)
+{
+	char **new_paths;
+	size_t new_capacity;
+
+	if (list->count == list->capacity)
+	{
+		new_capacity = list->capacity ? list->capacity * 2 : 64;
+		new_paths = realloc(list->paths, new_capacity * sizeof(char *));
+		if (!new_paths)
+			return -1;
+		list->paths = new_paths;
+		list->capacity = new_capacity;
+	}
+
+	list->paths[list->count] = malloc(strlen(path) + 1);
+	if (!list->paths[list->count])
+		return -1;
+	strcpy(list->paths[list->count], path);
+	list->count++;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int pathlist_add_dir(...)
+-Purpose:
+	Recursively adds the .wav files below a directory, sorted by name so that
+	the order of the results does not depend on the file system
+********************************************************************************************/
+static int pathlist_add_dir(DBMDPathList *list, const char *dir)
+{
+#ifndef WIN32
+	DIR *dp;
+	struct dirent *entry;
+	struct stat st;
+	DBMDPathList names;
+	char *path;
+	size_t i;
+	int error = 0;
+
+	dp = opendir(dir);
+	if (!dp)
+		return pathlist_append(list, dir);
+
+	/* collect and sort the directory entries */
+	dbmd_pathlist_init(&names);
+	while ( (entry = readdir(dp)) != NULL )
+	{
+		if ( !strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..") )
+			continue;
+		if ( (error = pathlist_append(&names, entry->d_name)) )
+			break;
+	}
+	closedir(dp);
+	qsort(names.paths, names.count, sizeof(char *), compare_names);
+
+	for (i = 0; (i < names.count) && !error; i++)
+	{
+		path = malloc(strlen(dir) + strlen(names.paths[i]) + 2);
+		if (!path)
+		{
+			error = -1;
+			break;
+		}
+		sprintf(path, "%s/%s", dir, names.paths[i]);
+
+		/* do not follow symbolic links to directories */
+		if (lstat(path, &st) == 0)
+		{
+			if (S_ISDIR(st.st_mode))
+				error = pathlist_add_dir(list, path);
+			else if (dbmd_has_wav_extension(names.paths[i]) && (stat(path, &st) == 0) && S_ISREG(st.st_mode))
+				error = pathlist_append(list, path);
+		}
+		free(path);
+	}
+
+	dbmd_pathlist_free(&names);
+	return error;
+#else
+	return pathlist_append(list, dir);
+#endif
+}
+
+/*******************************************************************************************
+int dbmd_has_wav_extension(...)
+-Purpose:
+	Tests for a .wav file name extension, ignoring case
+-Inputs:
+	const char *name	-	File name
+-Returns:
+	int					-	1 for a .wav file name, 0 otherwise
+********************************************************************************************/
+int dbmd_has_wav_extension(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+	const char *wav = ".wav";
+	int i;
+
+	if (!ext || (strlen(ext) != 4))
+		return 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		if ( (ext[i] | 0x20) != wav[i] )
+			return 0;
+	}
+
+	return 1;
+}
+
+/*******************************************************************************************
+static int compare_names(...)
+-Purpose:
+	qsort() comparison function for file names
+********************************************************************************************/
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/*******************************************************************************************
+static void scan_one(...)
+-Purpose:
+	Scans and parses one file of the batch and renders its result
+********************************************************************************************/
+static void scan_one(DBMDBatch *batch, DBMDContext *ctx, size_t index)
+{
+	DBMDBatchResult *result = &batch->results[index];
+
+	result->error = dbmd_batch_scan_file(batch->config, ctx, batch->list->paths[index], -1, &result->output, &result->cached);
+	result->read_count = ctx->read_count;
+	result->bytes_read = ctx->bytes_read;
+}
+
+/*******************************************************************************************
+static int index_file(...)
+-Purpose:
+	Scans one file and indexes the segments of its dbmd chunk, verifying their
+	checksums but decoding none of them
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int index_file(DBMDContext *ctx, const char *path)
+{
+	int error;
+
+	ctx->status = 0;
+	ctx->dbmd_chunk_size = 0;
+	ctx->read_count = 0;
+	ctx->bytes_read = 0;
+
+	if ( (error = dbmd_open(ctx, path)) )
+		return error;
+
+	error = dbmd_scan(ctx);
+	if (!error)
+		error = dbmd_index(ctx, DBMD_INDEX_VERIFY);
+	dbmd_close(ctx);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int scan_cached(...)
+-Purpose:
+	Answers a file from the scan cache if it is unchanged, otherwise scans and
+	parses it and adds the result to the cache. When verifying, the dbmd chunk
+	is located and compared with the cached hash, and only the parse is skipped;
+	a chunk too large to be held in the context is always parsed.
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int scan_cached(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, int *cached, const DBMDMemoEntry **entry)
+{
+	DBMDCache *cache = config->cache;
+	DBMDCacheKey key;
+	uint64_t hash = 0;
+	int error;
+
+	ctx->status = 0;
+	ctx->dbmd_chunk_size = 0;
+	ctx->read_count = 0;
+	ctx->bytes_read = 0;
+	*cached = 0;
+
+	/* pipes, URLs and files that cannot be identified are always scanned */
+	if (dbmd_cache_key(&key, path))
+		return parse_file(config, ctx, path, entry);
+
+	if ( !config->cache_verify && dbmd_cache_lookup(cache, &key, NULL, ctx, &error) )
+	{
+		*cached = 1;
+		return error;
+	}
+
+	if ( (error = dbmd_open(ctx, path)) )
+		return error;
+
+	error = dbmd_scan(ctx);
+	if ( !error && (ctx->dbmd_chunk_size > MAX_DBMD_SIZE) )
+	{
+		/* a chunk left in the file is not hashed, so is always parsed */
+		error = dbmd_parse(ctx);
+	}
+	else if (!error)
+	{
+		hash = dbmd_cache_hash(ctx->dbmd_chunk ? ctx->dbmd_chunk : ctx->dolby_metadata, (size_t)ctx->dbmd_chunk_size);
+		if ( config->cache_verify && dbmd_cache_lookup(cache, &key, &hash, ctx, &error) )
+			*cached = 1;
+		else
+			error = parse_scanned(config->memo, ctx, entry);
+	}
+	dbmd_close(ctx);
+
+	if (!*cached)
+		dbmd_cache_store(cache, &key, hash, ctx, error);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int parse_file(...)
+-Purpose:
+	Opens, scans and parses a single file as dbmd_parse_file() does, answering
+	its dbmd chunk from the memo if there is one, and scans its axml chunk if
+	configured
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int parse_file(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, const DBMDMemoEntry **entry)
+{
+	int error;
+
+	if ( !config->memo && !config->scan_adm )
+		return dbmd_parse_file(ctx, path);
+
+	ctx->status = 0;
+	ctx->dbmd_chunk_size = 0;
+	ctx->read_count = 0;
+	ctx->bytes_read = 0;
+
+	if ( (error = dbmd_open(ctx, path)) )
+		return error;
+
+	error = dbmd_scan(ctx);
+	if (!error)
+	{
+		error = parse_scanned(config->memo, ctx, entry);
+		if (config->scan_adm)
+			dbmd_scan_axml(ctx);
+	}
+	dbmd_close(ctx);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int parse_scanned(...)
+-Purpose:
+	Parses the dbmd chunk of a scanned file, through the memo if there is one
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int parse_scanned(DBMDMemo *memo, DBMDContext *ctx, const DBMDMemoEntry **entry)
+{
+	if (memo)
+		return dbmd_memo_parse(memo, ctx, entry);
+
+	return dbmd_parse(ctx);
+}
+
+/*******************************************************************************************
+static int get_num_jobs(...)
+-Purpose:
+	Determines the number of worker threads to start
+********************************************************************************************/
+static int get_num_jobs(const DBMDBatchConfig *config, size_t num_files)
+{
+	long num_jobs = config->num_jobs;
+
+#ifndef WIN32
+	if (num_jobs <= 0)
+		num_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (num_jobs <= 0)
+		num_jobs = 1;
+	if (num_jobs > DEFAULT_MAX_JOBS)
+		num_jobs = DEFAULT_MAX_JOBS;
+	if ((size_t)num_jobs > num_files)
+		num_jobs = (long)num_files;
+
+	return (int)num_jobs;
+}
+
+#ifndef WIN32
+/*******************************************************************************************
+static void *batch_worker(...)
+-Purpose:
+	Worker thread; takes files from the batch until none are left
+********************************************************************************************/
+static void *batch_worker(void *arg)
+{
+	DBMDBatchWorker *worker = (DBMDBatchWorker *)arg;
+	DBMDBatch *batch = worker->batch;
+	size_t index;
+
+	pthread_mutex_lock(&batch->lock);
+	while (1)
+	{
+		/* do not run too far ahead of the writer */
+		while ( (batch->next_file < batch->list->count) && (batch->next_file >= batch->next_write + batch->window) )
+			pthread_cond_wait(&batch->window_open, &batch->lock);
+
+		if (batch->next_file >= batch->list->count)
+			break;
+
+		index = batch->next_file++;
+		pthread_mutex_unlock(&batch->lock);
+
+		scan_one(batch, &worker->ctx, index);
+
+		pthread_mutex_lock(&batch->lock);
+		batch->results[index].done = 1;
+		pthread_cond_signal(&batch->result_ready);
+	}
+	pthread_mutex_unlock(&batch->lock);
+
+	return NULL;
+}
+#endif
+
+/*******************************************************************************************
+int dbmd_batch_scan_file(...)
+-Purpose:
+	Scans and parses one file as configured for the batch, adds it to the results
+	store and renders its result in the configured format. A file given as an
+	open file descriptor is read from it and not cached, the descriptor being
+	closed afterwards, and is otherwise scanned like a named one.
+-Inputs:
+	const DBMDBatchConfig *config	-	Batch configuration
+	DBMDContext *ctx				-	Parse context
+	const char *path				-	Input file name
+	int fd							-	Input file descriptor, or -1 to open the file by name
+	DBMDOutput *output				-	Buffer the result is rendered to
+	int *cached						-	Set if the result was answered from the cache
+-Returns:
+	int								-	error code of the scan
+********************************************************************************************/
+int dbmd_batch_scan_file(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, int fd, DBMDOutput *output, int *cached)
+{
+	const DBMDMemoEntry *entry = NULL;
+	int error;
+
+	/* a file answered from the cache is not opened */
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+
+	if (fd >= 0)
+		error = parse_fd(config, ctx, fd, &entry);
+	else if (config->list_segments)
+		error = index_file(ctx, path);
+	else if (config->cache)
+		error = scan_cached(config, ctx, path, cached, &entry);
+	else
+		error = parse_file(config, ctx, path, &entry);
+	if ( config->store && !config->list_segments )
+		dbmd_store_add(config->store, path, ctx, error);
+
+	dbmd_batch_format(config, ctx, path, error, entry, output);
+
+	return error;
+}
+
+/*******************************************************************************************
+int dbmd_batch_scan_fd(...)
+-Purpose:
+	Scans and parses a file given as an open file descriptor as configured for
+	the batch, closing the descriptor afterwards. Pipes and other descriptors
+	that cannot be read at an offset are streamed.
+-Inputs:
+	const DBMDBatchConfig *config	-	Batch configuration
+	DBMDContext *ctx				-	Parse context
+	int fd							-	Input file descriptor
+-Returns:
+	int								-	error code of the scan
+********************************************************************************************/
+int dbmd_batch_scan_fd(const DBMDBatchConfig *config, DBMDContext *ctx, int fd)
+{
+	const DBMDMemoEntry *entry = NULL;
+
+	return parse_fd(config, ctx, fd, &entry);
+}
+
+/*******************************************************************************************
+static int parse_fd(...)
+-Purpose:
+	Scans and parses a file given as an open file descriptor, answering its dbmd
+	chunk from the memo if there is one, and closes the descriptor
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int parse_fd(const DBMDBatchConfig *config, DBMDContext *ctx, int fd, const DBMDMemoEntry **entry)
+{
+	DBMDSource *source;
+	struct stat st;
+	int error;
+
+	ctx->status = 0;
+	ctx->dbmd_chunk_size = 0;
+	ctx->read_count = 0;
+	ctx->bytes_read = 0;
+	ctx->adm.scanned = 0;
+
+	if (fstat(fd, &st))
+	{
+		close(fd);
+		return DB_ERR_FILEOPEN;
+	}
+	if ( (error = dbmd_source_open_fd(&source, fd, !S_ISREG(st.st_mode))) )
+	{
+		close(fd);
+		return error;
+	}
+	dbmd_attach(ctx, source);
+
+	error = dbmd_scan(ctx);
+	if (!error)
+	{
+		error = config->list_segments ? dbmd_index(ctx, DBMD_INDEX_VERIFY) : parse_scanned(config->memo, ctx, entry);
+		if (config->scan_adm)
+			dbmd_scan_axml(ctx);
+	}
+	dbmd_close(ctx);
+
+	return error;
+}
+
+/*******************************************************************************************
+void dbmd_batch_format(...)
+-Purpose:
+	Renders the result of a scan in the configured format and adds its cost,
+	including the time spent rendering it, to the run statistics. In the text
+	format, metadata answered from the memo is copied from its rendering there.
+-Inputs:
+	const DBMDBatchConfig *config	-	Batch configuration
+	DBMDContext *ctx				-	Parse context holding the result
+	const char *path				-	Input file name
+	int error						-	error code of the scan
+	const DBMDMemoEntry *entry		-	Memo entry of the dbmd chunk, or NULL
+	DBMDOutput *output				-	Buffer the result is rendered to
+********************************************************************************************/
+void dbmd_batch_format(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, int error, const DBMDMemoEntry *entry, DBMDOutput *output)
+{
+	unsigned char *text;
+	uint64_t start = 0;
+
+	if (config->stats)
+		start = dbmd_clock_ns();
+
+	if (config->format == DBMD_FORMAT_NDJSON)
+	{
+		format_dbmd_json(output, path, ctx, error, config->list_segments, config->show_stats);
+	}
+	else if (config->format == DBMD_FORMAT_BINARY)
+	{
+		format_dbmd_record(output, path, ctx, error);
+	}
+	else
+	{
+		if (config->show_names)
+			dbmd_output_printf(output, "\n==> %s <==\n", path);
+		if (config->list_segments)
+			display_dbmd_segments(output, ctx, error);
+		else if ( entry && entry->text && (error == DB_ERR_OK) && (text = dbmd_output_append(output, entry->text_len)) )
+			memcpy(text, entry->text, entry->text_len);
+		else
+			display_dbmd_result(output, ctx, error);
+		if (config->scan_adm)
+			display_dbmd_adm(output, ctx, error);
+		if (config->show_stats)
+			display_dbmd_stats(output, ctx);
+	}
+
+	if (config->stats)
+	{
+		ctx->stats.phase_ns[DBMD_PHASE_OUTPUT] = dbmd_clock_ns() - start;
+		dbmd_stats_add(config->stats, &ctx->stats, ctx->read_count, ctx->bytes_read, error);
+	}
+}
+
+/*******************************************************************************************
+int dbmd_batch_run(...)
+-Purpose:
+	Scans every file of the list on a pool of worker threads and writes the
+	results to the output stream in list order
+-Inputs:
+	const DBMDPathList *list		-	Input files
+	const DBMDBatchConfig *config	-	Batch configuration
+	FILE *out						-	Output stream
+	DBMDBatchSummary *summary		-	Receives the file counts
+-Returns:
+	int								-	0 on success, -1 if out of resources
+********************************************************************************************/
+int dbmd_batch_run(const DBMDPathList *list, const DBMDBatchConfig *config, FILE *out, DBMDBatchSummary *summary)
+{
+	DBMDBatch batch;
+	DBMDBatchResult *result;
+	DBMDBatchWorker *workers;
+	size_t i;
+	int num_jobs;
+	int error;
+#ifndef WIN32
+	int num_threads = 0;
+#endif
+
+	summary->num_files = 0;
+	summary->num_passed = 0;
+	summary->num_failed = 0;
+	summary->num_reads = 0;
+	summary->num_bytes = 0;
+	summary->num_cached = 0;
+	if (list->count == 0)
+		return 0;
+
+	/* the io_uring engine handles the whole list unless it is unavailable */
+	if (config->engine == DBMD_ENGINE_URING)
+	{
+		error = dbmd_uring_run(list, config, out, summary);
+		if (error != DBMD_URING_UNAVAILABLE)
+			return error;
+	}
+
+	batch.list = list;
+	batch.config = config;
+	batch.next_file = 0;
+	batch.next_write = 0;
+	batch.results = calloc(list->count, sizeof(DBMDBatchResult));
+	if (!batch.results)
+		return -1;
+
+	num_jobs = get_num_jobs(config, list->count);
+	batch.window = (size_t)num_jobs * RESULT_WINDOW_PER_JOB;
+
+	workers = malloc(num_jobs * sizeof(DBMDBatchWorker));
+	if (!workers)
+	{
+		free(batch.results);
+		return -1;
+	}
+	for (i = 0; i < (size_t)num_jobs; i++)
+	{
+		workers[i].batch = &batch;
+		dbmd_init(&workers[i].ctx);
+		workers[i].ctx.io_mode = config->io_mode;
+		workers[i].ctx.tail_probe = config->tail_probe;
+		workers[i].ctx.timing = (config->stats != NULL);
+	}
+
+#ifndef WIN32
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.result_ready, NULL);
+	pthread_cond_init(&batch.window_open, NULL);
+
+	for (i = 0; i < (size_t)num_jobs; i++)
+	{
+		if (pthread_create(&workers[num_threads].thread, NULL, batch_worker, &workers[num_threads]) == 0)
+			num_threads++;
+	}
+	if (num_threads == 0)
+	{
+		/* no threads available, scan on the calling thread */
+		batch.window = list->count;
+		batch_worker(&workers[0]);
+	}
+#endif
+
+	/* write results in list order as they become ready */
+	for (i = 0; i < list->count; i++)
+	{
+		result = &batch.results[i];
+
+#ifndef WIN32
+		pthread_mutex_lock(&batch.lock);
+		while (!result->done)
+			pthread_cond_wait(&batch.result_ready, &batch.lock);
+		batch.next_write = i + 1;
+		pthread_cond_broadcast(&batch.window_open);
+		pthread_mutex_unlock(&batch.lock);
+#else
+		scan_one(&batch, &workers[0].ctx, i);
+#endif
+
+		if (dbmd_output_write(&result->output, out) != DB_ERR_OK)
+		{
+			fprintf(stderr, "%s: Error, out of memory rendering the result!\n", list->paths[i]);
+			result->error = DB_ERR_NOMEMORY;
+		}
+		dbmd_output_free(&result->output);
+
+		summary->num_files++;
+		summary->num_reads += result->read_count;
+		summary->num_bytes += result->bytes_read;
+		summary->num_cached += result->cached;
+		if (result->error == DB_ERR_OK)
+			summary->num_passed++;
+		else
+			summary->num_failed++;
+	}
+
+#ifndef WIN32
+	for (i = 0; i < (size_t)num_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	pthread_cond_destroy(&batch.window_open);
+	pthread_cond_destroy(&batch.result_ready);
+	pthread_mutex_destroy(&batch.lock);
+#endif
+	for (i = 0; i < (size_t)num_jobs; i++)
+		dbmd_free(&workers[i].ctx);
+	free(workers);
+	free(batch.results);
+
+	return 0;
+}
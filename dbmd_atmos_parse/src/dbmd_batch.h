@@ -0,0 +1,98 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_BATCH_H
+#define DBMD_BATCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "dbmd_wav_parse.h"
+#include "dbmd_cache.h"
+#include "dbmd_memo.h"
+#include "dbmd_output.h"
+#include "dbmd_store.h"
+#include "dbmd_stats.h"
+
+/* This defines the batch scanner. A list of input paths is scanned by a
+ *  pool of worker threads, each with its own parse context, and the
+ *  results are written in the order of the list.
+ */
+#define DEFAULT_MAX_JOBS 64
+#define DEFAULT_QUEUE_DEPTH 256
+
+/* Scan engines */
+typedef enum
+{
+	DBMD_ENGINE_THREADS = 0, /* Pool of worker threads with blocking reads */
+	DBMD_ENGINE_URING = 1    /* Asynchronous opens and reads with io_uring, threads where unavailable */
+} dbmd_batch_engine;
+
+typedef struct
+{
+	char **paths;    /* Input file names */
+	size_t count;    /* Number of input file names */
+	size_t capacity; /* Number of entries allocated */
+} DBMDPathList;
+
+typedef struct
+{
+	int num_jobs;         /* Number of worker threads, 0 selects one per CPU */
+	int show_names;       /* Print the file name ahead of each result */
+	dbmd_io_mode io_mode; /* Input file access mode */
+	int tail_probe;       /* Look for the dbmd chunk at the end of each file before walking its chunks */
+	DBMDCache *cache;     /* Scan cache, NULL to scan every file */
+	int cache_verify;     /* Only answer from the cache if the dbmd chunk is unchanged */
+	DBMDMemo *memo;       /* Memo of parsed dbmd chunks, NULL to parse every chunk */
+	int list_segments;    /* List the dbmd segments of each file instead of decoding them */
+	int scan_adm;         /* Also scan the axml chunk of each file and check it against the dbmd chunk */
+	dbmd_output_format format; /* Result format */
+	DBMDStoreWriter *store;    /* Results store every result is added to, NULL for none */
+	dbmd_batch_engine engine;  /* Scan engine */
+	int queue_depth;           /* Number of files in flight with io_uring, 0 for the default */
+	DBMDRunStats *stats;       /* Run statistics the cost of every scan is added to, NULL to not time scans */
+	int show_stats;            /* Render the cost of each scan with its result */
+} DBMDBatchConfig;
+
+typedef struct
+{
+	size_t num_files;        /* Number of files scanned */
+	size_t num_passed;       /* Number of files parsed without error */
+	size_t num_failed;       /* Number of files that could not be parsed */
+	unsigned long num_reads; /* Number of reads issued */
+	uint64_t num_bytes;      /* Number of bytes fetched */
+	size_t num_cached;       /* Number of files answered from the cache */
+} DBMDBatchSummary;
+
+void dbmd_pathlist_init(DBMDPathList *list);
+int dbmd_pathlist_add(DBMDPathList *list, const char *path);
+int dbmd_pathlist_read(DBMDPathList *list, FILE *fp);
+void dbmd_pathlist_free(DBMDPathList *list);
+int dbmd_has_wav_extension(const char *name);
+
+int dbmd_batch_scan_file(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, int fd, DBMDOutput *output, int *cached);
+int dbmd_batch_scan_fd(const DBMDBatchConfig *config, DBMDContext *ctx, int fd);
+void dbmd_batch_format(const DBMDBatchConfig *config, DBMDContext *ctx, const char *path, int error, const DBMDMemoEntry *entry, DBMDOutput *output);
+int dbmd_batch_run(const DBMDPathList *list, const DBMDBatchConfig *config, FILE *out, DBMDBatchSummary *summary);
+
+#endif /* DBMD_BATCH_H */
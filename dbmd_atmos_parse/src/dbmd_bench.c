@@ -0,0 +1,867 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "dbmd_atmos_parse.h"
+#include "dbmd_checksum.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_source.h"
+#include "dbmd_output.h"
+#include "dbmd_compact.h"
+
+/* Benchmark of the scan phases. The dbmd chunks of the given ADM WAV files
+ *  are loaded once and then checksummed, indexed, decoded and rendered in a
+ *  loop with each checksum kernel the processor supports. parse_wav_header()
+ *  is measured on every input file, and on large sparse RIFF and BW64 files
+ *  synthesized from the first input, with a warm and with a cold page cache.
+ *  Cycles, instructions and cache misses are counted with perf_event_open()
+ *  where the kernel allows it. Every measurement is appended to a CSV file.
+ */
+#define BENCH_MIN_SECONDS 0.5
+#define BENCH_MAX_CHUNKS 1024
+#define BENCH_RIFF_DATA_SIZE 0xC0000000ull  /* 3 GiB, close to the RIFF limit */
+#define BENCH_BW64_DATA_SIZE 0x200000000ull /* 8 GiB, needs ds64 */
+
+typedef struct
+{
+	char *data;
+	int size;
+	DBMDSegmentIndex index;
+	DBMetadata metadata;
+} BenchChunk;
+
+typedef struct
+{
+	BenchChunk *chunks;
+	int num_chunks;
+	DBMDOutput out;
+	DBMDCompactStore store;
+	DBMDCompact *compact;     /* One record per chunk */
+	DBMetadata decoded;       /* Decoding target, its object table reused across passes */
+} BenchCorpus;
+
+typedef struct
+{
+	const char *path;
+	DBMDSource *source;
+	DBMDContext ctx;
+	int fd;                 /* Used to drop the file from the page cache */
+} BenchFile;
+
+/* Hardware counters, in perf group read order */
+enum { BENCH_CYCLES, BENCH_INSTRUCTIONS, BENCH_CACHE_MISSES, BENCH_NUM_COUNTERS };
+
+typedef struct
+{
+	const char *phase;      /* Function measured */
+	const char *input;      /* Corpus or file name */
+	const char *kernel;     /* Checksum kernel */
+	const char *cache;      /* "warm" or "cold" page cache */
+	const char *unit;       /* What one operation is */
+	unsigned long (*run)(void *arg);   /* One timed pass, returns the operations done */
+	void (*prepare)(void *arg);        /* Untimed setup before each pass, or NULL */
+	void *arg;
+} BenchCase;
+
+static const char *simd_names[3] = { "scalar", "sse2", "avx2" };
+static int counter_fds[BENCH_NUM_COUNTERS] = { -1, -1, -1 };
+static FILE *results;
+
+/* Local function prototypes */
+static double now(void);
+static int check_kernels(void);
+static void counters_open(void);
+static int counters_read(uint64_t *values);
+static void bench_run(const BenchCase *bc);
+static unsigned long run_checksum(void *arg);
+static unsigned long run_index(void *arg);
+static unsigned long run_parse(void *arg);
+static unsigned long run_display(void *arg);
+static unsigned long run_compact_encode(void *arg);
+static unsigned long run_compact_decode(void *arg);
+static int check_compact(BenchCorpus *corpus);
+static unsigned long run_header(void *arg);
+static void drop_cache(void *arg);
+static void bench_header(const char *path);
+static int write_at(int fd, const void *buf, size_t len, uint64_t offset);
+static void put_le32(unsigned char *p, uint32_t value);
+/*******************************************************************************************
+static void put_le64(...)
+-Purpose:
+	Stores a 64-bit little-endian integer
+********************************************************************************************/
+static void put_le64(unsigned char *p, uint64_t value);
+static int synthesize(const char *path, const char *template_path, const char *form, uint64_t data_size);
+
+int main(int argc, char **argv)
+{
+	static BenchChunk chunks[BENCH_MAX_CHUNKS];
+	BenchCorpus corpus;
+	BenchCase bc;
+	DBMDContext ctx;
+	const char *results_path = NULL;
+	const char *synth_dir = NULL;
+	const char *template_path = NULL;
+	char synth_path[2][1024];
+	char corpus_name[32];
+	int num_synth = 0;
+	int level, i;
+
+	memset(&corpus, 0, sizeof(corpus));
+	corpus.chunks = chunks;
+
+	/* load the dbmd chunks */
+	dbmd_init(&ctx);
+	for (i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--results=", 10))
+		{
+			results_path = argv[i] + 10;
+			continue;
+		}
+		if (!strncmp(argv[i], "--synth-dir=", 12))
+		{
+			synth_dir = argv[i] + 12;
+			continue;
+		}
+		if (corpus.num_chunks == BENCH_MAX_CHUNKS)
+			continue;
+		if ( dbmd_open(&ctx, argv[i]) || dbmd_scan(&ctx) || (ctx.dbmd_chunk_size > MAX_DBMD_SIZE) ||
+		     index_dbmd_segments(ctx.dbmd_chunk ? ctx.dbmd_chunk : ctx.dolby_metadata, (int)ctx.dbmd_chunk_size, DBMD_INDEX_VERIFY, &chunks[corpus.num_chunks].index) ||
+		     parse_dbmd_metadata(ctx.dbmd_chunk ? (char *)ctx.dbmd_chunk : ctx.dolby_metadata, (int)ctx.dbmd_chunk_size, &chunks[corpus.num_chunks].metadata) )
+		{
+			printf("Skipping %s, no valid dbmd chunk\n", argv[i]);
+			dbmd_close(&ctx);
+			continue;
+		}
+		chunks[corpus.num_chunks].data = (char *)malloc((size_t)ctx.dbmd_chunk_size);
+		if (!chunks[corpus.num_chunks].data)
+		{
+			dbmd_close(&ctx);
+			break;
+		}
+		memcpy(chunks[corpus.num_chunks].data, ctx.dbmd_chunk ? ctx.dbmd_chunk : ctx.dolby_metadata, (size_t)ctx.dbmd_chunk_size);
+		chunks[corpus.num_chunks].size = (int)ctx.dbmd_chunk_size;
+		corpus.num_chunks++;
+		if (!template_path)
+			template_path = argv[i];
+		dbmd_close(&ctx);
+	}
+	if (corpus.num_chunks == 0)
+	{
+		puts("\nUsage: dbmd_bench [--results=<csv file>] [--synth-dir=<dir>] <input ADM WAV file> ...\n");
+		return 1;
+	}
+
+	if (check_kernels())
+	{
+		puts("Error, checksum kernels disagree!");
+		return 1;
+	}
+
+	if (results_path)
+	{
+		results = fopen(results_path, "w");
+		if (!results)
+		{
+			printf("Error, could not create %s\n", results_path);
+			return 1;
+		}
+		fprintf(results, "phase,input,kernel,cache,unit,ops,ns_per_op,cycles_per_op,instructions_per_op,cache_misses_per_op\n");
+	}
+
+	counters_open();
+	printf("%d dbmd chunks, widest checksum kernel: %s, hardware counters: %s\n\n",
+		corpus.num_chunks, simd_names[dbmd_simd_supported()], (counter_fds[0] >= 0) ? "yes" : "unavailable");
+
+	/* decode phases, on the in-memory chunks */
+	snprintf(corpus_name, sizeof(corpus_name), "corpus(%d)", corpus.num_chunks);
+	memset(&bc, 0, sizeof(bc));
+	bc.input = corpus_name;
+	bc.cache = "warm";
+	bc.arg = &corpus;
+	for (level = DBMD_SIMD_NONE; level <= (int)dbmd_simd_supported(); level++)
+	{
+		dbmd_simd_set((dbmd_simd_level)level);
+		bc.kernel = simd_names[level];
+
+		bc.phase = "calc_checksum";
+		bc.unit = "segment";
+		bc.run = run_checksum;
+		bench_run(&bc);
+
+		bc.phase = "index_dbmd_segments";
+		bc.unit = "chunk";
+		bc.run = run_index;
+		bench_run(&bc);
+
+		bc.phase = "parse_dbmd_metadata";
+		bc.run = run_parse;
+		bench_run(&bc);
+	}
+	dbmd_simd_set(dbmd_simd_supported());
+
+	bc.phase = "display_dbmd_metadata";
+	bc.kernel = "-";
+	bc.run = run_display;
+	dbmd_output_init(&corpus.out);
+	bench_run(&bc);
+	dbmd_output_free(&corpus.out);
+
+	/* compact metadata records, checked to round trip first */
+	if (check_compact(&corpus))
+	{
+		puts("Error, compact metadata records do not round trip!");
+		return 1;
+	}
+	bc.phase = "dbmd_compact_encode";
+	bc.run = run_compact_encode;
+	bench_run(&bc);
+	bc.phase = "dbmd_compact_decode";
+	bc.run = run_compact_decode;
+	bench_run(&bc);
+	dbmd_compact_free(&corpus.store);
+	free(corpus.compact);
+	dbmd_objects_free(&corpus.decoded.DolbyAtmosSupSeg.objects);
+	for (i = 0; i < corpus.num_chunks; i++)
+	{
+		free(chunks[i].data);
+		dbmd_objects_free(&chunks[i].metadata.DolbyAtmosSupSeg.objects);
+	}
+	dbmd_free(&ctx);
+
+	/* file phases, on the inputs and on the synthetic large files */
+	for (i = 1; i < argc; i++)
+	{
+		if ( strncmp(argv[i], "--", 2) )
+			bench_header(argv[i]);
+	}
+	if (synth_dir)
+	{
+		snprintf(synth_path[0], sizeof(synth_path[0]), "%s/bench_riff_3g.wav", synth_dir);
+		snprintf(synth_path[1], sizeof(synth_path[1]), "%s/bench_bw64_8g.wav", synth_dir);
+		if (!synthesize(synth_path[0], template_path, "RIFF", BENCH_RIFF_DATA_SIZE))
+			num_synth = 1;
+		if (!synthesize(synth_path[1], template_path, "BW64", BENCH_BW64_DATA_SIZE))
+			num_synth = 2;
+		for (i = 0; i < num_synth; i++)
+		{
+			bench_header(synth_path[i]);
+			unlink(synth_path[i]);
+		}
+	}
+
+	if (results)
+	{
+		fclose(results);
+		printf("\nResults written to %s\n", results_path);
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static double now(...)
+-Purpose:
+	Returns a monotonic time in seconds
+********************************************************************************************/
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************************
+static int check_kernels(...)
+-Purpose:
+	Compares every supported kernel with the scalar one on buffers of all
+	lengths and alignments up to a few vectors
+-Returns:
+	int				-	0 if all kernels agree
+********************************************************************************************/
+static int check_kernels(void)
+{
+	unsigned char buf[160];
+	unsigned int expected;
+	int level, offset, len, i;
+
+	for (i = 0; i < (int)sizeof(buf); i++)
+		buf[i] = (unsigned char)(i * 151 + 7);
+
+	for (offset = 0; offset < 32; offset++)
+	{
+		for (len = 0; offset + len <= (int)sizeof(buf); len++)
+		{
+			dbmd_simd_set(DBMD_SIMD_NONE);
+			expected = dbmd_byte_sum(buf + offset, len);
+			for (level = DBMD_SIMD_SSE2; level <= (int)dbmd_simd_supported(); level++)
+			{
+				dbmd_simd_set((dbmd_simd_level)level);
+				if (dbmd_byte_sum(buf + offset, len) != expected)
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void counters_open(...)
+-Purpose:
+	Opens a perf event group counting cycles, instructions and cache misses of
+	this thread. Kernel time is included where the kernel allows it, so that
+	the cost of reading cold files shows up. The counters stay closed if perf
+	events are not available.
+********************************************************************************************/
+static void counters_open(void)
+{
+#ifdef __linux__
+	static const uint64_t configs[BENCH_NUM_COUNTERS] =
+		{ PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+	struct perf_event_attr attr;
+	int exclude_kernel, i;
+
+	for (exclude_kernel = 0; exclude_kernel <= 1; exclude_kernel++)
+	{
+		for (i = 0; i < BENCH_NUM_COUNTERS; i++)
+		{
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = (i == 0);
+			attr.exclude_kernel = exclude_kernel;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+			counter_fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : counter_fds[0], 0);
+			if (counter_fds[i] < 0)
+				break;
+		}
+		if (i == BENCH_NUM_COUNTERS)
+			return;
+
+		/* close the partial group and retry */
+		while (i-- > 0)
+		{
+			close(counter_fds[i]);
+			counter_fds[i] = -1;
+		}
+	}
+#endif
+}
+
+/*******************************************************************************************
+static int counters_read(...)
+-Purpose:
+	Reads the perf event group
+-Inputs:
+	uint64_t *values	-	Receives BENCH_NUM_COUNTERS counts
+-Returns:
+	int				-	0 on success, -1 if the counters are not available
+********************************************************************************************/
+static int counters_read(uint64_t *values)
+{
+#ifdef __linux__
+	uint64_t group[1 + BENCH_NUM_COUNTERS];
+
+	if (counter_fds[0] < 0)
+		return -1;
+	if (read(counter_fds[0], group, sizeof(group)) != (ssize_t)sizeof(group))
+		return -1;
+	memcpy(values, group + 1, sizeof(uint64_t) * BENCH_NUM_COUNTERS);
+	return 0;
+#else
+	(void)values;
+	return -1;
+#endif
+}
+
+/*******************************************************************************************
+static void bench_run(...)
+-Purpose:
+	Runs a benchmark case for at least BENCH_MIN_SECONDS of measured time and
+	reports the time and counts per operation. Only the passes themselves are
+	timed and counted, the prepare step is not.
+-Inputs:
+	const BenchCase *bc	-	Case to run
+********************************************************************************************/
+static void bench_run(const BenchCase *bc)
+{
+	uint64_t before[BENCH_NUM_COUNTERS];
+	uint64_t after[BENCH_NUM_COUNTERS];
+	uint64_t counts[BENCH_NUM_COUNTERS] = { 0, 0, 0 };
+	unsigned long ops = 0;
+	double elapsed = 0.0;
+	double start, per_op[BENCH_NUM_COUNTERS];
+	int have_counters = (counter_fds[0] >= 0);
+	int i;
+
+#ifdef __linux__
+	if (have_counters)
+		ioctl(counter_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	do
+	{
+		if (bc->prepare)
+			bc->prepare(bc->arg);
+		if ( have_counters && counters_read(before) )
+			have_counters = 0;
+		start = now();
+		ops += bc->run(bc->arg);
+		elapsed += now() - start;
+		if ( have_counters && counters_read(after) )
+			have_counters = 0;
+		for (i = 0; have_counters && (i < BENCH_NUM_COUNTERS); i++)
+			counts[i] += after[i] - before[i];
+	} while (elapsed < BENCH_MIN_SECONDS);
+#ifdef __linux__
+	if (counter_fds[0] >= 0)
+		ioctl(counter_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+
+	for (i = 0; i < BENCH_NUM_COUNTERS; i++)
+		per_op[i] = (double)counts[i] / (double)ops;
+
+	printf("   %-22s %-24s %-6s %-4s %10.1f ns/%s", bc->phase, bc->input, bc->kernel, bc->cache,
+		elapsed * 1e9 / (double)ops, bc->unit);
+	if (have_counters)
+		printf("  %9.0f cycles  %9.0f instr  %7.1f misses", per_op[BENCH_CYCLES], per_op[BENCH_INSTRUCTIONS], per_op[BENCH_CACHE_MISSES]);
+	printf("\n");
+
+	if (results)
+	{
+		fprintf(results, "%s,%s,%s,%s,%s,%lu,%.1f", bc->phase, bc->input, bc->kernel, bc->cache, bc->unit, ops,
+			elapsed * 1e9 / (double)ops);
+		if (have_counters)
+			fprintf(results, ",%.1f,%.1f,%.2f\n", per_op[BENCH_CYCLES], per_op[BENCH_INSTRUCTIONS], per_op[BENCH_CACHE_MISSES]);
+		else
+			fprintf(results, ",,,\n");
+	}
+}
+
+/*******************************************************************************************
+static unsigned long run_checksum(...)
+-Purpose:
+	Checksums every segment of the corpus with calc_checksum()
+********************************************************************************************/
+static unsigned long run_checksum(void *arg)
+{
+	BenchCorpus *corpus = (BenchCorpus *)arg;
+	volatile int sink = 0;
+	unsigned long ops = 0;
+	int i, j;
+
+	for (i = 0; i < corpus->num_chunks; i++)
+	{
+		for (j = 0; j < corpus->chunks[i].index.num_segments; j++)
+		{
+			const DBMDSegment *segment = &corpus->chunks[i].index.segments[j];
+
+			sink += calc_checksum(segment->size, corpus->chunks[i].data + segment->offset);
+			ops++;
+		}
+	}
+
+	return ops;
+}
+
+/*******************************************************************************************
+static unsigned long run_index(...)
+-Purpose:
+	Indexes every chunk of the corpus with checksum verification
+********************************************************************************************/
+static unsigned long run_index(void *arg)
+{
+	BenchCorpus *corpus = (BenchCorpus *)arg;
+	DBMDSegmentIndex index;
+	int i;
+
+	for (i = 0; i < corpus->num_chunks; i++)
+		index_dbmd_segments(corpus->chunks[i].data, corpus->chunks[i].size, DBMD_INDEX_VERIFY, &index);
+
+	return (unsigned long)corpus->num_chunks;
+}
+
+/*******************************************************************************************
+static unsigned long run_parse(...)
+-Purpose:
+	Fully decodes every chunk of the corpus with parse_dbmd_metadata()
+********************************************************************************************/
+static unsigned long run_parse(void *arg)
+{
+	BenchCorpus *corpus = (BenchCorpus *)arg;
+	int i;
+
+	for (i = 0; i < corpus->num_chunks; i++)
+		parse_dbmd_metadata(corpus->chunks[i].data, corpus->chunks[i].size, &corpus->decoded);
+
+	return (unsigned long)corpus->num_chunks;
+}
+
+/*******************************************************************************************
+static unsigned long run_display(...)
+-Purpose:
+	Renders the decoded metadata of every chunk of the corpus as text
+********************************************************************************************/
+static unsigned long run_display(void *arg)
+{
+	BenchCorpus *corpus = (BenchCorpus *)arg;
+	int i;
+
+	for (i = 0; i < corpus->num_chunks; i++)
+	{
+		dbmd_output_reset(&corpus->out);
+		display_dbmd_metadata(&corpus->out, &corpus->chunks[i].metadata);
+	}
+
+	return (unsigned long)corpus->num_chunks;
+}
+
+/*******************************************************************************************
+static int check_compact(...)
+-Purpose:
+	Encodes the decoded metadata of every chunk of the corpus into a compact
+	record and checks that the record decodes to the same metadata and answers
+	the summary predicates as the metadata does
+-Returns:
+	int				-	0 if all records round trip
+********************************************************************************************/
+static int check_compact(BenchCorpus *corpus)
+{
+	const DolbyAtmosSupplementalSegment *sup;
+	const DBMetadata *metadata = &corpus->decoded;
+	unsigned int identical, bypass, j;
+	int i;
+
+	dbmd_compact_init(&corpus->store);
+	corpus->compact = (DBMDCompact *)calloc((size_t)corpus->num_chunks, sizeof(DBMDCompact));
+	if (!corpus->compact)
+		return -1;
+
+	for (i = 0; i < corpus->num_chunks; i++)
+	{
+		sup = &corpus->chunks[i].metadata.DolbyAtmosSupSeg;
+		if ( dbmd_compact_encode(&corpus->store, &corpus->chunks[i].metadata, &corpus->compact[i]) ||
+		     dbmd_compact_decode(&corpus->store, &corpus->compact[i], &corpus->decoded) )
+			return -1;
+		if ( memcmp(&metadata->DolbyAtmosSeg, &corpus->chunks[i].metadata.DolbyAtmosSeg, sizeof(DolbyAtmosSegment)) &&
+		     corpus->chunks[i].metadata.DolbyAtmosSeg.segment_exists )
+			return -1;
+		if ( (metadata->DolbyAtmosSupSeg.object_count != sup->object_count) ||
+		     memcmp(metadata->DolbyAtmosSupSeg.objects.flags, sup->objects.flags, sup->object_count) ||
+		     memcmp(metadata->DolbyAtmosSupSeg.objects.binaural_render_mode, sup->objects.binaural_render_mode, sup->object_count) ||
+		     memcmp(metadata->DolbyAtmosSupSeg.mode_histogram, sup->mode_histogram, sizeof(sup->mode_histogram)) ||
+		     memcmp(metadata->DolbyAtmosSupSeg.trims, sup->trims, sizeof(sup->trims)) )
+			return -1;
+
+		identical = (sup->object_count > 0);
+		bypass = 0;
+		for (j = 0; j < sup->object_count; j++)
+		{
+			identical &= (sup->objects.binaural_render_mode[j] == sup->objects.binaural_render_mode[0]);
+			bypass |= (sup->objects.binaural_render_mode[j] == ATMOS_DBMD_BINAURAL_RENDER_MODE_BYPASS);
+		}
+		if ( sup->segment_exists && ( (dbmd_compact_all_identical(&corpus->compact[i]) != (int)identical) ||
+		     (dbmd_compact_any_bypass(&corpus->compact[i]) != (int)bypass) ) )
+			return -1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static unsigned long run_compact_encode(...)
+-Purpose:
+	Encodes the decoded metadata of every chunk of the corpus into compact
+	records, starting from an empty store on each pass
+********************************************************************************************/
+static unsigned long run_compact_encode(void *arg)
+{
+	BenchCorpus *corpus = (BenchCorpus *)arg;
+	int i;
+
+	corpus->store.num_tools = 0;
+	corpus->store.modes_len = 0;
+	memset(corpus->store.slots, 0, corpus->store.num_slots * sizeof(uint16_t));
+	for (i = 0; i < corpus->num_chunks; i++)
+		dbmd_compact_encode(&corpus->store, &corpus->chunks[i].metadata, &corpus->compact[i]);
+
+	return (unsigned long)corpus->num_chunks;
+}
+
+/*******************************************************************************************
+static unsigned long run_compact_decode(...)
+-Purpose:
+	Expands the compact record of every chunk of the corpus
+********************************************************************************************/
+static unsigned long run_compact_decode(void *arg)
+{
+	BenchCorpus *corpus = (BenchCorpus *)arg;
+	int i;
+
+	for (i = 0; i < corpus->num_chunks; i++)
+		dbmd_compact_decode(&corpus->store, &corpus->compact[i], &corpus->decoded);
+
+	return (unsigned long)corpus->num_chunks;
+}
+
+/*******************************************************************************************
+static unsigned long run_header(...)
+-Purpose:
+	Walks the chunks of a file once with parse_wav_header()
+********************************************************************************************/
+static unsigned long run_header(void *arg)
+{
+	BenchFile *file = (BenchFile *)arg;
+
+	parse_wav_header(file->source, &file->ctx);
+
+	return 1;
+}
+
+/*******************************************************************************************
+static void drop_cache(...)
+-Purpose:
+	Evicts a file from the page cache so that the next pass reads from disk
+********************************************************************************************/
+static void drop_cache(void *arg)
+{
+#ifdef __linux__
+	BenchFile *file = (BenchFile *)arg;
+
+	posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+	(void)arg;
+#endif
+}
+
+/*******************************************************************************************
+static void bench_header(...)
+-Purpose:
+	Measures parse_wav_header() on a file with a warm page cache and, on Linux,
+	with a cold one
+-Inputs:
+	const char *path	-	File to scan, reported by its base name
+********************************************************************************************/
+static void bench_header(const char *path)
+{
+	const char *name = strrchr(path, '/');
+	BenchFile file;
+	BenchCase bc;
+
+	memset(&file, 0, sizeof(file));
+	file.path = path;
+	dbmd_init(&file.ctx);
+	if (dbmd_source_open_file(&file.source, path, 0))
+	{
+		printf("Skipping %s, could not be opened\n", path);
+		return;
+	}
+	if (parse_wav_header(file.source, &file.ctx))
+	{
+		printf("Skipping %s, not a valid ADM WAV file\n", path);
+		dbmd_source_close(file.source);
+		return;
+	}
+	file.fd = open(path, O_RDONLY);
+
+	memset(&bc, 0, sizeof(bc));
+	bc.phase = "parse_wav_header";
+	bc.input = name ? name + 1 : path;
+	bc.kernel = "-";
+	bc.unit = "file";
+	bc.run = run_header;
+	bc.arg = &file;
+
+	bc.cache = "warm";
+	bench_run(&bc);
+#ifdef __linux__
+	if (file.fd >= 0)
+	{
+		bc.cache = "cold";
+		bc.prepare = drop_cache;
+		bench_run(&bc);
+	}
+#endif
+
+	if (file.fd >= 0)
+		close(file.fd);
+	dbmd_source_close(file.source);
+}
+
+/*******************************************************************************************
+static int write_at(...)
+-Purpose:
+	Writes a buffer at an offset of a file
+********************************************************************************************/
+static int write_at(int fd, const void *buf, size_t len, uint64_t offset)
+{
+	if (lseek(fd, (off_t)offset, SEEK_SET) < 0)
+		return -1;
+	return (write(fd, buf, len) == (ssize_t)len) ? 0 : -1;
+}
+
+/*******************************************************************************************
+static void put_le32(...)
+-Purpose:
+	Stores a 32-bit little-endian integer
+********************************************************************************************/
+static void put_le32(unsigned char *p, uint32_t value)
+{
+	p[0] = (unsigned char)value;
+	p[1] = (unsigned char)(value >> 8);
+	p[2] = (unsigned char)(value >> 16);
+	p[3] = (unsigned char)(value >> 24);
+}
+
+static void put_le64(unsigned char *p, uint64_t value)
+{
+	put_le32(p, (uint32_t)value);
+	put_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+/*******************************************************************************************
+static int synthesize(...)
+-Purpose:
+	Writes a large ADM WAV file with the chunks of a template file and a data
+	chunk of the given size left as a sparse hole, so that the metadata chunks
+	follow gigabytes of audio without using the disk space. BW64 files carry a
+	ds64 chunk holding the 64-bit sizes.
+-Inputs:
+	const char *path			-	File to create
+	const char *template_path	-	ADM WAV file to take the other chunks from
+	const char *form			-	"RIFF" or "BW64"
+	uint64_t data_size			-	Size of the data chunk
+-Returns:
+	int						-	0 on success
+********************************************************************************************/
+static int synthesize(const char *path, const char *template_path, const char *form, uint64_t data_size)
+{
+	unsigned char header[12 + 8 + 28];
+	unsigned char chunk_header[8];
+	unsigned char *template_data;
+	uint64_t pos, riff_size;
+	long template_size;
+	size_t header_size;
+	uint32_t size;
+	FILE *fp;
+	int is_bw64 = !strcmp(form, "BW64");
+	int error = 0;
+	int fd;
+	long i;
+
+	/* load the template */
+	fp = fopen(template_path, "rb");
+	if (!fp)
+		return -1;
+	fseek(fp, 0, SEEK_END);
+	template_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	template_data = (unsigned char *)malloc((size_t)template_size);
+	if ( !template_data || (fread(template_data, 1, (size_t)template_size, fp) != (size_t)template_size) )
+	{
+		free(template_data);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		printf("Skipping synthetic %s file, could not create %s\n", form, path);
+		free(template_data);
+		return -1;
+	}
+
+	/* copy the template chunks after the headers, replacing the data chunk
+	 * with a hole and dropping JUNK, which only reserves space for ds64 */
+	header_size = is_bw64 ? sizeof(header) : 12;
+	pos = header_size;
+	for (i = 12; !error && (i + 8 <= template_size); i += 8 + size + (size & 1))
+	{
+		size = (uint32_t)template_data[i + 4] | ((uint32_t)template_data[i + 5] << 8) |
+			((uint32_t)template_data[i + 6] << 16) | ((uint32_t)template_data[i + 7] << 24);
+		if ((uint64_t)i + 8 + size > (uint64_t)template_size)
+			break;
+		if (!memcmp(template_data + i, "JUNK", 4))
+			continue;
+		if (!memcmp(template_data + i, "data", 4))
+		{
+			memcpy(chunk_header, "data", 4);
+			put_le32(chunk_header + 4, is_bw64 ? RF64_INDICATION : (uint32_t)data_size);
+			error = write_at(fd, chunk_header, 8, pos);
+			pos += 8 + data_size;
+			continue;
+		}
+		error = write_at(fd, template_data + i, 8 + size + (size & 1), pos);
+		pos += 8 + size + (size & 1);
+	}
+	riff_size = pos - 8;
+
+	/* write the headers */
+	memcpy(header, form, 4);
+	put_le32(header + 4, is_bw64 ? RF64_INDICATION : (uint32_t)riff_size);
+	memcpy(header + 8, "WAVE", 4);
+	if (is_bw64)
+	{
+		memcpy(header + 12, "ds64", 4);
+		put_le32(header + 16, 28);
+		put_le64(header + 20, riff_size);   /* riffSize */
+		put_le64(header + 28, data_size);   /* dataSize */
+		put_le64(header + 36, 0);           /* sampleCount */
+		put_le32(header + 44, 0);           /* tableLength */
+	}
+	if (!error)
+		error = write_at(fd, header, header_size, 0);
+
+	if ( close(fd) || error )
+	{
+		printf("Skipping synthetic %s file, could not write %s\n", form, path);
+		unlink(path);
+		error = -1;
+	}
+	free(template_data);
+
+	return error;
+}
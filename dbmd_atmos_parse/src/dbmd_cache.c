@@ -0,0 +1,815 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "dbmd_cache.h"
+#include "dbmd_source.h"
+#include "dbmd_io.h"
+
+/* Cache file layout: an 8 byte magic and a 32-bit version, followed by
+ *  records. All values are little-endian. Each record holds
+ *
+ *      u32 record length   u64 dev   u64 ino   u64 size
+ *      u64 mtime_sec       u32 mtime_nsec      u64 dbmd hash
+ *      i32 error           u8 status           u32 dbmd chunk size
+ *
+ *  followed, for a file parsed without error, by the metadata: a flags byte,
+ *  the Dolby Atmos segment (tool name length and name, version, warp mode)
+ *  if present and the supplemental segment (object count, one flags byte and
+ *  one binaural render mode per object, one auto trim flag per trim
+ *  configuration) if present.
+ *  A later record for the same device and inode supersedes an earlier one.
+ */
+#define CACHE_MAGIC "DBMDCACH"
+#define CACHE_HEADER_SIZE 12
+#define CACHE_KEY_OFFSET 4
+#define CACHE_KEY_SIZE 36
+#define CACHE_HASH_OFFSET 40
+#define CACHE_RESULT_OFFSET 48
+#define CACHE_METADATA_OFFSET 57
+#define CACHE_MAX_RECORD (CACHE_METADATA_OFFSET + 1 + 1 + ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN + 4 + 2 + 2 * MAX_OBJECT_COUNT + NUM_TRIM_CONFIGS)
+
+/* Metadata flags */
+#define CACHE_ATMOS_SEG 0x01
+#define CACHE_ATMOS_SUP_SEG 0x02
+
+#define CACHE_MIN_SLOTS 1024
+
+/* Number of superseded records tolerated before the cache file is rewritten */
+#define CACHE_STALE_RECORDS 1024
+
+/* A file modified this recently may be modified again without its modification
+ * time changing, so its result is not cached */
+#define CACHE_RACY_SECONDS 2
+
+#ifndef WIN32
+
+/* Local function prototypes */
+static void cache_init(DBMDCache *cache);
+static void cache_free(DBMDCache *cache);
+static int cache_load(DBMDCache *cache, int fd);
+static int cache_reserve(DBMDCache *cache, size_t len);
+static int cache_index(DBMDCache *cache, size_t offset);
+static size_t *cache_find(DBMDCache *cache, const unsigned char *key);
+static int cache_flush(DBMDCache *cache);
+static int cache_rewrite(DBMDCache *cache, int fd);
+static int lock_cache_file(const char *path, int flags, short type);
+static size_t encode_key(unsigned char *buf, const DBMDCacheKey *key);
+static size_t encode_record(unsigned char *buf, const DBMDCacheKey *key, uint64_t hash, const DBMDContext *ctx, int error);
+static int decode_record(const unsigned char *rec, DBMDContext *ctx, int *error);
+
+#endif
+
+/*******************************************************************************************
+int dbmd_cache_open(...)
+-Purpose:
+	Loads the scan cache from a file. A missing file is created when the cache is
+	closed; a file written by another cache version is ignored and replaced.
+-Inputs:
+	DBMDCache *cache	-	Cache
+	const char *path	-	Cache file name
+-Returns:
+	int					-	0 on success, -1 if the file cannot be read
+********************************************************************************************/
+int dbmd_cache_open(DBMDCache *cache, const char *path)
+{
+#ifndef WIN32
+	int fd;
+	int error;
+
+	cache_init(cache);
+	cache->path = malloc(strlen(path) + 1);
+	if (!cache->path)
+		return -1;
+	strcpy(cache->path, path);
+	pthread_mutex_init(&cache->lock, NULL);
+
+	fd = lock_cache_file(path, O_RDONLY, F_RDLCK);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+		{
+			dbmd_cache_close(cache);
+			return -1;
+		}
+		/* start an empty cache */
+		error = cache_load(cache, -1);
+	}
+	else
+	{
+		error = cache_load(cache, fd);
+		close(fd);
+	}
+
+	if (error)
+	{
+		dbmd_cache_close(cache);
+		return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*******************************************************************************************
+int dbmd_cache_key(...)
+-Purpose:
+	Determines the cache key of a file. Only regular files can be cached.
+-Inputs:
+	DBMDCacheKey *key		-	Receives the key
+	const char *filename	-	Input file name
+-Returns:
+	int						-	0 on success, -1 if the file cannot be cached
+********************************************************************************************/
+int dbmd_cache_key(DBMDCacheKey *key, const char *filename)
+{
+#ifndef WIN32
+	struct stat st;
+
+	if ( !strcmp(filename, DBMD_STDIN_NAME) || dbmd_source_is_url(filename) )
+		return -1;
+	if ( (stat(filename, &st) != 0) || !S_ISREG(st.st_mode) )
+		return -1;
+
+	key->dev = (uint64_t)st.st_dev;
+	key->ino = (uint64_t)st.st_ino;
+	key->size = (uint64_t)st.st_size;
+	key->mtime_sec = (int64_t)st.st_mtime;
+#ifdef __APPLE__
+	key->mtime_nsec = (uint32_t)st.st_mtimespec.tv_nsec;
+#else
+	key->mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+#endif
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*******************************************************************************************
+uint64_t dbmd_cache_hash(...)
+-Purpose:
+	Computes the 64-bit FNV-1a hash of a dbmd chunk
+********************************************************************************************/
+uint64_t dbmd_cache_hash(const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	uint64_t hash = 0xCBF29CE484222325ull;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+/*******************************************************************************************
+int dbmd_cache_lookup(...)
+-Purpose:
+	Looks up the result of a file. On a hit, the chunk status bits, dbmd chunk size
+	and metadata of the context are restored as dbmd_parse_file() left them.
+-Inputs:
+	DBMDCache *cache			-	Cache
+	const DBMDCacheKey *key		-	Key of the file
+	const uint64_t *hash		-	Hash of the dbmd chunk the entry must match, or NULL
+	DBMDContext *ctx			-	Receives the cached result
+	int *error					-	Receives the cached error code
+-Returns:
+	int							-	1 if the file was found, 0 otherwise
+********************************************************************************************/
+int dbmd_cache_lookup(DBMDCache *cache, const DBMDCacheKey *key, const uint64_t *hash, DBMDContext *ctx, int *error)
+{
+#ifndef WIN32
+	unsigned char key_buf[CACHE_KEY_SIZE];
+	const unsigned char *rec;
+	size_t *slot;
+	int found = 0;
+
+	encode_key(key_buf, key);
+
+	pthread_mutex_lock(&cache->lock);
+	slot = cache_find(cache, key_buf);
+	if (slot && *slot)
+	{
+		rec = cache->data + *slot - 1;
+
+		/* the device and inode match, the file must also be unchanged */
+		if ( !memcmp(rec + CACHE_KEY_OFFSET, key_buf, CACHE_KEY_SIZE) &&
+		     (!hash || (dbmd_get_le(rec + CACHE_HASH_OFFSET, 8) == *hash)) )
+			found = !decode_record(rec, ctx, error);
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+#else
+	return 0;
+#endif
+}
+
+/*******************************************************************************************
+void dbmd_cache_store(...)
+-Purpose:
+	Adds the result of a file to the cache, replacing any earlier entry. Errors
+	that depend on the environment rather than on the file contents, including
+	running out of memory or object table entries, and files modified too
+	recently to be told apart from a later change, are not cached.
+-Inputs:
+	DBMDCache *cache			-	Cache
+	const DBMDCacheKey *key		-	Key of the file, taken before it was scanned
+	uint64_t hash				-	Hash of the dbmd chunk, 0 if there is none
+	const DBMDContext *ctx		-	Parse context used to scan the file
+	int error					-	Error code of the scan
+********************************************************************************************/
+void dbmd_cache_store(DBMDCache *cache, const DBMDCacheKey *key, uint64_t hash, const DBMDContext *ctx, int error)
+{
+#ifndef WIN32
+	size_t len;
+
+	if ( (error == DB_ERR_FILEOPEN) || (error == DB_ERR_FILEREAD) || (error == DB_ERR_NOTSUPPORTED) || (error == DB_ERR_NOTSEEKABLE) )
+		return;
+	/* out of memory, or more objects than the caller's object table holds */
+	if ( (error == DB_ERR_NOMEMORY) || (error == DB_ERR_TOOMANYOBJS) )
+		return;
+	if (key->mtime_sec >= (int64_t)time(NULL) - CACHE_RACY_SECONDS)
+		return;
+
+	/* the record is encoded in place at the end of the cache data */
+	pthread_mutex_lock(&cache->lock);
+	if (!cache_reserve(cache, CACHE_MAX_RECORD))
+	{
+		len = encode_record(cache->data + cache->len, key, hash, ctx, error);
+		if (!cache_index(cache, cache->len))
+		{
+			cache->len += len;
+			cache->num_records++;
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+/*******************************************************************************************
+int dbmd_cache_close(...)
+-Purpose:
+	Writes the entries added since the cache was opened to the cache file and
+	releases the cache
+-Inputs:
+	DBMDCache *cache	-	Cache
+-Returns:
+	int					-	0 on success, -1 if the cache file could not be written
+********************************************************************************************/
+int dbmd_cache_close(DBMDCache *cache)
+{
+#ifndef WIN32
+	int error = 0;
+
+	if (cache->data)
+		error = cache_flush(cache);
+
+	pthread_mutex_destroy(&cache->lock);
+	cache_free(cache);
+
+	return error;
+#else
+	return -1;
+#endif
+}
+
+#ifndef WIN32
+
+/*******************************************************************************************
+static void cache_init(...)
+-Purpose:
+	Initializes an empty cache that is not yet attached to a file
+********************************************************************************************/
+static void cache_init(DBMDCache *cache)
+{
+	memset(cache, 0, sizeof(DBMDCache));
+}
+
+/*******************************************************************************************
+static void cache_free(...)
+-Purpose:
+	Releases the memory held by a cache
+********************************************************************************************/
+static void cache_free(DBMDCache *cache)
+{
+	free(cache->path);
+	free(cache->data);
+	free(cache->slots);
+	cache_init(cache);
+}
+
+/*******************************************************************************************
+static int cache_load(...)
+-Purpose:
+	Reads and indexes the records of a cache file, fd -1 for an empty cache. A
+	record cut short by an interrupted write ends the file and marks it for
+	rewriting, as does a file of another cache version.
+-Returns:
+	int				-	0 on success, -1 if out of memory or on a read error
+********************************************************************************************/
+static int cache_load(DBMDCache *cache, int fd)
+{
+	struct stat st;
+	size_t pos, rec_len;
+	ssize_t n;
+
+	cache->len = 0;
+	cache->file_len = 0;
+	cache->num_entries = 0;
+	cache->num_records = 0;
+	if (cache->slots)
+		memset(cache->slots, 0, cache->num_slots * sizeof(size_t));
+
+	if (fd >= 0)
+	{
+		if (fstat(fd, &st) != 0)
+			return -1;
+		if (cache_reserve(cache, (size_t)st.st_size))
+			return -1;
+		while (cache->len < (size_t)st.st_size)
+		{
+			n = pread(fd, cache->data + cache->len, (size_t)st.st_size - cache->len, (off_t)cache->len);
+			if ( (n < 0) && (errno == EINTR) )
+				continue;
+			if (n < 0)
+				return -1;
+			if (n == 0)
+				break;
+			cache->len += (size_t)n;
+		}
+	}
+
+	/* a file of another version is discarded */
+	if ( (cache->len < CACHE_HEADER_SIZE) || memcmp(cache->data, CACHE_MAGIC, 8) || (dbmd_get_le(cache->data + 8, 4) != DBMD_CACHE_VERSION) )
+	{
+		cache->rewrite = (cache->len != 0);
+		if (cache_reserve(cache, CACHE_HEADER_SIZE))
+			return -1;
+		memcpy(cache->data, CACHE_MAGIC, 8);
+		dbmd_put_le(cache->data + 8, DBMD_CACHE_VERSION, 4);
+		cache->len = CACHE_HEADER_SIZE;
+		return 0;
+	}
+
+	for (pos = CACHE_HEADER_SIZE; pos + 4 <= cache->len; pos += rec_len)
+	{
+		rec_len = (size_t)dbmd_get_le(cache->data + pos, 4);
+		if ( (rec_len < CACHE_METADATA_OFFSET) || (rec_len > CACHE_MAX_RECORD) || (rec_len > cache->len - pos) )
+			break;
+		if (cache_index(cache, pos))
+			return -1;
+		cache->num_records++;
+	}
+	if (pos != cache->len)
+	{
+		cache->rewrite = 1;
+		cache->len = pos;
+	}
+	cache->file_len = cache->len;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int cache_reserve(...)
+-Purpose:
+	Makes room for len more bytes of records
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int cache_reserve(DBMDCache *cache, size_t len)
+{
+	unsigned char *data;
+	size_t size;
+
+	if (cache->len + len <= cache->size)
+		return 0;
+
+	size = cache->size ? cache->size : 4096;
+	while (size < cache->len + len)
+		size *= 2;
+
+	data = realloc(cache->data, size);
+	if (!data)
+		return -1;
+	cache->data = data;
+	cache->size = size;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int cache_index(...)
+-Purpose:
+	Adds the record at an offset of the cache data to the hash table, replacing
+	the entry of the same device and inode, and grows the table as needed
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int cache_index(DBMDCache *cache, size_t offset)
+{
+	size_t *old_slots = cache->slots;
+	size_t old_num_slots = cache->num_slots;
+	size_t *slot;
+	size_t i;
+
+	/* keep the table at most half full */
+	if ( (cache->num_entries + 1) * 2 > cache->num_slots )
+	{
+		cache->num_slots = old_num_slots ? old_num_slots * 2 : CACHE_MIN_SLOTS;
+		cache->slots = calloc(cache->num_slots, sizeof(size_t));
+		if (!cache->slots)
+		{
+			cache->slots = old_slots;
+			cache->num_slots = old_num_slots;
+			return -1;
+		}
+		for (i = 0; i < old_num_slots; i++)
+		{
+			if (old_slots[i])
+				*cache_find(cache, cache->data + old_slots[i] - 1 + CACHE_KEY_OFFSET) = old_slots[i];
+		}
+		free(old_slots);
+	}
+
+	slot = cache_find(cache, cache->data + offset + CACHE_KEY_OFFSET);
+	if (!*slot)
+		cache->num_entries++;
+	*slot = offset + 1;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static size_t *cache_find(...)
+-Purpose:
+	Returns the hash table slot holding the record of a device and inode, or the
+	free slot where it belongs
+********************************************************************************************/
+static size_t *cache_find(DBMDCache *cache, const unsigned char *key)
+{
+	uint64_t h;
+	size_t i;
+
+	if (!cache->num_slots)
+		return NULL;
+
+	/* device and inode identify the file */
+	h = (dbmd_get_le(key, 8) * 0x9E3779B97F4A7C15ull) ^ dbmd_get_le(key + 8, 8);
+	h *= 0xBF58476D1CE4E5B9ull;
+	h ^= h >> 31;
+
+	for (i = (size_t)h & (cache->num_slots - 1); cache->slots[i]; i = (i + 1) & (cache->num_slots - 1))
+	{
+		if (!memcmp(cache->data + cache->slots[i] - 1 + CACHE_KEY_OFFSET, key, 16))
+			break;
+	}
+
+	return &cache->slots[i];
+}
+
+/*******************************************************************************************
+static int cache_flush(...)
+-Purpose:
+	Writes the records added since the cache was loaded. They are normally
+	appended to the cache file under an exclusive lock, so that concurrent writers
+	never interleave. A file holding too many superseded records, or one that
+	cannot be appended to, is rewritten instead.
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int cache_flush(DBMDCache *cache)
+{
+	unsigned char header[CACHE_HEADER_SIZE];
+	struct stat st;
+	size_t start;
+	int fd;
+	int error;
+
+	start = (cache->file_len > CACHE_HEADER_SIZE) ? cache->file_len : CACHE_HEADER_SIZE;
+	if ( (cache->len == start) && !cache->rewrite )
+		return 0;
+
+	if (cache->num_records > 2 * cache->num_entries + CACHE_STALE_RECORDS)
+		cache->rewrite = 1;
+
+	fd = lock_cache_file(cache->path, O_RDWR | O_CREAT, F_WRLCK);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	if ( !cache->rewrite && (st.st_size == 0) )
+	{
+		/* new file, write the header along with the records */
+		error = dbmd_write_all(fd, cache->data, cache->len, 0);
+	}
+	else if ( !cache->rewrite && (pread(fd, header, CACHE_HEADER_SIZE, 0) == CACHE_HEADER_SIZE) && !memcmp(header, cache->data, CACHE_HEADER_SIZE) )
+	{
+		/* append after any records written by other processes meanwhile */
+		error = dbmd_write_all(fd, cache->data + start, cache->len - start, (uint64_t)st.st_size);
+	}
+	else
+	{
+		error = cache_rewrite(cache, fd);
+	}
+
+	close(fd);
+	return error;
+}
+
+/*******************************************************************************************
+static int cache_rewrite(...)
+-Purpose:
+	Replaces the locked cache file with one holding a single record per file: the
+	current file contents merged with the records added since it was loaded. The
+	new file is written under a temporary name and renamed over the old one.
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int cache_rewrite(DBMDCache *cache, int fd)
+{
+	DBMDCache merged;
+	unsigned char *out;
+	size_t start, pos, rec_len, out_len, i;
+	char *tmp_path;
+	int tmp_fd;
+	int error = -1;
+
+	cache_init(&merged);
+	if (cache_load(&merged, fd))
+	{
+		cache_free(&merged);
+		return -1;
+	}
+
+	/* the records added by this process supersede those in the file */
+	start = (cache->file_len > CACHE_HEADER_SIZE) ? cache->file_len : CACHE_HEADER_SIZE;
+	for (pos = start; pos < cache->len; pos += rec_len)
+	{
+		rec_len = (size_t)dbmd_get_le(cache->data + pos, 4);
+		if ( cache_reserve(&merged, rec_len) )
+			break;
+		memcpy(merged.data + merged.len, cache->data + pos, rec_len);
+		if (cache_index(&merged, merged.len))
+			break;
+		merged.len += rec_len;
+	}
+
+	out = malloc(merged.len);
+	tmp_path = malloc(strlen(cache->path) + 32);
+	if ( (pos == cache->len) && out && tmp_path )
+	{
+		memcpy(out, merged.data, CACHE_HEADER_SIZE);
+		out_len = CACHE_HEADER_SIZE;
+		for (i = 0; i < merged.num_slots; i++)
+		{
+			if (merged.slots[i])
+			{
+				rec_len = (size_t)dbmd_get_le(merged.data + merged.slots[i] - 1, 4);
+				memcpy(out + out_len, merged.data + merged.slots[i] - 1, rec_len);
+				out_len += rec_len;
+			}
+		}
+
+		sprintf(tmp_path, "%s.%ld.tmp", cache->path, (long)getpid());
+		tmp_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (tmp_fd >= 0)
+		{
+			error = dbmd_write_all(tmp_fd, out, out_len, 0);
+			if (!error)
+				error = fsync(tmp_fd) ? -1 : 0;
+			close(tmp_fd);
+			if (!error)
+				error = rename(tmp_path, cache->path) ? -1 : 0;
+			if (error)
+				unlink(tmp_path);
+		}
+	}
+
+	free(tmp_path);
+	free(out);
+	cache_free(&merged);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int lock_cache_file(...)
+-Purpose:
+	Opens the cache file and waits for a shared (F_RDLCK) or exclusive (F_WRLCK)
+	lock on it. A file that was replaced by a rewrite while waiting is reopened.
+-Returns:
+	int				-	locked file descriptor, or -1 with errno set
+********************************************************************************************/
+static int lock_cache_file(const char *path, int flags, short type)
+{
+	int locked;
+	int fd;
+
+	while (1)
+	{
+		fd = open(path, flags, 0666);
+		if (fd < 0)
+			return -1;
+
+		locked = dbmd_lock_fd(fd, type, path);
+		if (!locked)
+			return fd;
+
+		close(fd);
+		if (locked < 0)
+			return -1;
+	}
+}
+
+/*******************************************************************************************
+static size_t encode_key(...)
+-Purpose:
+	Serializes a cache key
+********************************************************************************************/
+static size_t encode_key(unsigned char *buf, const DBMDCacheKey *key)
+{
+	dbmd_put_le(buf, key->dev, 8);
+	dbmd_put_le(buf + 8, key->ino, 8);
+	dbmd_put_le(buf + 16, key->size, 8);
+	dbmd_put_le(buf + 24, (uint64_t)key->mtime_sec, 8);
+	dbmd_put_le(buf + 32, key->mtime_nsec, 4);
+
+	return CACHE_KEY_SIZE;
+}
+
+/*******************************************************************************************
+static size_t encode_record(...)
+-Purpose:
+	Serializes the result of a file into a cache record
+-Returns:
+	size_t			-	record length
+********************************************************************************************/
+static size_t encode_record(unsigned char *buf, const DBMDCacheKey *key, uint64_t hash, const DBMDContext *ctx, int error)
+{
+	const DolbyAtmosSegment *seg = &ctx->metadata.DolbyAtmosSeg;
+	const DolbyAtmosSupplementalSegment *sup = &ctx->metadata.DolbyAtmosSupSeg;
+	size_t len, tool_len;
+	unsigned int i;
+
+	encode_key(buf + CACHE_KEY_OFFSET, key);
+	dbmd_put_le(buf + CACHE_HASH_OFFSET, hash, 8);
+	dbmd_put_le(buf + CACHE_RESULT_OFFSET, (uint32_t)error, 4);
+	buf[CACHE_RESULT_OFFSET + 4] = ctx->status;
+	dbmd_put_le(buf + CACHE_RESULT_OFFSET + 5, ctx->dbmd_chunk_size, 4);
+	len = CACHE_METADATA_OFFSET;
+
+	if (error == DB_ERR_OK)
+	{
+		buf[len++] = (seg->segment_exists ? CACHE_ATMOS_SEG : 0) | (sup->segment_exists ? CACHE_ATMOS_SUP_SEG : 0);
+
+		if (seg->segment_exists)
+		{
+			tool_len = strlen(seg->content_creation_tool);
+			buf[len++] = (unsigned char)tool_len;
+			memcpy(buf + len, seg->content_creation_tool, tool_len);
+			len += tool_len;
+			buf[len++] = (unsigned char)seg->content_creation_tool_version.major;
+			buf[len++] = (unsigned char)seg->content_creation_tool_version.minor;
+			buf[len++] = (unsigned char)seg->content_creation_tool_version.micro;
+			buf[len++] = (unsigned char)seg->warp_mode;
+		}
+
+		if (sup->segment_exists)
+		{
+			dbmd_put_le(buf + len, sup->object_count, 2);
+			len += 2;
+			memcpy(buf + len, sup->objects.flags, sup->object_count);
+			len += sup->object_count;
+			memcpy(buf + len, sup->objects.binaural_render_mode, sup->object_count);
+			len += sup->object_count;
+			for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+				buf[len++] = (unsigned char)sup->trims[i].auto_trim;
+		}
+	}
+
+	dbmd_put_le(buf, len, 4);
+	return len;
+}
+
+/*******************************************************************************************
+static int decode_record(...)
+-Purpose:
+	Restores the result of a file from a cache record
+-Returns:
+	int				-	0 on success, -1 if the record is malformed
+********************************************************************************************/
+static int decode_record(const unsigned char *rec, DBMDContext *ctx, int *error)
+{
+	DolbyAtmosSegment *seg = &ctx->metadata.DolbyAtmosSeg;
+	DolbyAtmosSupplementalSegment *sup = &ctx->metadata.DolbyAtmosSupSeg;
+	size_t rec_len = (size_t)dbmd_get_le(rec, 4);
+	size_t pos = CACHE_METADATA_OFFSET;
+	DBMDObjectTable objects;
+	size_t tool_len;
+	unsigned int flags, mode, i;
+
+	*error = (int)(int32_t)dbmd_get_le(rec + CACHE_RESULT_OFFSET, 4);
+	ctx->status = rec[CACHE_RESULT_OFFSET + 4];
+	ctx->dbmd_chunk_size = dbmd_get_le(rec + CACHE_RESULT_OFFSET + 5, 4);
+
+	/* clear the metadata, keeping the object table */
+	objects = sup->objects;
+	memset(&ctx->metadata, 0, sizeof(DBMetadata));
+	sup->objects = objects;
+
+	if (*error != DB_ERR_OK)
+		return 0;
+
+	if (pos + 1 > rec_len)
+		return -1;
+	flags = rec[pos++];
+
+	if (flags & CACHE_ATMOS_SEG)
+	{
+		if (pos + 1 > rec_len)
+			return -1;
+		tool_len = rec[pos++];
+		if ( (tool_len > ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN) || (pos + tool_len + 4 > rec_len) )
+			return -1;
+		seg->segment_exists = 1;
+		memcpy(seg->content_creation_tool, rec + pos, tool_len);
+		pos += tool_len;
+		seg->content_creation_tool_version.major = rec[pos++];
+		seg->content_creation_tool_version.minor = rec[pos++];
+		seg->content_creation_tool_version.micro = rec[pos++];
+		seg->warp_mode = (atmos_dbmd_warp_mode)rec[pos++];
+	}
+
+	if (flags & CACHE_ATMOS_SUP_SEG)
+	{
+		if (pos + 2 > rec_len)
+			return -1;
+		sup->segment_exists = 1;
+		sup->object_count = (unsigned int)dbmd_get_le(rec + pos, 2);
+		pos += 2;
+		if ( (pos + 2 * (size_t)sup->object_count + NUM_TRIM_CONFIGS > rec_len) ||
+		     dbmd_objects_reserve(&sup->objects, sup->object_count) )
+			return -1;
+		memcpy(sup->objects.flags, rec + pos, sup->object_count);
+		pos += sup->object_count;
+		for (i = 0; i < sup->object_count; i++)
+		{
+			mode = rec[pos++] & 0x7;
+			sup->objects.binaural_render_mode[i] = (unsigned char)mode;
+			sup->mode_histogram[mode]++;
+		}
+		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+			sup->trims[i].auto_trim = rec[pos++];
+	}
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_CACHE_H
+#define DBMD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+#include "dbmd_wav_parse.h"
+
+/* This defines the persistent scan cache. The result of scanning a file is
+ *  stored on disk, keyed by the identity of the file (device, inode, size and
+ *  modification time), and an unchanged file is answered from the cache
+ *  without being read. The cache file is an append-only log of compact
+ *  records that any number of processes may share; writers serialize on a
+ *  file lock and the log is rewritten once it holds too many stale records.
+ *  Bump DBMD_CACHE_VERSION whenever the parser output changes, or delete the
+ *  cache file, to invalidate all entries.
+ */
+#define DBMD_CACHE_VERSION 2
+
+typedef struct
+{
+	uint64_t dev;        /* Device holding the file */
+	uint64_t ino;        /* Inode number */
+	uint64_t size;       /* File size in bytes */
+	int64_t mtime_sec;   /* Modification time, seconds */
+	uint32_t mtime_nsec; /* Modification time, nanoseconds */
+} DBMDCacheKey;
+
+typedef struct
+{
+	char *path;           /* Cache file name */
+	unsigned char *data;  /* Cache file contents followed by the records added since it was read */
+	size_t len;           /* Number of valid bytes in data */
+	size_t size;          /* Number of bytes allocated for data */
+	size_t file_len;      /* Number of bytes of data read from the cache file */
+	size_t *slots;        /* Hash table of record offsets + 1, 0 for a free slot */
+	size_t num_slots;     /* Size of the hash table, a power of two */
+	size_t num_entries;   /* Number of distinct files in the cache */
+	size_t num_records;   /* Number of records in data, including superseded ones */
+	int rewrite;          /* Set if the cache file must be rewritten rather than appended to */
+#ifndef WIN32
+	pthread_mutex_t lock; /* Serializes lookups and stores of worker threads */
+#endif
+} DBMDCache;
+
+int dbmd_cache_open(DBMDCache *cache, const char *path);
+int dbmd_cache_key(DBMDCacheKey *key, const char *filename);
+uint64_t dbmd_cache_hash(const void *data, size_t len);
+int dbmd_cache_lookup(DBMDCache *cache, const DBMDCacheKey *key, const uint64_t *hash, DBMDContext *ctx, int *error);
+void dbmd_cache_store(DBMDCache *cache, const DBMDCacheKey *key, uint64_t hash, const DBMDContext *ctx, int error);
+int dbmd_cache_close(DBMDCache *cache);
+
+#endif /* DBMD_CACHE_H */
@@ -0,0 +1,205 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stddef.h>
+#include "dbmd_atmos_parse.h"
+#include "dbmd_checksum.h"
+
+/* SSE2 is part of x86-64 and optional on 32-bit x86 */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define DBMD_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* AVX2 is compiled per function and only used if the processor reports it */
+#if defined(DBMD_HAVE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DBMD_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+/* Selected kernel, -1 until the first checksum */
+static int simd_level = -1;
+
+/* Local function prototypes */
+static unsigned int byte_sum_scalar(const unsigned char *buf, int len);
+#ifdef DBMD_HAVE_SSE2
+static unsigned int byte_sum_sse2(const unsigned char *buf, int len);
+#endif
+#ifdef DBMD_HAVE_AVX2
+static unsigned int byte_sum_avx2(const unsigned char *buf, int len);
+#endif
+
+/*******************************************************************************************
+unsigned int dbmd_byte_sum(...)
+-Purpose:
+	Sums the bytes of a buffer modulo 256 with the selected kernel
+-Inputs:
+	const unsigned char *buf	-	Pointer to the bytes
+	int len						-	Number of bytes
+-Returns:
+	unsigned int				-	sum of the bytes, 0 to 255
+********************************************************************************************/
+unsigned int dbmd_byte_sum(const unsigned char *buf, int len)
+{
+	switch (dbmd_simd_get())
+	{
+#ifdef DBMD_HAVE_AVX2
+		case DBMD_SIMD_AVX2:
+			return byte_sum_avx2(buf, len);
+#endif
+#ifdef DBMD_HAVE_SSE2
+		case DBMD_SIMD_SSE2:
+			return byte_sum_sse2(buf, len);
+#endif
+		default:
+			return byte_sum_scalar(buf, len);
+	}
+}
+
+/*******************************************************************************************
+dbmd_simd_level dbmd_simd_supported(...)
+-Purpose:
+	Determines the widest checksum kernel supported by the build and the processor
+********************************************************************************************/
+dbmd_simd_level dbmd_simd_supported(void)
+{
+#ifdef DBMD_HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return DBMD_SIMD_AVX2;
+#endif
+#ifdef DBMD_HAVE_SSE2
+	return DBMD_SIMD_SSE2;
+#else
+	return DBMD_SIMD_NONE;
+#endif
+}
+
+/*******************************************************************************************
+dbmd_simd_level dbmd_simd_get(...)
+-Purpose:
+	Returns the selected checksum kernel, selecting the widest supported one on
+	first use
+********************************************************************************************/
+dbmd_simd_level dbmd_simd_get(void)
+{
+	/* concurrent first calls all store the same value */
+	if (simd_level < 0)
+		simd_level = (int)dbmd_simd_supported();
+
+	return (dbmd_simd_level)simd_level;
+}
+
+/*******************************************************************************************
+int dbmd_simd_set(...)
+-Purpose:
+	Selects a checksum kernel for the whole process, for comparing kernels in
+	benchmarks. Must not be called while other threads compute checksums.
+-Inputs:
+	dbmd_simd_level level	-	Kernel to use
+-Returns:
+	int						-	error code, DB_ERR_NOTSUPPORTED if the kernel is not available
+********************************************************************************************/
+int dbmd_simd_set(dbmd_simd_level level)
+{
+	if ( ((int)level < 0) || (level > dbmd_simd_supported()) )
+		return DB_ERR_NOTSUPPORTED;
+
+	simd_level = (int)level;
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static unsigned int byte_sum_scalar(...)
+-Purpose:
+	Sums the bytes of a buffer one at a time
+********************************************************************************************/
+static unsigned int byte_sum_scalar(const unsigned char *buf, int len)
+{
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < len; i++)
+		sum += buf[i];
+
+	return sum & 0xFF;
+}
+
+#ifdef DBMD_HAVE_SSE2
+/*******************************************************************************************
+static unsigned int byte_sum_sse2(...)
+-Purpose:
+	Sums the bytes of a buffer 16 at a time. The sum of absolute differences
+	against zero adds each group of 8 bytes into a 64-bit lane.
+********************************************************************************************/
+static unsigned int byte_sum_sse2(const unsigned char *buf, int len)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	unsigned int sum;
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i)), zero));
+
+	sum = (unsigned int)_mm_cvtsi128_si32(acc) + (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+	for (; i < len; i++)
+		sum += buf[i];
+
+	return sum & 0xFF;
+}
+#endif
+
+#ifdef DBMD_HAVE_AVX2
+/*******************************************************************************************
+static unsigned int byte_sum_avx2(...)
+-Purpose:
+	Sums the bytes of a buffer 32 at a time
+********************************************************************************************/
+__attribute__((target("avx2")))
+static unsigned int byte_sum_avx2(const unsigned char *buf, int len)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	__m128i acc128;
+	unsigned int sum;
+	int i;
+
+	for (i = 0; i + 32 <= len; i += 32)
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(buf + i)), zero));
+
+	/* fold the four lanes, then take a last half vector */
+	acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	if (i + 16 <= len)
+	{
+		acc128 = _mm_add_epi64(acc128, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i)), _mm256_castsi256_si128(zero)));
+		i += 16;
+	}
+	sum = (unsigned int)_mm_cvtsi128_si32(acc128) + (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(acc128, 8));
+	for (; i < len; i++)
+		sum += buf[i];
+
+	return sum & 0xFF;
+}
+#endif
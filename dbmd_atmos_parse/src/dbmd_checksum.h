@@ -0,0 +1,47 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_CHECKSUM_H
+#define DBMD_CHECKSUM_H
+
+/* This defines the metadata segment checksum kernels. The checksum of a
+ *  segment is the two's complement of its size plus the sum of its payload
+ *  bytes, modulo 256. The byte sum is computed with SSE2 or AVX2 where the
+ *  processor supports it and with a scalar loop otherwise; the best kernel
+ *  is selected on first use.
+ */
+typedef enum
+{
+	DBMD_SIMD_NONE = 0, /* Scalar loop */
+	DBMD_SIMD_SSE2 = 1, /* 16 bytes per step */
+	DBMD_SIMD_AVX2 = 2  /* 32 bytes per step */
+} dbmd_simd_level;
+
+int calc_checksum(int seg_size, char *buf);
+unsigned int dbmd_byte_sum(const unsigned char *buf, int len);
+dbmd_simd_level dbmd_simd_supported(void);
+dbmd_simd_level dbmd_simd_get(void);
+int dbmd_simd_set(dbmd_simd_level level);
+
+#endif /* DBMD_CHECKSUM_H */
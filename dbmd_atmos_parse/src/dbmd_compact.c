@@ -0,0 +1,525 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dbmd_compact.h"
+
+#define COMPACT_INLINE_MAX      10      /* Objects whose 3-bit modes fit in the modes field */
+#define COMPACT_MAX_TOOLS       0xFFFF
+#define COMPACT_MAX_MODES_LEN   0xFFFFFFFFu
+#define COMPACT_RUN_SHORT_MAX   31      /* Longest run held in the run byte itself */
+
+/* Local function prototypes */
+static uint32_t tool_hash(const char *name, const atmos_dbmd_version *version);
+static int intern_tool(DBMDCompactStore *store, const DolbyAtmosSegment *seg, uint16_t *tool_id);
+static int reserve_modes(DBMDCompactStore *store, size_t len);
+static size_t runs_size(const unsigned char *modes, unsigned int count);
+static void put_runs(unsigned char *out, const unsigned char *modes, unsigned int count);
+static void put_packed(unsigned char *out, const unsigned char *modes, unsigned int count);
+
+/*******************************************************************************************
+void dbmd_compact_init(...)
+-Purpose:
+	Initializes an empty compact store
+-Inputs:
+	DBMDCompactStore *store	-	Store to initialize
+********************************************************************************************/
+void dbmd_compact_init(DBMDCompactStore *store)
+{
+	memset(store, 0, sizeof(DBMDCompactStore));
+}
+
+/*******************************************************************************************
+void dbmd_compact_free(...)
+-Purpose:
+	Releases the memory of a compact store. Records encoded with the store can no
+	longer be decoded.
+-Inputs:
+	DBMDCompactStore *store	-	Store to release
+********************************************************************************************/
+void dbmd_compact_free(DBMDCompactStore *store)
+{
+	free(store->modes);
+	free(store->tools);
+	free(store->slots);
+	dbmd_compact_init(store);
+}
+
+/*******************************************************************************************
+int dbmd_compact_encode(...)
+-Purpose:
+	Encodes parsed metadata into a compact record, interning the creation tool
+	and appending the binaural render modes to the store if they do not fit in
+	the record
+-Inputs:
+	DBMDCompactStore *store		-	Store holding tools and encoded modes
+	const DBMetadata *metadata	-	Metadata as parsed by parse_dbmd_metadata()
+	DBMDCompact *compact		-	Receives the record
+-Returns:
+	int							-	error code
+********************************************************************************************/
+int dbmd_compact_encode(DBMDCompactStore *store, const DBMetadata *metadata, DBMDCompact *compact)
+{
+	const DolbyAtmosSegment *seg = &metadata->DolbyAtmosSeg;
+	const DolbyAtmosSupplementalSegment *sup = &metadata->DolbyAtmosSupSeg;
+	const unsigned char *modes = sup->objects.binaural_render_mode;
+	dbmd_modes_encoding encoding = DBMD_MODES_UNIFORM;
+	uint32_t mode_mask = 0;
+	size_t packed_len, runs_len, modes_len;
+	unsigned int count, i;
+	int has_flags = 0;
+	int error;
+
+	memset(compact, 0, sizeof(DBMDCompact));
+
+	if (seg->segment_exists)
+	{
+		compact->fields |= DBMD_COMPACT_ATMOS | ((uint32_t)(seg->warp_mode & 0x7) << DBMD_COMPACT_WARP_SHIFT);
+		if ( (error = intern_tool(store, seg, &compact->tool_id)) )
+			return error;
+	}
+
+	if (!sup->segment_exists)
+		return DB_ERR_OK;
+
+	compact->fields |= DBMD_COMPACT_SUPPLEMENTAL;
+	for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+	{
+		if (sup->trims[i].auto_trim)
+			compact->fields |= (uint32_t)1 << (DBMD_COMPACT_TRIM_SHIFT + i);
+	}
+
+	count = sup->object_count;
+	compact->object_count = (uint16_t)count;
+
+	/* the histogram tells which modes are in use */
+	for (i = 0; i < NUM_BINAURAL_RENDER_MODES; i++)
+	{
+		if (sup->mode_histogram[i])
+			mode_mask |= (uint32_t)1 << i;
+	}
+	compact->fields |= mode_mask << DBMD_COMPACT_MODES_SHIFT;
+
+	for (i = 0; (i < count) && !has_flags; i++)
+		has_flags = (sup->objects.flags[i] != 0);
+
+	/* choose the smallest encoding of the modes, which must go to the store
+	 * if the object flags do */
+	if ( !has_flags && ((mode_mask & (mode_mask - 1)) == 0) )
+		encoding = DBMD_MODES_UNIFORM;
+	else if ( !has_flags && (count <= COMPACT_INLINE_MAX) )
+	{
+		encoding = DBMD_MODES_INLINE;
+		for (i = 0; i < count; i++)
+			compact->modes |= (uint32_t)(modes[i] & 0x7) << (3 * i);
+	}
+	else
+	{
+		packed_len = (3 * (size_t)count + 7) / 8;
+		runs_len = runs_size(modes, count);
+		modes_len = (runs_len < packed_len) ? runs_len : packed_len;
+		if ( (error = reserve_modes(store, modes_len + (has_flags ? count : 0))) )
+			return error;
+
+		compact->modes = (uint32_t)store->modes_len;
+		if (runs_len < packed_len)
+		{
+			encoding = DBMD_MODES_RUNS;
+			put_runs(store->modes + store->modes_len, modes, count);
+		}
+		else
+		{
+			encoding = DBMD_MODES_PACKED;
+			put_packed(store->modes + store->modes_len, modes, count);
+		}
+		store->modes_len += modes_len;
+
+		if (has_flags)
+		{
+			compact->fields |= DBMD_COMPACT_OBJECT_FLAGS;
+			memcpy(store->modes + store->modes_len, sup->objects.flags, count);
+			store->modes_len += count;
+		}
+	}
+	compact->fields |= (uint32_t)encoding << DBMD_COMPACT_ENCODING_SHIFT;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+int dbmd_compact_decode(...)
+-Purpose:
+	Expands a compact record back into the metadata it was encoded from
+-Inputs:
+	const DBMDCompactStore *store	-	Store the record was encoded with
+	const DBMDCompact *compact		-	Record
+	DBMetadata *metadata			-	Receives the metadata
+-Returns:
+	int								-	error code
+********************************************************************************************/
+int dbmd_compact_decode(const DBMDCompactStore *store, const DBMDCompact *compact, DBMetadata *metadata)
+{
+	DolbyAtmosSegment *seg = &metadata->DolbyAtmosSeg;
+	DolbyAtmosSupplementalSegment *sup = &metadata->DolbyAtmosSupSeg;
+	const DBMDCompactTool *tool;
+	const unsigned char *p = NULL;
+	DBMDObjectTable objects;
+	unsigned int mode_mask = (compact->fields >> DBMD_COMPACT_MODES_SHIFT) & 0xFF;
+	unsigned int count = compact->object_count;
+	unsigned int mode, run, bit, i;
+	int error;
+
+	/* clear the metadata, keeping the object table */
+	objects = sup->objects;
+	memset(metadata, 0, sizeof(DBMetadata));
+	sup->objects = objects;
+
+	if (compact->fields & DBMD_COMPACT_ATMOS)
+	{
+		seg->segment_exists = 1;
+		seg->warp_mode = (atmos_dbmd_warp_mode)dbmd_compact_warp_mode(compact);
+		tool = dbmd_compact_tool(store, compact);
+		if (tool)
+		{
+			memcpy(seg->content_creation_tool, tool->name, sizeof(seg->content_creation_tool));
+			seg->content_creation_tool_version = tool->version;
+		}
+	}
+
+	if ( !(compact->fields & DBMD_COMPACT_SUPPLEMENTAL) )
+		return DB_ERR_OK;
+
+	sup->segment_exists = 1;
+	for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+		sup->trims[i].auto_trim = (dbmd_compact_trim_mask(compact) >> i) & 1;
+
+	if ( (error = dbmd_objects_reserve(&sup->objects, count)) )
+		return error;
+	sup->object_count = count;
+	memset(sup->objects.flags, 0, count);
+
+	switch ((compact->fields >> DBMD_COMPACT_ENCODING_SHIFT) & 0x3)
+	{
+		case DBMD_MODES_UNIFORM:
+			for (mode = 0; (mode < 7) && !(mode_mask & (1u << mode)); mode++)
+				;
+			memset(sup->objects.binaural_render_mode, (int)mode, count);
+			break;
+
+		case DBMD_MODES_INLINE:
+			for (i = 0; i < count; i++)
+				sup->objects.binaural_render_mode[i] = (unsigned char)((compact->modes >> (3 * i)) & 0x7);
+			break;
+
+		case DBMD_MODES_PACKED:
+			p = store->modes + compact->modes;
+			for (i = 0, bit = 0; i < count; i++, bit += 3)
+			{
+				mode = p[bit >> 3] | ((unsigned int)p[(bit >> 3) + 1] << 8);
+				sup->objects.binaural_render_mode[i] = (unsigned char)((mode >> (bit & 7)) & 0x7);
+			}
+			p += (3 * (size_t)count + 7) / 8;
+			break;
+
+		case DBMD_MODES_RUNS:
+			p = store->modes + compact->modes;
+			for (i = 0; i < count; i += run)
+			{
+				mode = *p & 0x7;
+				run = (*p++ >> 3) + 1;
+				if (run == COMPACT_RUN_SHORT_MAX + 1)
+				{
+					run = (p[0] | ((unsigned int)p[1] << 8)) + 1;
+					p += 2;
+				}
+				if (run > count - i)
+					run = count - i;
+				memset(sup->objects.binaural_render_mode + i, (int)mode, run);
+			}
+			break;
+	}
+
+	if (compact->fields & DBMD_COMPACT_OBJECT_FLAGS)
+		memcpy(sup->objects.flags, p, count);
+	for (i = 0; i < count; i++)
+		sup->mode_histogram[sup->objects.binaural_render_mode[i]]++;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+const DBMDCompactTool *dbmd_compact_tool(...)
+-Purpose:
+	Looks up the creation tool name and version of a compact record
+-Returns:
+	const DBMDCompactTool *	-	tool, NULL if the record has no Dolby Atmos segment
+********************************************************************************************/
+const DBMDCompactTool *dbmd_compact_tool(const DBMDCompactStore *store, const DBMDCompact *compact)
+{
+	if ( (compact->tool_id == DBMD_COMPACT_NO_TOOL) || (compact->tool_id > store->num_tools) )
+		return NULL;
+
+	return &store->tools[compact->tool_id - 1];
+}
+
+/*******************************************************************************************
+unsigned int dbmd_compact_warp_mode(...)
+-Purpose:
+	Returns the warp mode of a compact record
+********************************************************************************************/
+unsigned int dbmd_compact_warp_mode(const DBMDCompact *compact)
+{
+	return (compact->fields >> DBMD_COMPACT_WARP_SHIFT) & 0x7;
+}
+
+/*******************************************************************************************
+unsigned int dbmd_compact_trim_mask(...)
+-Purpose:
+	Returns the automatic trim mask of a compact record, bit n set if trim
+	config n uses automatic trims
+********************************************************************************************/
+unsigned int dbmd_compact_trim_mask(const DBMDCompact *compact)
+{
+	return (compact->fields >> DBMD_COMPACT_TRIM_SHIFT) & DBMD_COMPACT_ALL_TRIMS_AUTO;
+}
+
+/*******************************************************************************************
+int dbmd_compact_all_identical(...)
+-Purpose:
+	Tests whether all objects have the same binaural render mode. As in
+	display_dbmd_metadata(), a segment without objects does not qualify.
+********************************************************************************************/
+int dbmd_compact_all_identical(const DBMDCompact *compact)
+{
+	return (compact->object_count > 0) &&
+		(((compact->fields >> DBMD_COMPACT_ENCODING_SHIFT) & 0x3) == DBMD_MODES_UNIFORM);
+}
+
+/*******************************************************************************************
+int dbmd_compact_has_mode(...)
+-Purpose:
+	Tests whether any object has the given binaural render mode
+********************************************************************************************/
+int dbmd_compact_has_mode(const DBMDCompact *compact, atmos_dbmd_binaural_render_mode mode)
+{
+	return (compact->fields >> (DBMD_COMPACT_MODES_SHIFT + (mode & 0x7))) & 1;
+}
+
+/*******************************************************************************************
+int dbmd_compact_any_bypass(...)
+-Purpose:
+	Tests whether any object bypasses binauralization
+********************************************************************************************/
+int dbmd_compact_any_bypass(const DBMDCompact *compact)
+{
+	return dbmd_compact_has_mode(compact, ATMOS_DBMD_BINAURAL_RENDER_MODE_BYPASS);
+}
+
+/*******************************************************************************************
+static uint32_t tool_hash(...)
+-Purpose:
+	FNV-1a hash of a tool name and version
+********************************************************************************************/
+static uint32_t tool_hash(const char *name, const atmos_dbmd_version *version)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	hash = (hash ^ (unsigned char)version->major) * 16777619u;
+	hash = (hash ^ (unsigned char)version->minor) * 16777619u;
+	hash = (hash ^ (unsigned char)version->micro) * 16777619u;
+
+	return hash;
+}
+
+/*******************************************************************************************
+static int intern_tool(...)
+-Purpose:
+	Returns the id of the creation tool of a Dolby Atmos segment, adding the
+	tool to the store if it is new. The hash table is kept at most half full.
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int intern_tool(DBMDCompactStore *store, const DolbyAtmosSegment *seg, uint16_t *tool_id)
+{
+	const atmos_dbmd_version *version = &seg->content_creation_tool_version;
+	DBMDCompactTool *tool;
+	uint16_t *slots;
+	size_t num_slots, slot, i;
+
+	/* grow the hash table */
+	if (2 * (store->num_tools + 1) > store->num_slots)
+	{
+		num_slots = store->num_slots ? 2 * store->num_slots : 64;
+		slots = (uint16_t *)calloc(num_slots, sizeof(uint16_t));
+		if (!slots)
+			return DB_ERR_NOMEMORY;
+		for (i = 0; i < store->num_tools; i++)
+		{
+			tool = &store->tools[i];
+			slot = tool_hash(tool->name, &tool->version) & (num_slots - 1);
+			while (slots[slot])
+				slot = (slot + 1) & (num_slots - 1);
+			slots[slot] = (uint16_t)(i + 1);
+		}
+		free(store->slots);
+		store->slots = slots;
+		store->num_slots = num_slots;
+	}
+
+	/* look the tool up */
+	slot = tool_hash(seg->content_creation_tool, version) & (store->num_slots - 1);
+	while (store->slots[slot])
+	{
+		tool = &store->tools[store->slots[slot] - 1];
+		if ( !strcmp(tool->name, seg->content_creation_tool) && (tool->version.major == version->major) &&
+		     (tool->version.minor == version->minor) && (tool->version.micro == version->micro) )
+		{
+			*tool_id = store->slots[slot];
+			return DB_ERR_OK;
+		}
+		slot = (slot + 1) & (store->num_slots - 1);
+	}
+
+	/* add it */
+	if (store->num_tools == COMPACT_MAX_TOOLS)
+		return DB_ERR_NOMEMORY;
+	if (store->num_tools == store->tools_size)
+	{
+		i = store->tools_size ? 2 * store->tools_size : 16;
+		tool = (DBMDCompactTool *)realloc(store->tools, i * sizeof(DBMDCompactTool));
+		if (!tool)
+			return DB_ERR_NOMEMORY;
+		store->tools = tool;
+		store->tools_size = i;
+	}
+	tool = &store->tools[store->num_tools++];
+	memcpy(tool->name, seg->content_creation_tool, sizeof(tool->name));
+	tool->name[ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN] = 0;
+	tool->version = *version;
+	store->slots[slot] = (uint16_t)store->num_tools;
+	*tool_id = (uint16_t)store->num_tools;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int reserve_modes(...)
+-Purpose:
+	Makes room for len more bytes of encoded modes, plus one byte so that the
+	packed decoder may always read two bytes
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int reserve_modes(DBMDCompactStore *store, size_t len)
+{
+	unsigned char *modes;
+	size_t size;
+
+	if (store->modes_len + len + 1 > COMPACT_MAX_MODES_LEN)
+		return DB_ERR_NOMEMORY;
+	if (store->modes_len + len + 1 <= store->modes_size)
+		return DB_ERR_OK;
+
+	size = store->modes_size ? store->modes_size : 4096;
+	while (size < store->modes_len + len + 1)
+		size *= 2;
+	modes = (unsigned char *)realloc(store->modes, size);
+	if (!modes)
+		return DB_ERR_NOMEMORY;
+	memset(modes + store->modes_size, 0, size - store->modes_size);
+	store->modes = modes;
+	store->modes_size = size;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static size_t runs_size(...)
+-Purpose:
+	Returns the size of the run-length encoding of the modes. Each run is a byte
+	holding the mode in the low 3 bits and the run length - 1 in the high 5
+	bits; longer runs store 31 there and the run length - 1 in two more bytes.
+********************************************************************************************/
+static size_t runs_size(const unsigned char *modes, unsigned int count)
+{
+	size_t len = 0;
+	unsigned int i, run;
+
+	for (i = 0; i < count; i += run)
+	{
+		for (run = 1; (i + run < count) && (modes[i + run] == modes[i]); run++)
+			;
+		len += (run > COMPACT_RUN_SHORT_MAX) ? 3 : 1;
+	}
+
+	return len;
+}
+
+/*******************************************************************************************
+static void put_runs(...)
+-Purpose:
+	Writes the run-length encoding of the modes, see runs_size()
+********************************************************************************************/
+static void put_runs(unsigned char *out, const unsigned char *modes, unsigned int count)
+{
+	unsigned int i, run;
+
+	for (i = 0; i < count; i += run)
+	{
+		for (run = 1; (i + run < count) && (modes[i + run] == modes[i]); run++)
+			;
+		if (run > COMPACT_RUN_SHORT_MAX)
+		{
+			*out++ = (unsigned char)((modes[i] & 0x7) | (COMPACT_RUN_SHORT_MAX << 3));
+			*out++ = (unsigned char)(run - 1);
+			*out++ = (unsigned char)((run - 1) >> 8);
+		}
+		else
+			*out++ = (unsigned char)((modes[i] & 0x7) | ((run - 1) << 3));
+	}
+}
+
+/*******************************************************************************************
+static void put_packed(...)
+-Purpose:
+	Writes the modes packed 3 bits per object, least significant bits first
+********************************************************************************************/
+static void put_packed(unsigned char *out, const unsigned char *modes, unsigned int count)
+{
+	unsigned int i, bit;
+
+	memset(out, 0, (3 * (size_t)count + 7) / 8);
+	for (i = 0, bit = 0; i < count; i++, bit += 3)
+	{
+		out[bit >> 3] |= (unsigned char)((modes[i] & 0x7) << (bit & 7));
+		if ((bit & 7) > 5)
+			out[(bit >> 3) + 1] |= (unsigned char)((modes[i] & 0x7) >> (8 - (bit & 7)));
+	}
+}
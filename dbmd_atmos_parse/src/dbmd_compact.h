@@ -0,0 +1,101 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_COMPACT_H
+#define DBMD_COMPACT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dbmd_atmos_parse.h"
+
+/* This defines a compact encoded form of the parsed metadata, for holding the
+ *  results of a large number of files in memory. A DBMDCompact record is 12
+ *  bytes: the segment flags, warp mode, a 9-bit automatic trim mask and a
+ *  mask of the binaural render modes used are packed into one word, and the
+ *  creation tool name and version are interned in a DBMDCompactStore and
+ *  referred to by id. The binaural render modes are not stored at all if all
+ *  objects share one mode, are packed 3 bits per object in the record for up
+ *  to 10 objects, and are otherwise appended to the store, 3-bit packed or
+ *  run-length encoded, whichever is smaller. Object flags are only stored,
+ *  after the modes, if any object has flags set. The summary predicates only
+ *  look at the record. A store is not thread-safe.
+ */
+#define DBMD_COMPACT_ATMOS          0x00000001u /* Dolby Atmos segment present */
+#define DBMD_COMPACT_SUPPLEMENTAL   0x00000002u /* Dolby Atmos Supplemental segment present */
+#define DBMD_COMPACT_WARP_SHIFT     2           /* 3-bit warp mode */
+#define DBMD_COMPACT_TRIM_SHIFT     5           /* 9-bit mask, bit n set if trim config n is automatic */
+#define DBMD_COMPACT_MODES_SHIFT    14          /* 8-bit mask, bit n set if any object has binaural render mode n */
+#define DBMD_COMPACT_ENCODING_SHIFT 22          /* 2-bit binaural render mode encoding */
+#define DBMD_COMPACT_OBJECT_FLAGS   0x01000000u /* Object flags follow the modes in the store */
+
+#define DBMD_COMPACT_ALL_TRIMS_AUTO 0x1FF
+#define DBMD_COMPACT_NO_TOOL        0           /* tool_id of a record without Dolby Atmos segment */
+
+typedef enum
+{
+	DBMD_MODES_UNIFORM = 0, /* All objects use the one mode in the mode mask, nothing stored */
+	DBMD_MODES_INLINE = 1,  /* 3 bits per object in the modes field */
+	DBMD_MODES_PACKED = 2,  /* 3 bits per object at the modes offset of the store */
+	DBMD_MODES_RUNS = 3     /* Runs of identical modes at the modes offset of the store */
+} dbmd_modes_encoding;
+
+typedef struct
+{
+	uint32_t fields;        /* Flags, warp mode, trim and mode masks and mode encoding */
+	uint16_t tool_id;       /* Interned creation tool, DBMD_COMPACT_NO_TOOL if none */
+	uint16_t object_count;
+	uint32_t modes;         /* Inline modes, or the offset of the encoded modes in the store */
+} DBMDCompact;
+
+typedef struct
+{
+	char name[ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN + 1];
+	atmos_dbmd_version version;
+} DBMDCompactTool;
+
+typedef struct
+{
+	unsigned char *modes;     /* Encoded binaural render modes of the records */
+	size_t modes_len;         /* Number of bytes used */
+	size_t modes_size;        /* Number of bytes allocated */
+	DBMDCompactTool *tools;   /* Interned tools, tool id n is tools[n - 1] */
+	size_t num_tools;
+	size_t tools_size;        /* Number of tools allocated */
+	uint16_t *slots;          /* Hash table of tool ids, 0 for a free slot */
+	size_t num_slots;         /* Size of the hash table, a power of two */
+} DBMDCompactStore;
+
+void dbmd_compact_init(DBMDCompactStore *store);
+void dbmd_compact_free(DBMDCompactStore *store);
+int dbmd_compact_encode(DBMDCompactStore *store, const DBMetadata *metadata, DBMDCompact *compact);
+int dbmd_compact_decode(const DBMDCompactStore *store, const DBMDCompact *compact, DBMetadata *metadata);
+const DBMDCompactTool *dbmd_compact_tool(const DBMDCompactStore *store, const DBMDCompact *compact);
+
+unsigned int dbmd_compact_warp_mode(const DBMDCompact *compact);
+unsigned int dbmd_compact_trim_mask(const DBMDCompact *compact);
+int dbmd_compact_all_identical(const DBMDCompact *compact);
+int dbmd_compact_has_mode(const DBMDCompact *compact, atmos_dbmd_binaural_render_mode mode);
+int dbmd_compact_any_bypass(const DBMDCompact *compact);
+
+#endif /* DBMD_COMPACT_H */
@@ -0,0 +1,717 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "dbmd_atmos_parse.h"
+
+/* Generator of synthetic ADM WAV files for scale testing. The audio payload
+ *  is left as a sparse hole, so files with data chunks of any size take only
+ *  a few kilobytes of disk space. The chunk order, the RIFF, RF64 or BW64
+ *  form, the number of objects and the trim and binaural render mode patterns
+ *  of the dbmd chunk are configurable, and all segment checksums are valid.
+ */
+#define GEN_DBMD_VERSION        0x01000006
+#define GEN_DASMS_SYNC          0xf8726fbd
+#define GEN_ATMOS_SEG_SZ        248
+#define GEN_TRIM_CONFIG_SZ      15
+#define GEN_MAX_SEG_SZ          0xFFFF
+#define GEN_CHNA_ENTRY_SZ       40
+#define GEN_RF64_INDICATION     0xFFFFFFFFu
+#define GEN_BINAURAL_CYCLE      -1   /* Objects cycle through bypass, near, far and mid */
+#define GEN_MAX_CHUNKS          8
+
+typedef struct
+{
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+} GenBuffer;
+
+typedef struct
+{
+	const char *form;                   /* "RIFF", "RF64" or "BW64" */
+	uint64_t data_size;                 /* Size of the sparse data chunk */
+	const char *order;                  /* Comma separated chunk order */
+	unsigned int num_channels;
+	unsigned int object_count;
+	int binaural_render_mode;           /* Mode of all objects, or GEN_BINAURAL_CYCLE */
+	char trims[NUM_TRIM_CONFIGS + 1];   /* 'a' (automatic) or 'm' (manual) per trim config */
+	unsigned int warp_mode;
+	const char *tool;
+	unsigned int tool_version[3];
+	unsigned int unknown_segments;      /* Segments of other types before the Atmos segments */
+	unsigned int unknown_size;          /* Payload size of each of them */
+	uint64_t axml_size;                 /* Minimum size of the axml chunk, padded with spaces */
+} GenConfig;
+
+/* Local function prototypes */
+static void usage(void);
+static int parse_size(const char *text, uint64_t *size);
+static int parse_binaural(const char *text, int *mode);
+static int parse_trims(const char *text, char *trims);
+static void put8(GenBuffer *b, unsigned int value);
+static void put16(GenBuffer *b, unsigned int value);
+static void put32(GenBuffer *b, uint32_t value);
+static void put64(GenBuffer *b, uint64_t value);
+static void put_bytes(GenBuffer *b, const void *data, size_t len);
+static void put_text(GenBuffer *b, const char *format, ...);
+static void put_segment(GenBuffer *b, unsigned int id, const GenBuffer *payload);
+static void build_fmt(GenBuffer *b, const GenConfig *cfg);
+static void build_axml(GenBuffer *b, const GenConfig *cfg);
+static void build_chna(GenBuffer *b, const GenConfig *cfg);
+static int build_dbmd(GenBuffer *b, const GenConfig *cfg);
+static int write_at(int fd, const void *buf, size_t len, uint64_t offset);
+static int generate(const char *path, const GenConfig *cfg);
+
+int main(int argc, char **argv)
+{
+	GenConfig cfg;
+	const char *output = NULL;
+	uint64_t value;
+	int error = 0;
+	int i;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.form = "RIFF";
+	cfg.data_size = 1440000;
+	cfg.order = "fmt,data,axml,chna,dbmd";
+	cfg.num_channels = 2;
+	cfg.object_count = 2;
+	cfg.binaural_render_mode = ATMOS_DBMD_BINAURAL_RENDER_MODE_NOT_INDICATED;
+	strcpy(cfg.trims, "aaaaaaaaa");
+	cfg.warp_mode = ATMOS_DBMD_WARP_MODE_NOT_INDICATED;
+	cfg.tool = "dbmd_gen";
+	cfg.tool_version[0] = 1;
+	cfg.unknown_size = 96;
+
+	for (i = 1; !error && (i < argc); i++)
+	{
+		if (!strncmp(argv[i], "--form=", 7))
+		{
+			cfg.form = argv[i] + 7;
+			error = strcmp(cfg.form, "RIFF") && strcmp(cfg.form, "RF64") && strcmp(cfg.form, "BW64");
+		}
+		else if (!strncmp(argv[i], "--data-size=", 12))
+			error = parse_size(argv[i] + 12, &cfg.data_size);
+		else if (!strncmp(argv[i], "--order=", 8))
+			cfg.order = argv[i] + 8;
+		else if (!strncmp(argv[i], "--channels=", 11))
+		{
+			error = parse_size(argv[i] + 11, &value) || (value == 0) || (value > 0xFFFF);
+			cfg.num_channels = (unsigned int)value;
+		}
+		else if (!strncmp(argv[i], "--objects=", 10))
+		{
+			error = parse_size(argv[i] + 10, &value) || (value > 0xFFFF);
+			cfg.object_count = (unsigned int)value;
+		}
+		else if (!strncmp(argv[i], "--binaural=", 11))
+			error = parse_binaural(argv[i] + 11, &cfg.binaural_render_mode);
+		else if (!strncmp(argv[i], "--trims=", 8))
+			error = parse_trims(argv[i] + 8, cfg.trims);
+		else if (!strncmp(argv[i], "--warp=", 7))
+		{
+			error = parse_size(argv[i] + 7, &value) || (value > 7);
+			cfg.warp_mode = (unsigned int)value;
+		}
+		else if (!strncmp(argv[i], "--tool=", 7))
+			cfg.tool = argv[i] + 7;
+		else if (!strncmp(argv[i], "--tool-version=", 15))
+			error = (sscanf(argv[i] + 15, "%u.%u.%u", &cfg.tool_version[0], &cfg.tool_version[1], &cfg.tool_version[2]) != 3);
+		else if (!strncmp(argv[i], "--unknown-segments=", 19))
+		{
+			error = parse_size(argv[i] + 19, &value) || (value > 0xFFFF);
+			cfg.unknown_segments = (unsigned int)value;
+		}
+		else if (!strncmp(argv[i], "--unknown-size=", 15))
+		{
+			error = parse_size(argv[i] + 15, &value) || (value > GEN_MAX_SEG_SZ);
+			cfg.unknown_size = (unsigned int)value;
+		}
+		else if (!strncmp(argv[i], "--axml-size=", 12))
+			error = parse_size(argv[i] + 12, &cfg.axml_size);
+		else if ( (argv[i][0] != '-') && !output )
+			output = argv[i];
+		else
+			error = 1;
+
+		if (error)
+			printf("Error, invalid argument %s\n", argv[i]);
+	}
+
+	if (error || !output)
+	{
+		usage();
+		return 1;
+	}
+
+	return generate(output, &cfg) ? 1 : 0;
+}
+
+/*******************************************************************************************
+static void usage(...)
+-Purpose:
+	Prints the command line usage
+********************************************************************************************/
+static void usage(void)
+{
+	puts("\nUsage: dbmd_gen [options] <output ADM WAV file>\n");
+	puts("Options:");
+	puts("   --form=RIFF|RF64|BW64       File form, RF64 and BW64 carry a ds64 chunk (default: RIFF)");
+	puts("   --data-size=<n>[K|M|G|T]    Size of the sparse audio data chunk (default: 1440000)");
+	puts("   --order=<chunk,...>         Chunk order from fmt, data, axml, chna and dbmd; chunks");
+	puts("                               left out are not written (default: fmt,data,axml,chna,dbmd)");
+	puts("   --channels=<n>              Number of audio channels (default: 2)");
+	puts("   --objects=<n>               object_count of the supplemental segment (default: 2)");
+	puts("   --binaural=<mode>           bypass, near, far, mid, not-indicated or cycle (default: not-indicated)");
+	puts("   --trims=<pattern>           auto, manual, alternate, or one a/m per trim config, e.g. amaaaaaaa");
+	puts("   --warp=<n>                  warp_mode, 0 to 7 (default: 4, not indicated)");
+	puts("   --tool=<name>               Content creation tool (default: dbmd_gen)");
+	puts("   --tool-version=<x.y.z>      Content creation tool version (default: 1.0.0)");
+	puts("   --unknown-segments=<n>      Segments of other types before the Atmos segments (default: 0)");
+	puts("   --unknown-size=<n>          Payload size of each of these segments (default: 96)");
+	puts("   --axml-size=<n>[K|M|G]      Pad the ADM XML with spaces to at least this size");
+	puts("");
+}
+
+/*******************************************************************************************
+static int parse_size(...)
+-Purpose:
+	Parses a decimal number with an optional K, M, G or T (binary) suffix
+-Returns:
+	int				-	0 on success
+********************************************************************************************/
+static int parse_size(const char *text, uint64_t *size)
+{
+	char *end;
+	unsigned long long value = strtoull(text, &end, 10);
+	int shift = 0;
+
+	if (end == text)
+		return -1;
+	switch (*end)
+	{
+		case 'K': shift = 10; end++; break;
+		case 'M': shift = 20; end++; break;
+		case 'G': shift = 30; end++; break;
+		case 'T': shift = 40; end++; break;
+		default: break;
+	}
+	if ( *end || (value > (UINT64_MAX >> shift)) )
+		return -1;
+
+	*size = (uint64_t)value << shift;
+	return 0;
+}
+
+/*******************************************************************************************
+static int parse_binaural(...)
+-Purpose:
+	Parses a binaural render mode pattern
+-Returns:
+	int				-	0 on success
+********************************************************************************************/
+static int parse_binaural(const char *text, int *mode)
+{
+	static const char *names[5] = { "bypass", "near", "far", "mid", "not-indicated" };
+	int i;
+
+	if (!strcmp(text, "cycle"))
+	{
+		*mode = GEN_BINAURAL_CYCLE;
+		return 0;
+	}
+	for (i = 0; i < 5; i++)
+	{
+		if (!strcmp(text, names[i]))
+		{
+			*mode = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*******************************************************************************************
+static int parse_trims(...)
+-Purpose:
+	Parses a trim pattern into one 'a' or 'm' per trim config
+-Returns:
+	int				-	0 on success
+********************************************************************************************/
+static int parse_trims(const char *text, char *trims)
+{
+	int i;
+
+	if (!strcmp(text, "auto"))
+		text = "aaaaaaaaa";
+	else if (!strcmp(text, "manual"))
+		text = "mmmmmmmmm";
+	else if (!strcmp(text, "alternate"))
+		text = "amamamama";
+
+	if (strlen(text) != NUM_TRIM_CONFIGS)
+		return -1;
+	for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+	{
+		if ( (text[i] != 'a') && (text[i] != 'm') )
+			return -1;
+	}
+
+	strcpy(trims, text);
+	return 0;
+}
+
+/*******************************************************************************************
+static void put_bytes(...)
+-Purpose:
+	Appends bytes to a buffer, growing it as needed
+********************************************************************************************/
+static void put_bytes(GenBuffer *b, const void *data, size_t len)
+{
+	if (b->len + len > b->size)
+	{
+		size_t size = b->size ? b->size : 4096;
+
+		while (size < b->len + len)
+			size *= 2;
+		b->buf = (unsigned char *)realloc(b->buf, size);
+		if (!b->buf)
+		{
+			puts("Error, out of memory");
+			exit(1);
+		}
+		b->size = size;
+	}
+	if (data)
+		memcpy(b->buf + b->len, data, len);
+	else
+		memset(b->buf + b->len, 0, len);
+	b->len += len;
+}
+
+/*******************************************************************************************
+static void put8(...)
+-Purpose:
+	Appends a byte
+********************************************************************************************/
+static void put8(GenBuffer *b, unsigned int value)
+{
+	unsigned char byte = (unsigned char)value;
+
+	put_bytes(b, &byte, 1);
+}
+
+/*******************************************************************************************
+static void put16(...)
+-Purpose:
+	Appends a 16-bit little-endian integer
+********************************************************************************************/
+static void put16(GenBuffer *b, unsigned int value)
+{
+	put8(b, value);
+	put8(b, value >> 8);
+}
+
+/*******************************************************************************************
+static void put32(...)
+-Purpose:
+	Appends a 32-bit little-endian integer
+********************************************************************************************/
+static void put32(GenBuffer *b, uint32_t value)
+{
+	put16(b, value & 0xFFFF);
+	put16(b, value >> 16);
+}
+
+/*******************************************************************************************
+static void put64(...)
+-Purpose:
+	Appends a 64-bit little-endian integer
+********************************************************************************************/
+static void put64(GenBuffer *b, uint64_t value)
+{
+	put32(b, (uint32_t)value);
+	put32(b, (uint32_t)(value >> 32));
+}
+
+/*******************************************************************************************
+static void put_text(...)
+-Purpose:
+	Appends formatted text, without the terminating null
+********************************************************************************************/
+static void put_text(GenBuffer *b, const char *format, ...)
+{
+	char text[512];
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	put_bytes(b, text, (len < (int)sizeof(text)) ? (size_t)len : sizeof(text) - 1);
+}
+
+/*******************************************************************************************
+static void put_segment(...)
+-Purpose:
+	Appends a metadata segment: ID, size, payload and the checksum that
+	calc_checksum() expects, the two's complement of the size plus the sum of
+	the payload bytes
+********************************************************************************************/
+static void put_segment(GenBuffer *b, unsigned int id, const GenBuffer *payload)
+{
+	unsigned int sum = (unsigned int)payload->len;
+	size_t i;
+
+	for (i = 0; i < payload->len; i++)
+		sum += payload->buf[i];
+
+	put8(b, id);
+	put16(b, (unsigned int)payload->len);
+	put_bytes(b, payload->buf, payload->len);
+	put8(b, (~sum + 1) & 0xFF);
+}
+
+/*******************************************************************************************
+static void build_fmt(...)
+-Purpose:
+	Builds a 48 kHz, 24-bit PCM format chunk
+********************************************************************************************/
+static void build_fmt(GenBuffer *b, const GenConfig *cfg)
+{
+	put16(b, 1);                                /* PCM */
+	put16(b, cfg->num_channels);
+	put32(b, 48000);                            /* sample rate */
+	put32(b, 48000 * 3 * cfg->num_channels);    /* byte rate */
+	put16(b, 3 * cfg->num_channels);            /* block align */
+	put16(b, 24);                               /* bits per sample */
+}
+
+/*******************************************************************************************
+static void build_axml(...)
+-Purpose:
+	Builds an ADM XML document with one audio object per channel
+********************************************************************************************/
+static void build_axml(GenBuffer *b, const GenConfig *cfg)
+{
+	unsigned int ch;
+
+	put_text(b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	put_text(b, "<ebuCoreMain xmlns=\"urn:ebu:metadata-schema:ebuCore_2014\" version=\"1.0\">\n");
+	put_text(b, "<coreMetadata><format><audioFormatExtended>\n");
+	put_text(b, "<audioProgramme audioProgrammeID=\"APR_1001\" audioProgrammeName=\"dbmd_gen\">"
+		"<audioContentIDRef>ACO_1001</audioContentIDRef></audioProgramme>\n");
+	put_text(b, "<audioContent audioContentID=\"ACO_1001\" audioContentName=\"dbmd_gen\">\n");
+	for (ch = 0; ch < cfg->num_channels; ch++)
+		put_text(b, "<audioObjectIDRef>AO_%04x</audioObjectIDRef>\n", 0x1001 + ch);
+	put_text(b, "</audioContent>\n");
+	for (ch = 0; ch < cfg->num_channels; ch++)
+	{
+		put_text(b, "<audioObject audioObjectID=\"AO_%04x\" audioObjectName=\"Object %u\">"
+			"<audioPackFormatIDRef>AP_0003%04x</audioPackFormatIDRef>"
+			"<audioTrackUIDRef>ATU_%08x</audioTrackUIDRef></audioObject>\n",
+			0x1001 + ch, ch + 1, 0x1001 + ch, ch + 1);
+	}
+	for (ch = 0; ch < cfg->num_channels; ch++)
+		put_text(b, "<audioTrackUID UID=\"ATU_%08x\" sampleRate=\"48000\" bitDepth=\"24\"/>\n", ch + 1);
+	put_text(b, "</audioFormatExtended></format></coreMetadata>\n");
+	put_text(b, "</ebuCoreMain>\n");
+
+	while ((uint64_t)b->len < cfg->axml_size)
+		put8(b, ' ');
+}
+
+/*******************************************************************************************
+static void build_chna(...)
+-Purpose:
+	Builds a channel allocation chunk mapping each track to its audio object
+********************************************************************************************/
+static void build_chna(GenBuffer *b, const GenConfig *cfg)
+{
+	char ref[16];
+	unsigned int ch;
+
+	put16(b, cfg->num_channels);    /* numTracks */
+	put16(b, cfg->num_channels);    /* numUIDs */
+	for (ch = 0; ch < cfg->num_channels; ch++)
+	{
+		put16(b, ch + 1);           /* trackIndex */
+		snprintf(ref, sizeof(ref), "ATU_%08x", ch + 1);
+		put_bytes(b, ref, 12);      /* UID */
+		snprintf(ref, sizeof(ref), "AT_%08x_01", 0x10000000 + ch + 1);
+		put_bytes(b, ref, 14);      /* trackRef */
+		snprintf(ref, sizeof(ref), "AP_0003%04x", 0x1001 + ch);
+		put_bytes(b, ref, 11);      /* packRef */
+		put8(b, 0);                 /* pad */
+	}
+}
+
+/*******************************************************************************************
+static int build_dbmd(...)
+-Purpose:
+	Builds the Dolby Audio Metadata chunk: the unknown segments, the Dolby Atmos
+	segment and the Dolby Atmos Supplemental segment, followed by the end marker
+-Returns:
+	int				-	0 on success, -1 if the supplemental segment does not
+						fit the 16-bit segment size
+********************************************************************************************/
+static int build_dbmd(GenBuffer *b, const GenConfig *cfg)
+{
+	GenBuffer payload;
+	unsigned char tool[ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN];
+	unsigned int mode, cfg_index, obj, i;
+	size_t sup_size = 4 + 2 + 1 + NUM_TRIM_CONFIGS * GEN_TRIM_CONFIG_SZ + 2 * (size_t)cfg->object_count;
+
+	if (sup_size > GEN_MAX_SEG_SZ)
+	{
+		printf("Error, %u objects do not fit in a metadata segment (at most %u)\n", cfg->object_count,
+			(unsigned int)(GEN_MAX_SEG_SZ - (sup_size - 2 * (size_t)cfg->object_count)) / 2);
+		return -1;
+	}
+
+	memset(&payload, 0, sizeof(payload));
+	put32(b, GEN_DBMD_VERSION);
+
+	/* segments of types the parser skips */
+	for (i = 0; i < cfg->unknown_segments; i++)
+	{
+		payload.len = 0;
+		put_bytes(&payload, NULL, cfg->unknown_size);
+		put_segment(b, 1 + (i % (DOLBYATMOS_METD_SEG - 1)), &payload);
+	}
+
+	/* Dolby Atmos segment */
+	payload.len = 0;
+	put_bytes(&payload, NULL, 32);
+	memset(tool, 0, sizeof(tool));
+	memcpy(tool, cfg->tool, strlen(cfg->tool) < sizeof(tool) ? strlen(cfg->tool) : sizeof(tool));
+	put_bytes(&payload, tool, sizeof(tool));
+	put8(&payload, cfg->tool_version[0]);
+	put8(&payload, cfg->tool_version[1]);
+	put8(&payload, cfg->tool_version[2]);
+	put_bytes(&payload, NULL, 53);
+	put8(&payload, cfg->warp_mode);
+	put_bytes(&payload, NULL, GEN_ATMOS_SEG_SZ - payload.len);
+	put_segment(b, DOLBYATMOS_METD_SEG, &payload);
+
+	/* Dolby Atmos Supplemental segment */
+	payload.len = 0;
+	put32(&payload, GEN_DASMS_SYNC);
+	put16(&payload, cfg->object_count);
+	put8(&payload, 0);
+	for (cfg_index = 0; cfg_index < NUM_TRIM_CONFIGS; cfg_index++)
+	{
+		put8(&payload, (cfg->trims[cfg_index] == 'a') ? 1 : 0);
+		put_bytes(&payload, NULL, GEN_TRIM_CONFIG_SZ - 1);
+	}
+	put_bytes(&payload, NULL, cfg->object_count);
+	for (obj = 0; obj < cfg->object_count; obj++)
+	{
+		mode = (cfg->binaural_render_mode == GEN_BINAURAL_CYCLE) ? (obj % 4) : (unsigned int)cfg->binaural_render_mode;
+		put8(&payload, mode);
+	}
+	put_segment(b, DOLBYATMOS_SUP_METD_SEG, &payload);
+
+	/* end marker */
+	put8(b, 0);
+	free(payload.buf);
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int write_at(...)
+-Purpose:
+	Writes a buffer at an offset of a file
+-Returns:
+	int				-	0 on success
+********************************************************************************************/
+static int write_at(int fd, const void *buf, size_t len, uint64_t offset)
+{
+	if (lseek(fd, (off_t)offset, SEEK_SET) < 0)
+		return -1;
+	return (write(fd, buf, len) == (ssize_t)len) ? 0 : -1;
+}
+
+/*******************************************************************************************
+static int generate(...)
+-Purpose:
+	Writes the ADM WAV file. The chunks are written in the configured order,
+	the data chunk payload is skipped over so that it stays a hole, and the
+	RIFF header (and ds64 chunk) are written last once all sizes are known.
+-Inputs:
+	const char *path		-	File to create
+	const GenConfig *cfg	-	File layout
+-Returns:
+	int					-	0 on success
+********************************************************************************************/
+static int generate(const char *path, const GenConfig *cfg)
+{
+	GenBuffer header, chunk;
+	const char *name;
+	char order[256];
+	char *token, *next;
+	unsigned int block_align = 3 * cfg->num_channels;
+	uint64_t data_size = cfg->data_size - (cfg->data_size % block_align);
+	uint64_t pos, riff_size;
+	int is_64 = strcmp(cfg->form, "RIFF") != 0;
+	int write_error = 0;
+	int error = 0;
+	int fd;
+
+	memset(&header, 0, sizeof(header));
+	memset(&chunk, 0, sizeof(chunk));
+
+	if (strlen(cfg->order) >= sizeof(order))
+	{
+		printf("Error, chunk order too long\n");
+		return -1;
+	}
+	strcpy(order, cfg->order);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		printf("Error, could not create %s\n", path);
+		return -1;
+	}
+
+	/* leave room for the RIFF header and the ds64 chunk */
+	pos = 12 + (is_64 ? 8 + 28 : 0);
+	for (token = order; !error && !write_error && token; token = next)
+	{
+		next = strchr(token, ',');
+		if (next)
+			*next++ = 0;
+
+		chunk.len = 0;
+		if (!strcmp(token, "data"))
+		{
+			put_bytes(&chunk, "data", 4);
+			put32(&chunk, is_64 ? GEN_RF64_INDICATION : (uint32_t)data_size);
+			write_error |= write_at(fd, chunk.buf, chunk.len, pos);
+			pos += 8 + data_size + (data_size & 1);
+			continue;
+		}
+
+		if (!strcmp(token, "fmt"))
+		{
+			name = "fmt ";
+			put_bytes(&chunk, NULL, 8);
+			build_fmt(&chunk, cfg);
+		}
+		else if (!strcmp(token, "axml"))
+		{
+			name = "axml";
+			put_bytes(&chunk, NULL, 8);
+			build_axml(&chunk, cfg);
+		}
+		else if (!strcmp(token, "chna"))
+		{
+			name = "chna";
+			put_bytes(&chunk, NULL, 8);
+			build_chna(&chunk, cfg);
+		}
+		else if (!strcmp(token, "dbmd"))
+		{
+			name = "dbmd";
+			put_bytes(&chunk, NULL, 8);
+			if ( (error = build_dbmd(&chunk, cfg)) )
+				break;
+		}
+		else
+		{
+			printf("Error, unknown chunk %s in chunk order\n", token);
+			error = -1;
+			break;
+		}
+
+		/* fill in the chunk header and pad to an even size */
+		memcpy(chunk.buf, name, 4);
+		chunk.buf[4] = (unsigned char)(chunk.len - 8);
+		chunk.buf[5] = (unsigned char)((chunk.len - 8) >> 8);
+		chunk.buf[6] = (unsigned char)((chunk.len - 8) >> 16);
+		chunk.buf[7] = (unsigned char)((chunk.len - 8) >> 24);
+		if (chunk.len & 1)
+			put8(&chunk, 0);
+		write_error |= write_at(fd, chunk.buf, chunk.len, pos);
+		pos += chunk.len;
+	}
+	riff_size = pos - 8;
+
+	if ( !error && !is_64 && (riff_size > 0xFFFFFFFFu) )
+	{
+		printf("Error, file too large for RIFF, use --form=RF64 or --form=BW64\n");
+		error = -1;
+	}
+
+	/* RIFF header and ds64 chunk */
+	if ( !error && !write_error )
+	{
+		put_bytes(&header, cfg->form, 4);
+		put32(&header, is_64 ? GEN_RF64_INDICATION : (uint32_t)riff_size);
+		put_bytes(&header, "WAVE", 4);
+		if (is_64)
+		{
+			put_bytes(&header, "ds64", 4);
+			put32(&header, 28);
+			put64(&header, riff_size);                  /* riffSize */
+			put64(&header, data_size);                  /* dataSize */
+			put64(&header, data_size / block_align);    /* sampleCount */
+			put32(&header, 0);                          /* tableLength */
+		}
+		write_error |= write_at(fd, header.buf, header.len, 0);
+	}
+
+	/* extend the file over a trailing hole */
+	if ( !error && !write_error && ftruncate(fd, (off_t)pos) )
+		write_error = -1;
+
+	if (close(fd))
+		write_error = -1;
+	if ( write_error && !error )
+	{
+		printf("Error, could not write %s\n", path);
+		error = -1;
+	}
+	if (error)
+		unlink(path);
+	free(header.buf);
+	free(chunk.buf);
+
+	return error;
+}
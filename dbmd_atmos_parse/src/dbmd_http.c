@@ -0,0 +1,582 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#include "dbmd_atmos_parse.h"
+#include "dbmd_source.h"
+
+/* HTTP/1.1 byte-range source. Each read is a GET request with a Range header,
+ *  sent over a persistent connection that is re-established when the server
+ *  closes it. Only plain http:// URLs are supported. */
+#define HTTP_URL_PREFIX "http://"
+#define HTTP_MAX_HOST 256
+#define HTTP_RECV_BUFFER 16384 /* Also the limit on the size of the response headers */
+#define HTTP_TIMEOUT_SEC 30
+
+#ifndef WIN32
+
+typedef struct
+{
+	DBMDSource base;
+	char host[HTTP_MAX_HOST]; /* Host name or address */
+	char port[8];             /* Port number */
+	char *path;               /* Request target */
+	int sock;                 /* Connected socket, -1 if not connected */
+	char buf[HTTP_RECV_BUFFER + 1]; /* Receive buffer */
+	size_t buf_pos;           /* Start of unconsumed bytes in buf */
+	size_t buf_len;           /* End of received bytes in buf */
+	int streaming;            /* Set once the server has ignored a range, the body is read in order */
+	uint64_t body_pos;        /* File offset of the next body byte when streaming */
+	uint64_t body_left;       /* Body bytes not yet received when streaming */
+	uint64_t size;            /* Size of the file, 0 until a response has given it */
+} DBMDHttpSource;
+
+/* Response status and headers */
+typedef struct
+{
+	int status;              /* Status code */
+	int64_t content_length;  /* Content-Length, -1 if absent */
+	int64_t range_start;     /* First byte of Content-Range, -1 if absent */
+	uint64_t complete_length; /* Complete length of Content-Range, 0 if absent or unknown */
+	int keep_alive;          /* Connection can be reused */
+} DBMDHttpResponse;
+
+/* Local function prototypes */
+static int64_t http_read_at(DBMDSource *source, void *buf, size_t len, uint64_t offset);
+static void http_close(DBMDSource *source);
+static uint64_t http_size(DBMDSource *source);
+static int http_connect(DBMDHttpSource *http);
+static void http_disconnect(DBMDHttpSource *http);
+static int http_send_request(DBMDHttpSource *http, uint64_t first, uint64_t last);
+static int http_read_response(DBMDHttpSource *http, DBMDHttpResponse *response);
+static int64_t http_read_body(DBMDHttpSource *http, void *buf, uint64_t len);
+static int64_t http_read_stream(DBMDHttpSource *http, void *buf, size_t len, uint64_t offset);
+static int http_recv(DBMDHttpSource *http);
+
+static const DBMDSourceOps http_source_ops = { http_read_at, NULL, http_close, http_size };
+
+#endif
+
+/*******************************************************************************************
+int dbmd_source_is_url(...)
+-Purpose:
+	Tests whether an input name is an HTTP URL rather than a file name
+********************************************************************************************/
+int dbmd_source_is_url(const char *name)
+{
+	return !strncmp(name, HTTP_URL_PREFIX, strlen(HTTP_URL_PREFIX));
+}
+
+/*******************************************************************************************
+int dbmd_source_open_http(...)
+-Purpose:
+	Creates a source reading byte ranges of a file served over HTTP/1.1 and
+	connects to the server. Nothing is requested until the first read.
+-Inputs:
+	DBMDSource **source	-	Receives the new source
+	const char *url		-	http://host[:port]/path
+-Returns:
+	int					-	error code
+********************************************************************************************/
+int dbmd_source_open_http(DBMDSource **source, const char *url)
+{
+#ifndef WIN32
+	DBMDHttpSource *http;
+	const char *host, *host_end, *port, *path;
+	size_t host_len;
+
+	if (!dbmd_source_is_url(url))
+		return DB_ERR_FILEOPEN;
+
+	/* split http://host[:port]/path, host may be a bracketed IPv6 address */
+	host = url + strlen(HTTP_URL_PREFIX);
+	path = strchr(host, '/');
+	if (!path)
+		path = host + strlen(host);
+
+	if (*host == '[')
+	{
+		host++;
+		host_end = strchr(host, ']');
+		if (!host_end || (host_end > path))
+			return DB_ERR_FILEOPEN;
+		port = (host_end[1] == ':') ? host_end + 2 : NULL;
+	}
+	else
+	{
+		host_end = memchr(host, ':', (size_t)(path - host));
+		port = host_end ? host_end + 1 : NULL;
+		if (!host_end)
+			host_end = path;
+	}
+
+	host_len = (size_t)(host_end - host);
+	if ( (host_len == 0) || (host_len >= HTTP_MAX_HOST) )
+		return DB_ERR_FILEOPEN;
+	if ( port && ((path - port) >= 8 || (path == port)) )
+		return DB_ERR_FILEOPEN;
+
+	http = malloc(sizeof(DBMDHttpSource));
+	if (!http)
+		return DB_ERR_FILEOPEN;
+
+	memset(http, 0, sizeof(DBMDHttpSource));
+	http->base.ops = &http_source_ops;
+	http->base.prefetch = DBMD_HTTP_PREFETCH;
+	http->sock = -1;
+	memcpy(http->host, host, host_len);
+	if (port)
+		memcpy(http->port, port, (size_t)(path - port));
+	else
+		strcpy(http->port, "80");
+
+	http->path = malloc(strlen(path) + 2);
+	if (!http->path)
+	{
+		free(http);
+		return DB_ERR_FILEOPEN;
+	}
+	strcpy(http->path, *path ? path : "/");
+
+	if (http_connect(http))
+	{
+		http_close(&http->base);
+		return DB_ERR_FILEOPEN;
+	}
+
+	*source = &http->base;
+	return DB_ERR_OK;
+#else
+	return DB_ERR_NOTSUPPORTED;
+#endif
+}
+
+#ifndef WIN32
+
+/*******************************************************************************************
+static int64_t http_read_at(...)
+-Purpose:
+	Requests a byte range from the server. A request on a reused connection that
+	the server has meanwhile closed is retried once on a new connection. If the
+	server ignores the range and sends the whole file, the body of that response
+	is read in order like a pipe.
+********************************************************************************************/
+static int64_t http_read_at(DBMDSource *source, void *buf, size_t len, uint64_t offset)
+{
+	DBMDHttpSource *http = (DBMDHttpSource *)source;
+	DBMDHttpResponse response;
+	int64_t n;
+	int reused, attempt;
+
+	if (len == 0)
+		return 0;
+
+	if (http->streaming)
+		return http_read_stream(http, buf, len, offset);
+
+	for (attempt = 0; attempt < 2; attempt++)
+	{
+		reused = (http->sock >= 0);
+		if (!reused && http_connect(http))
+			return DB_ERR_FILEREAD;
+
+		source->read_count++;
+		if ( !http_send_request(http, offset, offset + len - 1) && !http_read_response(http, &response) )
+			break;
+
+		http_disconnect(http);
+		if (!reused)
+			return DB_ERR_FILEREAD;
+	}
+	if (attempt == 2)
+		return DB_ERR_FILEREAD;
+
+	switch (response.status)
+	{
+		case 206: /* Partial Content */
+			if ( (response.range_start != (int64_t)offset) || (response.content_length < 0) )
+			{
+				http_disconnect(http);
+				return DB_ERR_FILEREAD;
+			}
+			if (response.complete_length)
+				http->size = response.complete_length;
+			if ((uint64_t)response.content_length < len)
+				len = (size_t)response.content_length;
+			n = http_read_body(http, buf, len);
+			if ( (n != (int64_t)len) || (http_read_body(http, NULL, (uint64_t)response.content_length - len) < 0) )
+			{
+				http_disconnect(http);
+				return DB_ERR_FILEREAD;
+			}
+			break;
+
+		case 416: /* Range Not Satisfiable, the offset is at or past the end of the file */
+			n = 0;
+			if ( (response.content_length < 0) || (http_read_body(http, NULL, (uint64_t)response.content_length) < 0) )
+				http_disconnect(http);
+			break;
+
+		case 200: /* Server ignored the range, usable only at the start of the file */
+			if ( (offset != 0) || (response.content_length < 0) )
+			{
+				http_disconnect(http);
+				return DB_ERR_NOTSEEKABLE;
+			}
+			http->streaming = 1;
+			http->size = (uint64_t)response.content_length;
+			http->body_pos = 0;
+			http->body_left = (uint64_t)response.content_length;
+			return http_read_stream(http, buf, len, offset);
+
+		default:
+			http_disconnect(http);
+			return ( (response.status == 404) || (response.status == 403) || (response.status == 410) ) ? DB_ERR_FILEOPEN : DB_ERR_FILEREAD;
+	}
+
+	if (!response.keep_alive)
+		http_disconnect(http);
+
+	return n;
+}
+
+/*******************************************************************************************
+static void http_close(...)
+-Purpose:
+	Closes the connection and releases an HTTP source
+********************************************************************************************/
+static void http_close(DBMDSource *source)
+{
+	DBMDHttpSource *http = (DBMDHttpSource *)source;
+
+	http_disconnect(http);
+	free(http->path);
+	free(http);
+}
+
+/*******************************************************************************************
+static uint64_t http_size(...)
+-Purpose:
+	Returns the size of the file as given by the last response, so it is only
+	known once the first range has been read
+********************************************************************************************/
+static uint64_t http_size(DBMDSource *source)
+{
+	return ((DBMDHttpSource *)source)->size;
+}
+
+/*******************************************************************************************
+static int http_connect(...)
+-Purpose:
+	Connects to the server of the source
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int http_connect(DBMDHttpSource *http)
+{
+	struct addrinfo hints, *addrs, *addr;
+	struct timeval timeout;
+	int one = 1;
+	int sock = -1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(http->host, http->port, &hints, &addrs))
+		return -1;
+
+	for (addr = addrs; addr; addr = addr->ai_next)
+	{
+		sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if (sock < 0)
+			continue;
+		if (connect(sock, addr->ai_addr, addr->ai_addrlen) == 0)
+			break;
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(addrs);
+	if (sock < 0)
+		return -1;
+
+	/* requests are small and latency bound */
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	timeout.tv_sec = HTTP_TIMEOUT_SEC;
+	timeout.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	http->sock = sock;
+	http->buf_pos = 0;
+	http->buf_len = 0;
+	return 0;
+}
+
+/*******************************************************************************************
+static void http_disconnect(...)
+-Purpose:
+	Closes the connection to the server, if open
+********************************************************************************************/
+static void http_disconnect(DBMDHttpSource *http)
+{
+	if (http->sock >= 0)
+	{
+		close(http->sock);
+		http->sock = -1;
+	}
+	http->buf_pos = 0;
+	http->buf_len = 0;
+}
+
+/*******************************************************************************************
+static int http_send_request(...)
+-Purpose:
+	Sends a GET request for the bytes first to last, inclusive
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int http_send_request(DBMDHttpSource *http, uint64_t first, uint64_t last)
+{
+	char *request;
+	size_t len, sent = 0;
+	ssize_t n;
+
+	len = strlen(http->path) + strlen(http->host) + 200;
+	request = malloc(len);
+	if (!request)
+		return -1;
+
+	len = (size_t)snprintf(request, len,
+		"GET %s HTTP/1.1\r\n"
+		"Host: %s%s%s\r\n"
+		"Range: bytes=%llu-%llu\r\n"
+		"User-Agent: dbmd_atmos_parse\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n",
+		http->path,
+		http->host, strcmp(http->port, "80") ? ":" : "", strcmp(http->port, "80") ? http->port : "",
+		(unsigned long long)first, (unsigned long long)last);
+
+	while (sent < len)
+	{
+		n = send(http->sock, request + sent, len - sent, MSG_NOSIGNAL);
+		if ( (n < 0) && (errno == EINTR) )
+			continue;
+		if (n <= 0)
+			break;
+		sent += (size_t)n;
+	}
+
+	free(request);
+	return (sent == len) ? 0 : -1;
+}
+
+/*******************************************************************************************
+static int http_read_response(...)
+-Purpose:
+	Receives and parses the status line and headers of a response, leaving any
+	body bytes received with them in the receive buffer
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int http_read_response(DBMDHttpSource *http, DBMDHttpResponse *response)
+{
+	char *headers, *end, *line, *next;
+	unsigned long long range_start;
+	unsigned long long range_end;
+	unsigned long long complete_length;
+	int minor_version = 1;
+
+	/* receive until the end of the headers */
+	while (1)
+	{
+		http->buf[http->buf_len] = 0;
+		end = strstr(http->buf + http->buf_pos, "\r\n\r\n");
+		if (end)
+			break;
+		if (http_recv(http) <= 0)
+			return -1;
+	}
+
+	headers = http->buf + http->buf_pos;
+	*end = 0;
+	http->buf_pos = (size_t)(end + 4 - http->buf);
+
+	if (sscanf(headers, "HTTP/1.%d %d", &minor_version, &response->status) != 2)
+		return -1;
+	response->content_length = -1;
+	response->range_start = -1;
+	response->complete_length = 0;
+	response->keep_alive = (minor_version >= 1);
+
+	/* header names are case insensitive */
+	for (line = strstr(headers, "\r\n"); line; line = next)
+	{
+		line += 2;
+		next = strstr(line, "\r\n");
+		if (next)
+			*next = 0;
+
+		if (!strncasecmp(line, "Content-Length:", 15))
+			response->content_length = strtoll(line + 15, NULL, 10);
+		else if (!strncasecmp(line, "Content-Range:", 14))
+		{
+			if (sscanf(line + 14, " bytes %llu", &range_start) == 1)
+				response->range_start = (int64_t)range_start;
+			if (sscanf(line + 14, " bytes %llu-%llu/%llu", &range_start, &range_end, &complete_length) == 3)
+				response->complete_length = (uint64_t)complete_length;
+		}
+		else if (!strncasecmp(line, "Connection:", 11))
+		{
+			if (strstr(line + 11, "close") || strstr(line + 11, "Close"))
+				response->keep_alive = 0;
+			else if (strstr(line + 11, "keep-alive") || strstr(line + 11, "Keep-Alive"))
+				response->keep_alive = 1;
+		}
+		else if (!strncasecmp(line, "Transfer-Encoding:", 18))
+		{
+			/* only identity bodies with a length are supported */
+			response->content_length = -1;
+			response->keep_alive = 0;
+		}
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int64_t http_read_body(...)
+-Purpose:
+	Receives len bytes of the response body into buf, or discards them if buf is NULL
+-Returns:
+	int64_t			-	number of bytes received, or -1 on failure
+********************************************************************************************/
+static int64_t http_read_body(DBMDHttpSource *http, void *buf, uint64_t len)
+{
+	uint64_t total = 0;
+	size_t chunk;
+
+	while (total < len)
+	{
+		if ( (http->buf_pos == http->buf_len) && (http_recv(http) <= 0) )
+			return -1;
+
+		chunk = http->buf_len - http->buf_pos;
+		if (chunk > len - total)
+			chunk = (size_t)(len - total);
+		if (buf)
+			memcpy((char *)buf + total, http->buf + http->buf_pos, chunk);
+		http->buf_pos += chunk;
+		total += chunk;
+	}
+
+	http->base.bytes_read += total;
+	return (int64_t)total;
+}
+
+/*******************************************************************************************
+static int64_t http_read_stream(...)
+-Purpose:
+	Reads from the body of a response that carries the whole file, discarding the
+	bytes before the offset. Bytes already passed cannot be read again.
+-Returns:
+	int64_t			-	number of bytes read, less than len at end of file, or error code
+********************************************************************************************/
+static int64_t http_read_stream(DBMDHttpSource *http, void *buf, size_t len, uint64_t offset)
+{
+	uint64_t skip;
+	int64_t n;
+
+	if (offset < http->body_pos)
+		return DB_ERR_NOTSEEKABLE;
+
+	http->base.read_count++;
+
+	/* skip forward to the offset */
+	skip = offset - http->body_pos;
+	if (skip > http->body_left)
+		skip = http->body_left;
+	if (http_read_body(http, NULL, skip) < 0)
+		return DB_ERR_FILEREAD;
+	http->body_pos += skip;
+	http->body_left -= skip;
+
+	if (len > http->body_left)
+		len = (size_t)http->body_left;
+	n = http_read_body(http, buf, len);
+	if (n < 0)
+		return DB_ERR_FILEREAD;
+	http->body_pos += (uint64_t)n;
+	http->body_left -= (uint64_t)n;
+
+	return n;
+}
+
+/*******************************************************************************************
+static int http_recv(...)
+-Purpose:
+	Receives more bytes into the receive buffer, compacting it first
+-Returns:
+	int				-	number of bytes received, 0 if the server closed the connection
+					or the buffer is full, -1 on failure
+********************************************************************************************/
+static int http_recv(DBMDHttpSource *http)
+{
+	ssize_t n;
+
+	if (http->buf_pos > 0)
+	{
+		memmove(http->buf, http->buf + http->buf_pos, http->buf_len - http->buf_pos);
+		http->buf_len -= http->buf_pos;
+		http->buf_pos = 0;
+	}
+	if (http->buf_len == HTTP_RECV_BUFFER)
+		return 0;
+
+	do
+	{
+		n = recv(http->sock, http->buf + http->buf_len, HTTP_RECV_BUFFER - http->buf_len, 0);
+	} while ( (n < 0) && (errno == EINTR) );
+
+	if (n > 0)
+		http->buf_len += (size_t)n;
+
+	return (int)n;
+}
+
+#endif
@@ -0,0 +1,176 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#ifndef WIN32
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "dbmd_io.h"
+
+/*******************************************************************************************
+void dbmd_put_le(...)
+-Purpose:
+	Stores a value as num_bytes little-endian bytes
+-Inputs:
+	unsigned char *buf	-	Destination
+	uint64_t value		-	Value
+	int num_bytes		-	Number of bytes, at most 8
+********************************************************************************************/
+void dbmd_put_le(unsigned char *buf, uint64_t value, int num_bytes)
+{
+	int i;
+
+	for (i = 0; i < num_bytes; i++)
+		buf[i] = (unsigned char)(value >> (8 * i));
+}
+
+/*******************************************************************************************
+uint64_t dbmd_get_le(...)
+-Purpose:
+	Loads a value stored as num_bytes little-endian bytes
+-Inputs:
+	const unsigned char *buf	-	Source
+	int num_bytes				-	Number of bytes, at most 8
+-Returns:
+	uint64_t			-	Value
+********************************************************************************************/
+uint64_t dbmd_get_le(const unsigned char *buf, int num_bytes)
+{
+	uint64_t value = 0;
+	int i;
+
+	for (i = num_bytes - 1; i >= 0; i--)
+		value = (value << 8) | buf[i];
+
+	return value;
+}
+
+#ifndef WIN32
+
+/*******************************************************************************************
+int dbmd_read_all(...)
+-Purpose:
+	Reads a buffer at an absolute file offset, retrying short and interrupted reads
+-Inputs:
+	int fd				-	File descriptor
+	unsigned char *buf	-	Destination
+	size_t len			-	Number of bytes
+	uint64_t offset		-	File offset of the first byte
+-Returns:
+	int				-	0 on success, -1 on failure or at the end of the file
+********************************************************************************************/
+int dbmd_read_all(int fd, unsigned char *buf, size_t len, uint64_t offset)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = pread(fd, buf, len, (off_t)offset);
+		if ( (n < 0) && (errno == EINTR) )
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+int dbmd_write_all(...)
+-Purpose:
+	Writes a buffer at an absolute file offset, retrying short and interrupted writes
+-Inputs:
+	int fd					-	File descriptor
+	const unsigned char *buf	-	Source
+	size_t len				-	Number of bytes
+	uint64_t offset			-	File offset of the first byte
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+int dbmd_write_all(int fd, const unsigned char *buf, size_t len, uint64_t offset)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = pwrite(fd, buf, len, (off_t)offset);
+		if ( (n < 0) && (errno == EINTR) )
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+int dbmd_lock_fd(...)
+-Purpose:
+	Waits for a shared (F_RDLCK) or exclusive (F_WRLCK) lock on a whole file, and
+	optionally checks that the file still has its name, as one replaced by a
+	rename while waiting no longer does. The lock is a process's fcntl() lock, so
+	closing any descriptor of the file in the process releases it.
+-Inputs:
+	int fd					-	File descriptor
+	short type				-	F_RDLCK or F_WRLCK
+	const char *path		-	Name of the file, or NULL
+-Returns:
+	int				-	0 if locked, 1 if the name now refers to another file, -1 on failure
+********************************************************************************************/
+int dbmd_lock_fd(int fd, short type, const char *path)
+{
+	struct flock fl;
+	struct stat locked, current;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &fl) != 0)
+	{
+		if (errno != EINTR)
+			return -1;
+	}
+
+	if (!path)
+		return 0;
+	if ( fstat(fd, &locked) || stat(path, &current) )
+		return (errno == ENOENT) ? 1 : -1;
+
+	return ( (locked.st_dev == current.st_dev) && (locked.st_ino == current.st_ino) ) ? 0 : 1;
+}
+
+#endif
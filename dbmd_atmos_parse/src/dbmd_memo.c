@@ -0,0 +1,342 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dbmd_memo.h"
+#include "dbmd_cache.h"
+#include "dbmd_output.h"
+
+#define MEMO_INITIAL_SLOTS 256
+
+/* Local function prototypes */
+static DBMDMemoEntry *memo_find(const DBMDMemo *memo, uint64_t hash, const unsigned char *chunk, size_t size);
+static int memo_insert(DBMDMemo *memo, DBMDMemoEntry *entry);
+static DBMDMemoEntry *memo_entry(uint64_t hash, const unsigned char *chunk, size_t size, int error, const DBMetadata *metadata, const DBMDOutput *text, size_t *entry_size);
+static int memo_restore(const DBMDMemoEntry *entry, DBMDContext *ctx);
+static void memo_lock(DBMDMemo *memo);
+static void memo_unlock(DBMDMemo *memo);
+
+/*******************************************************************************************
+int dbmd_memo_init(...)
+-Purpose:
+	Initializes an empty memo
+-Inputs:
+	DBMDMemo *memo		-	Memo
+	size_t max_bytes	-	Memory limit, 0 for DBMD_MEMO_MAX_BYTES
+	int render			-	Keep the text rendering of each result, for the text format
+-Returns:
+	int					-	0 on success, -1 if out of memory
+********************************************************************************************/
+int dbmd_memo_init(DBMDMemo *memo, size_t max_bytes, int render)
+{
+	memset(memo, 0, sizeof(DBMDMemo));
+	memo->slots = (DBMDMemoEntry **)calloc(MEMO_INITIAL_SLOTS, sizeof(DBMDMemoEntry *));
+	if (!memo->slots)
+		return -1;
+	memo->num_slots = MEMO_INITIAL_SLOTS;
+	memo->max_bytes = max_bytes ? max_bytes : DBMD_MEMO_MAX_BYTES;
+	memo->render = render;
+#ifndef WIN32
+	pthread_mutex_init(&memo->lock, NULL);
+#endif
+
+	return 0;
+}
+
+/*******************************************************************************************
+int dbmd_memo_parse(...)
+-Purpose:
+	Parses the dbmd chunk found by dbmd_scan() as dbmd_parse() does, answering
+	a chunk seen before from the memo. The metadata and error code of a hit are
+	restored to the context; a chunk not seen before is parsed and, while the
+	memo has room, added to it. A chunk left in the input is always parsed.
+-Inputs:
+	DBMDMemo *memo					-	Memo
+	DBMDContext *ctx				-	Parse context
+	const DBMDMemoEntry **entry		-	Receives the memo entry of the chunk, which holds
+										its text rendering, or NULL if it has none
+-Returns:
+	int								-	error code
+********************************************************************************************/
+int dbmd_memo_parse(DBMDMemo *memo, DBMDContext *ctx, const DBMDMemoEntry **entry)
+{
+	const unsigned char *chunk;
+	DBMDMemoEntry *found;
+	DBMDMemoEntry *added;
+	DBMDOutput text;
+	size_t entry_size = 0;
+	uint64_t hash;
+	size_t size;
+	int room;
+	int error;
+
+	*entry = NULL;
+
+	/* a chunk left in the input is not held in memory to be hashed */
+	if ( !(ctx->status & WAV_DBMD_CHUNK_MASK) || !ctx->dbmd_chunk_size || (ctx->dbmd_chunk_size > MAX_DBMD_SIZE) )
+		return dbmd_parse(ctx);
+
+	chunk = (const unsigned char *)(ctx->dbmd_chunk ? ctx->dbmd_chunk : ctx->dolby_metadata);
+	size = (size_t)ctx->dbmd_chunk_size;
+	hash = dbmd_cache_hash(chunk, size);
+
+	memo_lock(memo);
+	memo->num_lookups++;
+	found = memo_find(memo, hash, chunk, size);
+	if (found)
+		memo->num_hits++;
+	room = (memo->num_bytes < memo->max_bytes);
+	memo_unlock(memo);
+
+	if (found)
+	{
+		if (!memo_restore(found, ctx))
+		{
+			*entry = found;
+			return found->error;
+		}
+
+		/* the caller's object table is too small, which the parse reports */
+		return dbmd_parse(ctx);
+	}
+
+	error = dbmd_parse(ctx);
+	if (!room)
+		return error;
+
+	dbmd_output_init(&text);
+	if ( memo->render && (error == DB_ERR_OK) )
+		display_dbmd_metadata(&text, &ctx->metadata);
+	added = memo_entry(hash, chunk, size, error, &ctx->metadata, &text, &entry_size);
+	dbmd_output_free(&text);
+	if (!added)
+		return error;
+
+	/* another thread may have added the same chunk in the meantime */
+	memo_lock(memo);
+	found = memo_find(memo, hash, chunk, size);
+	if ( !found && (memo->num_bytes + entry_size <= memo->max_bytes) && !memo_insert(memo, added) )
+	{
+		memo->num_bytes += entry_size;
+		found = added;
+		added = NULL;
+	}
+	memo_unlock(memo);
+	free(added);
+
+	*entry = found;
+	return error;
+}
+
+/*******************************************************************************************
+void dbmd_memo_free(...)
+-Purpose:
+	Releases a memo and all its entries
+-Inputs:
+	DBMDMemo *memo	-	Memo
+********************************************************************************************/
+void dbmd_memo_free(DBMDMemo *memo)
+{
+	size_t i;
+
+	for (i = 0; i < memo->num_slots; i++)
+		free(memo->slots[i]);
+	free(memo->slots);
+	memo->slots = NULL;
+	memo->num_slots = 0;
+	memo->num_entries = 0;
+	memo->num_bytes = 0;
+#ifndef WIN32
+	pthread_mutex_destroy(&memo->lock);
+#endif
+}
+
+/*******************************************************************************************
+static DBMDMemoEntry *memo_find(...)
+-Purpose:
+	Finds the entry of a chunk, comparing the bytes of entries with the same hash
+********************************************************************************************/
+static DBMDMemoEntry *memo_find(const DBMDMemo *memo, uint64_t hash, const unsigned char *chunk, size_t size)
+{
+	size_t mask = memo->num_slots - 1;
+	size_t i = (size_t)hash & mask;
+	DBMDMemoEntry *entry;
+
+	while ( (entry = memo->slots[i]) )
+	{
+		if ( (entry->hash == hash) && (entry->chunk_size == size) && !memcmp(entry->chunk, chunk, size) )
+			return entry;
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/*******************************************************************************************
+static int memo_insert(...)
+-Purpose:
+	Adds an entry to the hash table, doubling the table once it is half full
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int memo_insert(DBMDMemo *memo, DBMDMemoEntry *entry)
+{
+	DBMDMemoEntry **slots;
+	size_t num_slots;
+	size_t mask;
+	size_t i, j;
+
+	if (2 * (memo->num_entries + 1) > memo->num_slots)
+	{
+		num_slots = memo->num_slots * 2;
+		slots = (DBMDMemoEntry **)calloc(num_slots, sizeof(DBMDMemoEntry *));
+		if (!slots)
+			return -1;
+		for (i = 0; i < memo->num_slots; i++)
+		{
+			if (!memo->slots[i])
+				continue;
+			j = (size_t)memo->slots[i]->hash & (num_slots - 1);
+			while (slots[j])
+				j = (j + 1) & (num_slots - 1);
+			slots[j] = memo->slots[i];
+		}
+		free(memo->slots);
+		memo->slots = slots;
+		memo->num_slots = num_slots;
+	}
+
+	mask = memo->num_slots - 1;
+	i = (size_t)entry->hash & mask;
+	while (memo->slots[i])
+		i = (i + 1) & mask;
+	memo->slots[i] = entry;
+	memo->num_entries++;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static DBMDMemoEntry *memo_entry(...)
+-Purpose:
+	Allocates an entry holding a copy of a chunk, its parsed metadata and their
+	text rendering in a single block
+********************************************************************************************/
+static DBMDMemoEntry *memo_entry(uint64_t hash, const unsigned char *chunk, size_t size, int error, const DBMetadata *metadata, const DBMDOutput *text, size_t *entry_size)
+{
+	const DolbyAtmosSupplementalSegment *sup = &metadata->DolbyAtmosSupSeg;
+	unsigned int object_count = sup->segment_exists ? sup->object_count : 0;
+	DBMDMemoEntry *entry;
+	unsigned char *p;
+
+	*entry_size = sizeof(DBMDMemoEntry) + size + text->len + 2 * (size_t)object_count;
+	entry = (DBMDMemoEntry *)malloc(*entry_size);
+	if (!entry)
+		return NULL;
+	p = (unsigned char *)(entry + 1);
+
+	entry->hash = hash;
+	entry->chunk = p;
+	entry->chunk_size = size;
+	memcpy(p, chunk, size);
+	p += size;
+	entry->error = error;
+
+	entry->metadata = *metadata;
+	entry->metadata.DolbyAtmosSupSeg.object_count = object_count;
+	dbmd_objects_init(&entry->metadata.DolbyAtmosSupSeg.objects, p, p + object_count, object_count);
+	if (object_count)
+	{
+		memcpy(p, sup->objects.flags, object_count);
+		memcpy(p + object_count, sup->objects.binaural_render_mode, object_count);
+	}
+	p += 2 * (size_t)object_count;
+
+	entry->text = text->len ? (const char *)p : NULL;
+	entry->text_len = text->len;
+	if (text->len)
+		memcpy(p, text->buf, text->len);
+
+	return entry;
+}
+
+/*******************************************************************************************
+static int memo_restore(...)
+-Purpose:
+	Restores the metadata of an entry to a context, as dbmd_parse() left it
+-Returns:
+	int				-	0 on success, -1 if the object table cannot hold the objects
+********************************************************************************************/
+static int memo_restore(const DBMDMemoEntry *entry, DBMDContext *ctx)
+{
+	DolbyAtmosSupplementalSegment *sup = &ctx->metadata.DolbyAtmosSupSeg;
+	unsigned int object_count = entry->metadata.DolbyAtmosSupSeg.object_count;
+	DBMDObjectTable objects = sup->objects;
+
+	if ( object_count && dbmd_objects_reserve(&objects, object_count) )
+		return -1;
+
+	ctx->metadata = entry->metadata;
+	sup->objects = objects;
+	if (object_count)
+	{
+		memcpy(objects.flags, entry->metadata.DolbyAtmosSupSeg.objects.flags, object_count);
+		memcpy(objects.binaural_render_mode, entry->metadata.DolbyAtmosSupSeg.objects.binaural_render_mode, object_count);
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void memo_lock(...)
+-Purpose:
+	Takes the memo lock; batches on Windows are scanned on a single thread
+********************************************************************************************/
+static void memo_lock(DBMDMemo *memo)
+{
+#ifndef WIN32
+	pthread_mutex_lock(&memo->lock);
+#else
+	(void)memo;
+#endif
+}
+
+/*******************************************************************************************
+static void memo_unlock(...)
+-Purpose:
+	Releases the memo lock
+********************************************************************************************/
+static void memo_unlock(DBMDMemo *memo)
+{
+#ifndef WIN32
+	pthread_mutex_unlock(&memo->lock);
+#else
+	(void)memo;
+#endif
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_MEMO_H
+#define DBMD_MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+#include "dbmd_wav_parse.h"
+
+/* This defines the in-memory memo of parsed dbmd chunks. Deliverables made
+ *  from the same authoring template carry byte-identical dbmd chunks, so the
+ *  result of parsing a chunk is kept for the rest of the run, keyed by the
+ *  hash of its bytes, and a file whose chunk has been seen before is answered
+ *  from the memo without being parsed or, in the text format, rendered. The
+ *  bytes of each chunk are kept and compared on a hit, so a hash collision
+ *  never returns the wrong result. The memo is shared by all worker threads
+ *  and stops taking new chunks once it holds max_bytes.
+ */
+#define DBMD_MEMO_MAX_BYTES (64u << 20) /* Default memory limit of the memo */
+
+typedef struct
+{
+	uint64_t hash;                  /* Hash of the dbmd chunk */
+	const unsigned char *chunk;     /* Bytes of the dbmd chunk */
+	size_t chunk_size;              /* Size of the dbmd chunk */
+	int error;                      /* Error code of the parse */
+	DBMetadata metadata;            /* Parsed metadata, its object table held by the entry */
+	const char *text;               /* Text rendering of the metadata, or NULL */
+	size_t text_len;
+} DBMDMemoEntry;
+
+typedef struct
+{
+	DBMDMemoEntry **slots;          /* Hash table of entries, NULL for a free slot */
+	size_t num_slots;               /* Size of the hash table, a power of two */
+	size_t num_entries;             /* Number of distinct chunks held */
+	size_t num_bytes;               /* Memory held by the entries */
+	size_t max_bytes;               /* Limit on num_bytes */
+	int render;                     /* Keep the text rendering of each result */
+	unsigned long num_lookups;      /* Number of chunks looked up */
+	unsigned long num_hits;         /* Number of those answered from the memo */
+#ifndef WIN32
+	pthread_mutex_t lock;           /* Serializes lookups and inserts of worker threads */
+#endif
+} DBMDMemo;
+
+int dbmd_memo_init(DBMDMemo *memo, size_t max_bytes, int render);
+int dbmd_memo_parse(DBMDMemo *memo, DBMDContext *ctx, const DBMDMemoEntry **entry);
+void dbmd_memo_free(DBMDMemo *memo);
+
+#endif /* DBMD_MEMO_H */
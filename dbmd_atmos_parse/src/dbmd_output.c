@@ -0,0 +1,753 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dbmd_output.h"
+#include "dbmd_stats.h"
+#include "dbmd_text.h"
+#include "dbmd_io.h"
+
+/* Initial size of an output buffer */
+#define OUTPUT_INITIAL_SIZE 2048
+
+/* Local function prototypes */
+static void json_string(DBMDOutput *out, const char *s, size_t len);
+static void json_uint_array(DBMDOutput *out, const char *name, const unsigned char *values, unsigned int count);
+
+/*******************************************************************************************
+void dbmd_output_init(...)
+-Purpose:
+	Initializes an empty output buffer
+-Inputs:
+	DBMDOutput *out	-	Output buffer
+********************************************************************************************/
+void dbmd_output_init(DBMDOutput *out)
+{
+	out->buf = NULL;
+	out->len = 0;
+	out->size = 0;
+	out->error = DB_ERR_OK;
+}
+
+/*******************************************************************************************
+int dbmd_output_printf(...)
+-Purpose:
+	Appends formatted text to the output buffer, growing it as needed. If the
+	buffer cannot grow, the text is dropped and the buffer remembers the error.
+-Inputs:
+	DBMDOutput *out		-	Output buffer
+	const char *format	-	printf style format string
+-Returns:
+	int					-	DB_ERR_OK or DB_ERR_NOMEMORY
+********************************************************************************************/
+int dbmd_output_printf(DBMDOutput *out, const char *format, ...)
+{
+	va_list args;
+	size_t new_size;
+	char *new_buf;
+	int n;
+
+	while (1)
+	{
+		if (out->size > out->len)
+		{
+			va_start(args, format);
+			n = vsnprintf(out->buf + out->len, out->size - out->len, format, args);
+			va_end(args);
+
+			if (n < 0)
+				return DB_ERR_OK;
+			if ((size_t)n < out->size - out->len)
+			{
+				out->len += n;
+				return DB_ERR_OK;
+			}
+		}
+		else
+		{
+			n = OUTPUT_INITIAL_SIZE;
+		}
+
+		/* grow buffer to fit the formatted text and try again */
+		new_size = out->size ? out->size * 2 : OUTPUT_INITIAL_SIZE;
+		while (new_size < out->len + n + 1)
+			new_size = new_size * 2;
+		new_buf = realloc(out->buf, new_size);
+		if (!new_buf)
+		{
+			out->error = DB_ERR_NOMEMORY;
+			return DB_ERR_NOMEMORY;
+		}
+		out->buf = new_buf;
+		out->size = new_size;
+	}
+}
+
+/*******************************************************************************************
+unsigned char *dbmd_output_append(...)
+-Purpose:
+	Appends len bytes to the output buffer, growing it as needed, for the caller
+	to fill in
+-Inputs:
+	DBMDOutput *out	-	Output buffer
+	size_t len		-	Number of bytes
+-Returns:
+	unsigned char *	-	The appended bytes, NULL if out of memory
+********************************************************************************************/
+unsigned char *dbmd_output_append(DBMDOutput *out, size_t len)
+{
+	size_t new_size;
+	char *new_buf;
+
+	if (out->len + len > out->size)
+	{
+		new_size = out->size ? out->size * 2 : OUTPUT_INITIAL_SIZE;
+		while (new_size < out->len + len)
+			new_size = new_size * 2;
+		new_buf = realloc(out->buf, new_size);
+		if (!new_buf)
+		{
+			out->error = DB_ERR_NOMEMORY;
+			return NULL;
+		}
+		out->buf = new_buf;
+		out->size = new_size;
+	}
+
+	out->len += len;
+	return (unsigned char *)out->buf + out->len - len;
+}
+
+/*******************************************************************************************
+int dbmd_output_write(...)
+-Purpose:
+	Writes the contents of the output buffer with a single call
+-Inputs:
+	DBMDOutput *out	-	Output buffer
+	FILE *fp		-	Destination stream
+-Returns:
+	int				-	DB_ERR_NOMEMORY if text was dropped while rendering, so the
+						output is incomplete, otherwise DB_ERR_OK
+********************************************************************************************/
+int dbmd_output_write(DBMDOutput *out, FILE *fp)
+{
+	if (out->len > 0)
+		fwrite(out->buf, 1, out->len, fp);
+
+	return out->error;
+}
+
+/*******************************************************************************************
+void dbmd_output_reset(...)
+-Purpose:
+	Empties the output buffer, keeping its allocation for reuse
+-Inputs:
+	DBMDOutput *out	-	Output buffer
+********************************************************************************************/
+void dbmd_output_reset(DBMDOutput *out)
+{
+	out->len = 0;
+	out->error = DB_ERR_OK;
+}
+
+/*******************************************************************************************
+void dbmd_output_free(...)
+-Purpose:
+	Releases the memory held by the output buffer
+-Inputs:
+	DBMDOutput *out	-	Output buffer
+********************************************************************************************/
+void dbmd_output_free(DBMDOutput *out)
+{
+	free(out->buf);
+	dbmd_output_init(out);
+}
+
+/*******************************************************************************************
+void display_dbmd_result(...)
+-Purpose:
+	Renders the outcome of scanning a file: the metadata on success, otherwise
+	the messages describing why the file could not be parsed
+-Inputs:
+	DBMDOutput *out			-	Output buffer
+	const DBMDContext *ctx	-	Parse context used to scan the file
+	int error_code			-	Error code returned by dbmd_parse_file()
+********************************************************************************************/
+void display_dbmd_result(DBMDOutput *out, const DBMDContext *ctx, int error_code)
+{
+	if (error_code == DB_ERR_OK)
+	{
+		/* Display dbmd values for all programs */
+		display_dbmd_metadata(out, &ctx->metadata);
+	}
+	else if (error_code == DB_ERR_FILEOPEN)
+	{
+		dbmd_output_printf(out, "\nError opening input file!\n");
+	}
+	else if (error_code == DB_ERR_NOTSEEKABLE)
+	{
+		dbmd_output_printf(out, "\nError, input cannot be read out of order!\n");
+	}
+	else if (error_code <= DB_ERR_FILEOPEN)
+	{
+		/* Test if DBMD chunk was found */
+		if ( !(ctx->status & WAV_DBMD_CHUNK_MASK) || !ctx->dbmd_chunk_size )
+		{
+			dbmd_output_printf(out, "\nError, Dolby audio metadata chunk not found!\n");
+		}
+
+		/* Test if AXML chunk was found */
+		if ( !(ctx->status & WAV_AXML_CHUNK_MASK) )
+		{
+			dbmd_output_printf(out, "\nError, ADM XML chunk not found!\n");
+		}		
+		
+		dbmd_output_printf(out, "\nError, file not recognized as valid ADM WAV file!\n");
+	}
+	else
+	{
+		/* parse dbmd error & display message */
+		display_dbmd_error(out, error_code);
+	}
+}
+
+/*******************************************************************************************
+void display_dbmd_metadata(...)
+-Purpose:
+	Renders the parsed Dolby Atmos metadata as text
+-Inputs:
+	DBMDOutput *out				-	Output buffer
+	const DBMetadata *metadata	-	Parsed metadata
+********************************************************************************************/
+void display_dbmd_metadata(DBMDOutput *out, const DBMetadata *metadata)
+{
+	const DolbyAtmosSupplementalSegment *dasms = &metadata->DolbyAtmosSupSeg;
+	unsigned int i;
+	int is_same_brm = 0;
+	atmos_dbmd_binaural_render_mode brm = ATMOS_DBMD_BINAURAL_RENDER_MODE_NOT_INDICATED;
+
+	dbmd_output_printf(out, "\nDolby Audio Metadata Wave Chunk Found\n");
+
+	if (metadata->DolbyAtmosSeg.segment_exists)
+	{
+		dbmd_output_printf(out, "\nDolby Atmos Metadata\n");
+		dbmd_output_printf(out, "   Created by: %s (%d.%d.%d)\n",
+			metadata->DolbyAtmosSeg.content_creation_tool,
+			metadata->DolbyAtmosSeg.content_creation_tool_version.major,
+			metadata->DolbyAtmosSeg.content_creation_tool_version.minor,
+			metadata->DolbyAtmosSeg.content_creation_tool_version.micro);
+		dbmd_output_printf(out, "   warp_mode: %s\n", warpmodetext[metadata->DolbyAtmosSeg.warp_mode]);
+	}
+	else
+	{
+		dbmd_output_printf(out, "\nDolby Atmos Metdata\n");
+		dbmd_output_printf(out, "   Not present. This may indicate that this is not a valid Dolby Atmos ADM file.\n");
+	}
+
+	if (metadata->DolbyAtmosSupSeg.segment_exists)
+	{
+		dbmd_output_printf(out, "\nDolby Atmos Supplemental Metadata\n");
+
+		/* Determine if same brm is used for all objects, from the mode histogram */
+		for (i = 0; i < NUM_BINAURAL_RENDER_MODES; i++)
+		{
+			if ( (dasms->object_count > 0) && (dasms->mode_histogram[i] == dasms->object_count) )
+			{
+				is_same_brm = 1;
+				brm = (atmos_dbmd_binaural_render_mode)i;
+			}
+		}
+
+		if (is_same_brm == 1)
+		{
+			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_BYPASS)
+			{
+				dbmd_output_printf(out, "   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tNo binauralization will be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
+			}
+			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_NEAR)
+			{
+				dbmd_output_printf(out, "   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tNear binaural render mode will be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
+			}
+			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_FAR)
+			{
+				dbmd_output_printf(out, "   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tFar binaural render mode will be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
+			}
+			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_MID)
+			{
+				dbmd_output_printf(out, "   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tDefault binaural render mode will be applied.\n", binauralrendermodetext[brm]);
+			}
+			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_NOT_INDICATED)
+			{
+				dbmd_output_printf(out, "   Headphone metadata not present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tNo binaural render mode metadata present. Default binaural render mode metadata may be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
+			}
+		}
+		else
+		{
+			dbmd_output_printf(out, "   Headphone metadata present: \n   \tbinaural render mode: varied (objects have different values)\n");
+		}
+
+		/* check trim metadata */
+		dbmd_output_printf(out, "   Trim Metadata:\n");
+		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+		{
+			dbmd_output_printf(out, "   \tTrim mode: %s, %s trims\n",
+				trimmodecfgtext[i],
+				trimtypetext[metadata->DolbyAtmosSupSeg.trims[i].auto_trim]);
+		}
+	}
+	else
+	{
+		dbmd_output_printf(out, "\nDolby Atmos Supplemental Metadata\n"); 
+		dbmd_output_printf(out, "   Headphone metadata not present. Default metadata will apply.\n");
+		dbmd_output_printf(out, "   Trim metadata not present. Default metadata will apply.\n");
+	}
+
+	dbmd_output_printf(out, "\n");
+}
+
+/*******************************************************************************************
+void display_dbmd_adm(...)
+-Purpose:
+	Renders the summary of the axml chunk and whether it agrees with the dbmd
+	chunk, if the axml chunk was scanned
+-Inputs:
+	DBMDOutput *out			-	Output buffer
+	const DBMDContext *ctx	-	Parse context used to scan the file
+	int error_code			-	Error code returned by the parse of the dbmd chunk
+********************************************************************************************/
+void display_dbmd_adm(DBMDOutput *out, const DBMDContext *ctx, int error_code)
+{
+	const DBMDAxmlSummary *adm = &ctx->adm;
+	int matches;
+
+	if (!adm->scanned)
+		return;
+
+	dbmd_output_printf(out, "%sADM XML\n", (error_code == DB_ERR_OK) ? "" : "\n");
+	if (adm->error == DB_ERR_AXMLSYNTAX)
+	{
+		dbmd_output_printf(out, "   Error, ADM XML chunk ends within a tag!\n\n");
+		return;
+	}
+	else if (adm->error == DB_ERR_NOTSEEKABLE)
+	{
+		dbmd_output_printf(out, "   Error, input cannot be read out of order!\n\n");
+		return;
+	}
+	else if (adm->error != DB_ERR_OK)
+	{
+		dbmd_output_printf(out, "   Error reading ADM XML chunk!\n\n");
+		return;
+	}
+
+	dbmd_output_printf(out, "   %llu bytes, %lu elements\n", (unsigned long long)adm->size, adm->elements);
+	dbmd_output_printf(out, "   %lu audioProgramme, %lu audioContent, %lu audioObject\n",
+		adm->programmes, adm->contents, adm->objects);
+	dbmd_output_printf(out, "   %lu audioPackFormat (%lu Objects, %lu DirectSpeakers)\n",
+		adm->pack_formats, adm->object_packs, adm->bed_packs);
+	dbmd_output_printf(out, "   %lu audioChannelFormat, %lu audioBlockFormat, %lu audioTrackUID\n",
+		adm->channel_formats, adm->block_formats, adm->track_uids);
+
+	matches = (error_code == DB_ERR_OK) ? dbmd_axml_matches(adm, &ctx->metadata) : -1;
+	if (matches == 1)
+		dbmd_output_printf(out, "   object_count matches the number of tracks\n");
+	else if (matches == 0)
+		dbmd_output_printf(out, "   Warning, object_count is %u but the ADM XML has %lu tracks!\n",
+			ctx->metadata.DolbyAtmosSupSeg.object_count, adm->track_uids);
+
+	dbmd_output_printf(out, "\n");
+}
+
+/*******************************************************************************************
+void display_dbmd_error(...)
+-Purpose:
+	Renders the message for a dbmd chunk parse error
+-Inputs:
+	DBMDOutput *out		-	Output buffer
+	int error_code		-	Error code returned by parse_dbmd_metadata()
+********************************************************************************************/
+void display_dbmd_error(DBMDOutput *out, int error_code)
+{
+	switch(error_code)
+	{
+		case DB_ERR_OK:
+			break;
+		case DB_ERR_NEWERVERSION:
+			dbmd_output_printf(out, "DBMD Error, unsupported DBMD version!\n");
+			break;
+		case DB_ERR_BADDASMSSYNC:
+			dbmd_output_printf(out, "DBMD Error, invalid Dolby Atmos Supplemental Metadata sync!\n");
+			break;
+		case DB_ERR_TOOMANYOBJS:
+			dbmd_output_printf(out, "DBMD Error, too many objects!\n");
+			break;
+		case DB_ERR_DASEGSZ:
+			dbmd_output_printf(out, "DBMD Error, unsupported segment size for Dolby Atmos!\n");
+			break;
+		case DB_ERR_DACHECKSUM:
+			dbmd_output_printf(out, "DBMD Error, checksum failure for Dolby Atmos segment!\n");
+			break;
+		case DB_ERR_DASCHECKSUM: 
+			dbmd_output_printf(out, "DBMD Error, checksum failure for Dolby Atmos Supplemental segment!\n");
+			break;
+		case DB_ERR_SEGOVERRUN:
+			dbmd_output_printf(out, "DBMD Error, metadata segment extends beyond the dbmd chunk!\n");
+			break;
+		case DB_ERR_TOOMANYSEGS:
+			dbmd_output_printf(out, "DBMD Error, too many metadata segments!\n");
+			break;
+		case DB_ERR_PATCHFIELD:
+			dbmd_output_printf(out, "DBMD Error, edited segment or object not present!\n");
+			break;
+	}
+}
+
+/*******************************************************************************************
+void display_dbmd_segments(...)
+-Purpose:
+	Renders the segment index of a file, or the messages describing why the file
+	could not be indexed
+-Inputs:
+	DBMDOutput *out			-	Output buffer
+	const DBMDContext *ctx	-	Parse context used to index the file
+	int error_code			-	Error code returned by dbmd_index()
+********************************************************************************************/
+void display_dbmd_segments(DBMDOutput *out, const DBMDContext *ctx, int error_code)
+{
+	const DBMDSegment *segment;
+	int i;
+
+	if (error_code != DB_ERR_OK)
+	{
+		display_dbmd_result(out, ctx, error_code);
+		return;
+	}
+
+	dbmd_output_printf(out, "\nDolby Audio Metadata Wave Chunk Found\n");
+	dbmd_output_printf(out, "\nDBMD Segments (version %u.%u.%u.%u)\n",
+		(ctx->segments.version >> 24) & 0xFF,
+		(ctx->segments.version >> 16) & 0xFF,
+		(ctx->segments.version >> 8) & 0xFF,
+		ctx->segments.version & 0xFF);
+
+	for (i = 0; i < ctx->segments.num_segments; i++)
+	{
+		segment = &ctx->segments.segments[i];
+		dbmd_output_printf(out, "   ID 0x%02x (%s): offset %d, %d bytes, checksum %s\n",
+			segment->id,
+			(segment->id < 11) ? segmentidtext[segment->id] : "unknown",
+			segment->offset,
+			segment->size,
+			checksumstatustext[segment->checksum_status]);
+	}
+
+	dbmd_output_printf(out, "\n");
+}
+
+/*******************************************************************************************
+void display_dbmd_stats(...)
+-Purpose:
+	Renders the time spent in each phase of a scan and the I/O it needed. The
+	result is still being rendered, so its own time is not included.
+-Inputs:
+	DBMDOutput *out			-	Output buffer
+	const DBMDContext *ctx	-	Parse context used to scan the file, with timing set
+********************************************************************************************/
+void display_dbmd_stats(DBMDOutput *out, const DBMDContext *ctx)
+{
+	char duration[16];
+	const char *sep = "   ";
+	int i;
+
+	dbmd_output_printf(out, "\nScan Statistics\n");
+	for (i = 0; i < DBMD_PHASE_OUTPUT; i++)
+	{
+		if (!ctx->stats.phase_ns[i])
+			continue;
+		dbmd_stats_duration(duration, sizeof(duration), ctx->stats.phase_ns[i]);
+		dbmd_output_printf(out, "%s%s %s", sep, dbmd_phase_names[i], duration);
+		sep = ", ";
+	}
+	dbmd_output_printf(out, "\n   %lu reads, %llu bytes, %lu seeks, %lu chunks skipped\n\n",
+		ctx->read_count,
+		(unsigned long long)ctx->bytes_read,
+		ctx->stats.seeks,
+		ctx->stats.chunks_skipped);
+}
+
+/*******************************************************************************************
+void format_dbmd_json(...)
+-Purpose:
+	Renders the outcome of scanning a file as one line of JSON: the file name,
+	error code, chunk status bits and dbmd chunk size, optionally the cost of the
+	scan, then either the segment index or the axml chunk summary, if scanned, and
+	every decoded metadata field, null for a segment that is absent
+-Inputs:
+	DBMDOutput *out			-	Output buffer
+	const char *path		-	Input file name
+	const DBMDContext *ctx	-	Parse context used to scan the file
+	int error_code			-	Error code returned by the scan
+	int segments			-	Set if the file was indexed rather than decoded
+	int stats				-	Set to include the phase timings and I/O counters
+********************************************************************************************/
+void format_dbmd_json(DBMDOutput *out, const char *path, const DBMDContext *ctx, int error_code, int segments, int stats)
+{
+	const DolbyAtmosSegment *seg = &ctx->metadata.DolbyAtmosSeg;
+	const DolbyAtmosSupplementalSegment *sup = &ctx->metadata.DolbyAtmosSupSeg;
+	const DBMDSegment *segment;
+	unsigned char trims[NUM_TRIM_CONFIGS];
+	int matches;
+	int i;
+
+	dbmd_output_printf(out, "{\"file\":");
+	json_string(out, path, strlen(path));
+	dbmd_output_printf(out, ",\"error\":%d,\"status\":%u,\"dbmd_chunk_size\":%llu",
+		error_code, (unsigned int)ctx->status, (unsigned long long)ctx->dbmd_chunk_size);
+
+	if (stats)
+	{
+		dbmd_output_printf(out, ",\"stats\":{");
+		for (i = 0; i < DBMD_PHASE_OUTPUT; i++)
+			dbmd_output_printf(out, "\"%s_ns\":%llu,", dbmd_phase_names[i], (unsigned long long)ctx->stats.phase_ns[i]);
+		dbmd_output_printf(out, "\"reads\":%lu,\"bytes\":%llu,\"seeks\":%lu,\"chunks_skipped\":%lu}",
+			ctx->read_count, (unsigned long long)ctx->bytes_read, ctx->stats.seeks, ctx->stats.chunks_skipped);
+	}
+
+	if (segments)
+	{
+		dbmd_output_printf(out, ",\"segments\":");
+		if (error_code != DB_ERR_OK)
+		{
+			dbmd_output_printf(out, "null}\n");
+			return;
+		}
+		dbmd_output_printf(out, "{\"version\":%u,\"list\":[", ctx->segments.version);
+		for (i = 0; i < ctx->segments.num_segments; i++)
+		{
+			segment = &ctx->segments.segments[i];
+			dbmd_output_printf(out, "%s{\"id\":%d,\"offset\":%d,\"size\":%d,\"checksum\":%d}",
+				i ? "," : "", segment->id, segment->offset, segment->size, (int)segment->checksum_status);
+		}
+		dbmd_output_printf(out, "]}}\n");
+		return;
+	}
+
+	if (ctx->adm.scanned)
+	{
+		dbmd_output_printf(out, ",\"adm\":{\"error\":%d", ctx->adm.error);
+		if (ctx->adm.error == DB_ERR_OK)
+		{
+			dbmd_output_printf(out, ",\"size\":%llu,\"elements\":%lu,\"programmes\":%lu,\"contents\":%lu,\"objects\":%lu",
+				(unsigned long long)ctx->adm.size, ctx->adm.elements, ctx->adm.programmes, ctx->adm.contents, ctx->adm.objects);
+			dbmd_output_printf(out, ",\"pack_formats\":%lu,\"object_packs\":%lu,\"bed_packs\":%lu",
+				ctx->adm.pack_formats, ctx->adm.object_packs, ctx->adm.bed_packs);
+			dbmd_output_printf(out, ",\"channel_formats\":%lu,\"block_formats\":%lu,\"track_uids\":%lu",
+				ctx->adm.channel_formats, ctx->adm.block_formats, ctx->adm.track_uids);
+		}
+		matches = (error_code == DB_ERR_OK) ? dbmd_axml_matches(&ctx->adm, &ctx->metadata) : -1;
+		dbmd_output_printf(out, ",\"object_count_matches\":%s}", (matches < 0) ? "null" : (matches ? "true" : "false"));
+	}
+
+	dbmd_output_printf(out, ",\"atmos\":");
+	if ( (error_code == DB_ERR_OK) && seg->segment_exists )
+	{
+		dbmd_output_printf(out, "{\"tool\":");
+		for (i = 0; (i < ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN) && seg->content_creation_tool[i]; i++)
+			;
+		json_string(out, seg->content_creation_tool, (size_t)i);
+		dbmd_output_printf(out, ",\"tool_version\":[%d,%d,%d],\"warp_mode\":%d}",
+			seg->content_creation_tool_version.major,
+			seg->content_creation_tool_version.minor,
+			seg->content_creation_tool_version.micro,
+			(int)seg->warp_mode);
+	}
+	else
+	{
+		dbmd_output_printf(out, "null");
+	}
+
+	dbmd_output_printf(out, ",\"supplemental\":");
+	if ( (error_code == DB_ERR_OK) && sup->segment_exists )
+	{
+		dbmd_output_printf(out, "{\"object_count\":%u,\"binaural_render_mode_counts\":[", sup->object_count);
+		for (i = 0; i < NUM_BINAURAL_RENDER_MODES; i++)
+			dbmd_output_printf(out, "%s%u", i ? "," : "", sup->mode_histogram[i]);
+		dbmd_output_printf(out, "]");
+		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+			trims[i] = (unsigned char)sup->trims[i].auto_trim;
+		json_uint_array(out, "auto_trim", trims, NUM_TRIM_CONFIGS);
+		json_uint_array(out, "object_flags", sup->objects.flags, sup->object_count);
+		json_uint_array(out, "binaural_render_modes", sup->objects.binaural_render_mode, sup->object_count);
+		dbmd_output_printf(out, "}");
+	}
+	else
+	{
+		dbmd_output_printf(out, "null");
+	}
+
+	dbmd_output_printf(out, "}\n");
+}
+
+/*******************************************************************************************
+void format_dbmd_record(...)
+-Purpose:
+	Renders the outcome of scanning a file as a binary record, laid out as
+	described in dbmd_output.h
+-Inputs:
+	DBMDOutput *out			-	Output buffer
+	const char *path		-	Input file name
+	const DBMDContext *ctx	-	Parse context used to scan the file
+	int error_code			-	Error code returned by the scan
+********************************************************************************************/
+void format_dbmd_record(DBMDOutput *out, const char *path, const DBMDContext *ctx, int error_code)
+{
+	const DolbyAtmosSegment *seg = &ctx->metadata.DolbyAtmosSeg;
+	const DolbyAtmosSupplementalSegment *sup = &ctx->metadata.DolbyAtmosSupSeg;
+	size_t path_len = strlen(path);
+	unsigned int object_count = 0;
+	unsigned int trim_mask = 0;
+	unsigned char *rec;
+	int i;
+
+	if (path_len > 0xFFFF)
+		path_len = 0xFFFF;
+	if ( (error_code == DB_ERR_OK) && sup->segment_exists )
+		object_count = sup->object_count;
+
+	rec = dbmd_output_append(out, DBMD_RECORD_SIZE + path_len + 2 * (size_t)object_count);
+	if (!rec)
+		return;
+	memset(rec, 0, DBMD_RECORD_SIZE);
+
+	memcpy(rec, DBMD_RECORD_MAGIC, 4);
+	dbmd_put_le(rec + 4, DBMD_RECORD_VERSION, 2);
+	dbmd_put_le(rec + 6, DBMD_RECORD_SIZE, 2);
+	dbmd_put_le(rec + 8, path_len + 2 * (uint64_t)object_count, 4);
+	dbmd_put_le(rec + 12, (uint32_t)error_code, 4);
+	rec[16] = ctx->status;
+	dbmd_put_le(rec + 22, path_len, 2);
+	dbmd_put_le(rec + 24, ctx->dbmd_chunk_size, 8);
+	memcpy(rec + DBMD_RECORD_SIZE, path, path_len);
+
+	if (error_code != DB_ERR_OK)
+		return;
+
+	if (seg->segment_exists)
+	{
+		rec[17] |= DBMD_RECORD_ATMOS_SEG;
+		rec[18] = (unsigned char)seg->warp_mode;
+		rec[19] = (unsigned char)seg->content_creation_tool_version.major;
+		rec[20] = (unsigned char)seg->content_creation_tool_version.minor;
+		rec[21] = (unsigned char)seg->content_creation_tool_version.micro;
+		for (i = 0; (i < ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN) && seg->content_creation_tool[i]; i++)
+			rec[72 + i] = (unsigned char)seg->content_creation_tool[i];
+	}
+
+	if (sup->segment_exists)
+	{
+		rec[17] |= DBMD_RECORD_SUPPLEMENTAL_SEG;
+		dbmd_put_le(rec + 32, object_count, 4);
+		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+			trim_mask |= (unsigned int)(sup->trims[i].auto_trim & 1) << i;
+		dbmd_put_le(rec + 36, trim_mask, 2);
+		for (i = 0; i < NUM_BINAURAL_RENDER_MODES; i++)
+			dbmd_put_le(rec + 40 + 4 * i, sup->mode_histogram[i], 4);
+		memcpy(rec + DBMD_RECORD_SIZE + path_len, sup->objects.flags, object_count);
+		memcpy(rec + DBMD_RECORD_SIZE + path_len + object_count, sup->objects.binaural_render_mode, object_count);
+	}
+}
+
+/*******************************************************************************************
+static void json_string(...)
+-Purpose:
+	Appends a string as a quoted JSON string, copying runs of plain characters
+	and escaping quotes, backslashes and control characters
+********************************************************************************************/
+static void json_string(DBMDOutput *out, const char *s, size_t len)
+{
+	unsigned char *p;
+	unsigned char c;
+	size_t i, j;
+
+	dbmd_output_printf(out, "\"");
+	for (i = 0; i < len; i = j + 1)
+	{
+		for (j = i; j < len; j++)
+		{
+			c = (unsigned char)s[j];
+			if ( (c == '"') || (c == '\\') || (c < 0x20) )
+				break;
+		}
+		if ( (j > i) && (p = dbmd_output_append(out, j - i)) )
+			memcpy(p, s + i, j - i);
+		if (j == len)
+			break;
+
+		c = (unsigned char)s[j];
+		if (c < 0x20)
+			dbmd_output_printf(out, "\\u%04x", c);
+		else
+			dbmd_output_printf(out, "\\%c", c);
+	}
+	dbmd_output_printf(out, "\"");
+}
+
+/*******************************************************************************************
+static void json_uint_array(...)
+-Purpose:
+	Appends a named JSON array of byte values. Digits are written directly,
+	since an array may hold tens of thousands of per-object values.
+********************************************************************************************/
+static void json_uint_array(DBMDOutput *out, const char *name, const unsigned char *values, unsigned int count)
+{
+	unsigned char *p;
+	unsigned int i, v;
+
+	dbmd_output_printf(out, ",\"%s\":[", name);
+	if (count > 0)
+	{
+		/* at most three digits and a separator per value */
+		p = dbmd_output_append(out, 4 * (size_t)count);
+		if (!p)
+			return;
+		for (i = 0; i < count; i++)
+		{
+			v = values[i];
+			if (v >= 100)
+				*p++ = (unsigned char)('0' + v / 100);
+			if (v >= 10)
+				*p++ = (unsigned char)('0' + (v / 10) % 10);
+			*p++ = (unsigned char)('0' + v % 10);
+			*p++ = ',';
+		}
+		/* drop the unused space and the last separator */
+		out->len = (size_t)((char *)p - out->buf) - 1;
+	}
+	dbmd_output_printf(out, "]");
+}
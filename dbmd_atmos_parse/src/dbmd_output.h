@@ -0,0 +1,94 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_OUTPUT_H
+#define DBMD_OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "dbmd_atmos_parse.h"
+#include "dbmd_wav_parse.h"
+
+/* This defines a growable output buffer. Results for a file are rendered
+ *  into a buffer first and written out with a single call, so that files
+ *  scanned on different threads can be emitted in a stable order.
+ */
+typedef struct
+{
+	char *buf;   /* Rendered text */
+	size_t len;  /* Number of bytes used */
+	size_t size; /* Number of bytes allocated */
+	int error;   /* DB_ERR_NOMEMORY once text could not be added */
+} DBMDOutput;
+
+/* Result formats */
+typedef enum
+{
+	DBMD_FORMAT_TEXT = 0,   /* Prose for people to read */
+	DBMD_FORMAT_NDJSON = 1, /* One JSON object per file, one per line */
+	DBMD_FORMAT_BINARY = 2  /* One binary record per file */
+} dbmd_output_format;
+
+/* This defines the binary result record. All integers are little-endian.
+ *  Each record starts with a fixed part of DBMD_RECORD_SIZE bytes:
+ *
+ *      0  "DBMR"            4  u16 version       6  u16 fixed part size
+ *      8  u32 tail size    12  i32 error code   16  u8 chunk status bits
+ *     17  u8 segment flags 18  u8 warp mode     19  u8 tool version major
+ *     20  u8 minor         21  u8 micro         22  u16 file name length
+ *     24  u64 dbmd chunk size                   32  u32 object count
+ *     36  u16 automatic trim mask               38  u16 reserved
+ *     40  u32 objects per binaural render mode, 8 entries
+ *     72  content creation tool, NUL padded to 64 bytes
+ *
+ *  followed by a tail of tail size bytes: the file name, one flags byte per
+ *  object and one binaural render mode per object. The metadata fields are
+ *  zero unless the error code is DB_ERR_OK. Readers skip fixed parts larger
+ *  than they know and reject other versions.
+ */
+#define DBMD_RECORD_MAGIC "DBMR"
+#define DBMD_RECORD_VERSION 1
+#define DBMD_RECORD_SIZE 136
+
+/* Record segment flags */
+#define DBMD_RECORD_ATMOS_SEG 0x01
+#define DBMD_RECORD_SUPPLEMENTAL_SEG 0x02
+
+void dbmd_output_init(DBMDOutput *out);
+int dbmd_output_printf(DBMDOutput *out, const char *format, ...);
+unsigned char *dbmd_output_append(DBMDOutput *out, size_t len);
+int dbmd_output_write(DBMDOutput *out, FILE *fp);
+void dbmd_output_reset(DBMDOutput *out);
+void dbmd_output_free(DBMDOutput *out);
+
+void display_dbmd_result(DBMDOutput *out, const DBMDContext *ctx, int error_code);
+void display_dbmd_metadata(DBMDOutput *out, const DBMetadata *metadata);
+void display_dbmd_error(DBMDOutput *out, int error_code);
+void display_dbmd_adm(DBMDOutput *out, const DBMDContext *ctx, int error_code);
+void display_dbmd_segments(DBMDOutput *out, const DBMDContext *ctx, int error_code);
+void display_dbmd_stats(DBMDOutput *out, const DBMDContext *ctx);
+void format_dbmd_json(DBMDOutput *out, const char *path, const DBMDContext *ctx, int error_code, int segments, int stats);
+void format_dbmd_record(DBMDOutput *out, const char *path, const DBMDContext *ctx, int error_code);
+
+#endif /* DBMD_OUTPUT_H */
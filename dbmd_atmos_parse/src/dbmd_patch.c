@@ -0,0 +1,905 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "dbmd_patch.h"
+#include "dbmd_checksum.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_cache.h"
+#include "dbmd_io.h"
+
+/* Field offsets within the segment payloads, as parse_dolbyatmos_metadata()
+ *  and parse_dolbyatmos_splml_metadata() read them */
+#define ATMOS_WARP_MODE_OFFSET   152  /* bed_distribution, reserved, warp_mode */
+#define DASMS_OBJECT_COUNT_OFFSET 4
+#define DASMS_TRIM_OFFSET        7    /* reserved + auto_trim of the first configuration */
+#define DASMS_TRIM_SIZE          15
+#define DASMS_OBJECTS_OFFSET     (DASMS_TRIM_OFFSET + NUM_TRIM_CONFIGS * DASMS_TRIM_SIZE)
+
+/* Changed bytes closer together than this are written with one write */
+#define PATCH_MERGE_GAP 8
+
+/* Journal file layout: an 8 byte magic and a 32-bit version, followed by
+ *  records. All values are little-endian. Each record holds
+ *
+ *      u32 record length   u8 type   u64 sequence number
+ *
+ *  followed, for a patch record, by the u16 length and the absolute name of
+ *  the file, the u32 number of writes and for each write its u64 offset, u32
+ *  length and the old and new bytes. A completion record has no body. Every
+ *  record ends with the 64-bit FNV-1a hash of the bytes before it, so a
+ *  record torn by a crash is recognized and ignored.
+ */
+#define JOURNAL_MAGIC "DBMDJRNL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 12
+#define JOURNAL_RECORD_HEADER 13
+#define JOURNAL_PATCH 1
+#define JOURNAL_DONE 2
+
+/* One segment to be rewritten, with its bytes before and after the edits */
+typedef struct
+{
+	uint64_t offset;       /* File offset of the segment payload */
+	int size;              /* Payload size */
+	unsigned char *old_data; /* Payload and checksum as read */
+	unsigned char *new_data; /* Payload and checksum as edited */
+} PatchSegment;
+
+/* One range of changed bytes */
+typedef struct
+{
+	uint64_t offset;       /* File offset of the first byte */
+	size_t len;            /* Number of bytes */
+	const unsigned char *old_data;
+	const unsigned char *new_data;
+} PatchWrite;
+
+typedef struct
+{
+	PatchWrite *writes;
+	size_t num_writes;
+	size_t size;
+} PatchPlan;
+
+/* Local function prototypes */
+static int parse_name(const char *value, const char **names, int num_names, int *result);
+#ifndef WIN32
+static int read_segment(int fd, const DBMDContext *ctx, int segment_id, PatchSegment *segment);
+static int edit_atmos_segment(PatchSegment *segment, const DBMDPatch *patch);
+static int edit_supplemental_segment(PatchSegment *segment, const DBMDPatch *patch);
+static int plan_writes(PatchPlan *plan, const PatchSegment *segment);
+static int apply_plan(int fd, const PatchPlan *plan, size_t *num_written);
+static int journal_patch(DBMDJournal *journal, const char *filename, const PatchPlan *plan, uint64_t sequence);
+static int journal_done(DBMDJournal *journal, uint64_t sequence);
+static int journal_append(DBMDJournal *journal, unsigned char *rec, size_t len);
+static int journal_recover(DBMDJournal *journal, const unsigned char *data, size_t len);
+static int replay_patch(const unsigned char *rec, size_t rec_len);
+#endif
+
+/*******************************************************************************************
+void dbmd_patch_init(...)
+-Purpose:
+	Initializes a patch that leaves every field unchanged
+-Inputs:
+	DBMDPatch *patch	-	Patch
+********************************************************************************************/
+void dbmd_patch_init(DBMDPatch *patch)
+{
+	memset(patch, 0, sizeof(DBMDPatch));
+	patch->warp_mode = -1;
+	patch->binaural_render_mode = -1;
+}
+
+/*******************************************************************************************
+int dbmd_patch_edit(...)
+-Purpose:
+	Adds an edit to a patch. An edit is a field name, = and the new value:
+		warp_mode=<mode>				0 to 7, or normal, warping, pl2x, loro, not-indicated
+		trim.<config>=manual|auto		trim type of a trim configuration, e.g. trim.7.1.4
+		trim=manual|auto				trim type of all trim configurations
+		binaural=<mode>					binaural render mode of all objects:
+										0 to 7, or bypass, near, far, mid, not-indicated
+		binaural.<object>=<mode>		binaural render mode of one object, counted from 0
+-Inputs:
+	DBMDPatch *patch			-	Patch
+	const char *expression		-	Edit
+-Returns:
+	int							-	0 on success, -1 if the edit is not valid
+********************************************************************************************/
+int dbmd_patch_edit(DBMDPatch *patch, const char *expression)
+{
+	const char *value = strchr(expression, '=');
+	size_t name_len;
+	unsigned long object;
+	char *end;
+	int mode;
+	int i;
+
+	if (!value)
+		return -1;
+	name_len = (size_t)(value - expression);
+	value++;
+
+	if ( ((name_len == 9) && !strncmp(expression, "warp_mode", 9)) || ((name_len == 4) && !strncmp(expression, "warp", 4)) )
+		return parse_name(value, dbmd_warp_mode_names, 5, &patch->warp_mode);
+
+	if ( (name_len >= 4) && !strncmp(expression, "trim", 4) )
+	{
+		if (!strcmp(value, "manual"))
+			mode = 0;
+		else if ( !strcmp(value, "auto") || !strcmp(value, "automatic") )
+			mode = 1;
+		else
+			return -1;
+
+		if (name_len == 4)
+		{
+			patch->trim_mask = (1u << NUM_TRIM_CONFIGS) - 1;
+			patch->auto_trim = mode ? patch->trim_mask : 0;
+			return 0;
+		}
+		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+		{
+			if ( (expression[4] == '.') && (strlen(dbmd_trim_config_names[i]) == name_len - 5) && !strncmp(expression + 5, dbmd_trim_config_names[i], name_len - 5) )
+				break;
+		}
+		if (i == NUM_TRIM_CONFIGS)
+			return -1;
+		patch->trim_mask |= 1u << i;
+		patch->auto_trim = (patch->auto_trim & ~(1u << i)) | ((unsigned int)mode << i);
+		return 0;
+	}
+
+	if ( (name_len >= 8) && !strncmp(expression, "binaural", 8) )
+	{
+		if (parse_name(value, dbmd_binaural_mode_names, 5, &mode))
+			return -1;
+		if (name_len == 8)
+		{
+			/* a mode for all objects replaces the per-object modes given before it */
+			patch->binaural_render_mode = mode;
+			patch->num_objects = 0;
+			return 0;
+		}
+		if ( (expression[8] != '.') || (name_len == 9) || (patch->num_objects == DBMD_PATCH_MAX_OBJECTS) )
+			return -1;
+		object = strtoul(expression + 9, &end, 10);
+		if ( (end != value - 1) || (object > UINT16_MAX) )
+			return -1;
+		patch->objects[patch->num_objects].object = (unsigned int)object;
+		patch->objects[patch->num_objects].mode = mode;
+		patch->num_objects++;
+		return 0;
+	}
+
+	return -1;
+}
+
+/*******************************************************************************************
+static int parse_name(...)
+-Purpose:
+	Parses a field value given by name or as a number from 0 to 7
+********************************************************************************************/
+static int parse_name(const char *value, const char **names, int num_names, int *result)
+{
+	char *end;
+	long number;
+	int i;
+
+	for (i = 0; i < num_names; i++)
+	{
+		if (!strcmp(value, names[i]))
+		{
+			*result = i;
+			return 0;
+		}
+	}
+
+	number = strtol(value, &end, 10);
+	if ( (end == value) || *end || (number < 0) || (number > 7) )
+		return -1;
+	*result = (int)number;
+
+	return 0;
+}
+
+#ifndef WIN32
+
+/*******************************************************************************************
+int dbmd_patch_file(...)
+-Purpose:
+	Applies a patch to a file in place. The dbmd chunk is located and indexed as
+	for a scan, the segments holding the edited fields are read back and their
+	checksums verified, and the edits are applied to a copy. Only the bytes that
+	differ, and the regenerated segment checksums, are written, merging ranges a
+	few bytes apart into one write, and the file is synced. A file whose fields
+	already have the new values is not written at all. The file is locked for
+	writing from before its segments are read back until they are written, so
+	concurrent patches of a file, or a patch and a remux, take turns.
+-Inputs:
+	const char *filename		-	File to patch
+	const DBMDPatch *patch		-	Edits
+	DBMDJournal *journal		-	Journal opened with dbmd_journal_open(), or NULL
+	int flags					-	DBMD_PATCH_DRY_RUN to only work out the changes
+	DBMDPatchResult *result		-	Receives the number of bytes changed and writes
+-Returns:
+	int							-	error code
+********************************************************************************************/
+int dbmd_patch_file(const char *filename, const DBMDPatch *patch, DBMDJournal *journal, int flags, DBMDPatchResult *result)
+{
+	DBMDContext ctx;
+	PatchSegment segments[2];
+	PatchPlan plan;
+	uint64_t sequence = 0;
+	size_t num_written = 0;
+	int num_segments = 0;
+	int locked;
+	int error;
+	int fd;
+	int i;
+
+	memset(result, 0, sizeof(DBMDPatchResult));
+	memset(segments, 0, sizeof(segments));
+	memset(&plan, 0, sizeof(plan));
+
+	while (1)
+	{
+		fd = open(filename, O_RDWR);
+		if (fd < 0)
+			return DB_ERR_FILEOPEN;
+
+		/* locate the segments with the same walk as a scan */
+		dbmd_init(&ctx);
+		error = dbmd_open(&ctx, filename);
+		if (!error)
+			error = dbmd_scan(&ctx);
+		if (!error)
+			error = dbmd_index(&ctx, 0);
+		dbmd_close(&ctx);
+
+		/* lock only once the scan has closed its own descriptor, as that drops
+		 * the locks of the process; a file replaced meanwhile, by a remux in
+		 * place, is scanned again */
+		locked = error ? 0 : dbmd_lock_fd(fd, F_WRLCK, filename);
+		if (locked <= 0)
+			break;
+		dbmd_free(&ctx);
+		close(fd);
+	}
+	if (locked < 0)
+		error = DB_ERR_FILEWRITE;
+
+	if ( !error && (patch->warp_mode >= 0) )
+	{
+		error = read_segment(fd, &ctx, DOLBYATMOS_METD_SEG, &segments[num_segments]);
+		if (!error)
+			error = edit_atmos_segment(&segments[num_segments], patch);
+		num_segments++;
+	}
+	if ( !error && (patch->trim_mask || (patch->binaural_render_mode >= 0) || patch->num_objects) )
+	{
+		error = read_segment(fd, &ctx, DOLBYATMOS_SUP_METD_SEG, &segments[num_segments]);
+		if (!error)
+			error = edit_supplemental_segment(&segments[num_segments], patch);
+		num_segments++;
+	}
+	dbmd_free(&ctx);
+
+	for (i = 0; !error && (i < num_segments); i++)
+	{
+		num_written = plan.num_writes;
+		if (plan_writes(&plan, &segments[i]))
+			error = DB_ERR_NOMEMORY;
+		else if (plan.num_writes > num_written)
+			result->num_segments++;
+	}
+	for (i = 0; !error && ((size_t)i < plan.num_writes); i++)
+	{
+		result->num_bytes += (unsigned long)plan.writes[i].len;
+		result->num_writes++;
+	}
+
+	if ( !error && plan.num_writes && !(flags & DBMD_PATCH_DRY_RUN) )
+	{
+		if (journal)
+		{
+			sequence = journal->sequence++;
+			error = journal_patch(journal, filename, &plan, sequence);
+		}
+		if (!error)
+		{
+			error = apply_plan(fd, &plan, &num_written);
+			if (error)
+			{
+				/* put back what was written; if that fails too, the journal
+				 * completes the patch when it is next opened */
+				plan.num_writes = num_written;
+				if (apply_plan(fd, &plan, NULL) != DB_ERR_OK)
+					journal = NULL;
+			}
+			if (journal)
+				journal_done(journal, sequence);
+		}
+	}
+
+	close(fd);
+	for (i = 0; i < num_segments; i++)
+	{
+		free(segments[i].old_data);
+		free(segments[i].new_data);
+	}
+	free(plan.writes);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int read_segment(...)
+-Purpose:
+	Reads the payload and checksum of an indexed segment back from the file,
+	checking that its header and checksum are as the index found them
+********************************************************************************************/
+static int read_segment(int fd, const DBMDContext *ctx, int segment_id, PatchSegment *segment)
+{
+	const DBMDSegment *indexed = find_dbmd_segment(&ctx->segments, segment_id);
+	unsigned char *buf;
+	size_t len;
+
+	if (!indexed)
+		return DB_ERR_PATCHFIELD;
+
+	len = DBMD_SEG_HEADER_SZ + (size_t)indexed->size + 1;
+	buf = (unsigned char *)malloc(len);
+	segment->new_data = (unsigned char *)malloc(len);
+	if ( !buf || !segment->new_data )
+	{
+		free(buf);
+		return DB_ERR_NOMEMORY;
+	}
+	segment->offset = ctx->dbmd_offset + (uint64_t)indexed->offset;
+	segment->size = indexed->size;
+	segment->old_data = buf;
+
+	if (dbmd_read_all(fd, buf, len, segment->offset - DBMD_SEG_HEADER_SZ))
+		return DB_ERR_FILEREAD;
+	if ( (buf[0] != segment_id) || (dbmd_get_le(buf + 1, 2) != (uint64_t)indexed->size) )
+		return DB_ERR_FILEREAD;
+
+	/* keep the payload and checksum only */
+	memmove(buf, buf + DBMD_SEG_HEADER_SZ, len - DBMD_SEG_HEADER_SZ);
+	if (buf[segment->size] != calc_checksum(segment->size, (char *)buf))
+		return (segment_id == DOLBYATMOS_METD_SEG) ? DB_ERR_DACHECKSUM : DB_ERR_DASCHECKSUM;
+	memcpy(segment->new_data, buf, (size_t)segment->size + 1);
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int edit_atmos_segment(...)
+-Purpose:
+	Applies the warp mode edit to the Dolby Atmos segment and regenerates its
+	checksum
+********************************************************************************************/
+static int edit_atmos_segment(PatchSegment *segment, const DBMDPatch *patch)
+{
+	unsigned char *buf = segment->new_data;
+
+	if (segment->size != DOLBY_ATMOS_SEG_SZ)
+		return DB_ERR_DASEGSZ;
+
+	buf[ATMOS_WARP_MODE_OFFSET] = (unsigned char)((buf[ATMOS_WARP_MODE_OFFSET] & ~0x7) | patch->warp_mode);
+	buf[segment->size] = (unsigned char)calc_checksum(segment->size, (char *)buf);
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int edit_supplemental_segment(...)
+-Purpose:
+	Applies the trim and binaural render mode edits to the Dolby Atmos
+	Supplemental segment and regenerates its checksum. Reserved bits sharing a
+	byte with an edited field are kept.
+********************************************************************************************/
+static int edit_supplemental_segment(PatchSegment *segment, const DBMDPatch *patch)
+{
+	unsigned char *buf = segment->new_data;
+	unsigned char *modes;
+	unsigned int object_count;
+	unsigned int obj;
+	int cfg;
+	int i;
+
+	if (dbmd_get_le(buf, 4) != DASMS_SYNC)
+		return DB_ERR_BADDASMSSYNC;
+	object_count = (unsigned int)dbmd_get_le(buf + DASMS_OBJECT_COUNT_OFFSET, 2);
+	if (DASMS_OBJECTS_OFFSET + 2 * object_count > (unsigned int)segment->size)
+		return DB_ERR_SEGOVERRUN;
+	modes = buf + DASMS_OBJECTS_OFFSET + object_count;
+
+	for (i = 0; i < patch->num_objects; i++)
+	{
+		if (patch->objects[i].object >= object_count)
+			return DB_ERR_PATCHFIELD;
+	}
+
+	for (cfg = 0; cfg < NUM_TRIM_CONFIGS; cfg++)
+	{
+		if (patch->trim_mask & (1u << cfg))
+			buf[DASMS_TRIM_OFFSET + cfg * DASMS_TRIM_SIZE] = (unsigned char)((buf[DASMS_TRIM_OFFSET + cfg * DASMS_TRIM_SIZE] & ~0x1) | ((patch->auto_trim >> cfg) & 0x1));
+	}
+	if (patch->binaural_render_mode >= 0)
+	{
+		for (obj = 0; obj < object_count; obj++)
+			modes[obj] = (unsigned char)((modes[obj] & ~0x7) | patch->binaural_render_mode);
+	}
+	for (i = 0; i < patch->num_objects; i++)
+	{
+		obj = patch->objects[i].object;
+		modes[obj] = (unsigned char)((modes[obj] & ~0x7) | patch->objects[i].mode);
+	}
+	buf[segment->size] = (unsigned char)calc_checksum(segment->size, (char *)buf);
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int plan_writes(...)
+-Purpose:
+	Adds the ranges of bytes that differ between the old and new contents of a
+	segment to the write plan, merging ranges less than PATCH_MERGE_GAP bytes
+	apart
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int plan_writes(PatchPlan *plan, const PatchSegment *segment)
+{
+	PatchWrite *write = NULL;
+	PatchWrite *writes;
+	size_t len = (size_t)segment->size + 1;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (segment->old_data[i] == segment->new_data[i])
+			continue;
+
+		if ( write && (segment->offset + i - write->offset - write->len < PATCH_MERGE_GAP) )
+		{
+			write->len = (size_t)(segment->offset + i - write->offset) + 1;
+			continue;
+		}
+
+		if (plan->num_writes == plan->size)
+		{
+			writes = (PatchWrite *)realloc(plan->writes, (plan->size ? plan->size * 2 : 16) * sizeof(PatchWrite));
+			if (!writes)
+				return -1;
+			plan->writes = writes;
+			plan->size = plan->size ? plan->size * 2 : 16;
+		}
+		write = &plan->writes[plan->num_writes++];
+		write->offset = segment->offset + i;
+		write->len = 1;
+		write->old_data = segment->old_data + i;
+		write->new_data = segment->new_data + i;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int apply_plan(...)
+-Purpose:
+	Writes the planned ranges and syncs the file. With num_written, the new bytes
+	are written and the number of writes started is returned in it; without, the
+	old bytes are written back.
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int apply_plan(int fd, const PatchPlan *plan, size_t *num_written)
+{
+	const PatchWrite *write;
+	size_t i;
+
+	for (i = 0; i < plan->num_writes; i++)
+	{
+		write = &plan->writes[i];
+		if (num_written)
+			*num_written = i + 1;
+		if (dbmd_write_all(fd, num_written ? write->new_data : write->old_data, write->len, write->offset))
+			return DB_ERR_FILEWRITE;
+	}
+
+	if (fsync(fd))
+		return DB_ERR_FILEWRITE;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+int dbmd_journal_open(...)
+-Purpose:
+	Opens or creates a patch journal and locks it for this process. Patches left
+	without a completion record by an earlier run are completed, and the journal
+	is emptied.
+-Inputs:
+	DBMDJournal *journal	-	Journal
+	const char *path		-	Journal file name
+-Returns:
+	int						-	0 on success, -1 on failure
+********************************************************************************************/
+int dbmd_journal_open(DBMDJournal *journal, const char *path)
+{
+	struct stat st;
+	unsigned char *data = NULL;
+	unsigned char header[JOURNAL_HEADER_SIZE];
+	size_t len;
+	int error = 0;
+
+	memset(journal, 0, sizeof(DBMDJournal));
+	journal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0666);
+	if (journal->fd < 0)
+		return -1;
+
+	if ( dbmd_lock_fd(journal->fd, F_WRLCK, NULL) || fstat(journal->fd, &st) )
+		error = -1;
+	len = error ? 0 : (size_t)st.st_size;
+	if (len)
+	{
+		data = (unsigned char *)malloc(len);
+		if ( !data || dbmd_read_all(journal->fd, data, len, 0) )
+			error = -1;
+	}
+
+	/* refuse to empty a file that is not a journal */
+	if ( !error && (len >= JOURNAL_HEADER_SIZE) )
+	{
+		if ( memcmp(data, JOURNAL_MAGIC, 8) || (dbmd_get_le(data + 8, 4) != JOURNAL_VERSION) )
+			error = -1;
+		else
+			error = journal_recover(journal, data + JOURNAL_HEADER_SIZE, len - JOURNAL_HEADER_SIZE);
+	}
+	else if ( !error && len && memcmp(data, JOURNAL_MAGIC, len < 8 ? len : 8) )
+	{
+		error = -1;
+	}
+	free(data);
+
+	if (!error)
+	{
+		memcpy(header, JOURNAL_MAGIC, 8);
+		dbmd_put_le(header + 8, JOURNAL_VERSION, 4);
+		if ( ftruncate(journal->fd, 0) || dbmd_write_all(journal->fd, header, JOURNAL_HEADER_SIZE, 0) || fsync(journal->fd) )
+			error = -1;
+	}
+
+	if (error)
+	{
+		close(journal->fd);
+		journal->fd = -1;
+	}
+
+	return error;
+}
+
+/*******************************************************************************************
+int dbmd_journal_close(...)
+-Purpose:
+	Closes a patch journal. The journal is emptied unless a patch was left
+	without a completion record, which is then completed when it is next opened.
+-Inputs:
+	DBMDJournal *journal	-	Journal
+-Returns:
+	int						-	0 on success, -1 if a patch was left incomplete
+********************************************************************************************/
+int dbmd_journal_close(DBMDJournal *journal)
+{
+	int error = journal->pending ? -1 : 0;
+
+	if (journal->fd < 0)
+		return -1;
+
+	if ( !error && ftruncate(journal->fd, JOURNAL_HEADER_SIZE) )
+		error = -1;
+	close(journal->fd);
+	journal->fd = -1;
+
+	return error;
+}
+
+/*******************************************************************************************
+static int journal_patch(...)
+-Purpose:
+	Appends the record of a patch, with the old and new bytes of every write, to
+	the journal and syncs it
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int journal_patch(DBMDJournal *journal, const char *filename, const PatchPlan *plan, uint64_t sequence)
+{
+	char path[PATH_MAX];
+	unsigned char *rec;
+	unsigned char *p;
+	size_t path_len;
+	size_t len;
+	size_t i;
+	int error;
+
+	/* the journal may be replayed from another directory */
+	if ( !realpath(filename, path) || ((path_len = strlen(path)) > UINT16_MAX) )
+		return DB_ERR_FILEOPEN;
+
+	len = JOURNAL_RECORD_HEADER + 2 + path_len + 4 + 8;
+	for (i = 0; i < plan->num_writes; i++)
+		len += 12 + 2 * plan->writes[i].len;
+	rec = (unsigned char *)malloc(len);
+	if (!rec)
+		return DB_ERR_NOMEMORY;
+
+	p = rec + JOURNAL_RECORD_HEADER;
+	dbmd_put_le(rec + 4, JOURNAL_PATCH, 1);
+	dbmd_put_le(rec + 5, sequence, 8);
+	dbmd_put_le(p, path_len, 2);
+	memcpy(p + 2, path, path_len);
+	p += 2 + path_len;
+	dbmd_put_le(p, plan->num_writes, 4);
+	p += 4;
+	for (i = 0; i < plan->num_writes; i++)
+	{
+		dbmd_put_le(p, plan->writes[i].offset, 8);
+		dbmd_put_le(p + 8, plan->writes[i].len, 4);
+		memcpy(p + 12, plan->writes[i].old_data, plan->writes[i].len);
+		memcpy(p + 12 + plan->writes[i].len, plan->writes[i].new_data, plan->writes[i].len);
+		p += 12 + 2 * plan->writes[i].len;
+	}
+
+	error = journal_append(journal, rec, len);
+	if ( !error && fsync(journal->fd) )
+		error = -1;
+	free(rec);
+	if (error)
+		return DB_ERR_FILEWRITE;
+
+	journal->pending = 1;
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int journal_done(...)
+-Purpose:
+	Appends the completion record of a patch. It is not synced: a patch whose
+	completion record is lost is completed again, which changes nothing.
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int journal_done(DBMDJournal *journal, uint64_t sequence)
+{
+	unsigned char rec[JOURNAL_RECORD_HEADER + 8];
+
+	dbmd_put_le(rec + 4, JOURNAL_DONE, 1);
+	dbmd_put_le(rec + 5, sequence, 8);
+	if (journal_append(journal, rec, sizeof(rec)))
+		return -1;
+
+	journal->pending = 0;
+	return 0;
+}
+
+/*******************************************************************************************
+static int journal_append(...)
+-Purpose:
+	Fills in the length and hash of a record and appends it to the journal
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int journal_append(DBMDJournal *journal, unsigned char *rec, size_t len)
+{
+	ssize_t n;
+
+	dbmd_put_le(rec, len, 4);
+	dbmd_put_le(rec + len - 8, dbmd_cache_hash(rec, len - 8), 8);
+
+	while (len > 0)
+	{
+		n = write(journal->fd, rec, len);
+		if ( (n < 0) && (errno == EINTR) )
+			continue;
+		if (n <= 0)
+			return -1;
+		rec += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int journal_recover(...)
+-Purpose:
+	Completes every patch record of a journal that has no completion record. The
+	records end at the first one that is incomplete or fails its hash.
+-Returns:
+	int				-	0 on success, -1 if a file could not be written
+********************************************************************************************/
+static int journal_recover(DBMDJournal *journal, const unsigned char *data, size_t len)
+{
+	const unsigned char *rec;
+	const unsigned char *done;
+	size_t rec_len;
+	size_t valid = 0;
+	size_t pos;
+	size_t i;
+	int error = 0;
+	int result;
+
+	/* find the end of the intact records */
+	while (valid + JOURNAL_RECORD_HEADER + 8 <= len)
+	{
+		rec_len = (size_t)dbmd_get_le(data + valid, 4);
+		if ( (rec_len < JOURNAL_RECORD_HEADER + 8) || (rec_len > len - valid) ||
+		     (dbmd_get_le(data + valid + rec_len - 8, 8) != dbmd_cache_hash(data + valid, rec_len - 8)) )
+			break;
+		valid += rec_len;
+	}
+
+	for (pos = 0; pos < valid; pos += dbmd_get_le(data + pos, 4))
+	{
+		rec = data + pos;
+		if (dbmd_get_le(rec + 4, 1) != JOURNAL_PATCH)
+			continue;
+
+		/* completion records follow their patch record */
+		done = NULL;
+		for (i = pos + (size_t)dbmd_get_le(rec, 4); !done && (i < valid); i += dbmd_get_le(data + i, 4))
+		{
+			if ( (dbmd_get_le(data + i + 4, 1) == JOURNAL_DONE) && (dbmd_get_le(data + i + 5, 8) == dbmd_get_le(rec + 5, 8)) )
+				done = data + i;
+		}
+		if (done)
+			continue;
+
+		result = replay_patch(rec, (size_t)dbmd_get_le(rec, 4));
+		if (result < 0)
+			error = -1;
+		else if (result > 0)
+			journal->num_conflicts++;
+		else
+			journal->num_recovered++;
+	}
+
+	return error;
+}
+
+/*******************************************************************************************
+static int replay_patch(...)
+-Purpose:
+	Completes a patch record: with the file locked as for a patch, every range
+	must hold either its old or its new bytes, and the ranges are rewritten. A file that was
+	changed since, or removed, is left alone.
+-Returns:
+	int				-	0 if completed, 1 if left alone, -1 if the file could not be written
+********************************************************************************************/
+static int replay_patch(const unsigned char *rec, size_t rec_len)
+{
+	const unsigned char *end = rec + rec_len - 8;
+	const unsigned char *p = rec + JOURNAL_RECORD_HEADER;
+	const unsigned char *writes;
+	unsigned char *current;
+	char *path;
+	size_t path_len;
+	size_t num_writes;
+	size_t len;
+	size_t i;
+	int conflict = 0;
+	int locked;
+	int fd;
+
+	path_len = (size_t)dbmd_get_le(p, 2);
+	if (p + 2 + path_len + 4 > end)
+		return 1;
+	path = (char *)malloc(path_len + 1);
+	current = (unsigned char *)malloc(UINT16_MAX + 1);
+	if ( !path || !current )
+	{
+		free(path);
+		free(current);
+		return -1;
+	}
+	memcpy(path, p + 2, path_len);
+	path[path_len] = 0;
+	num_writes = (size_t)dbmd_get_le(p + 2 + path_len, 4);
+	writes = p + 2 + path_len + 4;
+
+	do
+	{
+		fd = open(path, O_RDWR);
+		locked = (fd < 0) ? 0 : dbmd_lock_fd(fd, F_WRLCK, path);
+		if ( (fd >= 0) && locked )
+			close(fd);
+	} while ( (fd >= 0) && (locked > 0) );
+	free(path);
+	if ( (fd < 0) || locked )
+	{
+		free(current);
+		return (fd < 0) ? 1 : -1;
+	}
+
+	/* check every range before writing any */
+	for (i = 0, p = writes; !conflict && (i < num_writes); i++, p += 12 + 2 * len)
+	{
+		len = (p + 12 <= end) ? (size_t)dbmd_get_le(p + 8, 4) : 0;
+		if ( (p + 12 + 2 * len > end) || (len > UINT16_MAX + 1) || dbmd_read_all(fd, current, len, dbmd_get_le(p, 8)) ||
+		     (memcmp(current, p + 12, len) && memcmp(current, p + 12 + len, len)) )
+			conflict = 1;
+	}
+	for (i = 0, p = writes; !conflict && (i < num_writes); i++, p += 12 + 2 * len)
+	{
+		len = (size_t)dbmd_get_le(p + 8, 4);
+		if (dbmd_write_all(fd, p + 12 + len, len, dbmd_get_le(p, 8)))
+			conflict = -1;
+	}
+	if ( !conflict && fsync(fd) )
+		conflict = -1;
+
+	close(fd);
+	free(current);
+
+	return conflict;
+}
+
+#else
+
+int dbmd_patch_file(const char *filename, const DBMDPatch *patch, DBMDJournal *journal, int flags, DBMDPatchResult *result)
+{
+	memset(result, 0, sizeof(DBMDPatchResult));
+	return DB_ERR_NOTSUPPORTED;
+}
+
+int dbmd_journal_open(DBMDJournal *journal, const char *path)
+{
+	memset(journal, 0, sizeof(DBMDJournal));
+	journal->fd = -1;
+	return -1;
+}
+
+int dbmd_journal_close(DBMDJournal *journal)
+{
+	return -1;
+}
+
+#endif /* WIN32 */
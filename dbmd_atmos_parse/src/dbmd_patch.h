@@ -0,0 +1,91 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_PATCH_H
+#define DBMD_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dbmd_atmos_parse.h"
+
+/* This defines in-place editing of the Dolby Atmos metadata of an ADM WAV
+ *  file. The warp mode of the Dolby Atmos segment and the automatic trim
+ *  flags and binaural render modes of the supplemental segment are fixed-size
+ *  fields, so a change only rewrites the bytes holding them and the checksum
+ *  of their segment; the rest of the file, including the audio data, is left
+ *  untouched. Each patched file is written with positioned writes and synced
+ *  before the next one is started.
+ *
+ *  With a journal, the old and new contents of every range are appended to
+ *  the journal and synced before the file is written, and a completion record
+ *  is appended once the file has been synced. Opening the journal again
+ *  completes every patch that has no completion record, writing the new bytes
+ *  of each range that still holds the old or new bytes, so a crash leaves each
+ *  file either patched or untouched. The journal is emptied when it is closed.
+ */
+#define DBMD_PATCH_MAX_OBJECTS 64   /* Per-object binaural render mode edits in a patch */
+
+/* dbmd_patch_file() flags */
+#define DBMD_PATCH_DRY_RUN 0x01     /* Work out the changes without writing them */
+
+typedef struct
+{
+	unsigned int object;            /* Object index */
+	int mode;                       /* New atmos_dbmd_binaural_render_mode */
+} DBMDPatchObject;
+
+typedef struct
+{
+	int warp_mode;                  /* New atmos_dbmd_warp_mode, or -1 to keep */
+	unsigned int trim_mask;         /* Trim configurations to change, one bit per configuration */
+	unsigned int auto_trim;         /* New auto_trim flag of each configuration in trim_mask */
+	int binaural_render_mode;       /* New binaural render mode of all objects, or -1 to keep */
+	DBMDPatchObject objects[DBMD_PATCH_MAX_OBJECTS]; /* Per-object modes, applied after the above */
+	int num_objects;
+} DBMDPatch;
+
+typedef struct
+{
+	unsigned long num_segments;     /* Number of segments changed */
+	unsigned long num_bytes;        /* Number of bytes changed, including checksums */
+	unsigned long num_writes;       /* Number of writes issued */
+} DBMDPatchResult;
+
+typedef struct
+{
+	int fd;                         /* Journal file, locked while open */
+	uint64_t sequence;              /* Sequence number of the next patch */
+	unsigned long num_recovered;    /* Number of patches completed when the journal was opened */
+	unsigned long num_conflicts;    /* Number of those whose file had changed since */
+	int pending;                    /* Set while a patch has no completion record */
+} DBMDJournal;
+
+void dbmd_patch_init(DBMDPatch *patch);
+int dbmd_patch_edit(DBMDPatch *patch, const char *expression);
+int dbmd_patch_file(const char *filename, const DBMDPatch *patch, DBMDJournal *journal, int flags, DBMDPatchResult *result);
+
+int dbmd_journal_open(DBMDJournal *journal, const char *path);
+int dbmd_journal_close(DBMDJournal *journal);
+
+#endif /* DBMD_PATCH_H */
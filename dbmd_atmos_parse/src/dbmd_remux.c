@@ -0,0 +1,606 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+
+#include "dbmd_remux.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_io.h"
+
+#define RIFF_HEADER_SIZE 12
+#define CHUNK_HEADER_SIZE 8
+#define DS64_SIZE 28                /* riffSize, dataSize, sampleCount and an empty table */
+#define MAX_CHUNK_SIZE 0xFFFFFFFEu  /* Largest size held in a chunk header */
+#define COPY_BUFFER_SIZE (1 << 20)  /* Bytes per read when the data is copied through user space */
+#define MAX_COPY_LEN (1 << 30)      /* Bytes per copy_file_range() call */
+
+/* Where the payload of an output chunk comes from */
+#define REMUX_FROM_INPUT 0
+#define REMUX_FROM_BUFFER 1
+
+/* One chunk of the output file */
+typedef struct
+{
+	char id[4];
+	int from;                       /* REMUX_FROM_INPUT or REMUX_FROM_BUFFER */
+	uint64_t size;                  /* Payload size, without the pad byte */
+	uint64_t in_offset;             /* Input offset of the payload */
+	const unsigned char *payload;   /* New payload */
+	uint64_t offset;                /* Output offset of the chunk header */
+} RemuxChunk;
+
+typedef struct
+{
+	RemuxChunk *chunks;
+	size_t count;
+	int is64;                       /* Written as RF64/BW64 with a ds64 chunk */
+	uint64_t size;                  /* Size of the file */
+	uint64_t data_size;             /* Payload size of the data chunk */
+} RemuxLayout;
+
+/* State of the copy of the carried chunks */
+typedef struct
+{
+	int in_fd;
+	int out_fd;
+	int no_clone;                   /* Set once the filesystem has refused to clone */
+	int no_copy;                    /* Set once copy_file_range() has failed */
+	unsigned char *buffer;          /* User space copy buffer, allocated on first use */
+	DBMDRemuxResult *result;
+} RemuxCopy;
+
+/* Payload of the JUNK chunk that aligns the data chunk */
+static const unsigned char junk[DBMD_REMUX_ALIGN + CHUNK_HEADER_SIZE + 2];
+
+/* Local function prototypes */
+#ifndef WIN32
+static int check_dbmd(const DBMDRemux *remux);
+static int plan_layout(const DBMDChunkList *list, const DBMDRemux *remux, int is64, int promote, RemuxLayout *layout);
+static void add_chunk(RemuxLayout *layout, const char *id, int from, uint64_t size, uint64_t in_offset, const unsigned char *payload);
+static uint64_t sample_count(int fd, const DBMDChunkList *list, uint64_t data_size);
+static int write_chunk(RemuxCopy *copy, const RemuxChunk *chunk, int is64);
+static int copy_range(RemuxCopy *copy, uint64_t in_offset, uint64_t out_offset, uint64_t len);
+static int copy_bytes(RemuxCopy *copy, uint64_t in_offset, uint64_t out_offset, uint64_t len);
+static int clone_blocks(RemuxCopy *copy, uint64_t in_offset, uint64_t out_offset, uint64_t len);
+
+/*******************************************************************************************
+int dbmd_remux_file(...)
+-Purpose:
+	Writes a copy of an ADM WAV file with its dbmd and/or axml chunk replaced. The
+	chunks of the input are found with the same walk as a scan, a replacement dbmd
+	chunk is checked by parsing it, and the output is laid out with its data chunk
+	aligned as in the input. The output is written to a temporary file with a
+	unique name next to it, given the owner, group and permissions of the input,
+	synced and renamed over the output, so an existing file is only ever replaced
+	by a complete one. A file replaced in place keeps its owner, or is left as it
+	is if the owner cannot be kept. The input is locked for reading while it is
+	copied, so a patch of it is not lost.
+-Inputs:
+	const char *input			-	File to remux
+	const char *output			-	File to write, or NULL to replace the input
+	const DBMDRemux *remux		-	Replacement chunks and flags
+	DBMDRemuxResult *result		-	Receives the number of bytes cloned, copied and written
+-Returns:
+	int							-	error code
+********************************************************************************************/
+int dbmd_remux_file(const char *input, const char *output, const DBMDRemux *remux, DBMDRemuxResult *result)
+{
+	DBMDContext ctx;
+	DBMDChunkList list;
+	RemuxLayout layout;
+	RemuxCopy copy;
+	RemuxChunk ds64;
+	unsigned char header[RIFF_HEADER_SIZE];
+	unsigned char ds64_payload[DS64_SIZE];
+	struct stat st;
+	char *temp = NULL;
+	int is64;
+	int error;
+	size_t i;
+
+	memset(result, 0, sizeof(DBMDRemuxResult));
+	memset(&list, 0, sizeof(list));
+	memset(&layout, 0, sizeof(layout));
+	memset(&copy, 0, sizeof(copy));
+	copy.out_fd = -1;
+	copy.result = result;
+	if (!output)
+		output = input;
+
+	error = check_dbmd(remux);
+	if (error)
+		return error;
+	if ( remux->axml && !remux->axml_len )
+		return DB_ERR_CHUNKSIZE;
+	if ( (remux->dbmd_len > MAX_CHUNK_SIZE) || (remux->axml_len > MAX_CHUNK_SIZE) )
+		return DB_ERR_NOTSUPPORTED;
+
+	copy.in_fd = open(input, O_RDONLY);
+	if (copy.in_fd < 0)
+		return DB_ERR_FILEOPEN;
+	if ( fstat(copy.in_fd, &st) || dbmd_read_all(copy.in_fd, header, sizeof(header), 0) )
+	{
+		close(copy.in_fd);
+		return DB_ERR_FILEREAD;
+	}
+
+	/* list the chunks with the same walk as a scan */
+	dbmd_init(&ctx);
+	error = dbmd_open(&ctx, input);
+	if (!error)
+		error = dbmd_scan_chunks(&ctx, &list);
+	dbmd_close(&ctx);
+	dbmd_free(&ctx);
+
+	/* a patch of the input waits until the copy is complete; the lock is taken
+	 * once the scan has closed its own descriptor, as that drops it */
+	if ( !error && dbmd_lock_fd(copy.in_fd, F_RDLCK, NULL) )
+		error = DB_ERR_FILEREAD;
+
+	/* lay the file out as RIFF unless it has to be RF64 */
+	is64 = !memcmp(header, "RF64", 4) || !memcmp(header, "BW64", 4) || (remux->flags & DBMD_REMUX_RF64);
+	if (!error)
+		error = plan_layout(&list, remux, is64, 0, &layout);
+	if ( !error && !is64 && ((layout.size - CHUNK_HEADER_SIZE > MAX_CHUNK_SIZE) || (layout.data_size > MAX_CHUNK_SIZE)) )
+	{
+		result->promoted = 1;
+		error = plan_layout(&list, remux, 1, 1, &layout);
+	}
+
+	if (!error)
+	{
+		temp = (char *)malloc(strlen(output) + 8);
+		if (!temp)
+			error = DB_ERR_NOMEMORY;
+	}
+	if (!error)
+	{
+		/* a unique name, so an existing file is never overwritten and concurrent
+		 * remuxes to the same output do not share a temporary file */
+		sprintf(temp, "%s.XXXXXX", output);
+		copy.out_fd = mkstemp(temp);
+		if (copy.out_fd < 0)
+			error = DB_ERR_FILEWRITE;
+	}
+
+	if (!error)
+	{
+		if (layout.is64)
+		{
+			memcpy(header, memcmp(header, "BW64", 4) ? "RF64" : "BW64", 4);
+			dbmd_put_le(header + 4, RF64_INDICATION, 4);
+		}
+		else
+		{
+			memcpy(header, "RIFF", 4);
+			dbmd_put_le(header + 4, layout.size - CHUNK_HEADER_SIZE, 4);
+		}
+		if (dbmd_write_all(copy.out_fd, header, sizeof(header), 0))
+			error = DB_ERR_FILEWRITE;
+		else
+			result->bytes_written += sizeof(header);
+	}
+
+	for (i = 0; !error && (i < layout.count); i++)
+	{
+		if ( layout.is64 && !memcmp(layout.chunks[i].id, "ds64", 4) )
+		{
+			/* the sizes of the new layout, and no table of other chunk sizes */
+			dbmd_put_le(ds64_payload, layout.size - CHUNK_HEADER_SIZE, 8);
+			dbmd_put_le(ds64_payload + 8, layout.data_size, 8);
+			dbmd_put_le(ds64_payload + 16, sample_count(copy.in_fd, &list, layout.data_size), 8);
+			dbmd_put_le(ds64_payload + 24, 0, 4);
+			ds64 = layout.chunks[i];
+			ds64.payload = ds64_payload;
+			error = write_chunk(&copy, &ds64, 1);
+		}
+		else
+			error = write_chunk(&copy, &layout.chunks[i], layout.is64);
+	}
+
+	/* the owner is set first, as changing it clears the set-user-ID bit; only a
+	 * file replaced in place must keep it, a new output may belong to the caller */
+	if ( !error && fchown(copy.out_fd, st.st_uid, st.st_gid) && (output == input) )
+		error = DB_ERR_FILEWRITE;
+	if (!error)
+	{
+		if ( fchmod(copy.out_fd, st.st_mode & 07777) || fsync(copy.out_fd) )
+			error = DB_ERR_FILEWRITE;
+	}
+	if ( (copy.out_fd >= 0) && close(copy.out_fd) && !error )
+		error = DB_ERR_FILEWRITE;
+	if ( !error && rename(temp, output) )
+		error = DB_ERR_FILEWRITE;
+	if ( error && (copy.out_fd >= 0) )
+		unlink(temp);
+
+	close(copy.in_fd);
+	free(copy.buffer);
+	free(temp);
+	free(layout.chunks);
+	dbmd_chunklist_free(&list);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int check_dbmd(...)
+-Purpose:
+	Parses a replacement dbmd chunk, so that a chunk the parser would reject is
+	not written
+********************************************************************************************/
+static int check_dbmd(const DBMDRemux *remux)
+{
+	DBMetadata metadata;
+	int error;
+
+	if (!remux->dbmd)
+		return DB_ERR_OK;
+	if (!remux->dbmd_len)
+		return DB_ERR_CHUNKSIZE;
+	if (remux->dbmd_len > INT32_MAX)
+		return DB_ERR_DBMDSIZE;
+
+	memset(&metadata, 0, sizeof(metadata));
+	error = parse_dbmd_metadata((char *)remux->dbmd, (int)remux->dbmd_len, &metadata);
+	dbmd_objects_free(&metadata.DolbyAtmosSupSeg.objects);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int plan_layout(...)
+-Purpose:
+	Works out the chunks of the output and their offsets. The ds64 chunk of an
+	RF64/BW64 output follows the header; that of the input is dropped, as is the
+	JUNK chunk a RIFF file reserves for it when the file is promoted. Replacement
+	chunks not found before the data chunk are placed before it, and a JUNK
+	chunk before it gives its payload the input offset modulo DBMD_REMUX_ALIGN,
+	replacing any JUNK chunk the input had there.
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int plan_layout(const DBMDChunkList *list, const DBMDRemux *remux, int is64, int promote, RemuxLayout *layout)
+{
+	const DBMDChunk *chunk;
+	int has_dbmd = 0;
+	int has_axml = 0;
+	uint64_t gap;
+	size_t i;
+
+	free(layout->chunks);
+	memset(layout, 0, sizeof(RemuxLayout));
+	layout->chunks = (RemuxChunk *)malloc((list->count + 4) * sizeof(RemuxChunk));
+	if (!layout->chunks)
+		return DB_ERR_NOMEMORY;
+	layout->is64 = is64;
+	layout->size = RIFF_HEADER_SIZE;
+
+	if (is64)
+		add_chunk(layout, "ds64", REMUX_FROM_BUFFER, DS64_SIZE, 0, NULL);
+
+	for (i = 0; i < list->count; i++)
+	{
+		chunk = &list->chunks[i];
+
+		if (!memcmp(chunk->id, "ds64", 4))
+			continue;
+		if ( promote && (chunk->offset == RIFF_HEADER_SIZE) && !memcmp(chunk->id, "JUNK", 4) )
+			continue;
+		if ( !memcmp(chunk->id, "JUNK", 4) && (i + 1 < list->count) && !memcmp(list->chunks[i + 1].id, "data", 4) )
+			continue;
+
+		if (!memcmp(chunk->id, "data", 4))
+		{
+			if ( remux->dbmd && !has_dbmd )
+				add_chunk(layout, "dbmd", REMUX_FROM_BUFFER, remux->dbmd_len, 0, remux->dbmd);
+			if ( remux->axml && !has_axml )
+				add_chunk(layout, "axml", REMUX_FROM_BUFFER, remux->axml_len, 0, remux->axml);
+			has_dbmd = has_axml = 1;
+
+			/* a JUNK chunk needs room for its header and a non-zero payload */
+			gap = (chunk->offset - layout->size) % DBMD_REMUX_ALIGN;
+			if ( (chunk->size >= DBMD_REMUX_ALIGN) && gap && !(gap % 2) )
+			{
+				if (gap <= CHUNK_HEADER_SIZE)
+					gap += DBMD_REMUX_ALIGN;
+				add_chunk(layout, "JUNK", REMUX_FROM_BUFFER, gap - CHUNK_HEADER_SIZE, 0, junk);
+			}
+			layout->data_size = chunk->size;
+		}
+		else if (chunk->size > MAX_CHUNK_SIZE)
+			return DB_ERR_NOTSUPPORTED;
+
+		if ( remux->dbmd && !memcmp(chunk->id, "dbmd", 4) )
+		{
+			if (!has_dbmd)
+				add_chunk(layout, "dbmd", REMUX_FROM_BUFFER, remux->dbmd_len, 0, remux->dbmd);
+			has_dbmd = 1;
+		}
+		else if ( remux->axml && !memcmp(chunk->id, "axml", 4) )
+		{
+			if (!has_axml)
+				add_chunk(layout, "axml", REMUX_FROM_BUFFER, remux->axml_len, 0, remux->axml);
+			has_axml = 1;
+		}
+		else
+			add_chunk(layout, chunk->id, REMUX_FROM_INPUT, chunk->size, chunk->offset + CHUNK_HEADER_SIZE, NULL);
+	}
+
+	if ( remux->dbmd && !has_dbmd )
+		add_chunk(layout, "dbmd", REMUX_FROM_BUFFER, remux->dbmd_len, 0, remux->dbmd);
+	if ( remux->axml && !has_axml )
+		add_chunk(layout, "axml", REMUX_FROM_BUFFER, remux->axml_len, 0, remux->axml);
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static void add_chunk(...)
+-Purpose:
+	Appends a chunk to the output layout
+********************************************************************************************/
+static void add_chunk(RemuxLayout *layout, const char *id, int from, uint64_t size, uint64_t in_offset, const unsigned char *payload)
+{
+	RemuxChunk *chunk = &layout->chunks[layout->count++];
+
+	memcpy(chunk->id, id, 4);
+	chunk->from = from;
+	chunk->size = size;
+	chunk->in_offset = in_offset;
+	chunk->payload = payload;
+	chunk->offset = layout->size;
+	layout->size += CHUNK_HEADER_SIZE + size + (size % 2);
+}
+
+/*******************************************************************************************
+static uint64_t sample_count(...)
+-Purpose:
+	Returns the sample count for the ds64 chunk: that of the input ds64 chunk, or
+	else the data size divided by the block alignment of the fmt chunk
+********************************************************************************************/
+static uint64_t sample_count(int fd, const DBMDChunkList *list, uint64_t data_size)
+{
+	unsigned char buf[8];
+	size_t i;
+
+	for (i = 0; i < list->count; i++)
+	{
+		if ( !memcmp(list->chunks[i].id, "ds64", 4) && (list->chunks[i].size >= 24) &&
+		     !dbmd_read_all(fd, buf, 8, list->chunks[i].offset + CHUNK_HEADER_SIZE + 16) )
+			return dbmd_get_le(buf, 8);
+	}
+	for (i = 0; i < list->count; i++)
+	{
+		if ( !memcmp(list->chunks[i].id, "fmt ", 4) && (list->chunks[i].size >= 14) &&
+		     !dbmd_read_all(fd, buf, 2, list->chunks[i].offset + CHUNK_HEADER_SIZE + 12) && dbmd_get_le(buf, 2) )
+			return data_size / dbmd_get_le(buf, 2);
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int write_chunk(...)
+-Purpose:
+	Writes one chunk of the output: its header, its payload from the input or a
+	buffer, and the pad byte of an odd sized payload. The data chunk of an
+	RF64/BW64 file has its size in the ds64 chunk.
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int write_chunk(RemuxCopy *copy, const RemuxChunk *chunk, int is64)
+{
+	unsigned char header[CHUNK_HEADER_SIZE];
+	uint64_t payload = chunk->offset + CHUNK_HEADER_SIZE;
+	int error;
+
+	memcpy(header, chunk->id, 4);
+	if ( is64 && !memcmp(chunk->id, "data", 4) )
+		dbmd_put_le(header + 4, RF64_INDICATION, 4);
+	else
+		dbmd_put_le(header + 4, chunk->size, 4);
+	if (dbmd_write_all(copy->out_fd, header, sizeof(header), chunk->offset))
+		return DB_ERR_FILEWRITE;
+	copy->result->bytes_written += sizeof(header);
+
+	if (chunk->from == REMUX_FROM_INPUT)
+	{
+		error = copy_range(copy, chunk->in_offset, payload, chunk->size);
+		if (error)
+			return error;
+	}
+	else
+	{
+		if (dbmd_write_all(copy->out_fd, chunk->payload, (size_t)chunk->size, payload))
+			return DB_ERR_FILEWRITE;
+		copy->result->bytes_written += chunk->size;
+	}
+
+	if (chunk->size % 2)
+	{
+		if (dbmd_write_all(copy->out_fd, junk, 1, payload + chunk->size))
+			return DB_ERR_FILEWRITE;
+		copy->result->bytes_written++;
+	}
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int copy_range(...)
+-Purpose:
+	Carries a range of the input across to the output. Where both offsets are at
+	the same place within a block, the whole blocks are cloned and only the
+	partial blocks at either end are copied.
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int copy_range(RemuxCopy *copy, uint64_t in_offset, uint64_t out_offset, uint64_t len)
+{
+	uint64_t head;
+	uint64_t body;
+	int error;
+
+	if ( !copy->no_clone && (len >= DBMD_REMUX_ALIGN) &&
+	     (in_offset % DBMD_REMUX_ALIGN == out_offset % DBMD_REMUX_ALIGN) )
+	{
+		head = (DBMD_REMUX_ALIGN - in_offset % DBMD_REMUX_ALIGN) % DBMD_REMUX_ALIGN;
+		body = (len - head) / DBMD_REMUX_ALIGN * DBMD_REMUX_ALIGN;
+
+		/* the output must end where the clone starts */
+		error = copy_bytes(copy, in_offset, out_offset, head);
+		if (error)
+			return error;
+		in_offset += head;
+		out_offset += head;
+		len -= head;
+
+		if ( body && !clone_blocks(copy, in_offset, out_offset, body) )
+		{
+			copy->result->bytes_cloned += body;
+			in_offset += body;
+			out_offset += body;
+			len -= body;
+		}
+		else
+			copy->no_clone = 1;
+	}
+
+	return copy_bytes(copy, in_offset, out_offset, len);
+}
+
+/*******************************************************************************************
+static int copy_bytes(...)
+-Purpose:
+	Copies a range of the input to the output with copy_file_range(), or through
+	a user space buffer once that has failed
+-Returns:
+	int				-	error code
+********************************************************************************************/
+static int copy_bytes(RemuxCopy *copy, uint64_t in_offset, uint64_t out_offset, uint64_t len)
+{
+	size_t n;
+
+#ifdef __NR_copy_file_range
+	while ( !copy->no_copy && (len > 0) )
+	{
+		loff_t in = (loff_t)in_offset;
+		loff_t out = (loff_t)out_offset;
+		long copied;
+
+		copied = syscall(__NR_copy_file_range, copy->in_fd, &in, copy->out_fd, &out,
+		                 (size_t)(len < MAX_COPY_LEN ? len : MAX_COPY_LEN), 0u);
+		if ( (copied < 0) && (errno == EINTR) )
+			continue;
+		if (copied == 0)
+			return DB_ERR_FILEREAD;
+		if (copied < 0)
+		{
+			/* not supported between these files; the rest goes through user space */
+			copy->no_copy = 1;
+			break;
+		}
+		copy->result->bytes_copied += (uint64_t)copied;
+		in_offset += (uint64_t)copied;
+		out_offset += (uint64_t)copied;
+		len -= (uint64_t)copied;
+	}
+#endif
+
+	if ( (len > 0) && !copy->buffer )
+	{
+		copy->buffer = (unsigned char *)malloc(COPY_BUFFER_SIZE);
+		if (!copy->buffer)
+			return DB_ERR_NOMEMORY;
+	}
+	while (len > 0)
+	{
+		n = (size_t)(len < COPY_BUFFER_SIZE ? len : COPY_BUFFER_SIZE);
+		if (dbmd_read_all(copy->in_fd, copy->buffer, n, in_offset))
+			return DB_ERR_FILEREAD;
+		if (dbmd_write_all(copy->out_fd, copy->buffer, n, out_offset))
+			return DB_ERR_FILEWRITE;
+		copy->result->bytes_written += n;
+		in_offset += n;
+		out_offset += n;
+		len -= n;
+	}
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int clone_blocks(...)
+-Purpose:
+	Makes a block aligned range of the output share the extents of the input
+-Returns:
+	int				-	0 on success, -1 if the filesystem does not clone
+********************************************************************************************/
+static int clone_blocks(RemuxCopy *copy, uint64_t in_offset, uint64_t out_offset, uint64_t len)
+{
+#ifdef FICLONERANGE
+	struct file_clone_range range;
+
+	range.src_fd = copy->in_fd;
+	range.src_offset = in_offset;
+	range.src_length = len;
+	range.dest_offset = out_offset;
+
+	return ioctl(copy->out_fd, FICLONERANGE, &range) ? -1 : 0;
+#else
+	(void)copy;
+	(void)in_offset;
+	(void)out_offset;
+	(void)len;
+	return -1;
+#endif
+}
+
+#else
+
+int dbmd_remux_file(const char *input, const char *output, const DBMDRemux *remux, DBMDRemuxResult *result)
+{
+	memset(result, 0, sizeof(DBMDRemuxResult));
+	return DB_ERR_NOTSUPPORTED;
+}
+
+#endif /* WIN32 */
@@ -0,0 +1,70 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_REMUX_H
+#define DBMD_REMUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dbmd_atmos_parse.h"
+
+/* This defines the rewriting of an ADM WAV file with a new dbmd or axml
+ *  chunk. A replacement that does not fit in place moves every chunk after
+ *  it, so the file is written again as a copy: a new header, ds64 chunk and
+ *  metadata chunks, and every other chunk carried across from the input. The
+ *  data chunk is placed at the same offset modulo DBMD_REMUX_ALIGN as in the
+ *  input, padded with a JUNK chunk, so that on a filesystem that shares
+ *  extents between files (XFS, Btrfs) its audio is cloned rather than copied.
+ *  Elsewhere it is copied by the kernel with copy_file_range(), and only
+ *  where that is not available either through user space.
+ *
+ *  The RIFF and ds64 sizes are recomputed for the new layout. A RIFF file
+ *  whose size reaches 4 GB is promoted to RF64; RF64 and BW64 files keep
+ *  their form. Only the data chunk may be larger than 4 GB.
+ */
+#define DBMD_REMUX_ALIGN 4096       /* Block size the data chunk is aligned to for cloning */
+
+/* DBMDRemux flags */
+#define DBMD_REMUX_RF64 0x01        /* Write an RF64 file even if it is smaller than 4 GB */
+
+typedef struct
+{
+	const unsigned char *dbmd;      /* New dbmd chunk payload, or NULL to keep */
+	size_t dbmd_len;
+	const unsigned char *axml;      /* New axml chunk payload, or NULL to keep */
+	size_t axml_len;
+	int flags;                      /* DBMD_REMUX_RF64 */
+} DBMDRemux;
+
+typedef struct
+{
+	uint64_t bytes_cloned;          /* Bytes sharing extents with the input */
+	uint64_t bytes_copied;          /* Bytes copied within the kernel */
+	uint64_t bytes_written;         /* Bytes written through user space */
+	int promoted;                   /* Set if a RIFF input was written as RF64 */
+} DBMDRemuxResult;
+
+int dbmd_remux_file(const char *input, const char *output, const DBMDRemux *remux, DBMDRemuxResult *result);
+
+#endif /* DBMD_REMUX_H */
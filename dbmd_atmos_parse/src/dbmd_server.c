@@ -0,0 +1,748 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifndef WIN32
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "dbmd_server.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_output.h"
+
+#ifndef WIN32
+
+/* Number of passed file descriptors a connection may hold before using them */
+#define SERVER_MAX_FDS 16
+
+/* Seconds a worker waits for a client to accept a response */
+#define SERVER_SEND_TIMEOUT 5
+
+#define SERVER_BACKLOG 128
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+/* A client connection. It is either idle and polled by the listener, or busy,
+ * that is queued for or being served by exactly one worker. */
+typedef struct
+{
+	int fd;                                /* Connected socket, -1 for a free slot */
+	int busy;                              /* Set while queued or being served */
+	int fds[SERVER_MAX_FDS];               /* Passed file descriptors not yet used */
+	int num_fds;                           /* Number of entries of fds */
+	size_t len;                            /* Number of bytes in request */
+	char request[DBMD_SERVER_MAX_REQUEST]; /* Partially received requests */
+} ServerClient;
+
+typedef struct
+{
+	DBMDBatchConfig config;     /* Scan configuration */
+	ServerClient *clients;      /* max_clients connection slots */
+	size_t max_clients;
+	size_t *queue;              /* Connections with input, waiting for a worker */
+	size_t queue_limit;
+	size_t queue_head;
+	int num_workers;
+	int stop;                   /* Set once the workers are to finish */
+	int wake[2];                /* Pipe waking the listener */
+	pthread_mutex_t lock;
+	pthread_cond_t ready;       /* Signalled when a connection is queued */
+	DBMDServerStats *stats;
+} DBMDServer;
+
+/* Worker thread and its parse context */
+typedef struct
+{
+	DBMDServer *server;
+	pthread_t thread;
+	DBMDContext ctx;
+	DBMDOutput output;
+} ServerWorker;
+
+static volatile sig_atomic_t server_stop = 0;
+static int server_wake_fd = -1;
+
+/* Local function prototypes */
+static void server_signal(int sig);
+static void wake_listener(DBMDServer *server);
+static uint64_t now_us(void);
+static int open_socket(const char *socket_path, FILE *report);
+static void accept_clients(DBMDServer *server, int listen_fd);
+static void close_client(ServerClient *client);
+static int send_all(int fd, const char *buf, size_t len);
+static void format_stats(DBMDServer *server, DBMDOutput *output);
+static int serve_request(ServerWorker *worker, ServerClient *client, char *line);
+static int serve_client(ServerWorker *worker, ServerClient *client);
+static void *server_worker(void *arg);
+
+/*******************************************************************************************
+static void server_signal(...)
+-Purpose:
+	SIGINT and SIGTERM handler, stops the server
+********************************************************************************************/
+static void server_signal(int sig)
+{
+	(void)sig;
+	server_stop = 1;
+	if (write(server_wake_fd, "s", 1) < 0)
+		return;
+}
+
+/*******************************************************************************************
+static void wake_listener(...)
+-Purpose:
+	Makes the listener rebuild its poll set, once a connection is idle again
+********************************************************************************************/
+static void wake_listener(DBMDServer *server)
+{
+	if (write(server->wake[1], "w", 1) < 0)
+		return; /* the pipe is full, so the listener wakes anyway */
+}
+
+/*******************************************************************************************
+static uint64_t now_us(...)
+-Purpose:
+	Returns the monotonic clock in microseconds
+********************************************************************************************/
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/*******************************************************************************************
+static int open_socket(...)
+-Purpose:
+	Creates the listening socket. A socket file left behind by a server that is
+	no longer running is replaced, one in use by a running server is not.
+-Returns:
+	int				-	listening socket, -1 on error
+********************************************************************************************/
+static int open_socket(const char *socket_path, FILE *report)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+	{
+		fprintf(report, "\nError, socket path %s is too long!\n", socket_path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	if ( (lstat(socket_path, &st) == 0) && S_ISSOCK(st.st_mode) )
+	{
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+		{
+			fprintf(report, "\nError, a server is already listening on %s!\n", socket_path);
+			close(fd);
+			return -1;
+		}
+		close(fd);
+		unlink(socket_path);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+	}
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if ( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SERVER_BACKLOG) )
+	{
+		fprintf(report, "\nError, cannot listen on %s: %s\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*******************************************************************************************
+static void accept_clients(...)
+-Purpose:
+	Accepts pending connections into free connection slots
+********************************************************************************************/
+static void accept_clients(DBMDServer *server, int listen_fd)
+{
+	struct timeval timeout;
+	ServerClient *client;
+	size_t i = 0;
+	int fd;
+
+	timeout.tv_sec = SERVER_SEND_TIMEOUT;
+	timeout.tv_usec = 0;
+
+	pthread_mutex_lock(&server->lock);
+	while (server->stats->num_clients < server->max_clients)
+	{
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0)
+			break;
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		while (server->clients[i].fd >= 0)
+			i++;
+		client = &server->clients[i];
+		client->fd = fd;
+		client->busy = 0;
+		client->num_fds = 0;
+		client->len = 0;
+		server->stats->num_clients++;
+		server->stats->num_connections++;
+	}
+	pthread_mutex_unlock(&server->lock);
+}
+
+/*******************************************************************************************
+static void close_client(...)
+-Purpose:
+	Closes a connection and any file descriptors passed on it but not used
+********************************************************************************************/
+static void close_client(ServerClient *client)
+{
+	int i;
+
+	for (i = 0; i < client->num_fds; i++)
+		close(client->fds[i]);
+	client->num_fds = 0;
+	close(client->fd);
+	client->fd = -1;
+}
+
+/*******************************************************************************************
+static int send_all(...)
+-Purpose:
+	Sends a response in full
+-Returns:
+	int				-	0 on success, -1 if the client is gone or not reading
+********************************************************************************************/
+static int send_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len)
+	{
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void format_stats(...)
+-Purpose:
+	Renders the server statistics as a JSON line
+********************************************************************************************/
+static void format_stats(DBMDServer *server, DBMDOutput *output)
+{
+	DBMDServerStats stats;
+
+	pthread_mutex_lock(&server->lock);
+	stats = *server->stats;
+	pthread_mutex_unlock(&server->lock);
+
+	dbmd_output_printf(output, "{\"connections\":%llu,\"requests\":%llu,\"failed\":%llu,\"bad_requests\":%llu,",
+		(unsigned long long)stats.num_connections,
+		(unsigned long long)stats.num_requests,
+		(unsigned long long)stats.num_failed,
+		(unsigned long long)stats.num_bad_requests);
+	dbmd_output_printf(output, "\"clients\":%lu,\"max_clients\":%lu,\"workers\":%d,",
+		(unsigned long)stats.num_clients,
+		(unsigned long)server->max_clients,
+		server->num_workers);
+	dbmd_output_printf(output, "\"queue_depth\":%lu,\"max_queue_depth\":%lu,\"queue_limit\":%lu,",
+		(unsigned long)stats.queue_depth,
+		(unsigned long)stats.max_queue_depth,
+		(unsigned long)server->queue_limit);
+	dbmd_output_printf(output, "\"mean_us\":%llu,\"max_us\":%llu}\n",
+		(unsigned long long)(stats.num_requests ? stats.total_us / stats.num_requests : 0),
+		(unsigned long long)stats.max_us);
+}
+
+/*******************************************************************************************
+static int serve_request(...)
+-Purpose:
+	Answers one request line
+-Returns:
+	int				-	0 if the response could not be sent, 1 otherwise
+********************************************************************************************/
+static int serve_request(ServerWorker *worker, ServerClient *client, char *line)
+{
+	DBMDServer *server = worker->server;
+	DBMDServerStats *stats = server->stats;
+	const char *bad_request = NULL;
+	const char *name;
+	uint64_t start = now_us();
+	uint64_t elapsed;
+	int parsed = 0;
+	int cached = 0;
+	int error = DB_ERR_OK;
+	int fd;
+
+	if (line[0] == '\0')
+		return 1;
+
+	dbmd_output_reset(&worker->output);
+	if ( !strncmp(line, "PARSE ", 6) && line[6] )
+	{
+		error = dbmd_batch_scan_file(&server->config, &worker->ctx, line + 6, -1, &worker->output, &cached);
+		parsed = 1;
+	}
+	else if ( !strcmp(line, "FD") || !strncmp(line, "FD ", 3) )
+	{
+		name = line[2] ? line + 3 : "-";
+		if (client->num_fds == 0)
+		{
+			bad_request = "no file descriptor passed";
+		}
+		else
+		{
+			fd = client->fds[0];
+			client->num_fds--;
+			memmove(client->fds, client->fds + 1, client->num_fds * sizeof(int));
+			error = dbmd_batch_scan_file(&server->config, &worker->ctx, name, fd, &worker->output, &cached);
+			parsed = 1;
+		}
+	}
+	else if (!strcmp(line, "STATS"))
+	{
+		format_stats(server, &worker->output);
+	}
+	else
+	{
+		bad_request = "unknown request";
+	}
+	if (bad_request)
+		dbmd_output_printf(&worker->output, "{\"request_error\":\"%s\"}\n", bad_request);
+	if (worker->output.error)
+	{
+		/* send an error rather than an incomplete result */
+		dbmd_output_reset(&worker->output);
+		dbmd_output_printf(&worker->output, "{\"request_error\":\"out of memory\"}\n");
+		error = DB_ERR_NOMEMORY;
+	}
+
+	elapsed = now_us() - start;
+	pthread_mutex_lock(&server->lock);
+	if (parsed)
+	{
+		stats->num_requests++;
+		if (error != DB_ERR_OK)
+			stats->num_failed++;
+		stats->total_us += elapsed;
+		if (elapsed > stats->max_us)
+			stats->max_us = elapsed;
+	}
+	if (bad_request)
+		stats->num_bad_requests++;
+	pthread_mutex_unlock(&server->lock);
+
+	return send_all(client->fd, worker->output.buf, worker->output.len) == 0;
+}
+
+/*******************************************************************************************
+static int serve_client(...)
+-Purpose:
+	Receives what a client has sent, keeping any file descriptors passed with it,
+	and answers every complete request line
+-Returns:
+	int				-	1 if the connection stays open, 0 if it is to be closed
+********************************************************************************************/
+static int serve_client(ServerWorker *worker, ServerClient *client)
+{
+	union
+	{
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int) * SERVER_MAX_FDS)];
+	} control;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char *line;
+	char *end;
+	size_t start;
+	ssize_t n;
+	int num_fds;
+	int fd;
+	int i;
+
+	iov.iov_base = client->request + client->len;
+	iov.iov_len = sizeof(client->request) - client->len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	n = recvmsg(client->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (n < 0)
+		return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if ( (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) )
+			continue;
+		num_fds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		for (i = 0; i < num_fds; i++)
+		{
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			if (client->num_fds < SERVER_MAX_FDS)
+				client->fds[client->num_fds++] = fd;
+			else
+				close(fd);
+		}
+	}
+	if (n == 0)
+		return 0;
+	client->len += (size_t)n;
+
+	start = 0;
+	while ( (end = memchr(client->request + start, '\n', client->len - start)) )
+	{
+		line = client->request + start;
+		*end = '\0';
+		if ( (end > line) && (end[-1] == '\r') )
+			end[-1] = '\0';
+		start = (size_t)(end - client->request) + 1;
+		if (!serve_request(worker, client, line))
+			return 0;
+	}
+	client->len -= start;
+	memmove(client->request, client->request + start, client->len);
+
+	if (client->len == sizeof(client->request))
+	{
+		dbmd_output_reset(&worker->output);
+		dbmd_output_printf(&worker->output, "{\"request_error\":\"request too long\"}\n");
+		send_all(client->fd, worker->output.buf, worker->output.len);
+		pthread_mutex_lock(&worker->server->lock);
+		worker->server->stats->num_bad_requests++;
+		pthread_mutex_unlock(&worker->server->lock);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*******************************************************************************************
+static void *server_worker(...)
+-Purpose:
+	Worker thread: serves queued connections until the server stops and the
+	queue is empty
+********************************************************************************************/
+static void *server_worker(void *arg)
+{
+	ServerWorker *worker = (ServerWorker *)arg;
+	DBMDServer *server = worker->server;
+	ServerClient *client;
+	size_t index;
+	int open;
+
+	pthread_mutex_lock(&server->lock);
+	for (;;)
+	{
+		while ( (server->stats->queue_depth == 0) && !server->stop )
+			pthread_cond_wait(&server->ready, &server->lock);
+		if (server->stats->queue_depth == 0)
+			break;
+		index = server->queue[server->queue_head];
+		server->queue_head = (server->queue_head + 1) % server->queue_limit;
+		server->stats->queue_depth--;
+		pthread_mutex_unlock(&server->lock);
+
+		client = &server->clients[index];
+		open = serve_client(worker, client);
+
+		pthread_mutex_lock(&server->lock);
+		if (!open)
+		{
+			close_client(client);
+			server->stats->num_clients--;
+		}
+		client->busy = 0;
+		wake_listener(server);
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	return NULL;
+}
+
+#endif /* WIN32 */
+
+/*******************************************************************************************
+int dbmd_server_run(...)
+-Purpose:
+	Listens on a Unix domain socket and answers parse requests on a pool of
+	worker threads until SIGINT or SIGTERM is received. Requests already
+	received are answered before returning, and the socket file is removed.
+-Inputs:
+	const char *socket_path			-	Socket file name
+	const DBMDBatchConfig *config	-	Scan configuration
+	const DBMDServerConfig *server	-	Number of workers and connection limits
+	FILE *report					-	Message stream
+	DBMDServerStats *stats			-	Server statistics
+-Returns:
+	int								-	0 on success, -1 on error
+********************************************************************************************/
+int dbmd_server_run(const char *socket_path, const DBMDBatchConfig *config, const DBMDServerConfig *server,
+	FILE *report, DBMDServerStats *stats)
+{
+#ifndef WIN32
+	DBMDServer s;
+	ServerWorker *workers;
+	struct sigaction action;
+	struct sigaction old_int;
+	struct sigaction old_term;
+	struct sigaction old_pipe;
+	struct pollfd *pfds;
+	size_t *slots;
+	size_t num_pfds;
+	size_t tail;
+	size_t i;
+	char drain[64];
+	int num_threads = 0;
+	int listen_fd;
+	int listening;
+
+	memset(stats, 0, sizeof(*stats));
+	memset(&s, 0, sizeof(s));
+	s.config = *config;
+	if (s.config.format == DBMD_FORMAT_TEXT)
+		s.config.format = DBMD_FORMAT_NDJSON;
+	s.max_clients = server->max_clients ? server->max_clients : DBMD_SERVER_MAX_CLIENTS;
+	s.queue_limit = server->queue_limit ? server->queue_limit : DBMD_SERVER_QUEUE_LIMIT;
+	s.num_workers = server->num_workers;
+	if (s.num_workers <= 0)
+		s.num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (s.num_workers <= 0)
+		s.num_workers = 1;
+	if (s.num_workers > DEFAULT_MAX_JOBS)
+		s.num_workers = DEFAULT_MAX_JOBS;
+	s.stats = stats;
+
+	listen_fd = open_socket(socket_path, report);
+	if (listen_fd < 0)
+		return -1;
+
+	s.clients = malloc(s.max_clients * sizeof(ServerClient));
+	s.queue = malloc(s.queue_limit * sizeof(size_t));
+	pfds = malloc((s.max_clients + 2) * sizeof(struct pollfd));
+	slots = malloc((s.max_clients + 2) * sizeof(size_t));
+	workers = malloc(s.num_workers * sizeof(ServerWorker));
+	if ( !s.clients || !s.queue || !pfds || !slots || !workers || pipe(s.wake) )
+	{
+		free(s.clients);
+		free(s.queue);
+		free(pfds);
+		free(slots);
+		free(workers);
+		close(listen_fd);
+		unlink(socket_path);
+		return -1;
+	}
+	for (i = 0; i < s.max_clients; i++)
+	{
+		s.clients[i].fd = -1;
+		s.clients[i].busy = 0;
+	}
+	for (i = 0; i < 2; i++)
+	{
+		fcntl(s.wake[i], F_SETFD, FD_CLOEXEC);
+		fcntl(s.wake[i], F_SETFL, fcntl(s.wake[i], F_GETFL) | O_NONBLOCK);
+	}
+
+	/* Clients that disconnect early must not terminate the server */
+	server_stop = 0;
+	server_wake_fd = s.wake[1];
+	memset(&action, 0, sizeof(action));
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, &old_pipe);
+	action.sa_handler = server_signal;
+	sigaction(SIGINT, &action, &old_int);
+	sigaction(SIGTERM, &action, &old_term);
+
+	pthread_mutex_init(&s.lock, NULL);
+	pthread_cond_init(&s.ready, NULL);
+	for (i = 0; i < (size_t)s.num_workers; i++)
+	{
+		workers[num_threads].server = &s;
+		dbmd_init(&workers[num_threads].ctx);
+		workers[num_threads].ctx.io_mode = config->io_mode;
+		workers[num_threads].ctx.tail_probe = config->tail_probe;
+		workers[num_threads].ctx.timing = (config->stats != NULL);
+		dbmd_output_init(&workers[num_threads].output);
+		if (pthread_create(&workers[num_threads].thread, NULL, server_worker, &workers[num_threads]) == 0)
+			num_threads++;
+		else
+		{
+			dbmd_output_free(&workers[num_threads].output);
+			dbmd_free(&workers[num_threads].ctx);
+		}
+	}
+	s.num_workers = num_threads;
+
+	fprintf(report, "Listening on %s with %d workers\n", socket_path, num_threads);
+	fflush(report);
+
+	/* Poll the listening socket while connection slots are free and the idle
+	 * connections while the queue has room, and queue those with input */
+	while ( !server_stop && num_threads )
+	{
+		num_pfds = 0;
+		pfds[num_pfds].fd = s.wake[0];
+		pfds[num_pfds++].events = POLLIN;
+
+		pthread_mutex_lock(&s.lock);
+		listening = stats->num_clients < s.max_clients;
+		if (listening)
+		{
+			pfds[num_pfds].fd = listen_fd;
+			pfds[num_pfds++].events = POLLIN;
+		}
+		for (i = 0; (i < s.max_clients) && (stats->queue_depth < s.queue_limit); i++)
+		{
+			if ( (s.clients[i].fd >= 0) && !s.clients[i].busy )
+			{
+				slots[num_pfds] = i;
+				pfds[num_pfds].fd = s.clients[i].fd;
+				pfds[num_pfds++].events = POLLIN;
+			}
+		}
+		pthread_mutex_unlock(&s.lock);
+
+		if (poll(pfds, (nfds_t)num_pfds, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(report, "\nError waiting for requests: %s\n", strerror(errno));
+			break;
+		}
+
+		if (pfds[0].revents)
+		{
+			while (read(s.wake[0], drain, sizeof(drain)) > 0)
+				;
+		}
+		if ( listening && pfds[1].revents )
+			accept_clients(&s, listen_fd);
+
+		pthread_mutex_lock(&s.lock);
+		for (i = listening ? 2 : 1; (i < num_pfds) && (stats->queue_depth < s.queue_limit); i++)
+		{
+			if (!pfds[i].revents)
+				continue;
+			s.clients[slots[i]].busy = 1;
+			tail = (s.queue_head + stats->queue_depth) % s.queue_limit;
+			s.queue[tail] = slots[i];
+			stats->queue_depth++;
+			if (stats->queue_depth > stats->max_queue_depth)
+				stats->max_queue_depth = stats->queue_depth;
+			pthread_cond_signal(&s.ready);
+		}
+		pthread_mutex_unlock(&s.lock);
+	}
+
+	/* answer what has been queued, then close every connection */
+	pthread_mutex_lock(&s.lock);
+	s.stop = 1;
+	pthread_cond_broadcast(&s.ready);
+	pthread_mutex_unlock(&s.lock);
+	for (i = 0; i < (size_t)num_threads; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		dbmd_output_free(&workers[i].output);
+		dbmd_free(&workers[i].ctx);
+	}
+	for (i = 0; i < s.max_clients; i++)
+	{
+		if (s.clients[i].fd >= 0)
+			close_client(&s.clients[i]);
+	}
+	stats->num_clients = 0;
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	sigaction(SIGPIPE, &old_pipe, NULL);
+	server_wake_fd = -1;
+	pthread_cond_destroy(&s.ready);
+	pthread_mutex_destroy(&s.lock);
+	close(listen_fd);
+	unlink(socket_path);
+	close(s.wake[0]);
+	close(s.wake[1]);
+	free(s.clients);
+	free(s.queue);
+	free(pfds);
+	free(slots);
+	free(workers);
+
+	return num_threads ? 0 : -1;
+#else
+	(void)socket_path;
+	(void)config;
+	(void)server;
+	(void)report;
+	(void)stats;
+	return -1;
+#endif
+}
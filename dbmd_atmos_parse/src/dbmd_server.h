@@ -0,0 +1,75 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_SERVER_H
+#define DBMD_SERVER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dbmd_batch.h"
+
+/* This defines the parse server. A resident process listens on a Unix domain
+ *  socket and answers parse requests from any number of clients with a pool of
+ *  worker threads, each keeping its parse context warm between requests.
+ *
+ *  Requests are text lines, answered in order on each connection:
+ *
+ *      PARSE <path>    parse the named file
+ *      FD [<name>]     parse the file descriptor passed with SCM_RIGHTS on the
+ *                      connection, reporting it as <name>
+ *      STATS           report the server statistics as a JSON line
+ *
+ *  A result is answered with one line of JSON, or one binary record if the
+ *  server runs with --format=binary. A request that cannot be understood is
+ *  answered with {"request_error":"<reason>"}.
+ */
+#define DBMD_SERVER_MAX_CLIENTS 256
+#define DBMD_SERVER_QUEUE_LIMIT 1024
+#define DBMD_SERVER_MAX_REQUEST 4096
+
+typedef struct
+{
+	int num_workers;    /* Number of worker threads, 0 selects one per CPU */
+	size_t max_clients; /* Maximum number of open connections */
+	size_t queue_limit; /* Maximum number of connections waiting for a worker */
+} DBMDServerConfig;
+
+typedef struct
+{
+	uint64_t num_connections;  /* Number of connections accepted */
+	uint64_t num_requests;     /* Number of files parsed */
+	uint64_t num_failed;       /* Number of files that could not be parsed */
+	uint64_t num_bad_requests; /* Number of requests that could not be understood */
+	size_t num_clients;        /* Number of open connections */
+	size_t queue_depth;        /* Number of connections waiting for a worker */
+	size_t max_queue_depth;    /* Largest number of connections that have waited for a worker */
+	uint64_t total_us;         /* Total time spent answering requests, in microseconds */
+	uint64_t max_us;           /* Longest time spent answering a request, in microseconds */
+} DBMDServerStats;
+
+int dbmd_server_run(const char *socket_path, const DBMDBatchConfig *config, const DBMDServerConfig *server,
+	FILE *report, DBMDServerStats *stats);
+
+#endif /* DBMD_SERVER_H */
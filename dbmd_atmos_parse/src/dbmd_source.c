@@ -0,0 +1,504 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifdef __linux__
+#define _GNU_SOURCE /* splice() */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <io.h>
+#endif
+
+#include "dbmd_atmos_parse.h"
+#include "dbmd_source.h"
+
+/* Size of the buffer used to discard skipped bytes of a stream */
+#define STREAM_DISCARD_BUFFER 0x100000
+
+/* Source reading a file descriptor, either with positioned reads or,
+ *  for pipes and other non-seekable input, strictly in order */
+typedef struct
+{
+	DBMDSource base;
+	int fd;                     /* Input file descriptor */
+	uint64_t pos;               /* Number of bytes consumed, when sequential */
+	unsigned char *discard_buf; /* Buffer receiving discarded bytes, allocated on first use */
+	int null_fd;                /* /dev/null, destination of spliced bytes */
+	int use_splice;             /* Cleared once splice() is found not to work for the input */
+} DBMDFileSource;
+
+/* Source reading a file mapped into memory */
+typedef struct
+{
+	DBMDSource base;
+	const unsigned char *map; /* Mapped input file */
+	uint64_t size;            /* Size of the mapped input file */
+} DBMDMapSource;
+
+/* Local function prototypes */
+static int64_t file_read_at(DBMDSource *source, void *buf, size_t len, uint64_t offset);
+static void file_close(DBMDSource *source);
+static uint64_t file_size(DBMDSource *source);
+static int64_t stream_read(DBMDFileSource *file, void *buf, size_t len);
+static int stream_discard(DBMDFileSource *file, uint64_t len);
+static int64_t map_read_at(DBMDSource *source, void *buf, size_t len, uint64_t offset);
+static const unsigned char *map_map_at(DBMDSource *source, uint64_t offset, size_t len);
+static void map_close(DBMDSource *source);
+static uint64_t map_size(DBMDSource *source);
+
+static const DBMDSourceOps file_source_ops = { file_read_at, NULL, file_close, file_size };
+static const DBMDSourceOps map_source_ops = { map_read_at, map_map_at, map_close, map_size };
+
+/*******************************************************************************************
+int dbmd_source_open_file(...)
+-Purpose:
+	Opens a local file as a source read with positioned reads. A pipe or other
+	non-seekable file is detected on the first read and then read in order.
+-Inputs:
+	DBMDSource **source		-	Receives the new source
+	const char *filename	-	Input file name
+	int sequential			-	Non-zero to read the file strictly in order
+-Returns:
+	int						-	error code
+********************************************************************************************/
+int dbmd_source_open_file(DBMDSource **source, const char *filename, int sequential)
+{
+	int fd;
+	int error;
+
+#ifndef WIN32
+	fd = open(filename, O_RDONLY);
+#else
+	fd = _open(filename, _O_RDONLY | _O_BINARY);
+#endif
+	if (fd < 0)
+		return DB_ERR_FILEOPEN;
+
+	if ( (error = dbmd_source_open_fd(source, fd, sequential)) )
+	{
+#ifndef WIN32
+		close(fd);
+#else
+		_close(fd);
+#endif
+	}
+
+	return error;
+}
+
+/*******************************************************************************************
+int dbmd_source_open_fd(...)
+-Purpose:
+	Creates a source reading an open file descriptor. The source takes ownership
+	of the descriptor and closes it when the source is closed.
+-Inputs:
+	DBMDSource **source	-	Receives the new source
+	int fd				-	Input file descriptor
+	int sequential		-	Non-zero to read the input strictly in order, as a pipe
+							always is
+-Returns:
+	int					-	error code
+********************************************************************************************/
+int dbmd_source_open_fd(DBMDSource **source, int fd, int sequential)
+{
+	DBMDFileSource *file;
+
+	file = malloc(sizeof(DBMDFileSource));
+	if (!file)
+		return DB_ERR_FILEOPEN;
+
+	memset(file, 0, sizeof(DBMDFileSource));
+	file->base.ops = &file_source_ops;
+	file->base.prefetch = DBMD_FILE_PREFETCH;
+	file->fd = fd;
+	file->base.sequential = sequential;
+#ifndef WIN32
+	/* a pipe or socket can only be read in order */
+	if ( !sequential && (lseek(fd, 0, SEEK_CUR) < 0) && (errno == ESPIPE) )
+		file->base.sequential = 1;
+#endif
+	file->null_fd = -1;
+	file->use_splice = 1;
+
+	*source = &file->base;
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+int dbmd_source_open_mmap(...)
+-Purpose:
+	Maps a local file into memory as a source. The walker reads chunk headers and
+	the dbmd chunk in place, so only the pages holding them are ever touched. A
+	pipe or device that cannot be mapped is opened for reading in order instead.
+-Inputs:
+	DBMDSource **source		-	Receives the new source
+	const char *filename	-	Input file name
+-Returns:
+	int						-	error code
+********************************************************************************************/
+int dbmd_source_open_mmap(DBMDSource **source, const char *filename)
+{
+#ifndef WIN32
+	DBMDMapSource *mapped;
+	struct stat st;
+	void *map;
+	int fd;
+	int error;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return DB_ERR_FILEOPEN;
+
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return DB_ERR_FILEOPEN;
+	}
+
+	/* non-seekable input is read sequentially */
+	if (!S_ISREG(st.st_mode))
+	{
+		if ( (error = dbmd_source_open_fd(source, fd, 1)) )
+			close(fd);
+		return error;
+	}
+
+	/* an empty file cannot be mapped and is not a WAV file either */
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return DB_ERR_NOTRIFF;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return DB_ERR_FILEREAD;
+
+	/* chunk headers are scattered, do not read ahead into the audio */
+	madvise(map, (size_t)st.st_size, MADV_RANDOM);
+
+	mapped = malloc(sizeof(DBMDMapSource));
+	if (!mapped)
+	{
+		munmap(map, (size_t)st.st_size);
+		return DB_ERR_FILEOPEN;
+	}
+
+	memset(mapped, 0, sizeof(DBMDMapSource));
+	mapped->base.ops = &map_source_ops;
+	mapped->base.prefetch = DBMD_FILE_PREFETCH;
+	mapped->map = (const unsigned char *)map;
+	mapped->size = (uint64_t)st.st_size;
+
+	*source = &mapped->base;
+	return DB_ERR_OK;
+#else
+	return DB_ERR_NOTSUPPORTED;
+#endif
+}
+
+/*******************************************************************************************
+void dbmd_source_close(...)
+-Purpose:
+	Closes a source of any type
+-Inputs:
+	DBMDSource *source	-	Source to close, may be NULL
+********************************************************************************************/
+void dbmd_source_close(DBMDSource *source)
+{
+	if (source)
+		source->ops->close(source);
+}
+
+/*******************************************************************************************
+static int64_t file_read_at(...)
+-Purpose:
+	Reads a range of a file. Positioned reads leave the file position alone, so no
+	seeks are needed between reads. Once the input is found to be a pipe, ranges
+	must be requested in increasing order and the bytes in between are discarded.
+********************************************************************************************/
+static int64_t file_read_at(DBMDSource *source, void *buf, size_t len, uint64_t offset)
+{
+	DBMDFileSource *file = (DBMDFileSource *)source;
+	int64_t n;
+
+	if (!source->sequential)
+	{
+#ifndef WIN32
+		/* a regular file only returns fewer bytes than requested at end of file */
+		do
+		{
+			source->read_count++;
+			n = pread(file->fd, buf, len, (off_t)offset);
+		} while ( (n < 0) && (errno == EINTR) );
+
+		if (n >= 0)
+		{
+			source->bytes_read += (uint64_t)n;
+			return n;
+		}
+		if ( (errno != ESPIPE) || (offset != 0) )
+			return DB_ERR_FILEREAD;
+
+		/* nothing has been consumed yet, continue as a stream */
+		source->sequential = 1;
+#else
+		source->read_count++;
+		if (_lseeki64(file->fd, (__int64)offset, SEEK_SET) < 0)
+			return DB_ERR_FILEREAD;
+		n = _read(file->fd, buf, (unsigned int)len);
+		if (n < 0)
+			return DB_ERR_FILEREAD;
+		source->bytes_read += (uint64_t)n;
+		return n;
+#endif
+	}
+
+	/* stream: skip forward to the requested offset, then read */
+	if (offset < file->pos)
+		return DB_ERR_NOTSEEKABLE;
+	if (stream_discard(file, offset - file->pos))
+		return 0;
+
+	return stream_read(file, buf, len);
+}
+
+/*******************************************************************************************
+static void file_close(...)
+-Purpose:
+	Closes a file source
+********************************************************************************************/
+static void file_close(DBMDSource *source)
+{
+	DBMDFileSource *file = (DBMDFileSource *)source;
+
+#ifndef WIN32
+	if (file->null_fd >= 0)
+		close(file->null_fd);
+	close(file->fd);
+#else
+	_close(file->fd);
+#endif
+	free(file->discard_buf);
+	free(file);
+}
+
+/*******************************************************************************************
+static uint64_t file_size(...)
+-Purpose:
+	Returns the size of a regular file read with positioned reads. The size of a
+	stream is not known.
+********************************************************************************************/
+static uint64_t file_size(DBMDSource *source)
+{
+	DBMDFileSource *file = (DBMDFileSource *)source;
+#ifndef WIN32
+	struct stat st;
+
+	if ( source->sequential || fstat(file->fd, &st) || !S_ISREG(st.st_mode) )
+		return 0;
+	return (uint64_t)st.st_size;
+#else
+	struct _stati64 st;
+
+	if ( source->sequential || _fstati64(file->fd, &st) )
+		return 0;
+	return (uint64_t)st.st_size;
+#endif
+}
+
+/*******************************************************************************************
+static int64_t stream_read(...)
+-Purpose:
+	Reads exactly len bytes from a stream, fewer only at end of input
+-Returns:
+	int64_t			-	number of bytes read
+********************************************************************************************/
+static int64_t stream_read(DBMDFileSource *file, void *buf, size_t len)
+{
+	size_t total = 0;
+#ifndef WIN32
+	ssize_t n;
+#else
+	int n;
+#endif
+
+	while (total < len)
+	{
+		file->base.read_count++;
+#ifndef WIN32
+		n = read(file->fd, (char *)buf + total, len - total);
+		if ( (n < 0) && (errno == EINTR) )
+			continue;
+#else
+		n = _read(file->fd, (char *)buf + total, (unsigned int)(len - total));
+#endif
+		if (n <= 0)
+			break;
+		total += (size_t)n;
+	}
+
+	file->pos += total;
+	file->base.bytes_read += total;
+	return (int64_t)total;
+}
+
+/*******************************************************************************************
+static int stream_discard(...)
+-Purpose:
+	Skips len bytes of a stream. Where the platform allows it, the bytes are
+	spliced from the input pipe to /dev/null without being copied to user space.
+	Otherwise they are read into a reusable buffer, using reads that are aligned
+	to the buffer size relative to the start of the stream.
+-Returns:
+	int				-	0 on success, -1 at end of input
+********************************************************************************************/
+static int stream_discard(DBMDFileSource *file, uint64_t len)
+{
+	size_t chunk;
+	int64_t n;
+
+#ifdef __linux__
+	if ( (len > 0) && file->use_splice && (file->null_fd < 0) )
+	{
+		file->null_fd = open("/dev/null", O_WRONLY);
+		if (file->null_fd < 0)
+			file->use_splice = 0;
+	}
+
+	while ( (len > 0) && file->use_splice )
+	{
+		chunk = (len > STREAM_DISCARD_BUFFER) ? STREAM_DISCARD_BUFFER : (size_t)len;
+		file->base.read_count++;
+		n = splice(file->fd, NULL, file->null_fd, NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n < 0)
+		{
+			/* input is not a pipe, read it instead */
+			if (errno != EINTR)
+				file->use_splice = 0;
+			continue;
+		}
+		if (n == 0)
+			return -1;
+		file->pos += (uint64_t)n;
+		len -= (uint64_t)n;
+	}
+#endif
+
+	if ( (len > 0) && !file->discard_buf )
+	{
+#ifndef WIN32
+		if (posix_memalign((void **)&file->discard_buf, DBMD_FILE_PREFETCH, STREAM_DISCARD_BUFFER))
+			file->discard_buf = NULL;
+#else
+		file->discard_buf = malloc(STREAM_DISCARD_BUFFER);
+#endif
+		if (!file->discard_buf)
+			return -1;
+	}
+
+	while (len > 0)
+	{
+		/* keep reads aligned to the buffer size */
+		chunk = STREAM_DISCARD_BUFFER - (size_t)(file->pos % STREAM_DISCARD_BUFFER);
+		if (chunk > len)
+			chunk = (size_t)len;
+
+		n = stream_read(file, file->discard_buf, chunk);
+		if ((size_t)n != chunk)
+			return -1;
+		len -= (uint64_t)n;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int64_t map_read_at(...)
+-Purpose:
+	Copies a range of a mapped file
+********************************************************************************************/
+static int64_t map_read_at(DBMDSource *source, void *buf, size_t len, uint64_t offset)
+{
+	DBMDMapSource *mapped = (DBMDMapSource *)source;
+
+	if (offset >= mapped->size)
+		return 0;
+	if (len > mapped->size - offset)
+		len = (size_t)(mapped->size - offset);
+
+	memcpy(buf, mapped->map + offset, len);
+	return (int64_t)len;
+}
+
+/*******************************************************************************************
+static const unsigned char *map_map_at(...)
+-Purpose:
+	Returns a pointer to a range of a mapped file without copying it
+********************************************************************************************/
+static const unsigned char *map_map_at(DBMDSource *source, uint64_t offset, size_t len)
+{
+	DBMDMapSource *mapped = (DBMDMapSource *)source;
+
+	if ( (offset > mapped->size) || (len > mapped->size - offset) )
+		return NULL;
+
+	return mapped->map + offset;
+}
+
+/*******************************************************************************************
+static void map_close(...)
+-Purpose:
+	Unmaps a mapped file source
+********************************************************************************************/
+static void map_close(DBMDSource *source)
+{
+	DBMDMapSource *mapped = (DBMDMapSource *)source;
+
+#ifndef WIN32
+	munmap((void *)mapped->map, (size_t)mapped->size);
+#endif
+	free(mapped);
+}
+
+/*******************************************************************************************
+static uint64_t map_size(...)
+-Purpose:
+	Returns the size of a mapped file
+********************************************************************************************/
+static uint64_t map_size(DBMDSource *source)
+{
+	return ((DBMDMapSource *)source)->size;
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_SOURCE_H
+#define DBMD_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This defines the byte-range input interface used by the chunk walker.
+ *  A source only has to read a range of bytes at an absolute offset; the
+ *  walker takes care of prefetching and coalescing the small reads it needs.
+ *  Applications may supply their own source by embedding a DBMDSource as the
+ *  first member of their structure and attaching it with dbmd_attach().
+ */
+#define DBMD_FILE_PREFETCH 4096   /* Minimum read size for local files */
+#define DBMD_HTTP_PREFETCH 65536  /* Minimum read size for HTTP requests */
+#define DBMD_MAX_PREFETCH 65536   /* Largest prefetch size supported by the walker */
+
+typedef struct DBMDSource DBMDSource;
+
+typedef struct
+{
+	/* Reads up to len bytes at offset. Returns the number of bytes read, which is
+	   less than len only at the end of the input, or a negative DB_ERR_ code. */
+	int64_t (*read_at)(DBMDSource *source, void *buf, size_t len, uint64_t offset);
+
+	/* Optional. Returns a pointer to len bytes at offset that stays valid until the
+	   source is closed, or NULL if the range is not within the input. */
+	const unsigned char *(*map_at)(DBMDSource *source, uint64_t offset, size_t len);
+
+	/* Releases the source and everything it holds */
+	void (*close)(DBMDSource *source);
+	/* Optional. Returns the size of the input in bytes, or 0 if it is not known,
+	   for example for a stream or before the first read of a URL. */
+	uint64_t (*size)(DBMDSource *source);
+} DBMDSourceOps;
+
+struct DBMDSource
+{
+	const DBMDSourceOps *ops;
+	size_t prefetch;          /* Minimum number of bytes to fetch per read */
+	unsigned long read_count; /* Number of reads issued */
+	uint64_t bytes_read;      /* Number of bytes fetched */
+	int sequential;           /* Set when ranges must be read in increasing order */
+};
+
+int dbmd_source_open_file(DBMDSource **source, const char *filename, int sequential);
+int dbmd_source_open_fd(DBMDSource **source, int fd, int sequential);
+int dbmd_source_open_mmap(DBMDSource **source, const char *filename);
+int dbmd_source_open_http(DBMDSource **source, const char *url);
+int dbmd_source_is_url(const char *name);
+void dbmd_source_close(DBMDSource *source);
+
+#endif /* DBMD_SOURCE_H */
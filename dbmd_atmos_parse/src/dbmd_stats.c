@@ -0,0 +1,411 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dbmd_stats.h"
+
+/* Suffix of the file an export is written to before it replaces the old one */
+#define EXPORT_TMP_SUFFIX ".tmp"
+
+/* Phase names, as used in the report and the exported labels */
+const char *const dbmd_phase_names[DBMD_NUM_PHASES] =
+{
+	"open",
+	"walk",
+	"dbmd_read",
+	"checksum",
+	"decode",
+	"axml",
+	"output"
+};
+
+/* Local function prototypes */
+static void histogram_add(DBMDHistogram *hist, uint64_t ns);
+static uint64_t histogram_quantile(const DBMDHistogram *hist, double q);
+static void snapshot(DBMDRunStats *stats, DBMDRunStats *snap);
+static void report_row(FILE *fp, const char *name, const DBMDHistogram *hist);
+static void export_histogram(FILE *fp, const char *name, const char *label, const DBMDHistogram *hist);
+
+/*******************************************************************************************
+void dbmd_stats_init(...)
+-Purpose:
+	Initializes empty run statistics
+-Inputs:
+	DBMDRunStats *stats		-	Run statistics
+	const char *export_path	-	Prometheus textfile to keep up to date, NULL for none
+********************************************************************************************/
+void dbmd_stats_init(DBMDRunStats *stats, const char *export_path)
+{
+	memset(stats, 0, sizeof(DBMDRunStats));
+	stats->export_path = export_path;
+	stats->last_export_ns = dbmd_clock_ns();
+#ifndef WIN32
+	pthread_mutex_init(&stats->lock, NULL);
+#endif
+}
+
+/*******************************************************************************************
+void dbmd_stats_add(...)
+-Purpose:
+	Adds the cost of one scan to the run statistics. Phases the scan did not go
+	through, such as the decode of a file answered from the cache, are left out
+	of their histograms. With an export path set, the export is rewritten once
+	DBMD_STATS_EXPORT_INTERVAL_MS has passed since the last one. May be called
+	from any thread.
+-Inputs:
+	DBMDRunStats *stats			-	Run statistics
+	const DBMDScanStats *scan	-	Phase timings and counters of the scan
+	unsigned long read_count	-	Number of reads issued by the scan
+	uint64_t bytes_read			-	Number of bytes fetched by the scan
+	int error					-	error code of the scan
+********************************************************************************************/
+void dbmd_stats_add(DBMDRunStats *stats, const DBMDScanStats *scan, unsigned long read_count, uint64_t bytes_read, int error)
+{
+	uint64_t total_ns = 0;
+	uint64_t now;
+	int export = 0;
+	int i;
+
+#ifndef WIN32
+	pthread_mutex_lock(&stats->lock);
+#endif
+	for (i = 0; i < DBMD_NUM_PHASES; i++)
+	{
+		if (scan->phase_ns[i])
+			histogram_add(&stats->phases[i], scan->phase_ns[i]);
+		total_ns += scan->phase_ns[i];
+	}
+	histogram_add(&stats->total, total_ns);
+
+	stats->num_files++;
+	if (error)
+		stats->num_failed++;
+	stats->num_reads += read_count;
+	stats->num_bytes += bytes_read;
+	stats->num_seeks += scan->seeks;
+	stats->num_chunks_skipped += scan->chunks_skipped;
+
+	/* claim the export under the lock so that only one thread writes it */
+	if (stats->export_path)
+	{
+		now = dbmd_clock_ns();
+		if (now - stats->last_export_ns >= (uint64_t)DBMD_STATS_EXPORT_INTERVAL_MS * 1000000u)
+		{
+			stats->last_export_ns = now;
+			export = 1;
+		}
+	}
+#ifndef WIN32
+	pthread_mutex_unlock(&stats->lock);
+#endif
+
+	if (export)
+		dbmd_stats_export(stats, stats->export_path);
+}
+
+/*******************************************************************************************
+void dbmd_stats_report(...)
+-Purpose:
+	Writes the run statistics as a table of the mean, median, 90th and 99th
+	percentile and maximum time spent per phase, followed by the I/O counters.
+	Percentiles are interpolated within the histogram buckets they fall in.
+-Inputs:
+	DBMDRunStats *stats	-	Run statistics
+	FILE *fp			-	Output stream
+********************************************************************************************/
+void dbmd_stats_report(DBMDRunStats *stats, FILE *fp)
+{
+	DBMDRunStats snap;
+	int i;
+
+	snapshot(stats, &snap);
+
+	fprintf(fp, "\nScan timings over %llu files:\n", (unsigned long long)snap.num_files);
+	fprintf(fp, "  %-10s %8s %10s %10s %10s %10s %10s\n", "phase", "files", "mean", "p50", "p90", "p99", "max");
+	for (i = 0; i < DBMD_NUM_PHASES; i++)
+		report_row(fp, dbmd_phase_names[i], &snap.phases[i]);
+	report_row(fp, "total", &snap.total);
+	fprintf(fp, "%llu reads issued, %llu bytes fetched, %llu seeks, %llu chunks skipped\n",
+		(unsigned long long)snap.num_reads,
+		(unsigned long long)snap.num_bytes,
+		(unsigned long long)snap.num_seeks,
+		(unsigned long long)snap.num_chunks_skipped);
+}
+
+/*******************************************************************************************
+int dbmd_stats_export(...)
+-Purpose:
+	Writes the run statistics in the Prometheus text exposition format. The file
+	is written under a temporary name and renamed over the old one, so that a
+	textfile collector reading it concurrently never sees a partial file.
+-Inputs:
+	DBMDRunStats *stats	-	Run statistics
+	const char *path	-	Output file name, normally ending in .prom
+-Returns:
+	int					-	0 on success, -1 if the file could not be written
+********************************************************************************************/
+int dbmd_stats_export(DBMDRunStats *stats, const char *path)
+{
+	DBMDRunStats snap;
+	char label[64];
+	char *tmp_path;
+	FILE *fp;
+	int error;
+	int i;
+
+	tmp_path = malloc(strlen(path) + sizeof(EXPORT_TMP_SUFFIX));
+	if (!tmp_path)
+		return -1;
+	sprintf(tmp_path, "%s%s", path, EXPORT_TMP_SUFFIX);
+
+	fp = fopen(tmp_path, "w");
+	if (!fp)
+	{
+		free(tmp_path);
+		return -1;
+	}
+
+	snapshot(stats, &snap);
+
+	fprintf(fp, "# HELP dbmd_files_total Files scanned, by result.\n");
+	fprintf(fp, "# TYPE dbmd_files_total counter\n");
+	fprintf(fp, "dbmd_files_total{result=\"parsed\"} %llu\n", (unsigned long long)(snap.num_files - snap.num_failed));
+	fprintf(fp, "dbmd_files_total{result=\"failed\"} %llu\n", (unsigned long long)snap.num_failed);
+	fprintf(fp, "# HELP dbmd_reads_total Reads issued.\n");
+	fprintf(fp, "# TYPE dbmd_reads_total counter\n");
+	fprintf(fp, "dbmd_reads_total %llu\n", (unsigned long long)snap.num_reads);
+	fprintf(fp, "# HELP dbmd_bytes_read_total Bytes fetched.\n");
+	fprintf(fp, "# TYPE dbmd_bytes_read_total counter\n");
+	fprintf(fp, "dbmd_bytes_read_total %llu\n", (unsigned long long)snap.num_bytes);
+	fprintf(fp, "# HELP dbmd_seeks_total Reads not continuing the previous read.\n");
+	fprintf(fp, "# TYPE dbmd_seeks_total counter\n");
+	fprintf(fp, "dbmd_seeks_total %llu\n", (unsigned long long)snap.num_seeks);
+	fprintf(fp, "# HELP dbmd_chunks_skipped_total Chunks jumped over without being read.\n");
+	fprintf(fp, "# TYPE dbmd_chunks_skipped_total counter\n");
+	fprintf(fp, "dbmd_chunks_skipped_total %llu\n", (unsigned long long)snap.num_chunks_skipped);
+
+	fprintf(fp, "# HELP dbmd_phase_duration_seconds Time spent per scan phase.\n");
+	fprintf(fp, "# TYPE dbmd_phase_duration_seconds histogram\n");
+	for (i = 0; i < DBMD_NUM_PHASES; i++)
+	{
+		sprintf(label, "phase=\"%s\"", dbmd_phase_names[i]);
+		export_histogram(fp, "dbmd_phase_duration_seconds", label, &snap.phases[i]);
+	}
+	fprintf(fp, "# HELP dbmd_scan_duration_seconds Time spent per file.\n");
+	fprintf(fp, "# TYPE dbmd_scan_duration_seconds histogram\n");
+	export_histogram(fp, "dbmd_scan_duration_seconds", NULL, &snap.total);
+
+	error = ferror(fp);
+	if (fclose(fp))
+		error = 1;
+#ifdef WIN32
+	/* rename() does not replace an existing file on Windows */
+	if (!error)
+		remove(path);
+#endif
+	if (error || rename(tmp_path, path))
+	{
+		remove(tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+
+	free(tmp_path);
+	return 0;
+}
+
+/*******************************************************************************************
+void dbmd_stats_free(...)
+-Purpose:
+	Releases the resources held by the run statistics
+-Inputs:
+	DBMDRunStats *stats	-	Run statistics
+********************************************************************************************/
+void dbmd_stats_free(DBMDRunStats *stats)
+{
+#ifndef WIN32
+	pthread_mutex_destroy(&stats->lock);
+#else
+	(void)stats;
+#endif
+}
+
+/*******************************************************************************************
+void dbmd_stats_duration(...)
+-Purpose:
+	Formats a duration with a unit suited to its size
+-Inputs:
+	char *buf		-	Receives the text
+	size_t size		-	Size of buf
+	uint64_t ns		-	Duration in nanoseconds
+********************************************************************************************/
+void dbmd_stats_duration(char *buf, size_t size, uint64_t ns)
+{
+	if (ns < 1000)
+		snprintf(buf, size, "%llu ns", (unsigned long long)ns);
+	else if (ns < 1000000)
+		snprintf(buf, size, "%.1f us", (double)ns / 1e3);
+	else if (ns < 1000000000)
+		snprintf(buf, size, "%.1f ms", (double)ns / 1e6);
+	else
+		snprintf(buf, size, "%.2f s", (double)ns / 1e9);
+}
+
+/*******************************************************************************************
+static void histogram_add(...)
+-Purpose:
+	Adds a value to a histogram. Bucket i holds the values below 2^(6 + i) ns
+	not held by the buckets before it.
+********************************************************************************************/
+static void histogram_add(DBMDHistogram *hist, uint64_t ns)
+{
+	int bucket = 0;
+
+	while ( (bucket < DBMD_STATS_BUCKETS) && (ns >= ((uint64_t)1 << (DBMD_STATS_MIN_BUCKET + bucket))) )
+		bucket++;
+
+	hist->counts[bucket]++;
+	hist->count++;
+	hist->sum_ns += ns;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+}
+
+/*******************************************************************************************
+static uint64_t histogram_quantile(...)
+-Purpose:
+	Estimates the q quantile of a histogram by linear interpolation within the
+	bucket it falls in, as Prometheus does, limited to the largest value
+********************************************************************************************/
+static uint64_t histogram_quantile(const DBMDHistogram *hist, double q)
+{
+	double rank = q * (double)hist->count;
+	uint64_t seen = 0;
+	uint64_t lower = 0;
+	uint64_t upper;
+	uint64_t value;
+	int i;
+
+	for (i = 0; i < DBMD_STATS_BUCKETS; i++)
+	{
+		upper = (uint64_t)1 << (DBMD_STATS_MIN_BUCKET + i);
+		if ( hist->counts[i] && ((double)(seen + hist->counts[i]) >= rank) )
+		{
+			value = lower + (uint64_t)((double)(upper - lower) * (rank - (double)seen) / (double)hist->counts[i]);
+			return (value < hist->max_ns) ? value : hist->max_ns;
+		}
+		seen += hist->counts[i];
+		lower = upper;
+	}
+
+	return hist->max_ns;
+}
+
+/*******************************************************************************************
+static void snapshot(...)
+-Purpose:
+	Copies the histograms and counters of the run statistics under their lock
+********************************************************************************************/
+static void snapshot(DBMDRunStats *stats, DBMDRunStats *snap)
+{
+#ifndef WIN32
+	pthread_mutex_lock(&stats->lock);
+#endif
+	memcpy(snap->phases, stats->phases, sizeof(snap->phases));
+	snap->total = stats->total;
+	snap->num_files = stats->num_files;
+	snap->num_failed = stats->num_failed;
+	snap->num_reads = stats->num_reads;
+	snap->num_bytes = stats->num_bytes;
+	snap->num_seeks = stats->num_seeks;
+	snap->num_chunks_skipped = stats->num_chunks_skipped;
+#ifndef WIN32
+	pthread_mutex_unlock(&stats->lock);
+#endif
+}
+
+/*******************************************************************************************
+static void report_row(...)
+-Purpose:
+	Writes the report line of one histogram
+********************************************************************************************/
+static void report_row(FILE *fp, const char *name, const DBMDHistogram *hist)
+{
+	char mean[16];
+	char p50[16];
+	char p90[16];
+	char p99[16];
+	char max[16];
+
+	if (!hist->count)
+	{
+		fprintf(fp, "  %-10s %8s\n", name, "0");
+		return;
+	}
+
+	dbmd_stats_duration(mean, sizeof(mean), hist->sum_ns / hist->count);
+	dbmd_stats_duration(p50, sizeof(p50), histogram_quantile(hist, 0.50));
+	dbmd_stats_duration(p90, sizeof(p90), histogram_quantile(hist, 0.90));
+	dbmd_stats_duration(p99, sizeof(p99), histogram_quantile(hist, 0.99));
+	dbmd_stats_duration(max, sizeof(max), hist->max_ns);
+	fprintf(fp, "  %-10s %8llu %10s %10s %10s %10s %10s\n", name, (unsigned long long)hist->count, mean, p50, p90, p99, max);
+}
+
+/*******************************************************************************************
+static void export_histogram(...)
+-Purpose:
+	Writes the cumulative buckets, sum and count of one histogram in the
+	Prometheus text format, with an optional label
+********************************************************************************************/
+static void export_histogram(FILE *fp, const char *name, const char *label, const DBMDHistogram *hist)
+{
+	const char *sep = label ? "," : "";
+	uint64_t cumulative = 0;
+	int i;
+
+	if (!label)
+		label = "";
+
+	for (i = 0; i < DBMD_STATS_BUCKETS; i++)
+	{
+		cumulative += hist->counts[i];
+		fprintf(fp, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, label, sep,
+			(double)((uint64_t)1 << (DBMD_STATS_MIN_BUCKET + i)) / 1e9, (unsigned long long)cumulative);
+	}
+	fprintf(fp, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, label, sep, (unsigned long long)hist->count);
+	if (*label)
+	{
+		fprintf(fp, "%s_sum{%s} %.9f\n", name, label, (double)hist->sum_ns / 1e9);
+		fprintf(fp, "%s_count{%s} %llu\n", name, label, (unsigned long long)hist->count);
+	}
+	else
+	{
+		fprintf(fp, "%s_sum %.9f\n", name, (double)hist->sum_ns / 1e9);
+		fprintf(fp, "%s_count %llu\n", name, (unsigned long long)hist->count);
+	}
+}
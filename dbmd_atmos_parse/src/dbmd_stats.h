@@ -0,0 +1,82 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_STATS_H
+#define DBMD_STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+#include "dbmd_wav_parse.h"
+
+/* This defines the run statistics. The phase timings and I/O counters of
+ *  every scan are added to a latency histogram per phase, with buckets
+ *  bounded by the powers of two from 64 ns to 32 s, and summed into counters for the run.
+ *  They are reported as text at the end of the run, and can be exported in
+ *  the Prometheus text format for the node exporter's textfile collector,
+ *  both at the end of the run and while it goes on, at most once per export
+ *  interval, for long runs such as --watch and --server.
+ */
+#define DBMD_STATS_MIN_BUCKET 6 /* Upper bound of the first bucket, 2^6 ns */
+#define DBMD_STATS_BUCKETS 30   /* Finite buckets up to 2^35 ns, then +Inf */
+#define DBMD_STATS_EXPORT_INTERVAL_MS 1000
+
+typedef struct
+{
+	uint64_t counts[DBMD_STATS_BUCKETS + 1]; /* Number of values per bucket, the last is unbounded */
+	uint64_t count;                          /* Number of values */
+	uint64_t sum_ns;                         /* Sum of the values */
+	uint64_t max_ns;                         /* Largest value */
+} DBMDHistogram;
+
+typedef struct
+{
+	DBMDHistogram phases[DBMD_NUM_PHASES]; /* Time spent per phase */
+	DBMDHistogram total;                   /* Time spent per file */
+	uint64_t num_files;                    /* Number of files scanned */
+	uint64_t num_failed;                   /* Number of files that could not be parsed */
+	uint64_t num_reads;                    /* Number of reads issued */
+	uint64_t num_bytes;                    /* Number of bytes fetched */
+	uint64_t num_seeks;                    /* Number of reads not continuing the previous one */
+	uint64_t num_chunks_skipped;           /* Number of chunks jumped over unread */
+	const char *export_path;               /* Prometheus textfile kept up to date as scans are added, NULL for none */
+	uint64_t last_export_ns;               /* Time of the last export */
+#ifndef WIN32
+	pthread_mutex_t lock;
+#endif
+} DBMDRunStats;
+
+extern const char *const dbmd_phase_names[DBMD_NUM_PHASES];
+
+void dbmd_stats_init(DBMDRunStats *stats, const char *export_path);
+void dbmd_stats_add(DBMDRunStats *stats, const DBMDScanStats *scan, unsigned long read_count, uint64_t bytes_read, int error);
+void dbmd_stats_report(DBMDRunStats *stats, FILE *fp);
+int dbmd_stats_export(DBMDRunStats *stats, const char *path);
+void dbmd_stats_free(DBMDRunStats *stats);
+void dbmd_stats_duration(char *buf, size_t size, uint64_t ns);
+
+#endif /* DBMD_STATS_H */
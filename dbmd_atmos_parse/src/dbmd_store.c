@@ -0,0 +1,961 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "dbmd_store.h"
+#include "dbmd_io.h"
+
+/* Store file layout: an 8 byte magic, a 32-bit version and 4 reserved bytes,
+ *  followed by blocks. Each block starts with a header
+ *
+ *      u32 magic          u32 row count       u64 block size
+ *      u32 tool count     u32 file names size u16 min object count
+ *      u16 max object count                   u32 reserved
+ *
+ *  followed by these sections, each starting at a multiple of 8 bytes:
+ *
+ *      STORE_NUM_BITMAPS row bitmaps of one bit per row, in 64-bit words
+ *      u32 metadata fields (DBMDCompact fields, without the mode encoding)
+ *      i32 error code      u16 tool id         u16 object count
+ *      u8 chunk status     u32 file name offset
+ *      the tools, STORE_TOOL_SIZE bytes each: NUL padded name, major, minor, micro
+ *      the file names, NUL terminated
+ *
+ *  All values are little-endian. The object count range covers the rows
+ *  with a supplemental segment.
+ */
+#define STORE_MAGIC "DBMDSTOR"
+#define STORE_HEADER_SIZE 16
+#define STORE_BLOCK_MAGIC 0x4B4C4244u /* "DBLK" */
+#define STORE_BLOCK_HEADER_SIZE 32
+#define STORE_TOOL_SIZE 72
+
+/* Row bitmaps */
+#define STORE_BITMAP_OK 0            /* Parsed without error */
+#define STORE_BITMAP_ATMOS 1         /* Dolby Atmos segment present */
+#define STORE_BITMAP_SUPPLEMENTAL 2  /* Supplemental segment present */
+#define STORE_BITMAP_WARP 3          /* 8 bitmaps, one per warp mode */
+#define STORE_BITMAP_MANUAL_TRIM 11  /* 9 bitmaps, one per trim configuration */
+#define STORE_BITMAP_MODE 20         /* 8 bitmaps, one per binaural render mode */
+#define STORE_NUM_BITMAPS 28
+
+/* Metadata fields kept in the store */
+#define STORE_FIELDS_MASK ((1u << DBMD_COMPACT_ENCODING_SHIFT) - 1)
+
+#define STORE_WORDS(rows) (((rows) + 63) / 64)
+#define STORE_ALIGN(len) (((len) + 7) & ~(size_t)7)
+
+typedef struct
+{
+	size_t bitmaps;
+	size_t fields;
+	size_t errors;
+	size_t tool_ids;
+	size_t object_counts;
+	size_t status;
+	size_t path_offsets;
+	size_t tools;
+	size_t names;
+	size_t size;
+} StoreLayout;
+
+/* Local function prototypes */
+static int parse_name(const char *s, const char **names, int num_names, int64_t *value);
+
+#ifndef WIN32
+
+static void store_layout(StoreLayout *layout, size_t num_rows, size_t num_tools, size_t names_len);
+static int store_flush(DBMDStoreWriter *writer);
+static unsigned char *store_encode_block(DBMDStoreWriter *writer, size_t *len);
+static void store_reset_block(DBMDStoreWriter *writer);
+static int store_grow(DBMDStoreWriter *writer, size_t name_len);
+static uint64_t store_valid_end(int fd, uint64_t file_len);
+static int store_query_block(const unsigned char *block, const StoreLayout *layout, size_t num_rows,
+                             const DBMDStoreQuery *query, uint64_t *match, unsigned char *tool_match,
+                             DBMDStoreVisit visit, void *arg, size_t *count);
+static int compare(int64_t a, dbmd_store_op op, int64_t b);
+
+#endif
+
+/*******************************************************************************************
+int dbmd_store_open(...)
+-Purpose:
+	Prepares a results store writer. The store file is created, or appended to,
+	when the first block is written.
+-Inputs:
+	DBMDStoreWriter *writer	-	Writer
+	const char *path		-	Store file name
+-Returns:
+	int						-	0 on success, -1 if out of memory or not supported
+********************************************************************************************/
+int dbmd_store_open(DBMDStoreWriter *writer, const char *path)
+{
+#ifndef WIN32
+	memset(writer, 0, sizeof(DBMDStoreWriter));
+	dbmd_compact_init(&writer->tools);
+	writer->path = malloc(strlen(path) + 1);
+	if (!writer->path)
+		return -1;
+	strcpy(writer->path, path);
+	pthread_mutex_init(&writer->lock, NULL);
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*******************************************************************************************
+void dbmd_store_add(...)
+-Purpose:
+	Adds the result of scanning a file to the store. Rows are buffered and
+	written a block at a time. May be called from several threads.
+-Inputs:
+	DBMDStoreWriter *writer	-	Writer
+	const char *filename	-	Input file name
+	const DBMDContext *ctx	-	Parse context used to scan the file
+	int error				-	Error code returned by the scan
+********************************************************************************************/
+void dbmd_store_add(DBMDStoreWriter *writer, const char *filename, const DBMDContext *ctx, int error)
+{
+#ifndef WIN32
+	DBMDCompact *row;
+	size_t name_len = strlen(filename) + 1;
+
+	pthread_mutex_lock(&writer->lock);
+	if (store_grow(writer, name_len))
+	{
+		writer->error = 1;
+		pthread_mutex_unlock(&writer->lock);
+		return;
+	}
+
+	row = &writer->rows[writer->num_rows];
+	if ( (error != DB_ERR_OK) || dbmd_compact_encode(&writer->tools, &ctx->metadata, row) )
+		memset(row, 0, sizeof(DBMDCompact));
+	/* the per-object modes are not kept */
+	writer->tools.modes_len = 0;
+
+	writer->errors[writer->num_rows] = error;
+	writer->status[writer->num_rows] = ctx->status;
+	writer->path_offsets[writer->num_rows] = (uint32_t)writer->names_len;
+	memcpy(writer->names + writer->names_len, filename, name_len);
+	writer->names_len += name_len;
+	writer->num_rows++;
+
+	/* a full block, or one whose tool ids or names would overflow */
+	if ( (writer->num_rows == DBMD_STORE_BLOCK_ROWS) || (writer->tools.num_tools >= 0xFFFF) || (writer->names_len > 0x7FFFFFFF) )
+	{
+		if (store_flush(writer))
+			writer->error = 1;
+		store_reset_block(writer);
+	}
+	pthread_mutex_unlock(&writer->lock);
+#endif
+}
+
+/*******************************************************************************************
+int dbmd_store_close(...)
+-Purpose:
+	Writes the rows still buffered and releases the writer
+-Inputs:
+	DBMDStoreWriter *writer	-	Writer
+-Returns:
+	int						-	0 on success, -1 if any block could not be written
+********************************************************************************************/
+int dbmd_store_close(DBMDStoreWriter *writer)
+{
+#ifndef WIN32
+	int error = writer->error;
+
+	if ( (writer->num_rows > 0) && store_flush(writer) )
+		error = 1;
+
+	store_reset_block(writer);
+	dbmd_compact_free(&writer->tools);
+	free(writer->rows);
+	free(writer->errors);
+	free(writer->status);
+	free(writer->path_offsets);
+	free(writer->names);
+	free(writer->path);
+	pthread_mutex_destroy(&writer->lock);
+
+	return error ? -1 : 0;
+#else
+	return -1;
+#endif
+}
+
+/*******************************************************************************************
+int dbmd_store_map(...)
+-Purpose:
+	Maps a results store file into memory for querying
+-Inputs:
+	DBMDStore *store	-	Store
+	const char *path	-	Store file name
+-Returns:
+	int					-	0 on success, -1 if the file cannot be read or is not a
+							results store of this version
+********************************************************************************************/
+int dbmd_store_map(DBMDStore *store, const char *path)
+{
+#ifndef WIN32
+	const uint16_t byte_order = 1;
+	struct stat st;
+	void *data;
+	int fd;
+
+	store->data = NULL;
+	store->len = 0;
+
+	/* the columns are read in place */
+	if (*(const unsigned char *)&byte_order != 1)
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if ( (fstat(fd, &st) != 0) || (st.st_size < STORE_HEADER_SIZE) )
+	{
+		close(fd);
+		return -1;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return -1;
+
+	store->data = (const unsigned char *)data;
+	store->len = (size_t)st.st_size;
+	if ( memcmp(store->data, STORE_MAGIC, 8) || (dbmd_get_le(store->data + 8, 4) != DBMD_STORE_VERSION) )
+	{
+		dbmd_store_unmap(store);
+		return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*******************************************************************************************
+void dbmd_store_unmap(...)
+-Purpose:
+	Releases the mapping of a results store
+-Inputs:
+	DBMDStore *store	-	Store
+********************************************************************************************/
+void dbmd_store_unmap(DBMDStore *store)
+{
+#ifndef WIN32
+	if (store->data)
+		munmap((void *)store->data, store->len);
+#endif
+	store->data = NULL;
+	store->len = 0;
+}
+
+/*******************************************************************************************
+int dbmd_store_condition(...)
+-Purpose:
+	Adds a condition to a query. A condition is a field name, an operator (=, !=,
+	<, <=, > or >=) and a value:
+		error=<code>					error code, 0 for files parsed without error
+		warp_mode=<mode>				0 to 7, or normal, warping, pl2x, loro, not-indicated
+		tool=<name>						creation tool name (= and != only)
+		tool_version<major.minor.micro>	creation tool version
+		objects>=<count>				object count
+		trim.<config>=manual|auto		trim type of a trim configuration, e.g. trim.7.1.4
+		binaural=<mode>					some object has the mode (=), or none has it (!=):
+										0 to 7, or bypass, near, far, mid, not-indicated
+-Inputs:
+	DBMDStoreQuery *query		-	Query
+	const char *expression		-	Condition
+-Returns:
+	int							-	0 on success, -1 if the condition is not valid
+********************************************************************************************/
+int dbmd_store_condition(DBMDStoreQuery *query, const char *expression)
+{
+	DBMDStoreCondition *cond;
+	const char *value;
+	size_t name_len;
+	char *end;
+	long major, minor = 0, micro = 0;
+	int i;
+
+	if (query->num_conditions == DBMD_STORE_MAX_CONDITIONS)
+		return -1;
+	cond = &query->conditions[query->num_conditions];
+	memset(cond, 0, sizeof(DBMDStoreCondition));
+
+	/* split the expression at the operator */
+	name_len = strcspn(expression, "=!<>");
+	value = expression + name_len;
+	if (!strncmp(value, "!=", 2))
+		cond->op = DBMD_OP_NE;
+	else if (!strncmp(value, "<=", 2))
+		cond->op = DBMD_OP_LE;
+	else if (!strncmp(value, ">=", 2))
+		cond->op = DBMD_OP_GE;
+	else if (!strncmp(value, "==", 2))
+		cond->op = DBMD_OP_EQ;
+	else if (*value == '<')
+		cond->op = DBMD_OP_LT;
+	else if (*value == '>')
+		cond->op = DBMD_OP_GT;
+	else if (*value == '=')
+		cond->op = DBMD_OP_EQ;
+	else
+		return -1;
+	value += ( (value[1] == '=') ? 2 : 1 );
+
+	if ( (name_len == 5) && !strncmp(expression, "error", 5) )
+	{
+		cond->field = DBMD_FIELD_ERROR;
+		cond->value = strtol(value, &end, 10);
+		if ( (end == value) || *end )
+			return -1;
+	}
+	else if ( ((name_len == 9) && !strncmp(expression, "warp_mode", 9)) || ((name_len == 4) && !strncmp(expression, "warp", 4)) )
+	{
+		cond->field = DBMD_FIELD_WARP_MODE;
+		if (parse_name(value, dbmd_warp_mode_names, 5, &cond->value))
+			return -1;
+	}
+	else if ( (name_len == 4) && !strncmp(expression, "tool", 4) )
+	{
+		cond->field = DBMD_FIELD_TOOL;
+		if ( ((cond->op != DBMD_OP_EQ) && (cond->op != DBMD_OP_NE)) || (strlen(value) > ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN) )
+			return -1;
+		strcpy(cond->tool, value);
+	}
+	else if ( (name_len == 12) && !strncmp(expression, "tool_version", 12) )
+	{
+		cond->field = DBMD_FIELD_TOOL_VERSION;
+		major = strtol(value, &end, 10);
+		if ( (end != value) && (*end == '.') )
+			minor = strtol(value = end + 1, &end, 10);
+		if ( (end != value) && (*end == '.') )
+			micro = strtol(value = end + 1, &end, 10);
+		if ( (end == value) || *end || (major < 0) || (major > 255) || (minor < 0) || (minor > 255) || (micro < 0) || (micro > 255) )
+			return -1;
+		cond->value = (major << 16) | (minor << 8) | micro;
+	}
+	else if ( (name_len == 7) && !strncmp(expression, "objects", 7) )
+	{
+		cond->field = DBMD_FIELD_OBJECTS;
+		cond->value = strtol(value, &end, 10);
+		if ( (end == value) || *end )
+			return -1;
+	}
+	else if ( (name_len > 5) && !strncmp(expression, "trim.", 5) )
+	{
+		cond->field = DBMD_FIELD_TRIM;
+		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+		{
+			if ( (strlen(dbmd_trim_config_names[i]) == name_len - 5) && !strncmp(expression + 5, dbmd_trim_config_names[i], name_len - 5) )
+				break;
+		}
+		if ( (i == NUM_TRIM_CONFIGS) || ((cond->op != DBMD_OP_EQ) && (cond->op != DBMD_OP_NE)) )
+			return -1;
+		cond->index = (unsigned int)i;
+		if (!strcmp(value, "manual"))
+			cond->value = 0;
+		else if ( !strcmp(value, "auto") || !strcmp(value, "automatic") )
+			cond->value = 1;
+		else
+			return -1;
+	}
+	else if ( (name_len == 8) && !strncmp(expression, "binaural", 8) )
+	{
+		cond->field = DBMD_FIELD_BINAURAL;
+		if ( ((cond->op != DBMD_OP_EQ) && (cond->op != DBMD_OP_NE)) || parse_name(value, dbmd_binaural_mode_names, 5, &cond->value) )
+			return -1;
+	}
+	else
+	{
+		return -1;
+	}
+
+	query->num_conditions++;
+	return 0;
+}
+
+/*******************************************************************************************
+size_t dbmd_store_query(...)
+-Purpose:
+	Finds the rows of a store for which all conditions of a query hold. Within
+	each block, the conditions on low-cardinality fields are answered from the
+	row bitmaps, those on the creation tool from the block's tool dictionary,
+	and blocks whose object count range or tools rule out any match are skipped.
+-Inputs:
+	const DBMDStore *store		-	Store
+	const DBMDStoreQuery *query	-	Query
+	DBMDStoreVisit visit		-	Called for each matching row, in store order, unless
+									NULL; returning non-zero stops the query
+	void *arg					-	Passed to visit
+-Returns:
+	size_t						-	Number of matching rows visited
+********************************************************************************************/
+size_t dbmd_store_query(const DBMDStore *store, const DBMDStoreQuery *query, DBMDStoreVisit visit, void *arg)
+{
+	size_t count = 0;
+#ifndef WIN32
+	StoreLayout layout;
+	const unsigned char *block;
+	unsigned char *tool_match;
+	uint64_t *match;
+	size_t pos, num_rows;
+	uint64_t block_size;
+
+	/* a row bitmap and a flag per tool id */
+	match = malloc(STORE_WORDS(DBMD_STORE_BLOCK_ROWS) * sizeof(uint64_t) + 0x10000);
+	if (!match)
+		return 0;
+	tool_match = (unsigned char *)(match + STORE_WORDS(DBMD_STORE_BLOCK_ROWS));
+
+	for (pos = STORE_HEADER_SIZE; pos + STORE_BLOCK_HEADER_SIZE <= store->len; pos += (size_t)block_size)
+	{
+		block = store->data + pos;
+		num_rows = (size_t)dbmd_get_le(block + 4, 4);
+		block_size = dbmd_get_le(block + 8, 8);
+		if ( (dbmd_get_le(block, 4) != STORE_BLOCK_MAGIC) || (num_rows > DBMD_STORE_BLOCK_ROWS) || (block_size > store->len - pos) )
+			break;
+		store_layout(&layout, num_rows, (size_t)dbmd_get_le(block + 16, 4), (size_t)dbmd_get_le(block + 20, 4));
+		if ( (layout.size != block_size) || (dbmd_get_le(block + 16, 4) >= 0xFFFF) )
+			break;
+
+		if (store_query_block(block, &layout, num_rows, query, match, tool_match, visit, arg, &count))
+			break;
+	}
+
+	free(match);
+#endif
+	return count;
+}
+
+#ifndef WIN32
+
+/*******************************************************************************************
+static void store_layout(...)
+-Purpose:
+	Computes the offsets of the sections of a block
+********************************************************************************************/
+static void store_layout(StoreLayout *layout, size_t num_rows, size_t num_tools, size_t names_len)
+{
+	layout->bitmaps = STORE_BLOCK_HEADER_SIZE;
+	layout->fields = layout->bitmaps + STORE_NUM_BITMAPS * STORE_WORDS(num_rows) * 8;
+	layout->errors = STORE_ALIGN(layout->fields + 4 * num_rows);
+	layout->tool_ids = STORE_ALIGN(layout->errors + 4 * num_rows);
+	layout->object_counts = STORE_ALIGN(layout->tool_ids + 2 * num_rows);
+	layout->status = STORE_ALIGN(layout->object_counts + 2 * num_rows);
+	layout->path_offsets = STORE_ALIGN(layout->status + num_rows);
+	layout->tools = STORE_ALIGN(layout->path_offsets + 4 * num_rows);
+	layout->names = layout->tools + STORE_TOOL_SIZE * num_tools;
+	layout->size = STORE_ALIGN(layout->names + names_len);
+}
+
+/*******************************************************************************************
+static int store_flush(...)
+-Purpose:
+	Appends the buffered rows to the store file as one block, under an exclusive
+	lock so that concurrent writers never interleave. A torn block left at the end
+	of the file by an interrupted writer is overwritten.
+-Returns:
+	int				-	0 on success, -1 on failure
+********************************************************************************************/
+static int store_flush(DBMDStoreWriter *writer)
+{
+	unsigned char header[STORE_HEADER_SIZE];
+	unsigned char *block;
+	struct flock fl;
+	struct stat st;
+	uint64_t end;
+	size_t len;
+	int fd;
+	int error = -1;
+
+	block = store_encode_block(writer, &len);
+	if (!block)
+		return -1;
+
+	fd = open(writer->path, O_RDWR | O_CREAT, 0666);
+	if (fd < 0)
+	{
+		free(block);
+		return -1;
+	}
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &fl) != 0)
+	{
+		if (errno != EINTR)
+			goto done;
+	}
+	if (fstat(fd, &st) != 0)
+		goto done;
+
+	if (st.st_size == 0)
+	{
+		/* new file */
+		memset(header, 0, sizeof(header));
+		memcpy(header, STORE_MAGIC, 8);
+		dbmd_put_le(header + 8, DBMD_STORE_VERSION, 4);
+		if (dbmd_write_all(fd, header, STORE_HEADER_SIZE, 0))
+			goto done;
+		end = STORE_HEADER_SIZE;
+	}
+	else
+	{
+		/* never append to a file that is not a store of this version */
+		if ( (pread(fd, header, STORE_HEADER_SIZE, 0) != STORE_HEADER_SIZE) ||
+		     memcmp(header, STORE_MAGIC, 8) || (dbmd_get_le(header + 8, 4) != DBMD_STORE_VERSION) )
+			goto done;
+		end = store_valid_end(fd, (uint64_t)st.st_size);
+	}
+
+	if ( !dbmd_write_all(fd, block, len, end) && !ftruncate(fd, (off_t)(end + len)) )
+		error = 0;
+
+done:
+	close(fd);
+	free(block);
+	return error;
+}
+
+/*******************************************************************************************
+static unsigned char *store_encode_block(...)
+-Purpose:
+	Lays out the buffered rows as a block
+-Returns:
+	unsigned char *	-	the block, to be freed by the caller, or NULL if out of memory
+********************************************************************************************/
+static unsigned char *store_encode_block(DBMDStoreWriter *writer, size_t *len)
+{
+	StoreLayout layout;
+	const DBMDCompactTool *tool;
+	unsigned char *block, *bitmaps;
+	size_t num_rows = writer->num_rows;
+	size_t words = STORE_WORDS(num_rows);
+	unsigned int min_objects = 0xFFFF, max_objects = 0;
+	uint32_t fields;
+	size_t i;
+	int j;
+
+	store_layout(&layout, num_rows, writer->tools.num_tools, writer->names_len);
+	block = calloc(1, layout.size);
+	if (!block)
+		return NULL;
+
+	bitmaps = block + layout.bitmaps;
+	for (i = 0; i < num_rows; i++)
+	{
+		const DBMDCompact *row = &writer->rows[i];
+
+		/* bit i of a little-endian bitmap is bit i % 8 of byte i / 8 */
+#define SET_BITMAP(n) (bitmaps[(n) * words * 8 + (i >> 3)] |= (unsigned char)(1 << (i & 7)))
+		fields = row->fields & STORE_FIELDS_MASK;
+		if (writer->errors[i] == DB_ERR_OK)
+			SET_BITMAP(STORE_BITMAP_OK);
+		if (fields & DBMD_COMPACT_ATMOS)
+		{
+			SET_BITMAP(STORE_BITMAP_ATMOS);
+			SET_BITMAP(STORE_BITMAP_WARP + dbmd_compact_warp_mode(row));
+		}
+		if (fields & DBMD_COMPACT_SUPPLEMENTAL)
+		{
+			SET_BITMAP(STORE_BITMAP_SUPPLEMENTAL);
+			for (j = 0; j < NUM_TRIM_CONFIGS; j++)
+			{
+				if ( !(dbmd_compact_trim_mask(row) & (1u << j)) )
+					SET_BITMAP(STORE_BITMAP_MANUAL_TRIM + j);
+			}
+			for (j = 0; j < NUM_BINAURAL_RENDER_MODES; j++)
+			{
+				if (dbmd_compact_has_mode(row, (atmos_dbmd_binaural_render_mode)j))
+					SET_BITMAP(STORE_BITMAP_MODE + j);
+			}
+			if (row->object_count < min_objects)
+				min_objects = row->object_count;
+			if (row->object_count > max_objects)
+				max_objects = row->object_count;
+		}
+#undef SET_BITMAP
+
+		dbmd_put_le(block + layout.fields + 4 * i, fields, 4);
+		dbmd_put_le(block + layout.errors + 4 * i, (uint32_t)writer->errors[i], 4);
+		dbmd_put_le(block + layout.tool_ids + 2 * i, row->tool_id, 2);
+		dbmd_put_le(block + layout.object_counts + 2 * i, row->object_count, 2);
+		block[layout.status + i] = writer->status[i];
+		dbmd_put_le(block + layout.path_offsets + 4 * i, writer->path_offsets[i], 4);
+	}
+
+	for (i = 0; i < writer->tools.num_tools; i++)
+	{
+		tool = &writer->tools.tools[i];
+		memcpy(block + layout.tools + STORE_TOOL_SIZE * i, tool->name, ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN);
+		block[layout.tools + STORE_TOOL_SIZE * i + 65] = (unsigned char)tool->version.major;
+		block[layout.tools + STORE_TOOL_SIZE * i + 66] = (unsigned char)tool->version.minor;
+		block[layout.tools + STORE_TOOL_SIZE * i + 67] = (unsigned char)tool->version.micro;
+	}
+	memcpy(block + layout.names, writer->names, writer->names_len);
+
+	dbmd_put_le(block, STORE_BLOCK_MAGIC, 4);
+	dbmd_put_le(block + 4, num_rows, 4);
+	dbmd_put_le(block + 8, layout.size, 8);
+	dbmd_put_le(block + 16, writer->tools.num_tools, 4);
+	dbmd_put_le(block + 20, writer->names_len, 4);
+	dbmd_put_le(block + 24, min_objects, 2);
+	dbmd_put_le(block + 26, max_objects, 2);
+
+	*len = layout.size;
+	return block;
+}
+
+/*******************************************************************************************
+static void store_reset_block(...)
+-Purpose:
+	Empties the buffered block, keeping the row arrays for reuse. Tool ids are
+	local to a block, so the tool dictionary starts over.
+********************************************************************************************/
+static void store_reset_block(DBMDStoreWriter *writer)
+{
+	dbmd_compact_free(&writer->tools);
+	dbmd_compact_init(&writer->tools);
+	writer->num_rows = 0;
+	writer->names_len = 0;
+}
+
+/*******************************************************************************************
+static int store_grow(...)
+-Purpose:
+	Makes room for one more row with a file name of name_len bytes
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int store_grow(DBMDStoreWriter *writer, size_t name_len)
+{
+	size_t size;
+	void *p;
+
+	if (writer->num_rows == writer->rows_size)
+	{
+		size = writer->rows_size ? writer->rows_size * 2 : 1024;
+		if (size > DBMD_STORE_BLOCK_ROWS)
+			size = DBMD_STORE_BLOCK_ROWS;
+		if ( !(p = realloc(writer->rows, size * sizeof(DBMDCompact))) )
+			return -1;
+		writer->rows = p;
+		if ( !(p = realloc(writer->errors, size * sizeof(int32_t))) )
+			return -1;
+		writer->errors = p;
+		if ( !(p = realloc(writer->status, size)) )
+			return -1;
+		writer->status = p;
+		if ( !(p = realloc(writer->path_offsets, size * sizeof(uint32_t))) )
+			return -1;
+		writer->path_offsets = p;
+		writer->rows_size = size;
+	}
+
+	if (writer->names_len + name_len > writer->names_size)
+	{
+		size = writer->names_size ? writer->names_size * 2 : 65536;
+		while (size < writer->names_len + name_len)
+			size *= 2;
+		if ( !(p = realloc(writer->names, size)) )
+			return -1;
+		writer->names = p;
+		writer->names_size = size;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static uint64_t store_valid_end(...)
+-Purpose:
+	Walks the block headers of a store file to find the end of the last
+	complete block
+-Returns:
+	uint64_t		-	offset just past the last complete block
+********************************************************************************************/
+static uint64_t store_valid_end(int fd, uint64_t file_len)
+{
+	unsigned char header[STORE_BLOCK_HEADER_SIZE];
+	StoreLayout layout;
+	uint64_t pos = STORE_HEADER_SIZE;
+	uint64_t block_size;
+
+	while (pos + STORE_BLOCK_HEADER_SIZE <= file_len)
+	{
+		if (pread(fd, header, STORE_BLOCK_HEADER_SIZE, (off_t)pos) != STORE_BLOCK_HEADER_SIZE)
+			break;
+		block_size = dbmd_get_le(header + 8, 8);
+		store_layout(&layout, (size_t)dbmd_get_le(header + 4, 4), (size_t)dbmd_get_le(header + 16, 4), (size_t)dbmd_get_le(header + 20, 4));
+		if ( (dbmd_get_le(header, 4) != STORE_BLOCK_MAGIC) || (dbmd_get_le(header + 4, 4) > DBMD_STORE_BLOCK_ROWS) ||
+		     (layout.size != block_size) || (block_size > file_len - pos) )
+			break;
+		pos += block_size;
+	}
+
+	return pos;
+}
+
+/*******************************************************************************************
+static int store_query_block(...)
+-Purpose:
+	Evaluates a query on one block, combining the conditions into a bitmap of
+	matching rows a 64-bit word at a time, and visits the matching rows
+-Returns:
+	int				-	non-zero if the visit function asked to stop
+********************************************************************************************/
+static int store_query_block(const unsigned char *block, const StoreLayout *layout, size_t num_rows,
+                             const DBMDStoreQuery *query, uint64_t *match, unsigned char *tool_match,
+                             DBMDStoreVisit visit, void *arg, size_t *count)
+{
+	const uint64_t *bitmaps = (const uint64_t *)(block + layout->bitmaps);
+	const uint32_t *fields = (const uint32_t *)(block + layout->fields);
+	const int32_t *errors = (const int32_t *)(block + layout->errors);
+	const uint16_t *tool_ids = (const uint16_t *)(block + layout->tool_ids);
+	const uint16_t *object_counts = (const uint16_t *)(block + layout->object_counts);
+	const uint32_t *path_offsets = (const uint32_t *)(block + layout->path_offsets);
+	const unsigned char *tool;
+	const DBMDStoreCondition *cond;
+	size_t words = STORE_WORDS(num_rows);
+	size_t num_tools = (size_t)dbmd_get_le(block + 16, 4);
+	unsigned int min_objects = (unsigned int)dbmd_get_le(block + 24, 2);
+	unsigned int max_objects = (unsigned int)dbmd_get_le(block + 26, 2);
+	DBMDStoreRow row;
+	uint64_t mask, word;
+	size_t w, r, i;
+	int c, k, any;
+
+#define BITMAP(n) (bitmaps + (n) * words)
+	for (w = 0; w < words; w++)
+		match[w] = ~(uint64_t)0;
+	if (num_rows & 63)
+		match[words - 1] = ((uint64_t)1 << (num_rows & 63)) - 1;
+
+	for (c = 0; c < query->num_conditions; c++)
+	{
+		cond = &query->conditions[c];
+		switch (cond->field)
+		{
+			case DBMD_FIELD_ERROR:
+				for (w = 0; w < words; w++)
+				{
+					if ( (cond->value == 0) && (cond->op == DBMD_OP_EQ) )
+						mask = BITMAP(STORE_BITMAP_OK)[w];
+					else if ( (cond->value == 0) && (cond->op == DBMD_OP_NE) )
+						mask = ~BITMAP(STORE_BITMAP_OK)[w];
+					else
+					{
+						mask = 0;
+						for (r = w * 64; (r < num_rows) && (r < w * 64 + 64); r++)
+							mask |= (uint64_t)compare(errors[r], cond->op, cond->value) << (r & 63);
+					}
+					match[w] &= mask;
+				}
+				break;
+
+			case DBMD_FIELD_WARP_MODE:
+			case DBMD_FIELD_BINAURAL:
+				/* the union of the bitmaps of the values that satisfy the condition */
+				for (w = 0; w < words; w++)
+				{
+					mask = 0;
+					for (k = 0; k < 8; k++)
+					{
+						if (cond->field == DBMD_FIELD_WARP_MODE)
+						{
+							if (compare(k, cond->op, cond->value))
+								mask |= BITMAP(STORE_BITMAP_WARP + k)[w];
+						}
+						else if (k == cond->value)
+						{
+							mask = BITMAP(STORE_BITMAP_MODE + k)[w];
+							if (cond->op == DBMD_OP_NE)
+								mask = BITMAP(STORE_BITMAP_SUPPLEMENTAL)[w] & ~mask;
+						}
+					}
+					match[w] &= mask;
+				}
+				break;
+
+			case DBMD_FIELD_TRIM:
+				for (w = 0; w < words; w++)
+				{
+					mask = BITMAP(STORE_BITMAP_MANUAL_TRIM + cond->index)[w];
+					if ( (cond->value == 1) == (cond->op == DBMD_OP_EQ) )
+						mask = BITMAP(STORE_BITMAP_SUPPLEMENTAL)[w] & ~mask;
+					match[w] &= mask;
+				}
+				break;
+
+			case DBMD_FIELD_OBJECTS:
+				/* skip the block if no object count in its range qualifies */
+				if ( (min_objects > max_objects) ||
+				     ((cond->op == DBMD_OP_EQ) && ((cond->value < min_objects) || (cond->value > max_objects))) ||
+				     ((cond->op == DBMD_OP_NE) && (min_objects == max_objects) && (cond->value == min_objects)) ||
+				     ((cond->op == DBMD_OP_LT) && (min_objects >= cond->value)) ||
+				     ((cond->op == DBMD_OP_LE) && (min_objects > cond->value)) ||
+				     ((cond->op == DBMD_OP_GT) && (max_objects <= cond->value)) ||
+				     ((cond->op == DBMD_OP_GE) && (max_objects < cond->value)) )
+					return 0;
+				for (w = 0; w < words; w++)
+				{
+					mask = 0;
+					for (r = w * 64; (r < num_rows) && (r < w * 64 + 64); r++)
+						mask |= (uint64_t)compare(object_counts[r], cond->op, cond->value) << (r & 63);
+					match[w] &= mask & BITMAP(STORE_BITMAP_SUPPLEMENTAL)[w];
+				}
+				break;
+
+			case DBMD_FIELD_TOOL:
+			case DBMD_FIELD_TOOL_VERSION:
+				/* evaluate the condition once per tool of the block */
+				any = 0;
+				tool_match[0] = 0;
+				for (i = 0; i < num_tools; i++)
+				{
+					tool = block + layout->tools + STORE_TOOL_SIZE * i;
+					if (cond->field == DBMD_FIELD_TOOL)
+						tool_match[i + 1] = (unsigned char)(!strncmp((const char *)tool, cond->tool, ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN) == (cond->op == DBMD_OP_EQ));
+					else
+						tool_match[i + 1] = (unsigned char)compare(((int64_t)tool[65] << 16) | (tool[66] << 8) | tool[67], cond->op, cond->value);
+					any |= tool_match[i + 1];
+				}
+				if (!any)
+					return 0;
+				for (w = 0; w < words; w++)
+				{
+					mask = 0;
+					for (r = w * 64; (r < num_rows) && (r < w * 64 + 64); r++)
+						mask |= (uint64_t)tool_match[(tool_ids[r] <= num_tools) ? tool_ids[r] : 0] << (r & 63);
+					match[w] &= mask;
+				}
+				break;
+		}
+	}
+#undef BITMAP
+
+	/* visit the matching rows */
+	for (w = 0; w < words; w++)
+	{
+		if (!visit)
+		{
+			*count += (size_t)__builtin_popcountll(match[w]);
+			continue;
+		}
+		for (word = match[w]; word; word &= word - 1)
+		{
+			(*count)++;
+			r = w * 64 + (size_t)__builtin_ctzll(word);
+			memset(&row, 0, sizeof(row));
+			row.path = (const char *)block + layout->names + path_offsets[r];
+			row.error = errors[r];
+			row.status = block[layout->status + r];
+			row.metadata.fields = fields[r];
+			row.metadata.tool_id = tool_ids[r];
+			row.metadata.object_count = object_counts[r];
+			if ( (tool_ids[r] != DBMD_COMPACT_NO_TOOL) && (tool_ids[r] <= num_tools) )
+			{
+				tool = block + layout->tools + STORE_TOOL_SIZE * (tool_ids[r] - 1);
+				row.tool = (const char *)tool;
+				row.tool_version.major = tool[65];
+				row.tool_version.minor = tool[66];
+				row.tool_version.micro = tool[67];
+			}
+			if (visit(arg, &row))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*******************************************************************************************
+static int compare(...)
+-Purpose:
+	Applies a comparison operator
+********************************************************************************************/
+static int compare(int64_t a, dbmd_store_op op, int64_t b)
+{
+	switch (op)
+	{
+		case DBMD_OP_EQ: return a == b;
+		case DBMD_OP_NE: return a != b;
+		case DBMD_OP_LT: return a < b;
+		case DBMD_OP_LE: return a <= b;
+		case DBMD_OP_GT: return a > b;
+		case DBMD_OP_GE: return a >= b;
+	}
+	return 0;
+}
+
+#endif
+
+/*******************************************************************************************
+static int parse_name(...)
+-Purpose:
+	Parses a mode given as a number from 0 to 7 or as one of its names
+-Returns:
+	int				-	0 on success, -1 if not valid
+********************************************************************************************/
+static int parse_name(const char *s, const char **names, int num_names, int64_t *value)
+{
+	char *end;
+	int i;
+
+	for (i = 0; i < num_names; i++)
+	{
+		if (!strcmp(s, names[i]))
+		{
+			*value = i;
+			return 0;
+		}
+	}
+
+	*value = strtol(s, &end, 10);
+	return ( (end == s) || *end || (*value < 0) || (*value > 7) ) ? -1 : 0;
+}
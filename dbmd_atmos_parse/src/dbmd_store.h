@@ -0,0 +1,138 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_STORE_H
+#define DBMD_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+#include "dbmd_wav_parse.h"
+#include "dbmd_compact.h"
+
+/* This defines the results store, an append-only columnar file of scan
+ *  results that can be queried without parsing any files again. Results are
+ *  buffered and appended in blocks of up to DBMD_STORE_BLOCK_ROWS rows; each
+ *  block holds one column per field, a dictionary of the creation tools used
+ *  in the block, row bitmaps for the low-cardinality fields (warp mode,
+ *  manual trims, binaural render modes in use) and the range of object
+ *  counts, so that a query combines bitmaps and skips whole blocks instead
+ *  of visiting rows. The columns are stored in little-endian byte order and
+ *  aligned, and are read in place from a memory mapping of the file. Any
+ *  number of processes may append to a store; writers serialize on a file
+ *  lock and a torn block at the end of the file is ignored.
+ */
+#define DBMD_STORE_VERSION 1
+#define DBMD_STORE_BLOCK_ROWS 65536
+
+typedef struct
+{
+	char *path;                  /* Store file name */
+	DBMDCompactStore tools;      /* Creation tools of the block */
+	DBMDCompact *rows;           /* Metadata of each row */
+	int32_t *errors;             /* Error code of each row */
+	unsigned char *status;       /* Chunk status bits of each row */
+	uint32_t *path_offsets;      /* Offset of each row's file name in the names */
+	char *names;                 /* File names, NUL terminated */
+	size_t names_len;            /* Number of bytes used */
+	size_t names_size;           /* Number of bytes allocated */
+	size_t num_rows;             /* Number of rows buffered */
+	size_t rows_size;            /* Number of rows allocated */
+	int error;                   /* Set once a block could not be written */
+#ifndef WIN32
+	pthread_mutex_t lock;        /* Serializes rows added by worker threads */
+#endif
+} DBMDStoreWriter;
+
+typedef struct
+{
+	const unsigned char *data;   /* Mapped store file */
+	size_t len;                  /* Number of bytes mapped */
+} DBMDStore;
+
+/* Query condition operators */
+typedef enum
+{
+	DBMD_OP_EQ = 0,
+	DBMD_OP_NE,
+	DBMD_OP_LT,
+	DBMD_OP_LE,
+	DBMD_OP_GT,
+	DBMD_OP_GE
+} dbmd_store_op;
+
+/* Queryable fields */
+typedef enum
+{
+	DBMD_FIELD_ERROR = 0,        /* Error code */
+	DBMD_FIELD_WARP_MODE,        /* Warp mode, of files with a Dolby Atmos segment */
+	DBMD_FIELD_TOOL,             /* Creation tool name */
+	DBMD_FIELD_TOOL_VERSION,     /* Creation tool version, major << 16 | minor << 8 | micro */
+	DBMD_FIELD_OBJECTS,          /* Object count, of files with a supplemental segment */
+	DBMD_FIELD_TRIM,             /* Trim type of a trim configuration, 0 manual, 1 automatic */
+	DBMD_FIELD_BINAURAL          /* Binaural render mode used by any object */
+} dbmd_store_field;
+
+#define DBMD_STORE_MAX_CONDITIONS 16
+
+typedef struct
+{
+	dbmd_store_field field;
+	dbmd_store_op op;
+	int64_t value;               /* Value compared with, for all fields but the tool name */
+	unsigned int index;          /* Trim configuration, for DBMD_FIELD_TRIM */
+	char tool[ATMOS_DBMD_CONTENT_CREATION_TOOL_LEN + 1];
+} DBMDStoreCondition;
+
+typedef struct
+{
+	DBMDStoreCondition conditions[DBMD_STORE_MAX_CONDITIONS]; /* All must hold */
+	int num_conditions;
+} DBMDStoreQuery;
+
+/* A row matched by a query */
+typedef struct
+{
+	const char *path;                 /* File name */
+	int error;                        /* Error code */
+	unsigned char status;             /* Chunk status bits */
+	DBMDCompact metadata;             /* Metadata fields, without the per-object modes */
+	const char *tool;                 /* Creation tool name, NULL if none */
+	atmos_dbmd_version tool_version;  /* Creation tool version */
+} DBMDStoreRow;
+
+typedef int (*DBMDStoreVisit)(void *arg, const DBMDStoreRow *row);
+
+int dbmd_store_open(DBMDStoreWriter *writer, const char *path);
+void dbmd_store_add(DBMDStoreWriter *writer, const char *filename, const DBMDContext *ctx, int error);
+int dbmd_store_close(DBMDStoreWriter *writer);
+
+int dbmd_store_map(DBMDStore *store, const char *path);
+void dbmd_store_unmap(DBMDStore *store);
+int dbmd_store_condition(DBMDStoreQuery *query, const char *expression);
+size_t dbmd_store_query(const DBMDStore *store, const DBMDStoreQuery *query, DBMDStoreVisit visit, void *arg);
+
+#endif /* DBMD_STORE_H */
@@ -28,4 +28,8 @@ const char *warpmodetext[5] = { "normal", "warping", "downmix Dolby Pro Logic II
 
 const char *trimmodecfgtext[9] = { "2.0", "5.1", "7.1", "2.1.2", "5.1.2", "7.1.2", "2.1.4", "5.1.4", "7.1.4" }; 
 
-const char *trimtypetext[2] = { "manual", "automatic" }; 
\ No newline at end of file
+const char *trimtypetext[2] = { "manual", "automatic" }; 
+
+const char *segmentidtext[11] = { "end", "Dolby E", "reserved", "Dolby Digital", "reserved", "reserved", "reserved", "Dolby Digital Plus", "Audio Info", "Dolby Atmos", "Dolby Atmos Supplemental" };
+
+const char *checksumstatustext[3] = { "not checked", "ok", "bad" };
\ No newline at end of file
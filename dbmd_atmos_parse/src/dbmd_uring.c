@@ -0,0 +1,670 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define DBMD_HAVE_URING
+#endif
+#endif
+
+#ifdef DBMD_HAVE_URING
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "dbmd_uring.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_output.h"
+
+#ifdef DBMD_HAVE_URING
+
+/* Number of results the engine may run ahead of the writer, per file in flight */
+#define RESULT_WINDOW_PER_SLOT 4
+
+#define SLOT_FREE 0
+#define SLOT_OPEN 1 /* openat submitted */
+#define SLOT_READ 2 /* read submitted */
+
+/* Submission and completion rings shared with the kernel */
+typedef struct
+{
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned to_submit; /* Entries queued since the last submission */
+} URing;
+
+/* A file in flight and the reader window of its chunk walk */
+typedef struct
+{
+	int state;
+	size_t index;               /* Index of the file in the list */
+	int fd;
+	DBMDWalk walk;
+	DBMDContext ctx;
+	DBMDWindow window;          /* Bytes of the file held */
+	unsigned long read_count;   /* Number of reads issued */
+	uint64_t bytes_read;        /* Number of bytes fetched */
+	uint64_t submitted_ns;      /* Submission time of the operation in flight, when timing */
+} URingSlot;
+
+/* Result of a single file, waiting to be written in list order */
+typedef struct
+{
+	DBMDOutput output;
+	int error;
+	unsigned long read_count;
+	uint64_t bytes_read;
+	int done;
+} URingResult;
+
+typedef struct
+{
+	const DBMDPathList *list;
+	const DBMDBatchConfig *config;
+	URing ring;
+	URingSlot *slots;
+	size_t *free_slots;     /* Stack of free slot indices */
+	size_t num_free;
+	URingResult *results;
+} URingEngine;
+
+/* Local function prototypes */
+static int uring_setup(URing *ring, unsigned entries);
+static void uring_close(URing *ring);
+static struct io_uring_sqe *uring_get_sqe(URing *ring);
+static int uring_submit_and_wait(URing *ring);
+static void start_file(URingEngine *engine, size_t index);
+static void advance(URingEngine *engine, size_t slot_index);
+static void submit_read(URingEngine *engine, size_t slot_index, size_t len);
+static void complete(URingEngine *engine, size_t slot_index, int res);
+static void finish(URingEngine *engine, size_t slot_index, int error, int parse);
+static void scan_sync(URingEngine *engine, DBMDContext *ctx, size_t index);
+
+/*******************************************************************************************
+static int uring_setup(...)
+-Purpose:
+	Creates an io_uring instance and maps its rings, checking that the kernel
+	supports the operations the engine needs
+-Returns:
+	int				-	0 on success, -1 if io_uring cannot be used
+********************************************************************************************/
+static int uring_setup(URing *ring, unsigned entries)
+{
+	struct io_uring_params params;
+	struct io_uring_probe *probe;
+	size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	unsigned char *sq;
+	unsigned char *cq;
+	int supported;
+
+	memset(ring, 0, sizeof(URing));
+	memset(&params, 0, sizeof(params));
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0)
+		return -1;
+
+	/* openat and read were added in Linux 5.6, as was the probe itself */
+	probe = calloc(1, probe_size);
+	supported = probe && (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0) &&
+		(probe->last_op >= IORING_OP_READ) &&
+		(probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+		(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	if (!supported)
+	{
+		close(ring->fd);
+		return -1;
+	}
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = 0;
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+	{
+		close(ring->fd);
+		return -1;
+	}
+	ring->cq_ring = ring->sq_ring;
+	if (ring->cq_ring_size)
+	{
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED)
+		{
+			munmap(ring->sq_ring, ring->sq_ring_size);
+			close(ring->fd);
+			return -1;
+		}
+	}
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+	{
+		if (ring->cq_ring_size)
+			munmap(ring->cq_ring, ring->cq_ring_size);
+		munmap(ring->sq_ring, ring->sq_ring_size);
+		close(ring->fd);
+		return -1;
+	}
+
+	sq = (unsigned char *)ring->sq_ring;
+	ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+	cq = (unsigned char *)ring->cq_ring;
+	ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void uring_close(...)
+-Purpose:
+	Unmaps the rings and closes the io_uring instance
+********************************************************************************************/
+static void uring_close(URing *ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring_size)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+}
+
+/*******************************************************************************************
+static struct io_uring_sqe *uring_get_sqe(...)
+-Purpose:
+	Returns a cleared submission queue entry. The ring holds one entry per slot
+	and each slot has at most one operation in flight, so one is always free.
+********************************************************************************************/
+static struct io_uring_sqe *uring_get_sqe(URing *ring)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+
+	return sqe;
+}
+
+/*******************************************************************************************
+static int uring_submit_and_wait(...)
+-Purpose:
+	Submits the queued entries and waits for at least one completion
+-Returns:
+	int				-	0 on success, -1 on error
+********************************************************************************************/
+static int uring_submit_and_wait(URing *ring)
+{
+	int n;
+
+	do
+	{
+		n = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	} while ( (n < 0) && (errno == EINTR) );
+	if (n < 0)
+		return -1;
+	ring->to_submit -= (unsigned)n;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void start_file(...)
+-Purpose:
+	Starts the scan of a file in a free slot with an asynchronous open
+********************************************************************************************/
+static void start_file(URingEngine *engine, size_t index)
+{
+	size_t slot_index = engine->free_slots[--engine->num_free];
+	URingSlot *slot = &engine->slots[slot_index];
+	struct io_uring_sqe *sqe;
+
+	slot->state = SLOT_OPEN;
+	slot->index = index;
+	slot->fd = -1;
+	dbmd_window_init(&slot->window, slot->window.buf, 0);
+	slot->read_count = 0;
+	slot->bytes_read = 0;
+	slot->ctx.read_count = 0;
+	slot->ctx.bytes_read = 0;
+	memset(&slot->ctx.stats, 0, sizeof(slot->ctx.stats));
+	if (slot->ctx.timing)
+		slot->submitted_ns = dbmd_clock_ns();
+	dbmd_walk_init(&slot->walk, &slot->ctx, 1);
+
+	sqe = uring_get_sqe(&engine->ring);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t)(uintptr_t)engine->list->paths[index];
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	sqe->user_data = slot_index;
+}
+
+/*******************************************************************************************
+static void advance(...)
+-Purpose:
+	Runs the chunk walk of a file on the bytes held, as far as they go, then
+	submits a read for the bytes it needs next, refilling the window as the
+	synchronous reader does
+********************************************************************************************/
+static void advance(URingEngine *engine, size_t slot_index)
+{
+	URingSlot *slot = &engine->slots[slot_index];
+	DBMDWalk *walk = &slot->walk;
+	const unsigned char *data;
+	int result;
+
+	while ( (data = dbmd_window_find(&slot->window, walk->offset, walk->len)) )
+	{
+		result = dbmd_walk_step(walk, &slot->ctx, data);
+		if (result != DBMD_WALK_MORE)
+		{
+			finish(engine, slot_index, result, 1);
+			return;
+		}
+	}
+	if (walk->len > DBMD_MAX_PREFETCH)
+	{
+		finish(engine, slot_index, DB_ERR_FILEREAD, 1);
+		return;
+	}
+
+	/* a dbmd chunk the walk points to in the window is copied out before the
+	 * refill moves it */
+	if (slot->ctx.dbmd_chunk)
+	{
+		memcpy(slot->ctx.dolby_metadata, slot->ctx.dbmd_chunk, (size_t)slot->ctx.dbmd_chunk_size);
+		slot->ctx.dbmd_chunk = NULL;
+	}
+	submit_read(engine, slot_index, dbmd_window_refill(&slot->window, walk->offset, walk->len, DBMD_FILE_PREFETCH));
+}
+
+/*******************************************************************************************
+static void submit_read(...)
+-Purpose:
+	Submits a read of len bytes following the bytes held in the window
+********************************************************************************************/
+static void submit_read(URingEngine *engine, size_t slot_index, size_t len)
+{
+	URingSlot *slot = &engine->slots[slot_index];
+	struct io_uring_sqe *sqe;
+
+	slot->state = SLOT_READ;
+	slot->read_count++;
+	if (slot->ctx.timing)
+		slot->submitted_ns = dbmd_clock_ns();
+	sqe = uring_get_sqe(&engine->ring);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = slot->fd;
+	sqe->addr = (uint64_t)(uintptr_t)(slot->window.buf + slot->window.len);
+	sqe->len = (uint32_t)len;
+	sqe->off = slot->window.offset + slot->window.len;
+	sqe->user_data = slot_index;
+}
+
+/*******************************************************************************************
+static void complete(...)
+-Purpose:
+	Handles the completion of the operation in flight for a slot
+********************************************************************************************/
+static void complete(URingEngine *engine, size_t slot_index, int res)
+{
+	URingSlot *slot = &engine->slots[slot_index];
+	int phase;
+	int error;
+
+	/* an operation's time runs from its submission to its completion */
+	if (slot->ctx.timing)
+	{
+		if (slot->state == SLOT_OPEN)
+			phase = DBMD_PHASE_OPEN;
+		else if (slot->walk.state == DBMD_WALK_DBMD_CHUNK)
+			phase = DBMD_PHASE_DBMD_READ;
+		else
+			phase = DBMD_PHASE_WALK;
+		slot->ctx.stats.phase_ns[phase] += dbmd_clock_ns() - slot->submitted_ns;
+	}
+
+	if (slot->state == SLOT_OPEN)
+	{
+		if (res < 0)
+		{
+			finish(engine, slot_index, DB_ERR_FILEOPEN, 1);
+			return;
+		}
+		slot->fd = res;
+		if (lseek(slot->fd, 0, SEEK_CUR) < 0)
+		{
+			/* a pipe or socket, read it in order on this thread instead */
+			error = dbmd_batch_scan_fd(engine->config, &slot->ctx, slot->fd);
+			slot->fd = -1;
+			slot->read_count = slot->ctx.read_count;
+			slot->bytes_read = slot->ctx.bytes_read;
+			finish(engine, slot_index, error, 0);
+			return;
+		}
+		advance(engine, slot_index);
+		return;
+	}
+
+	if (res < 0)
+	{
+		finish(engine, slot_index, DB_ERR_FILEREAD, 1);
+		return;
+	}
+
+	slot->bytes_read += (uint64_t)res;
+	slot->window.len += (size_t)res;
+	if (slot->window.len < slot->walk.len)
+	{
+		/* the input ends before the bytes the walk needs, which ends the walk */
+		if (res == 0)
+		{
+			finish(engine, slot_index, dbmd_walk_step(&slot->walk, &slot->ctx, NULL), 1);
+			return;
+		}
+
+		/* a short read, as network file systems may return, is continued for the
+		 * rest of the bytes asked for */
+		submit_read(engine, slot_index, (size_t)(slot->window.end - slot->window.offset - slot->window.len));
+		return;
+	}
+
+	/* the next read follows the bytes actually read */
+	slot->window.end = slot->window.offset + slot->window.len;
+	advance(engine, slot_index);
+}
+
+/*******************************************************************************************
+static void finish(...)
+-Purpose:
+	Completes the scan of a file: closes it, parses the dbmd chunk found by the
+	walk if asked to, which is still held in the slot, renders the result and
+	frees the slot
+********************************************************************************************/
+static void finish(URingEngine *engine, size_t slot_index, int error, int parse)
+{
+	URingSlot *slot = &engine->slots[slot_index];
+	URingResult *result = &engine->results[slot->index];
+	const DBMDBatchConfig *config = engine->config;
+	const char *path = engine->list->paths[slot->index];
+	const DBMDMemoEntry *entry = NULL;
+	DBMDSource *source = NULL;
+
+	/* a dbmd chunk too large for the slot is parsed from the file, which the
+	 * source then owns */
+	if ( parse && !error && (slot->ctx.dbmd_chunk_size > MAX_DBMD_SIZE) && (slot->fd >= 0) )
+	{
+		if ( (error = dbmd_source_open_fd(&source, slot->fd, 0)) == DB_ERR_OK )
+		{
+			slot->fd = -1;
+			slot->ctx.source = source;
+		}
+	}
+
+	if (slot->fd >= 0)
+		close(slot->fd);
+	slot->fd = -1;
+
+	if ( parse && !error && config->list_segments )
+		error = dbmd_index(&slot->ctx, DBMD_INDEX_VERIFY);
+	else if ( parse && !error && config->memo )
+		error = dbmd_memo_parse(config->memo, &slot->ctx, &entry);
+	else if ( parse && !error )
+		error = dbmd_parse(&slot->ctx);
+	if (source)
+	{
+		slot->read_count += source->read_count;
+		slot->bytes_read += source->bytes_read;
+		dbmd_source_close(source);
+		slot->ctx.source = NULL;
+	}
+	slot->ctx.read_count = slot->read_count;
+	slot->ctx.bytes_read = slot->bytes_read;
+	slot->ctx.stats.seeks += slot->window.seeks;
+	if ( config->store && !config->list_segments )
+		dbmd_store_add(config->store, path, &slot->ctx, error);
+	dbmd_batch_format(config, &slot->ctx, path, error, entry, &result->output);
+	slot->ctx.dbmd_chunk = NULL;
+
+	result->error = error;
+	result->read_count = slot->read_count;
+	result->bytes_read = slot->bytes_read;
+	result->done = 1;
+
+	slot->state = SLOT_FREE;
+	engine->free_slots[engine->num_free++] = slot_index;
+}
+
+/*******************************************************************************************
+static void scan_sync(...)
+-Purpose:
+	Scans a file that cannot be read with positioned reads, such as standard
+	input, a URL or a pipe, with a blocking scan on the engine thread
+********************************************************************************************/
+static void scan_sync(URingEngine *engine, DBMDContext *ctx, size_t index)
+{
+	URingResult *result = &engine->results[index];
+	int cached = 0;
+
+	result->error = dbmd_batch_scan_file(engine->config, ctx, engine->list->paths[index], -1, &result->output, &cached);
+	result->read_count = ctx->read_count;
+	result->bytes_read = ctx->bytes_read;
+}
+
+#endif /* DBMD_HAVE_URING */
+
+/*******************************************************************************************
+int dbmd_uring_run(...)
+-Purpose:
+	Scans every file of the list with asynchronous opens and reads, keeping up
+	to queue_depth files in flight on the calling thread, and writes the results
+	to the output stream in list order
+-Inputs:
+	const DBMDPathList *list		-	Input files
+	const DBMDBatchConfig *config	-	Batch configuration
+	FILE *out						-	Output stream
+	DBMDBatchSummary *summary		-	Receives the counts of files scanned
+-Returns:
+	int								-	0 on success, -1 if out of memory,
+										DBMD_URING_UNAVAILABLE if io_uring cannot be used
+********************************************************************************************/
+int dbmd_uring_run(const DBMDPathList *list, const DBMDBatchConfig *config, FILE *out, DBMDBatchSummary *summary)
+{
+#ifdef DBMD_HAVE_URING
+	URingEngine engine;
+	URingResult *result;
+	struct io_uring_cqe *cqe;
+	size_t depth = config->queue_depth > 0 ? (size_t)config->queue_depth : DEFAULT_QUEUE_DEPTH;
+	size_t window;
+	size_t next_file = 0;
+	size_t next_write = 0;
+	size_t i;
+	unsigned head;
+	unsigned tail;
+	const char *path;
+	int error = 0;
+
+	/* the scan cache, memory mapped input, the tail probe and the axml chunk scan need
+	   blocking calls per file */
+	if ( config->cache || config->tail_probe || config->scan_adm || (config->io_mode != DBMD_IO_READ) )
+		return DBMD_URING_UNAVAILABLE;
+
+	memset(summary, 0, sizeof(DBMDBatchSummary));
+	if (list->count == 0)
+		return 0;
+	if (depth > list->count)
+		depth = list->count;
+	if (depth > 4096)
+		depth = 4096;
+	window = depth * RESULT_WINDOW_PER_SLOT;
+
+	engine.list = list;
+	engine.config = config;
+	if (uring_setup(&engine.ring, (unsigned)depth))
+		return DBMD_URING_UNAVAILABLE;
+
+	engine.slots = calloc(depth, sizeof(URingSlot));
+	engine.free_slots = malloc(depth * sizeof(size_t));
+	engine.results = calloc(list->count, sizeof(URingResult));
+	if ( !engine.slots || !engine.free_slots || !engine.results )
+	{
+		free(engine.slots);
+		free(engine.free_slots);
+		free(engine.results);
+		uring_close(&engine.ring);
+		return -1;
+	}
+	engine.num_free = 0;
+	for (i = depth; i-- > 0; )
+	{
+		dbmd_init(&engine.slots[i].ctx);
+		engine.slots[i].ctx.timing = (config->stats != NULL);
+		engine.slots[i].fd = -1;
+		engine.slots[i].window.buf = malloc(DBMD_MAX_PREFETCH);
+		if (!engine.slots[i].window.buf)
+			error = -1;
+		engine.free_slots[engine.num_free++] = i;
+	}
+
+	while ( !error && (next_write < list->count) )
+	{
+		/* start files while slots are free and the writer is not too far behind */
+		while ( engine.num_free && (next_file < list->count) && (next_file < next_write + window) )
+		{
+			path = list->paths[next_file];
+			if ( !strcmp(path, DBMD_STDIN_NAME) || dbmd_source_is_url(path) )
+			{
+				scan_sync(&engine, &engine.slots[engine.free_slots[engine.num_free - 1]].ctx, next_file);
+				engine.results[next_file].done = 1;
+			}
+			else
+			{
+				start_file(&engine, next_file);
+			}
+			next_file++;
+		}
+
+		/* write results in list order as they become ready */
+		while ( (next_write < next_file) && engine.results[next_write].done )
+		{
+			result = &engine.results[next_write];
+			if (dbmd_output_write(&result->output, out) != DB_ERR_OK)
+			{
+				fprintf(stderr, "%s: Error, out of memory rendering the result!\n", list->paths[next_write]);
+				result->error = DB_ERR_NOMEMORY;
+			}
+			dbmd_output_free(&result->output);
+			next_write++;
+
+			summary->num_files++;
+			summary->num_reads += result->read_count;
+			summary->num_bytes += result->bytes_read;
+			if (result->error == DB_ERR_OK)
+				summary->num_passed++;
+			else
+				summary->num_failed++;
+		}
+		if ( (next_write == list->count) || (engine.num_free == depth) )
+			continue;
+
+		if (uring_submit_and_wait(&engine.ring))
+		{
+			error = -1;
+			break;
+		}
+
+		/* completions may start further operations, which are submitted next time */
+		head = *engine.ring.cq_head;
+		tail = __atomic_load_n(engine.ring.cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail)
+		{
+			cqe = &engine.ring.cqes[head & *engine.ring.cq_mask];
+			complete(&engine, (size_t)cqe->user_data, cqe->res);
+			head++;
+			__atomic_store_n(engine.ring.cq_head, head, __ATOMIC_RELEASE);
+			tail = __atomic_load_n(engine.ring.cq_tail, __ATOMIC_ACQUIRE);
+		}
+	}
+
+	for (i = 0; i < depth; i++)
+	{
+		if (engine.slots[i].fd >= 0)
+			close(engine.slots[i].fd);
+		free(engine.slots[i].window.buf);
+		dbmd_free(&engine.slots[i].ctx);
+	}
+	for (i = next_write; i < list->count; i++)
+		dbmd_output_free(&engine.results[i].output);
+	uring_close(&engine.ring);
+	free(engine.slots);
+	free(engine.free_slots);
+	free(engine.results);
+
+	return error;
+#else
+	(void)list;
+	(void)config;
+	(void)out;
+	(void)summary;
+	return DBMD_URING_UNAVAILABLE;
+#endif
+}
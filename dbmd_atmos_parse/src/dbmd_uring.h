@@ -0,0 +1,43 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_URING_H
+#define DBMD_URING_H
+
+#include <stdio.h>
+#include "dbmd_batch.h"
+
+/* This defines the io_uring scan engine. Instead of one blocking thread per
+ *  file, a single thread keeps up to queue_depth files in flight: each file
+ *  is a state machine driving the chunk walk (DBMDWalk) with asynchronous
+ *  opens and reads, so the latency of slow storage is overlapped across
+ *  files rather than paid one read at a time. It is only available on Linux
+ *  kernels providing io_uring; dbmd_batch_run() falls back to worker threads
+ *  otherwise.
+ */
+#define DBMD_URING_UNAVAILABLE 1 /* dbmd_uring_run() result: io_uring cannot be used */
+
+int dbmd_uring_run(const DBMDPathList *list, const DBMDBatchConfig *config, FILE *out, DBMDBatchSummary *summary);
+
+#endif /* DBMD_URING_H */
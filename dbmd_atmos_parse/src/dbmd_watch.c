@@ -0,0 +1,696 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifdef __linux__
+#define _GNU_SOURCE /* ppoll() */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef __linux__
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#endif
+
+#include "dbmd_watch.h"
+
+#ifdef __linux__
+
+/* Events of a watched directory. A file is complete when it is closed after
+ * writing or renamed into the directory, and forgotten when it is deleted or
+ * renamed away before its debounce interval has passed. */
+#define WATCH_DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_ONLYDIR)
+
+#define WATCH_EVENT_BUFFER 65536
+#define WATCH_NONE ((size_t)-1)
+
+/* A file waiting out its debounce interval */
+typedef struct
+{
+	char *path;        /* File name */
+	uint64_t deadline; /* Time the file is parsed at, in milliseconds */
+	uint32_t hash;     /* Hash of the file name */
+	size_t prev;       /* Previous entry in deadline order */
+	size_t next;       /* Next entry in deadline order, or next free entry */
+	size_t chain;      /* Next entry of the same hash bucket */
+} WatchEntry;
+
+typedef struct
+{
+	int fd;                        /* inotify instance */
+	char **dirs;                   /* Directory of each watch descriptor */
+	size_t dirs_size;              /* Number of entries of dirs */
+	size_t num_watches;            /* Number of live watch descriptors */
+	WatchEntry *entries;           /* Pending files, queue_limit entries */
+	size_t *buckets;               /* Hash buckets of the pending files */
+	size_t bucket_mask;            /* Number of hash buckets minus one */
+	size_t head;                   /* Pending file with the earliest deadline */
+	size_t tail;                   /* Pending file with the latest deadline */
+	size_t free_list;              /* Unused entries */
+	size_t count;                  /* Number of pending files */
+	size_t limit;                  /* Maximum number of pending files */
+	uint64_t debounce;             /* Debounce interval in milliseconds */
+	DBMDBatchConfig config;        /* Scan configuration */
+	DBMDContext ctx;               /* Parse context */
+	DBMDOutput output;             /* Rendered result */
+	FILE *out;                     /* Result stream */
+	FILE *report;                  /* Message stream */
+	DBMDWatchSummary *summary;
+} DBMDWatch;
+
+static volatile sig_atomic_t watch_stop = 0;
+
+/* Local function prototypes */
+static void watch_signal(int sig);
+static uint64_t now_ms(void);
+static uint32_t hash_path(const char *path);
+static char *join_path(const char *dir, const char *name);
+static int has_path_prefix(const char *path, const char *prefix);
+static size_t find_entry(DBMDWatch *w, const char *path, uint32_t hash);
+static void unlink_entry(DBMDWatch *w, size_t index);
+static void append_entry(DBMDWatch *w, size_t index);
+static void parse_entry(DBMDWatch *w, size_t index);
+static int queue_file(DBMDWatch *w, const char *path);
+static void drop_file(DBMDWatch *w, const char *path);
+static int add_tree(DBMDWatch *w, const char *path, int queue_existing);
+static void remove_tree(DBMDWatch *w, const char *path);
+static void handle_event(DBMDWatch *w, const struct inotify_event *event);
+
+/*******************************************************************************************
+static void watch_signal(...)
+-Purpose:
+	SIGINT and SIGTERM handler, ends the watch loop
+********************************************************************************************/
+static void watch_signal(int sig)
+{
+	(void)sig;
+	watch_stop = 1;
+}
+
+/*******************************************************************************************
+static uint64_t now_ms(...)
+-Purpose:
+	Returns the monotonic clock in milliseconds
+********************************************************************************************/
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*******************************************************************************************
+static uint32_t hash_path(...)
+-Purpose:
+	FNV-1a hash of a file name
+********************************************************************************************/
+static uint32_t hash_path(const char *path)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*path)
+	{
+		hash ^= (unsigned char)*path++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*******************************************************************************************
+static char *join_path(...)
+-Purpose:
+	Returns a newly allocated "dir/name", or NULL if out of memory
+********************************************************************************************/
+static char *join_path(const char *dir, const char *name)
+{
+	size_t dir_len = strlen(dir);
+	size_t name_len = strlen(name);
+	char *path = malloc(dir_len + name_len + 2);
+
+	if (!path)
+		return NULL;
+	memcpy(path, dir, dir_len);
+	if ( (dir_len == 0) || (dir[dir_len - 1] != '/') )
+		path[dir_len++] = '/';
+	memcpy(path + dir_len, name, name_len + 1);
+
+	return path;
+}
+
+/*******************************************************************************************
+static int has_path_prefix(...)
+-Purpose:
+	Tests whether path is the directory prefix or lies below it
+********************************************************************************************/
+static int has_path_prefix(const char *path, const char *prefix)
+{
+	size_t len = strlen(prefix);
+
+	return !strncmp(path, prefix, len) && ( (path[len] == '\0') || (path[len] == '/') );
+}
+
+/*******************************************************************************************
+static size_t find_entry(...)
+-Purpose:
+	Looks up a pending file
+-Returns:
+	size_t			-	entry index, WATCH_NONE if the file is not pending
+********************************************************************************************/
+static size_t find_entry(DBMDWatch *w, const char *path, uint32_t hash)
+{
+	size_t index = w->buckets[hash & w->bucket_mask];
+
+	while (index != WATCH_NONE)
+	{
+		if ( (w->entries[index].hash == hash) && !strcmp(w->entries[index].path, path) )
+			break;
+		index = w->entries[index].chain;
+	}
+
+	return index;
+}
+
+/*******************************************************************************************
+static void unlink_entry(...)
+-Purpose:
+	Removes a pending file from the deadline order
+********************************************************************************************/
+static void unlink_entry(DBMDWatch *w, size_t index)
+{
+	WatchEntry *entry = &w->entries[index];
+
+	if (entry->prev != WATCH_NONE)
+		w->entries[entry->prev].next = entry->next;
+	else
+		w->head = entry->next;
+	if (entry->next != WATCH_NONE)
+		w->entries[entry->next].prev = entry->prev;
+	else
+		w->tail = entry->prev;
+}
+
+/*******************************************************************************************
+static void append_entry(...)
+-Purpose:
+	Sets the deadline of a pending file to one debounce interval from now.
+	As the interval is fixed, this places it last in deadline order.
+********************************************************************************************/
+static void append_entry(DBMDWatch *w, size_t index)
+{
+	WatchEntry *entry = &w->entries[index];
+
+	entry->deadline = now_ms() + w->debounce;
+	entry->prev = w->tail;
+	entry->next = WATCH_NONE;
+	if (w->tail != WATCH_NONE)
+		w->entries[w->tail].next = index;
+	else
+		w->head = index;
+	w->tail = index;
+}
+
+/*******************************************************************************************
+static void parse_entry(...)
+-Purpose:
+	Removes a file from the queue, parses it and writes its result
+********************************************************************************************/
+static void parse_entry(DBMDWatch *w, size_t index)
+{
+	WatchEntry *entry = &w->entries[index];
+	size_t *link = &w->buckets[entry->hash & w->bucket_mask];
+	DBMDBatchSummary *summary = &w->summary->batch;
+	int cached = 0;
+	int error;
+
+	unlink_entry(w, index);
+	while (*link != index)
+		link = &w->entries[*link].chain;
+	*link = entry->chain;
+	w->count--;
+
+	dbmd_output_reset(&w->output);
+	error = dbmd_batch_scan_file(&w->config, &w->ctx, entry->path, -1, &w->output, &cached);
+	if (dbmd_output_write(&w->output, w->out) != DB_ERR_OK)
+	{
+		fprintf(w->report, "%s: Error, out of memory rendering the result!\n", entry->path);
+		error = DB_ERR_NOMEMORY;
+	}
+	fflush(w->out);
+
+	summary->num_files++;
+	summary->num_reads += w->ctx.read_count;
+	summary->num_bytes += w->ctx.bytes_read;
+	summary->num_cached += cached;
+	if (error == DB_ERR_OK)
+		summary->num_passed++;
+	else
+		summary->num_failed++;
+
+	free(entry->path);
+	entry->path = NULL;
+	entry->next = w->free_list;
+	w->free_list = index;
+}
+
+/*******************************************************************************************
+static int queue_file(...)
+-Purpose:
+	Queues a file that has been completed, or restarts its debounce interval if
+	it is already queued. If the queue is full, the file that has waited
+	longest is parsed straight away to make room.
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int queue_file(DBMDWatch *w, const char *path)
+{
+	uint32_t hash = hash_path(path);
+	size_t index = find_entry(w, path, hash);
+	WatchEntry *entry;
+
+	if (index != WATCH_NONE)
+	{
+		unlink_entry(w, index);
+		append_entry(w, index);
+		return 0;
+	}
+
+	if (w->count == w->limit)
+	{
+		w->summary->num_forced++;
+		parse_entry(w, w->head);
+	}
+
+	index = w->free_list;
+	entry = &w->entries[index];
+	entry->path = strdup(path);
+	if (!entry->path)
+		return -1;
+	w->free_list = entry->next;
+	entry->hash = hash;
+	entry->chain = w->buckets[hash & w->bucket_mask];
+	w->buckets[hash & w->bucket_mask] = index;
+	append_entry(w, index);
+	w->count++;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void drop_file(...)
+-Purpose:
+	Forgets a queued file that has been deleted or renamed away
+********************************************************************************************/
+static void drop_file(DBMDWatch *w, const char *path)
+{
+	uint32_t hash = hash_path(path);
+	size_t index = find_entry(w, path, hash);
+	size_t *link;
+
+	if (index == WATCH_NONE)
+		return;
+
+	unlink_entry(w, index);
+	link = &w->buckets[hash & w->bucket_mask];
+	while (*link != index)
+		link = &w->entries[*link].chain;
+	*link = w->entries[index].chain;
+	w->count--;
+
+	free(w->entries[index].path);
+	w->entries[index].path = NULL;
+	w->entries[index].next = w->free_list;
+	w->free_list = index;
+}
+
+/*******************************************************************************************
+static int add_tree(...)
+-Purpose:
+	Watches a directory and every directory below it. Files already present in
+	a directory that appeared while watching may have been completed before
+	its watch was added, so these are queued.
+-Returns:
+	int				-	0 on success, -1 if the directory could not be watched
+********************************************************************************************/
+static int add_tree(DBMDWatch *w, const char *path, int queue_existing)
+{
+	struct dirent *ent;
+	struct stat st;
+	char **dirs;
+	char *name;
+	char *dir;
+	DIR *dp;
+	size_t size;
+	int wd;
+
+	wd = inotify_add_watch(w->fd, path, WATCH_DIR_EVENTS);
+	if (wd < 0)
+		return -1;
+
+	if ((size_t)wd >= w->dirs_size)
+	{
+		size = w->dirs_size ? w->dirs_size : 64;
+		while (size <= (size_t)wd)
+			size *= 2;
+		dirs = realloc(w->dirs, size * sizeof(char *));
+		if (!dirs)
+		{
+			inotify_rm_watch(w->fd, wd);
+			return -1;
+		}
+		memset(dirs + w->dirs_size, 0, (size - w->dirs_size) * sizeof(char *));
+		w->dirs = dirs;
+		w->dirs_size = size;
+	}
+
+	/* a directory watched again, for instance after a rename, keeps its descriptor */
+	dir = strdup(path);
+	if (!dir)
+	{
+		if (!w->dirs[wd])
+			inotify_rm_watch(w->fd, wd);
+		return -1;
+	}
+	if (w->dirs[wd])
+		free(w->dirs[wd]);
+	else
+		w->num_watches++;
+	w->dirs[wd] = dir;
+	w->summary->num_dirs++;
+
+	dp = opendir(path);
+	if (!dp)
+		return 0;
+	while ( (ent = readdir(dp)) )
+	{
+		if ( !strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..") )
+			continue;
+		if ( !queue_existing && (ent->d_type != DT_DIR) && (ent->d_type != DT_UNKNOWN) )
+			continue;
+		name = join_path(path, ent->d_name);
+		if (!name)
+			break;
+		if (lstat(name, &st) == 0)
+		{
+			if (S_ISDIR(st.st_mode))
+				add_tree(w, name, queue_existing);
+			else if ( queue_existing && S_ISREG(st.st_mode) && dbmd_has_wav_extension(ent->d_name) )
+				queue_file(w, name);
+		}
+		free(name);
+	}
+	closedir(dp);
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void remove_tree(...)
+-Purpose:
+	Stops watching a directory renamed away and every directory below it, and
+	forgets the files queued in them
+********************************************************************************************/
+static void remove_tree(DBMDWatch *w, const char *path)
+{
+	size_t index;
+	size_t next;
+	size_t wd;
+
+	for (wd = 0; wd < w->dirs_size; wd++)
+	{
+		if ( w->dirs[wd] && has_path_prefix(w->dirs[wd], path) )
+			inotify_rm_watch(w->fd, (int)wd);
+	}
+
+	for (index = w->head; index != WATCH_NONE; index = next)
+	{
+		next = w->entries[index].next;
+		if (has_path_prefix(w->entries[index].path, path))
+			drop_file(w, w->entries[index].path);
+	}
+}
+
+/*******************************************************************************************
+static void handle_event(...)
+-Purpose:
+	Acts on one inotify event
+********************************************************************************************/
+static void handle_event(DBMDWatch *w, const struct inotify_event *event)
+{
+	char *path;
+
+	if (event->mask & IN_Q_OVERFLOW)
+	{
+		w->summary->num_overflows++;
+		fprintf(w->report, "\nWarning, inotify event queue overflowed, files may have been missed!\n");
+		return;
+	}
+	if ( (event->wd < 0) || ((size_t)event->wd >= w->dirs_size) || !w->dirs[event->wd] )
+		return;
+	if (event->mask & IN_IGNORED)
+	{
+		/* the directory was deleted, renamed away or unmounted */
+		free(w->dirs[event->wd]);
+		w->dirs[event->wd] = NULL;
+		w->num_watches--;
+		return;
+	}
+	if (event->len == 0)
+		return;
+
+	path = join_path(w->dirs[event->wd], event->name);
+	if (!path)
+		return;
+
+	if (event->mask & IN_ISDIR)
+	{
+		if (event->mask & (IN_CREATE | IN_MOVED_TO))
+			add_tree(w, path, 1);
+		else if (event->mask & IN_MOVED_FROM)
+			remove_tree(w, path);
+	}
+	else if (dbmd_has_wav_extension(event->name))
+	{
+		w->summary->num_events++;
+		if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+		{
+			if (queue_file(w, path))
+				fprintf(w->report, "\nError, out of memory queueing %s!\n", path);
+		}
+		else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+		{
+			drop_file(w, path);
+		}
+	}
+
+	free(path);
+}
+
+#endif /* __linux__ */
+
+/*******************************************************************************************
+int dbmd_watch_run(...)
+-Purpose:
+	Watches directory trees and parses every ADM WAV file completed in them,
+	writing each result as soon as it is available. Runs until SIGINT or SIGTERM
+	is received or no watched directory remains; files still waiting out their
+	debounce interval are then parsed before returning.
+-Inputs:
+	char * const *dirs				-	Directories to watch
+	int num_dirs					-	Number of directories
+	const DBMDBatchConfig *config	-	Scan configuration
+	const DBMDWatchConfig *watch	-	Debounce interval and queue limit
+	FILE *out						-	Result stream
+	FILE *report					-	Message stream
+	DBMDWatchSummary *summary		-	Counts of the files and events handled
+-Returns:
+	int								-	0 on success, -1 if no directory could be watched
+********************************************************************************************/
+int dbmd_watch_run(char * const *dirs, int num_dirs, const DBMDBatchConfig *config, const DBMDWatchConfig *watch,
+	FILE *out, FILE *report, DBMDWatchSummary *summary)
+{
+#ifdef __linux__
+	DBMDWatch w;
+	struct sigaction action;
+	struct sigaction old_int;
+	struct sigaction old_term;
+	struct pollfd pfd;
+	struct timespec timeout;
+	sigset_t block;
+	sigset_t old_mask;
+	const struct inotify_event *event;
+	char *buffer;
+	uint64_t now;
+	size_t num_buckets;
+	size_t i;
+	ssize_t len;
+	ssize_t pos;
+	int result;
+
+	memset(summary, 0, sizeof(*summary));
+	memset(&w, 0, sizeof(w));
+	w.limit = watch->queue_limit ? watch->queue_limit : DBMD_WATCH_QUEUE_LIMIT;
+	w.debounce = (watch->debounce_ms > 0) ? (uint64_t)watch->debounce_ms : 0;
+	w.config = *config;
+	w.config.show_names = 1;
+	w.out = out;
+	w.report = report;
+	w.summary = summary;
+	w.head = WATCH_NONE;
+	w.tail = WATCH_NONE;
+
+	for (num_buckets = 16; num_buckets < 2 * w.limit; num_buckets *= 2)
+		;
+	w.bucket_mask = num_buckets - 1;
+	w.entries = malloc(w.limit * sizeof(WatchEntry));
+	w.buckets = malloc(num_buckets * sizeof(size_t));
+	buffer = malloc(WATCH_EVENT_BUFFER);
+	if ( !w.entries || !w.buckets || !buffer )
+	{
+		free(w.entries);
+		free(w.buckets);
+		free(buffer);
+		return -1;
+	}
+	for (i = 0; i < num_buckets; i++)
+		w.buckets[i] = WATCH_NONE;
+	for (i = 0; i < w.limit; i++)
+	{
+		w.entries[i].path = NULL;
+		w.entries[i].next = i + 1;
+	}
+	w.entries[w.limit - 1].next = WATCH_NONE;
+	w.free_list = 0;
+
+	w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (w.fd < 0)
+	{
+		free(w.entries);
+		free(w.buckets);
+		free(buffer);
+		return -1;
+	}
+	for (i = 0; i < (size_t)num_dirs; i++)
+	{
+		if (add_tree(&w, dirs[i], 0))
+			fprintf(report, "\nError, cannot watch %s: %s\n", dirs[i], strerror(errno));
+	}
+
+	result = -1;
+	if (w.num_watches)
+	{
+		result = 0;
+		dbmd_init(&w.ctx);
+		w.ctx.io_mode = config->io_mode;
+		w.ctx.tail_probe = config->tail_probe;
+		w.ctx.timing = (config->stats != NULL);
+		dbmd_output_init(&w.output);
+
+		/* The signals are only delivered while waiting for events, so a stop
+		 * request never interrupts a parse and is never missed */
+		watch_stop = 0;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = watch_signal;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGINT, &action, &old_int);
+		sigaction(SIGTERM, &action, &old_term);
+		sigemptyset(&block);
+		sigaddset(&block, SIGINT);
+		sigaddset(&block, SIGTERM);
+		sigprocmask(SIG_BLOCK, &block, &old_mask);
+
+		pfd.fd = w.fd;
+		pfd.events = POLLIN;
+		while ( !watch_stop && w.num_watches )
+		{
+			/* parse the files whose debounce interval has passed */
+			now = now_ms();
+			while ( (w.head != WATCH_NONE) && (w.entries[w.head].deadline <= now) )
+				parse_entry(&w, w.head);
+
+			if (w.head != WATCH_NONE)
+			{
+				timeout.tv_sec = (time_t)((w.entries[w.head].deadline - now) / 1000);
+				timeout.tv_nsec = (long)((w.entries[w.head].deadline - now) % 1000) * 1000000;
+			}
+			if (ppoll(&pfd, 1, (w.head != WATCH_NONE) ? &timeout : NULL, &old_mask) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				fprintf(report, "\nError waiting for file events: %s\n", strerror(errno));
+				break;
+			}
+			if (!(pfd.revents & POLLIN))
+				continue;
+
+			while ( (len = read(w.fd, buffer, WATCH_EVENT_BUFFER)) > 0 )
+			{
+				for (pos = 0; pos < len; pos += sizeof(struct inotify_event) + event->len)
+				{
+					event = (const struct inotify_event *)(buffer + pos);
+					handle_event(&w, event);
+				}
+			}
+		}
+
+		/* files completed before the stop request are not lost */
+		while (w.head != WATCH_NONE)
+			parse_entry(&w, w.head);
+
+		sigprocmask(SIG_SETMASK, &old_mask, NULL);
+		sigaction(SIGINT, &old_int, NULL);
+		sigaction(SIGTERM, &old_term, NULL);
+		dbmd_output_free(&w.output);
+		dbmd_free(&w.ctx);
+	}
+
+	close(w.fd);
+	for (i = 0; i < w.dirs_size; i++)
+		free(w.dirs[i]);
+	free(w.dirs);
+	free(w.entries);
+	free(w.buckets);
+	free(buffer);
+
+	return result;
+#else
+	(void)dirs;
+	(void)num_dirs;
+	(void)config;
+	(void)watch;
+	(void)out;
+	(void)report;
+	(void)summary;
+	return -1;
+#endif
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_WATCH_H
+#define DBMD_WATCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "dbmd_batch.h"
+
+/* This defines the watch mode. Directory trees are watched with inotify and
+ *  every ADM WAV file written or moved into them is parsed once it is complete,
+ *  that is once it has been closed after writing or renamed into place and no
+ *  further such event has arrived for the debounce interval. Results are
+ *  written as they happen. Watch mode is only available on Linux.
+ */
+#define DBMD_WATCH_DEBOUNCE_MS 200
+#define DBMD_WATCH_QUEUE_LIMIT 4096
+
+typedef struct
+{
+	int debounce_ms;    /* Quiet time after the last event before a file is parsed */
+	size_t queue_limit; /* Maximum number of files waiting out their debounce interval */
+} DBMDWatchConfig;
+
+typedef struct
+{
+	DBMDBatchSummary batch; /* Files scanned */
+	size_t num_events;      /* Number of file events received */
+	size_t num_forced;      /* Number of files parsed early because the queue was full */
+	size_t num_overflows;   /* Number of times the kernel event queue overflowed */
+	size_t num_dirs;        /* Number of directories watched */
+} DBMDWatchSummary;
+
+int dbmd_watch_run(char * const *dirs, int num_dirs, const DBMDBatchConfig *config, const DBMDWatchConfig *watch,
+	FILE *out, FILE *report, DBMDWatchSummary *summary);
+
+#endif /* DBMD_WATCH_H */
@@ -0,0 +1,1328 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <time.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#include <windows.h>
+#endif
+
+#include "dbmd_wav_parse.h"
+
+/* Bytes of the input held by the walker, read with the source's prefetch size */
+typedef struct
+{
+	DBMDSource *source;
+	unsigned char buf[DBMD_MAX_PREFETCH];
+	DBMDWindow window; /* Window over buf */
+	int error;         /* Error reported by the source, if any */
+} DBMDReader;
+
+/* Local function prototypes */
+static int open_source(DBMDContext *ctx, const char *filename);
+static int parse_chunk(DBMDContext *ctx, DBMDChunkParser *parser, DBMDSegmentIndex *index, int phase);
+static int read_chunk(DBMDContext *ctx, DBMDChunkParser *parser, DBMDSegmentIndex *index);
+static int scan_source(DBMDSource *source, DBMDContext *ctx, DBMDChunkList *list);
+static int walk_chunks(DBMDReader *reader, DBMDContext *ctx, DBMDChunkList *list);
+static int walk_record(DBMDWalk *walk, const unsigned char *header, uint64_t size);
+static int walk_end(DBMDWalk *walk, DBMDContext *ctx);
+static int probe_tail(DBMDReader *reader, DBMDReader *tail, DBMDContext *ctx, DBMDWalk *walk);
+static int tail_chain(const unsigned char *data, size_t pos, size_t end);
+static void reader_init(DBMDReader *reader, DBMDSource *source, uint64_t end);
+static const unsigned char *fetch(DBMDReader *reader, uint64_t offset, size_t len);
+static unsigned char required_mask(int b_is_RF64_BW64, int b_ds64_present);
+static const char *chunk_data(const DBMDContext *ctx);
+static uint32_t read_le32(const unsigned char *buf);
+
+/*******************************************************************************************
+void dbmd_init(...)
+-Purpose:
+	Initializes a parse context before first use
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+********************************************************************************************/
+void dbmd_init(DBMDContext *ctx)
+{
+	memset(ctx, 0, sizeof(DBMDContext));
+}
+
+/*******************************************************************************************
+int dbmd_open(...)
+-Purpose:
+	Opens the input ADM WAV file and attaches it to the parse context. The name -
+	selects standard input and http:// URLs are read with HTTP range requests;
+	local files are opened according to the context I/O mode.
+-Inputs:
+	DBMDContext *ctx		-	Parse context
+	const char *filename	-	Input file name
+-Returns:
+	int						-	error code
+********************************************************************************************/
+int dbmd_open(DBMDContext *ctx, const char *filename)
+{
+	uint64_t start = 0;
+	int error;
+
+	/* Release any file left over from a previous scan */
+	dbmd_close(ctx);
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	ctx->adm.scanned = 0;
+	if (ctx->timing)
+		start = dbmd_clock_ns();
+
+	error = open_source(ctx, filename);
+	if (ctx->timing)
+		ctx->stats.phase_ns[DBMD_PHASE_OPEN] = dbmd_clock_ns() - start;
+
+	return error;
+}
+
+/*******************************************************************************************
+static int open_source(...)
+-Purpose:
+	Opens the source named by dbmd_open()
+********************************************************************************************/
+static int open_source(DBMDContext *ctx, const char *filename)
+{
+	int error;
+	int fd;
+
+	if (!strcmp(filename, DBMD_STDIN_NAME))
+	{
+		/* Standard input is scanned as a stream */
+#ifndef WIN32
+		fd = dup(STDIN_FILENO);
+#else
+		fd = _dup(0);
+		if (fd >= 0)
+			_setmode(fd, _O_BINARY);
+#endif
+		if (fd < 0)
+			return DB_ERR_FILEOPEN;
+		if ( (error = dbmd_source_open_fd(&ctx->source, fd, 1)) )
+		{
+#ifndef WIN32
+			close(fd);
+#else
+			_close(fd);
+#endif
+		}
+		return error;
+	}
+
+	if (dbmd_source_is_url(filename))
+		return dbmd_source_open_http(&ctx->source, filename);
+
+	if (ctx->io_mode == DBMD_IO_MMAP)
+		return dbmd_source_open_mmap(&ctx->source, filename);
+
+	return dbmd_source_open_file(&ctx->source, filename, ctx->io_mode == DBMD_IO_STREAM);
+}
+
+/*******************************************************************************************
+void dbmd_attach(...)
+-Purpose:
+	Attaches an application supplied source to the parse context. The context
+	takes ownership of the source and closes it in dbmd_close().
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+	DBMDSource *source	-	Input source
+********************************************************************************************/
+void dbmd_attach(DBMDContext *ctx, DBMDSource *source)
+{
+	dbmd_close(ctx);
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	ctx->adm.scanned = 0;
+	ctx->source = source;
+}
+
+/*******************************************************************************************
+int dbmd_scan(...)
+-Purpose:
+	Walks the chunks of the opened file and locates the dbmd chunk
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+-Returns:
+	int					-	error code
+********************************************************************************************/
+int dbmd_scan(DBMDContext *ctx)
+{
+	if (!ctx->source)
+		return DB_ERR_FILEOPEN;
+
+	return parse_wav_header(ctx->source, ctx);
+}
+
+/*******************************************************************************************
+int dbmd_scan_chunks(...)
+-Purpose:
+	Walks all chunks of the opened file, recording the ID, offset and size of each
+	in a chunk list, and locates the dbmd chunk as dbmd_scan() does. Unlike a scan,
+	the walk does not stop once the required chunks have been found, and a file
+	without them is not an error.
+-Inputs:
+	DBMDContext *ctx		-	Parse context
+	DBMDChunkList *list		-	Receives the chunks; must be zeroed or have been
+								used before, and is released with dbmd_chunklist_free()
+-Returns:
+	int						-	error code
+********************************************************************************************/
+int dbmd_scan_chunks(DBMDContext *ctx, DBMDChunkList *list)
+{
+	if (!ctx->source)
+		return DB_ERR_FILEOPEN;
+
+	list->count = 0;
+	return scan_source(ctx->source, ctx, list);
+}
+
+/*******************************************************************************************
+void dbmd_chunklist_free(...)
+-Purpose:
+	Releases the chunks of a chunk list, leaving it empty
+-Inputs:
+	DBMDChunkList *list		-	Chunk list
+********************************************************************************************/
+void dbmd_chunklist_free(DBMDChunkList *list)
+{
+	free(list->chunks);
+	list->chunks = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+/*******************************************************************************************
+int dbmd_parse(...)
+-Purpose:
+	Parses the dbmd chunk found by dbmd_scan() into the context metadata. For a
+	mapped file this must be called before dbmd_close(). A chunk too large for the
+	context is read from the input again, unless the input can only be read in
+	order, in which case the scan parsed it as it passed it.
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+-Returns:
+	int					-	error code
+********************************************************************************************/
+int dbmd_parse(DBMDContext *ctx)
+{
+	DBMDChunkParser parser;
+	uint64_t start = 0;
+	int error;
+	int i;
+
+	/* A chunk the scan could only parse as it passed it has been decoded already */
+	if ( ctx->streamed && (ctx->dbmd_chunk_size > MAX_DBMD_SIZE) )
+		return ctx->streamed_error;
+
+	/* Index and verify all segments, then decode them in chunk order. A chunk left
+	 * in the input, or with more segments than the index holds, is decoded one
+	 * segment at a time instead. */
+	if (ctx->dbmd_chunk_size > MAX_DBMD_SIZE)
+		error = DB_ERR_TOOMANYSEGS;
+	else
+		error = dbmd_index(ctx, DBMD_INDEX_VERIFY);
+	if (error == DB_ERR_TOOMANYSEGS)
+	{
+		if ( !(ctx->status & WAV_DBMD_CHUNK_MASK) )
+			return DB_ERR_MISSINGCHUNK;
+		ctx->metadata.DolbyAtmosSeg.segment_exists = 0;
+		ctx->metadata.DolbyAtmosSupSeg.segment_exists = 0;
+		dbmd_chunk_init(&parser, ctx->dbmd_chunk_size, DBMD_CHUNK_DECODE);
+		return parse_chunk(ctx, &parser, NULL, DBMD_PHASE_DECODE);
+	}
+	if (error)
+		return error;
+
+	if (ctx->timing)
+		start = dbmd_clock_ns();
+
+	ctx->metadata.DolbyAtmosSeg.segment_exists = 0;
+	ctx->metadata.DolbyAtmosSupSeg.segment_exists = 0;
+	for (i = 0; i < ctx->segments.num_segments; i++)
+	{
+		if ( (error = parse_dbmd_segment(chunk_data(ctx), &ctx->segments.segments[i], &ctx->metadata)) )
+			break;
+	}
+
+	if (ctx->timing)
+		ctx->stats.phase_ns[DBMD_PHASE_DECODE] += dbmd_clock_ns() - start;
+
+	return error;
+}
+
+/*******************************************************************************************
+int dbmd_index(...)
+-Purpose:
+	Records the ID, offset and size of every segment of the dbmd chunk found by
+	dbmd_scan() in ctx->segments, without decoding any segment fields. A chunk
+	left in the input is indexed one segment at a time, reading the payloads
+	only to verify their checksums.
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+	int flags			-	DBMD_INDEX_VERIFY to also verify the segment checksums
+-Returns:
+	int					-	error code
+********************************************************************************************/
+int dbmd_index(DBMDContext *ctx, int flags)
+{
+	DBMDChunkParser parser;
+	uint64_t start = 0;
+	int error;
+
+	if ( !(ctx->status & WAV_DBMD_CHUNK_MASK) || !ctx->dbmd_chunk_size )
+		return DB_ERR_MISSINGCHUNK;
+
+	/* the scan indexed and verified a chunk it could only parse as it passed it */
+	if ( ctx->streamed && (ctx->dbmd_chunk_size > MAX_DBMD_SIZE) )
+		return ctx->streamed_index_error;
+
+	if (ctx->dbmd_chunk_size > MAX_DBMD_SIZE)
+	{
+		dbmd_chunk_init(&parser, ctx->dbmd_chunk_size, flags & DBMD_INDEX_VERIFY);
+		error = parse_chunk(ctx, &parser, &ctx->segments, DBMD_PHASE_CHECKSUM);
+		ctx->indexed = (error == DB_ERR_OK);
+		return error;
+	}
+
+	if (ctx->timing)
+		start = dbmd_clock_ns();
+
+	error = index_dbmd_segments(chunk_data(ctx), (int)ctx->dbmd_chunk_size, flags, &ctx->segments);
+	ctx->indexed = (error == DB_ERR_OK);
+
+	if (ctx->timing)
+		ctx->stats.phase_ns[DBMD_PHASE_CHECKSUM] += dbmd_clock_ns() - start;
+
+	return error;
+}
+
+/*******************************************************************************************
+int dbmd_decode(...)
+-Purpose:
+	Decodes only the segments with the given ID into the context metadata, for
+	example DOLBYATMOS_SUP_METD_SEG for the binaural render modes. The dbmd chunk
+	is indexed first if dbmd_index() has not been called since dbmd_scan(). As
+	with dbmd_parse(), a mapped file, or one with a dbmd chunk too large for the
+	context, must not be closed first.
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+	int segment_id		-	Metadata segment ID
+-Returns:
+	int					-	error code
+********************************************************************************************/
+int dbmd_decode(DBMDContext *ctx, int segment_id)
+{
+	DBMDChunkParser parser;
+	int error = DB_ERR_OK;
+	int i;
+
+	/* every segment of a chunk the scan parsed as it passed it is decoded already */
+	if ( ctx->streamed && (ctx->dbmd_chunk_size > MAX_DBMD_SIZE) )
+		return ctx->streamed_error;
+
+	/* the index of a chunk left in the input cannot be decoded from */
+	if ( !ctx->indexed && (ctx->dbmd_chunk_size <= MAX_DBMD_SIZE) )
+		error = dbmd_index(ctx, 0);
+	if ( error && (error != DB_ERR_TOOMANYSEGS) )
+		return error;
+
+	if (segment_id == DOLBYATMOS_METD_SEG)
+		ctx->metadata.DolbyAtmosSeg.segment_exists = 0;
+	else if (segment_id == DOLBYATMOS_SUP_METD_SEG)
+		ctx->metadata.DolbyAtmosSupSeg.segment_exists = 0;
+
+	if ( error || (ctx->dbmd_chunk_size > MAX_DBMD_SIZE) )
+	{
+		if ( !(ctx->status & WAV_DBMD_CHUNK_MASK) || !ctx->dbmd_chunk_size )
+			return DB_ERR_MISSINGCHUNK;
+		dbmd_chunk_init(&parser, ctx->dbmd_chunk_size, DBMD_CHUNK_DECODE);
+		parser.decode_id = segment_id;
+		return parse_chunk(ctx, &parser, NULL, DBMD_PHASE_DECODE);
+	}
+
+	for (i = 0; i < ctx->segments.num_segments; i++)
+	{
+		if (ctx->segments.segments[i].id != segment_id)
+			continue;
+		if ( (error = parse_dbmd_segment(chunk_data(ctx), &ctx->segments.segments[i], &ctx->metadata)) )
+			return error;
+	}
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+int dbmd_scan_axml(...)
+-Purpose:
+	Scans the axml chunk found by dbmd_scan() into ctx->adm, reading it through
+	a reader window of fixed size, so memory use does not depend on the size of
+	the chunk. A mapped file is scanned in place. The reads are added to the I/O
+	of the scan. A sequential source that has gone past the chunk fails with
+	DB_ERR_NOTSEEKABLE. Like dbmd_parse(), this must be called before dbmd_close().
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+-Returns:
+	int					-	error code, also kept in ctx->adm.error
+********************************************************************************************/
+int dbmd_scan_axml(DBMDContext *ctx)
+{
+	DBMDAxmlScanner scanner;
+	DBMDReader reader;
+	DBMDSource *source = ctx->source;
+	const unsigned char *data;
+	unsigned long read_count;
+	uint64_t bytes_read;
+	uint64_t start = 0;
+	uint64_t pos;
+	size_t len;
+	int error = DB_ERR_OK;
+
+	dbmd_axml_init(&scanner, &ctx->adm);
+	ctx->adm.size = ctx->axml_chunk_size;
+	ctx->adm.scanned = 1;
+
+	if (!source)
+		return ctx->adm.error = DB_ERR_FILEOPEN;
+	if ( !(ctx->status & WAV_AXML_CHUNK_MASK) )
+		return ctx->adm.error = DB_ERR_MISSINGCHUNK;
+
+	reader_init(&reader, source, 0);
+
+	read_count = source->read_count;
+	bytes_read = source->bytes_read;
+	if (ctx->timing)
+		start = dbmd_clock_ns();
+
+	for (pos = 0; pos < ctx->axml_chunk_size; pos += len)
+	{
+		len = (ctx->axml_chunk_size - pos > sizeof(reader.buf)) ? sizeof(reader.buf) : (size_t)(ctx->axml_chunk_size - pos);
+		if ( !(data = fetch(&reader, ctx->axml_offset + pos, len)) )
+		{
+			error = reader.error ? reader.error : DB_ERR_FILEREAD;
+			break;
+		}
+		dbmd_axml_feed(&scanner, (const char *)data, len);
+	}
+	if (!error)
+		error = dbmd_axml_finish(&scanner);
+	if (ctx->timing)
+		ctx->stats.phase_ns[DBMD_PHASE_AXML] += dbmd_clock_ns() - start;
+
+	ctx->read_count += source->read_count - read_count;
+	ctx->bytes_read += source->bytes_read - bytes_read;
+	ctx->stats.seeks += reader.window.seeks;
+
+	return ctx->adm.error = error;
+}
+
+/*******************************************************************************************
+static int parse_chunk(...)
+-Purpose:
+	Runs an incremental parse of the dbmd chunk, from the context or, for a chunk
+	too large to be held there, from the source. The time spent, less the time
+	spent reading, is added to the given phase.
+********************************************************************************************/
+static int parse_chunk(DBMDContext *ctx, DBMDChunkParser *parser, DBMDSegmentIndex *index, int phase)
+{
+	uint64_t dbmd_read_ns = ctx->stats.phase_ns[DBMD_PHASE_DBMD_READ];
+	uint64_t start = 0;
+	int result;
+
+	if (ctx->timing)
+		start = dbmd_clock_ns();
+
+	if (ctx->dbmd_chunk_size <= MAX_DBMD_SIZE)
+	{
+		do
+		{
+			result = dbmd_chunk_step(parser, (const unsigned char *)chunk_data(ctx) + parser->offset, &ctx->metadata, index);
+		} while (result == DBMD_CHUNK_MORE);
+	}
+	else
+	{
+		result = read_chunk(ctx, parser, index);
+	}
+
+	if (ctx->timing)
+		ctx->stats.phase_ns[phase] += dbmd_clock_ns() - start - (ctx->stats.phase_ns[DBMD_PHASE_DBMD_READ] - dbmd_read_ns);
+
+	return result;
+}
+
+/*******************************************************************************************
+static int read_chunk(...)
+-Purpose:
+	Feeds an incremental parse with the dbmd chunk read from the source, one
+	segment header or payload at a time, through a reader window of fixed size.
+	Memory use therefore does not depend on the size of the chunk. The reads are
+	added to the I/O of the scan. The walk parses the chunk of a sequential
+	source as it passes it, as such a source cannot go back to it.
+********************************************************************************************/
+static int read_chunk(DBMDContext *ctx, DBMDChunkParser *parser, DBMDSegmentIndex *index)
+{
+	DBMDReader reader;
+	DBMDSource *source = ctx->source;
+	const unsigned char *data;
+	unsigned long read_count;
+	uint64_t bytes_read;
+	uint64_t start = 0;
+	int result;
+
+	if (!source)
+		return DB_ERR_FILEOPEN;
+
+	reader_init(&reader, source, 0);
+
+	read_count = source->read_count;
+	bytes_read = source->bytes_read;
+
+	do
+	{
+		if (ctx->timing)
+			start = dbmd_clock_ns();
+		data = fetch(&reader, ctx->dbmd_offset + parser->offset, parser->len);
+		if (ctx->timing)
+			ctx->stats.phase_ns[DBMD_PHASE_DBMD_READ] += dbmd_clock_ns() - start;
+		if (!data)
+		{
+			result = reader.error ? reader.error : DB_ERR_FILEREAD;
+			break;
+		}
+		result = dbmd_chunk_step(parser, data, &ctx->metadata, index);
+	} while (result == DBMD_CHUNK_MORE);
+
+	ctx->read_count += source->read_count - read_count;
+	ctx->bytes_read += source->bytes_read - bytes_read;
+	ctx->stats.seeks += reader.window.seeks;
+
+	return result;
+}
+
+/*******************************************************************************************
+void dbmd_close(...)
+-Purpose:
+	Closes the source attached to the parse context, if any
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+********************************************************************************************/
+void dbmd_close(DBMDContext *ctx)
+{
+	dbmd_source_close(ctx->source);
+	ctx->source = NULL;
+	ctx->dbmd_chunk = NULL;
+}
+
+/*******************************************************************************************
+void dbmd_free(...)
+-Purpose:
+	Closes the source attached to the parse context and releases the memory the
+	parser allocated for it. The context must be initialized again before reuse.
+-Inputs:
+	DBMDContext *ctx	-	Parse context
+********************************************************************************************/
+void dbmd_free(DBMDContext *ctx)
+{
+	dbmd_close(ctx);
+	dbmd_objects_free(&ctx->metadata.DolbyAtmosSupSeg.objects);
+}
+
+/*******************************************************************************************
+int dbmd_parse_file(...)
+-Purpose:
+	Opens, scans and parses a single file, closing it again before returning
+-Inputs:
+	DBMDContext *ctx		-	Parse context
+	const char *filename	-	Input file name
+-Returns:
+	int						-	error code
+********************************************************************************************/
+int dbmd_parse_file(DBMDContext *ctx, const char *filename)
+{
+	int error;
+
+	ctx->status = 0;
+	ctx->dbmd_chunk_size = 0;
+	ctx->read_count = 0;
+	ctx->bytes_read = 0;
+
+	if ( (error = dbmd_open(ctx, filename)) )
+		return error;
+
+	error = dbmd_scan(ctx);
+	if (!error)
+		error = dbmd_parse(ctx);
+	dbmd_close(ctx);
+
+	return error;
+}
+
+/*******************************************************************************************
+uint64_t dbmd_clock_ns(...)
+-Purpose:
+	Reads the monotonic clock used to time the scan phases
+-Returns:
+	uint64_t	-	time in nanoseconds from an arbitrary origin
+********************************************************************************************/
+uint64_t dbmd_clock_ns(void)
+{
+#ifndef WIN32
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000u +
+		(uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000u / (uint64_t)freq.QuadPart;
+#endif
+}
+
+/*******************************************************************************************
+int parse_wav_header(...)
+-Purpose:
+	Parses the input file wave header, if it exists. Chunk headers are located at
+	absolute 64-bit offsets, chunks that are not needed (such as the audio data)
+	are jumped over without being read, and the walk stops as soon as all required
+	chunks have been found. With ctx->tail_probe set, the end of the input is
+	searched for the dbmd chunk first.
+-Inputs:
+	DBMDSource *source	-	input source
+	DBMDContext *ctx	-	parse context receiving the status bits and dbmd chunk
+-Returns:
+	int				-	error code
+********************************************************************************************/
+int parse_wav_header(DBMDSource *source, DBMDContext *ctx)
+{
+	return scan_source(source, ctx, NULL);
+}
+
+/*******************************************************************************************
+static int scan_source(...)
+-Purpose:
+	Walks the chunks of a source for parse_wav_header() and dbmd_scan_chunks(),
+	recording the I/O and time the walk needed
+********************************************************************************************/
+static int scan_source(DBMDSource *source, DBMDContext *ctx, DBMDChunkList *list)
+{
+	DBMDReader reader;
+	unsigned long read_count;
+	uint64_t bytes_read;
+	uint64_t start = 0;
+	uint64_t dbmd_read_ns;
+	int error;
+
+	if (source == NULL)
+		return DB_ERR_FILEOPEN;
+
+	reader_init(&reader, source, 0);
+
+	read_count = source->read_count;
+	bytes_read = source->bytes_read;
+	dbmd_read_ns = ctx->stats.phase_ns[DBMD_PHASE_DBMD_READ];
+	if (ctx->timing)
+		start = dbmd_clock_ns();
+
+	error = walk_chunks(&reader, ctx, list);
+
+	/* Report the I/O needed by this scan; the time not spent reading the dbmd chunk
+	 * went into walking the chunk headers */
+	ctx->read_count = source->read_count - read_count;
+	ctx->bytes_read = source->bytes_read - bytes_read;
+	ctx->stats.seeks += reader.window.seeks;
+	if (ctx->timing)
+		ctx->stats.phase_ns[DBMD_PHASE_WALK] += dbmd_clock_ns() - start - (ctx->stats.phase_ns[DBMD_PHASE_DBMD_READ] - dbmd_read_ns);
+
+	return error;
+}
+
+/*******************************************************************************************
+static int walk_chunks(...)
+-Purpose:
+	Walks the chunks of the input, setting the status bits of the chunks found
+	and capturing the dbmd chunk, reading the bytes each step needs through the
+	reader window
+********************************************************************************************/
+static int walk_chunks(DBMDReader *reader, DBMDContext *ctx, DBMDChunkList *list)
+{
+	DBMDWalk walk;
+	DBMDReader tail;
+	DBMDReader *from;
+	const unsigned char *data;
+	int result;
+
+	/* Mapped sources are parsed in place, anything else is copied */
+	dbmd_walk_init(&walk, ctx, reader->source->ops->map_at != NULL);
+	walk.chunks = list;
+	walk.parse_passing = reader->source->sequential && !list;
+
+	/* A dbmd chunk written after the audio data is looked for at the end of the
+	 * input first. The walk still checks the other chunks, taking the headers
+	 * that lie in the tail from the bytes the probe read. */
+	if ( ctx->tail_probe && !list )
+	{
+		if ( (probe_tail(reader, &tail, ctx, &walk) != DB_ERR_OK) && reader->error )
+			return reader->error;
+	}
+	do
+	{
+		from = ( walk.tail_pos && (walk.offset >= tail.window.offset) ) ? &tail : reader;
+		if ( ctx->timing && ((walk.state == DBMD_WALK_DBMD_CHUNK) || (walk.state == DBMD_WALK_DBMD_SEGMENTS)) )
+		{
+			uint64_t start = dbmd_clock_ns();
+			data = fetch(from, walk.offset, walk.len);
+			ctx->stats.phase_ns[DBMD_PHASE_DBMD_READ] += dbmd_clock_ns() - start;
+		}
+		else
+			data = fetch(from, walk.offset, walk.len);
+		if (!data && from->error)
+			return from->error;
+		result = dbmd_walk_step(&walk, ctx, data);
+	} while (result == DBMD_WALK_MORE);
+
+	return result;
+}
+
+/*******************************************************************************************
+static int probe_tail(...)
+-Purpose:
+	Looks for the dbmd chunk in the last DBMD_TAIL_PROBE_SIZE bytes of the input,
+	where exporters that write the metadata after the audio data put it. Only the
+	RIFF header and the tail are read, so the chunk is found without walking the
+	chunks ahead of it, even when the data chunk is truncated or its size is
+	wrong. The window is searched backwards for a dbmd chunk header whose payload
+	ends within the input and holds at least one segment, all with valid
+	checksums. The chunk is then kept in the context and its header offset in
+	walk->tail_pos, and the tail stays in the tail reader, so that the walk
+	that follows only checks for the other chunks. An axml chunk followed in
+	the tail by chunks that lead up to the dbmd chunk is recorded as well, as
+	the walk cannot reach it past a data chunk of the wrong size.
+-Returns:
+	int		-	DB_ERR_OK if the chunk was found, otherwise an error code with the
+				context left for the walk
+********************************************************************************************/
+static int probe_tail(DBMDReader *reader, DBMDReader *tail, DBMDContext *ctx, DBMDWalk *walk)
+{
+	DBMDSegmentIndex index;
+	DBMDSource *source = reader->source;
+	const unsigned char *data;
+	uint64_t size;
+	uint64_t offset;
+	uint32_t chunk_size;
+	uint32_t axml_size;
+	size_t len;
+	size_t i;
+	size_t k;
+	int j;
+
+	/* the header stays in the reader window for the walk */
+	if ( !(data = fetch(reader, 0, 12)) )
+		return reader->error ? reader->error : DB_ERR_FILEREAD;
+	if ( memcmp(data, "RIFF", 4) && memcmp(data, "RF64", 4) && memcmp(data, "BW64", 4) )
+		return DB_ERR_NOTRIFF;
+	if (memcmp(data + 8, "WAVE", 4))
+		return DB_ERR_NOTWAVE;
+
+	/* the size of a URL is known once the header has been read */
+	if ( !source->ops->size || ((size = source->ops->size(source)) < 20) )
+		return DB_ERR_NOTSUPPORTED;
+
+	offset = (size - 12 > DBMD_TAIL_PROBE_SIZE) ? size - DBMD_TAIL_PROBE_SIZE : 12;
+	len = (size_t)(size - offset);
+
+	reader_init(tail, source, reader->window.end);
+	data = fetch(tail, offset, len);
+	reader->window.seeks += tail->window.seeks;
+	if (!data)
+		return tail->error ? tail->error : DB_ERR_FILEREAD;
+
+	/* the dbmd chunk usually ends the file, so search from the end */
+	for (i = len - 8 + 1; i-- > 0; )
+	{
+		if ( (data[i] != 'd') || memcmp(data + i, "dbmd", 4) )
+			continue;
+		chunk_size = read_le32(data + i + 4);
+		if ( !chunk_size || (chunk_size > len - i - 8) )
+			continue;
+
+		if ( index_dbmd_segments((const char *)data + i + 8, (int)chunk_size, DBMD_INDEX_VERIFY, &index) || !index.num_segments )
+			continue;
+		for (j = 0; (j < index.num_segments) && (index.segments[j].checksum_status == DBMD_CHECKSUM_OK); j++)
+			;
+		if (j < index.num_segments)
+			continue;
+
+		/* the size includes the pad byte of an odd sized chunk, as for the walk */
+		if ( (chunk_size & 1) && (chunk_size < len - i - 8) )
+			chunk_size++;
+
+		ctx->status |= WAV_DBMD_CHUNK_MASK;
+		ctx->dbmd_offset = offset + i + 8;
+		ctx->dbmd_chunk_size = chunk_size;
+		if (walk->in_place)
+			ctx->dbmd_chunk = (const char *)data + i + 8;
+		else
+			memcpy(ctx->dolby_metadata, data + i + 8, chunk_size);
+		walk->tail_pos = offset + i;
+
+		for (k = i; k-- > 0; )
+		{
+			if ( (data[k] != 'a') || memcmp(data + k, "axml", 4) || !tail_chain(data, k, i) )
+				continue;
+			axml_size = read_le32(data + k + 4);
+			ctx->status |= WAV_AXML_CHUNK_MASK;
+			ctx->axml_offset = offset + k + 8;
+			ctx->axml_chunk_size = axml_size + (axml_size & 1);
+			break;
+		}
+		return DB_ERR_OK;
+	}
+
+	return DB_ERR_MISSINGCHUNK;
+}
+
+/*******************************************************************************************
+static int tail_chain(...)
+-Purpose:
+	Checks that the chunks starting at data[pos] follow one another up to the
+	chunk header at data[end], each with a printable ID and a size that keeps
+	it before end
+-Returns:
+	int		-	non-zero if they do
+********************************************************************************************/
+static int tail_chain(const unsigned char *data, size_t pos, size_t end)
+{
+	uint64_t size;
+	int i;
+
+	while (pos < end)
+	{
+		if (end - pos < 8)
+			return 0;
+		for (i = 0; i < 4; i++)
+		{
+			if ( (data[pos + i] < 0x20) || (data[pos + i] > 0x7e) )
+				return 0;
+		}
+		size = read_le32(data + pos + 4);
+		size += size & 1;
+		if ( !size || (size > end - pos - 8) )
+			return 0;
+		pos += 8 + (size_t)size;
+	}
+
+	return pos == end;
+}
+
+/*******************************************************************************************
+void dbmd_walk_init(...)
+-Purpose:
+	Starts a chunk walk. The first step needs the RIFF header.
+-Inputs:
+	DBMDWalk *walk		-	Walk state
+	DBMDContext *ctx	-	Parse context receiving the status bits and dbmd chunk
+	int in_place		-	Non-zero to point to the dbmd chunk in the bytes supplied
+							for it, which must then stay valid until it is parsed
+********************************************************************************************/
+void dbmd_walk_init(DBMDWalk *walk, DBMDContext *ctx, int in_place)
+{
+	ctx->status = 0;          /* Initialize status variable */
+	ctx->dbmd_chunk_size = 0; /* Initialize dbmd chunk size */
+	ctx->dbmd_offset = 0;     /* Initialize dbmd chunk offset */
+	ctx->dbmd_chunk = NULL;   /* Initialize dbmd chunk pointer */
+	ctx->indexed = 0;         /* dbmd chunk not yet indexed */
+	ctx->streamed = 0;        /* dbmd chunk not yet parsed */
+	ctx->axml_chunk_size = 0; /* Initialize axml chunk size */
+	ctx->axml_offset = 0;     /* Initialize axml chunk offset */
+	ctx->adm.scanned = 0;     /* axml chunk not yet scanned */
+
+	walk->state = DBMD_WALK_RIFF_HEADER;
+	walk->in_place = in_place;
+	walk->b_is_RF64_BW64 = 0;
+	walk->b_ds64_present = 0;
+	walk->pos = 0;
+	walk->subchunk_size = 0;
+	walk->data64_chunk_size = 0;
+	walk->chunks = NULL;
+	walk->parse_passing = 0;
+	walk->index_full = 0;
+	walk->tail_pos = 0;
+
+	/* Read in the RIFF header */
+	walk->offset = 0;
+	walk->len = 12;
+}
+
+/*******************************************************************************************
+int dbmd_walk_step(...)
+-Purpose:
+	Advances a chunk walk with the bytes it asked for. Chunk headers are located
+	at absolute 64-bit offsets, chunks that are not needed (such as the audio
+	data) are jumped over without being read, and the walk stops as soon as all
+	required chunks have been found.
+-Inputs:
+	DBMDWalk *walk				-	Walk state
+	DBMDContext *ctx			-	Parse context receiving the status bits and dbmd chunk
+	const unsigned char *data	-	walk->len bytes at walk->offset, or NULL if the
+									input ends before them
+-Returns:
+	int							-	DBMD_WALK_MORE if walk->offset and walk->len give
+									the bytes needed next, otherwise the error code
+********************************************************************************************/
+int dbmd_walk_step(DBMDWalk *walk, DBMDContext *ctx, const unsigned char *data)
+{
+	uint64_t subchunk_size;
+	int result;
+
+	switch (walk->state)
+	{
+	case DBMD_WALK_RIFF_HEADER:
+		/* if file does not begin with RIFF/RF64/BW64 bytes */
+		if (!data)
+			return DB_ERR_NOTRIFF;
+		if ( memcmp(data, "RIFF", 4) && memcmp(data, "RF64", 4) && memcmp(data, "BW64", 4) )
+			return DB_ERR_NOTRIFF;
+
+		if ( !memcmp(data, "RF64", 4) || !memcmp(data, "BW64", 4) )
+		{
+			/* Flag that file adheres to RF64/BW64 specification */
+			walk->b_is_RF64_BW64 = 1;
+		}
+
+		ctx->status = ctx->status | WAV_RIFF_HEADER_MASK; /* update status */
+
+		/* skip size of RIFF/RF64/BW64 chunk, check form type */
+		if (!memcmp(data + 8, "WAVE", 4))
+			ctx->status = ctx->status | WAV_WAVE_HEADER_MASK; /* update status */
+		else
+			return DB_ERR_NOTWAVE;
+
+		/* read the first subchunk ID and size */
+		walk->state = DBMD_WALK_CHUNK_HEADER;
+		walk->pos = 12;
+		walk->offset = 12;
+		walk->len = 8;
+		return DBMD_WALK_MORE;
+
+	case DBMD_WALK_CHUNK_HEADER:
+		if (!data)
+			return walk_end(walk, ctx);
+		subchunk_size = read_le32(data + 4);
+		if ( walk->chunks && walk_record(walk, data, subchunk_size) )
+			return DB_ERR_NOMEMORY;
+
+		/* sanity check size */
+		if ((subchunk_size % 2) && (subchunk_size != RF64_INDICATION))
+		{
+			subchunk_size++;
+		}
+		if (subchunk_size == 0)
+			return DB_ERR_CHUNKSIZE;
+		walk->subchunk_size = subchunk_size;
+
+		/* Read in subchunk based on ID */
+		if (!memcmp(data, "ds64", 4))	/* DS64 Chunk for RF64/BW64 */
+		{
+			walk->b_ds64_present = 1;                        /* flag presence of ds64 chunk */
+			ctx->status = ctx->status | WAV_DS64_CHUNK_MASK; /* update status */
+
+			if (subchunk_size < 16)
+				return DB_ERR_DS64SIZE;
+
+			/* read in riffSize, dataSize */
+			walk->state = DBMD_WALK_DS64_CHUNK;
+			walk->offset = walk->pos + 8;
+			walk->len = 16;
+			return DBMD_WALK_MORE;
+		}
+		else if (!memcmp(data, "fmt ", 4))	/* Format Chunk */
+		{
+			ctx->status = ctx->status | WAV_FMT_CHUNK_MASK; /* update status */
+		}
+		else if (!memcmp(data, "data", 4))
+		{
+			ctx->status = ctx->status | WAV_DATA_CHUNK_MASK; /* update status */
+
+			if ( (walk->b_is_RF64_BW64 == 1) && (subchunk_size == RF64_INDICATION) )
+			{
+				walk->subchunk_size = walk->data64_chunk_size; /* rewrite size value using ds64 data size */
+			}
+		}
+		else if (!memcmp(data, "dbmd", 4))	/* Dolby Audio Metadata Chunk */
+		{
+			ctx->status = ctx->status | WAV_DBMD_CHUNK_MASK; /* update status */
+
+			/* the chunk found by the tail probe is the one kept */
+			if (walk->tail_pos)
+				break;
+			ctx->dbmd_offset = walk->pos + 8;
+
+			/* Segment offsets are kept as int */
+			if (subchunk_size > INT32_MAX)
+				return DB_ERR_DBMDSIZE;
+
+			/* A chunk too large for the context is left in the input and
+			 *  parsed from it a segment at a time, or parsed that way now if
+			 *  the input cannot go back to it */
+			if (subchunk_size > MAX_DBMD_SIZE)
+			{
+				ctx->dbmd_chunk_size = subchunk_size;
+				if (!walk->parse_passing)
+					break;
+
+				ctx->metadata.DolbyAtmosSeg.segment_exists = 0;
+				ctx->metadata.DolbyAtmosSupSeg.segment_exists = 0;
+				walk->index_full = 0;
+				dbmd_chunk_init(&walk->parser, subchunk_size, DBMD_CHUNK_DECODE | DBMD_INDEX_VERIFY);
+				walk->state = DBMD_WALK_DBMD_SEGMENTS;
+				walk->offset = ctx->dbmd_offset + walk->parser.offset;
+				walk->len = walk->parser.len;
+				return DBMD_WALK_MORE;
+			}
+
+			/* Read in the metadata chunk */
+			walk->state = DBMD_WALK_DBMD_CHUNK;
+			walk->offset = walk->pos + 8;
+			walk->len = (size_t)subchunk_size;
+			return DBMD_WALK_MORE;
+		}
+		else if (!memcmp(data, "axml", 4))	/* ADM XML Chunk */
+		{
+			ctx->status = ctx->status | WAV_AXML_CHUNK_MASK; /* update status */
+			ctx->axml_offset = walk->pos + 8;
+			ctx->axml_chunk_size = subchunk_size;
+		}
+		break;
+
+	case DBMD_WALK_DS64_CHUNK:
+		if (!data)
+			return DB_ERR_FILEREAD;
+
+		/* combine dataSizeLow and dataSizeHigh to form actual size */
+		walk->data64_chunk_size = ((uint64_t)read_le32(data + 12) << 32) | (uint64_t)read_le32(data + 8);
+		break;
+
+	case DBMD_WALK_DBMD_CHUNK:
+		if (!data)
+			return DB_ERR_FILEREAD;
+
+		if (walk->in_place)
+			ctx->dbmd_chunk = (const char *)data;
+		else
+			memcpy(ctx->dolby_metadata, data, walk->len);
+
+		/* Save the chunk size */
+		ctx->dbmd_chunk_size = walk->subchunk_size;
+		break;
+
+	case DBMD_WALK_DBMD_SEGMENTS:
+		if (!data)
+			return DB_ERR_FILEREAD;
+
+		/* decode and verify every segment, indexing as many as the index holds */
+		result = dbmd_chunk_step(&walk->parser, data, &ctx->metadata, walk->index_full ? NULL : &ctx->segments);
+		if ( (result == DB_ERR_TOOMANYSEGS) && !walk->index_full )
+		{
+			/* the parser stopped at the segment header, go on without the index */
+			walk->index_full = 1;
+			result = dbmd_chunk_step(&walk->parser, data, &ctx->metadata, NULL);
+		}
+		if (result == DBMD_CHUNK_MORE)
+		{
+			walk->offset = ctx->dbmd_offset + walk->parser.offset;
+			walk->len = walk->parser.len;
+			return DBMD_WALK_MORE;
+		}
+
+		/* a decode error is only reported once the whole chunk has been checked,
+		 * so any other error is one of structure, which leaves no index */
+		ctx->streamed = 1;
+		ctx->streamed_error = result;
+		if (walk->index_full)
+			ctx->streamed_index_error = DB_ERR_TOOMANYSEGS;
+		else
+			ctx->streamed_index_error = (result == walk->parser.error) ? DB_ERR_OK : result;
+		ctx->indexed = (ctx->streamed_index_error == DB_ERR_OK);
+		break;
+
+	default:
+		return DB_ERR_FILEREAD;
+	}
+
+	/* chunks other than ds64 and dbmd are jumped over unread */
+	if (walk->state == DBMD_WALK_CHUNK_HEADER)
+		ctx->stats.chunks_skipped++;
+
+	/* jump to the next subchunk header */
+	if (walk->subchunk_size > UINT64_MAX - walk->pos - 8)
+		return walk_end(walk, ctx);
+	walk->pos = walk->pos + 8 + walk->subchunk_size;
+
+	if ( !walk->chunks && (ctx->status == required_mask(walk->b_is_RF64_BW64, walk->b_ds64_present)) )
+		return DB_ERR_OK;
+
+	/* after the tail probe, the walk ends at the dbmd chunk it found, or where a
+	 * chunk of the wrong size jumps past it */
+	if ( walk->tail_pos && (walk->pos >= walk->tail_pos) )
+		return walk_end(walk, ctx);
+
+	/* read next subchunk ID and size */
+	walk->state = DBMD_WALK_CHUNK_HEADER;
+	walk->offset = walk->pos;
+	walk->len = 8;
+	return DBMD_WALK_MORE;
+}
+
+/*******************************************************************************************
+static int walk_end(...)
+-Purpose:
+	Ends a walk that ran out of chunks, checking that the required ones were found
+********************************************************************************************/
+static int walk_end(DBMDWalk *walk, DBMDContext *ctx)
+{
+	if (walk->chunks)
+		return DB_ERR_OK;
+	if ( ctx->status != required_mask(walk->b_is_RF64_BW64, walk->b_ds64_present) )
+		return DB_ERR_MISSINGCHUNK;
+
+	return DB_ERR_OK;
+}
+
+/*******************************************************************************************
+static int walk_record(...)
+-Purpose:
+	Appends the chunk whose header the walk has just read to its chunk list
+-Returns:
+	int				-	0 on success, -1 if out of memory
+********************************************************************************************/
+static int walk_record(DBMDWalk *walk, const unsigned char *header, uint64_t size)
+{
+	DBMDChunkList *list = walk->chunks;
+	DBMDChunk *chunks;
+	size_t capacity;
+
+	if (list->count == list->capacity)
+	{
+		capacity = list->capacity ? list->capacity * 2 : 16;
+		chunks = (DBMDChunk *)realloc(list->chunks, capacity * sizeof(DBMDChunk));
+		if (!chunks)
+			return -1;
+		list->chunks = chunks;
+		list->capacity = capacity;
+	}
+
+	/* the size of an RF64/BW64 data chunk is held in the ds64 chunk */
+	if ( walk->b_is_RF64_BW64 && (size == RF64_INDICATION) && !memcmp(header, "data", 4) )
+		size = walk->data64_chunk_size;
+
+	memcpy(list->chunks[list->count].id, header, 4);
+	list->chunks[list->count].offset = walk->pos;
+	list->chunks[list->count].size = size;
+	list->count++;
+
+	return 0;
+}
+
+/*******************************************************************************************
+static void reader_init(...)
+-Purpose:
+	Starts a reader with an empty window
+********************************************************************************************/
+static void reader_init(DBMDReader *reader, DBMDSource *source, uint64_t end)
+{
+	reader->source = source;
+	reader->error = DB_ERR_OK;
+	dbmd_window_init(&reader->window, reader->buf, end);
+}
+
+/*******************************************************************************************
+static const unsigned char *fetch(...)
+-Purpose:
+	Returns a pointer to len bytes at an absolute input offset. Mapped sources are
+	accessed in place, anything else through the reader window.
+-Returns:
+	const unsigned char *	-	pointer to the bytes, NULL at end of input or on error
+********************************************************************************************/
+static const unsigned char *fetch(DBMDReader *reader, uint64_t offset, size_t len)
+{
+	DBMDSource *source = reader->source;
+	DBMDWindow *window = &reader->window;
+	const unsigned char *data;
+	size_t read_len;
+	int64_t n;
+
+	if (source->ops->map_at)
+		return source->ops->map_at(source, offset, len);
+
+	if (len > DBMD_MAX_PREFETCH)
+		return NULL;
+	if ( (data = dbmd_window_find(window, offset, len)) )
+		return data;
+
+	read_len = dbmd_window_refill(window, offset, len, source->prefetch);
+	n = source->ops->read_at(source, window->buf + window->len, read_len, window->offset + window->len);
+	if (n < 0)
+	{
+		reader->error = (int)n;
+		return NULL;
+	}
+	window->len += (size_t)n;
+
+	if (window->len < len)
+		return NULL;
+
+	return window->buf;
+}
+
+/*******************************************************************************************
+void dbmd_window_init(...)
+-Purpose:
+	Starts an empty window
+-Inputs:
+	DBMDWindow *window	-	Window
+	unsigned char *buf	-	Buffer of DBMD_MAX_PREFETCH bytes
+	uint64_t end		-	Input offset following the last read, so that a read
+							starting there is not counted as a seek
+********************************************************************************************/
+void dbmd_window_init(DBMDWindow *window, unsigned char *buf, uint64_t end)
+{
+	window->buf = buf;
+	window->offset = 0;
+	window->len = 0;
+	window->end = end;
+	window->seeks = 0;
+}
+
+/*******************************************************************************************
+const unsigned char *dbmd_window_find(...)
+-Purpose:
+	Looks for a range of the input in the window
+-Inputs:
+	const DBMDWindow *window	-	Window
+	uint64_t offset				-	Input offset of the range
+	size_t len					-	Number of bytes
+-Returns:
+	const unsigned char *		-	pointer to the bytes, NULL if the window does not
+									hold all of them
+********************************************************************************************/
+const unsigned char *dbmd_window_find(const DBMDWindow *window, uint64_t offset, size_t len)
+{
+	if ( (offset >= window->offset) && (offset + len <= window->offset + window->len) )
+		return window->buf + (offset - window->offset);
+
+	return NULL;
+}
+
+/*******************************************************************************************
+size_t dbmd_window_refill(...)
+-Purpose:
+	Prepares the window for a single read of a range it does not hold. When the
+	range starts inside the window, the bytes already held are kept and only the
+	bytes following them are read, so adjacent ranges are coalesced into one read
+	and no byte is fetched twice. The read is at least the prefetch size, which
+	usually also picks up the following chunk headers. The window then starts at
+	the range: the caller reads into window->buf + window->len, at input offset
+	window->offset + window->len, and adds the number of bytes read to
+	window->len.
+-Inputs:
+	DBMDWindow *window	-	Window
+	uint64_t offset		-	Input offset of the range
+	size_t len			-	Number of bytes, at most DBMD_MAX_PREFETCH
+	size_t prefetch		-	Minimum read size
+-Returns:
+	size_t				-	Number of bytes to read
+********************************************************************************************/
+size_t dbmd_window_refill(DBMDWindow *window, uint64_t offset, size_t len, size_t prefetch)
+{
+	size_t keep = 0;
+	size_t read_len;
+
+	/* keep the part of the range already in the window */
+	if ( (offset >= window->offset) && (offset < window->offset + window->len) )
+	{
+		keep = (size_t)(window->offset + window->len - offset);
+		memmove(window->buf, window->buf + (offset - window->offset), keep);
+	}
+
+	read_len = len - keep;
+	if (read_len < prefetch)
+		read_len = prefetch;
+	if (read_len > DBMD_MAX_PREFETCH - keep)
+		read_len = DBMD_MAX_PREFETCH - keep;
+
+	if (offset + keep != window->end)
+		window->seeks++;
+	window->end = offset + keep + read_len;
+	window->offset = offset;
+	window->len = keep;
+
+	return read_len;
+}
+
+/*******************************************************************************************
+static unsigned char required_mask(...)
+-Purpose:
+	Returns the chunk status bits a file must have to be recognized: RF64/BW64
+	files that carry a ds64 chunk additionally require it.
+********************************************************************************************/
+static unsigned char required_mask(int b_is_RF64_BW64, int b_ds64_present)
+{
+	/* if we received all necessary subchunks for RF64/BW64 large files */
+	if ( (b_is_RF64_BW64 == 1) && (b_ds64_present == 1) )
+		return WAV_RF64_REQUIRED_MASK;
+
+	/* if we received all necessary subchunks for RIFF files */
+	return WAV_RIFF_REQUIRED_MASK;
+}
+
+/*******************************************************************************************
+static const char *chunk_data(...)
+-Purpose:
+	Returns the dbmd chunk found by the last scan, in the mapping or the context
+********************************************************************************************/
+static const char *chunk_data(const DBMDContext *ctx)
+{
+	return ctx->dbmd_chunk ? ctx->dbmd_chunk : ctx->dolby_metadata;
+}
+
+/*******************************************************************************************
+static uint32_t read_le32(...)
+-Purpose:
+	Reads a 32-bit little-endian value from a byte buffer
+********************************************************************************************/
+static uint32_t read_le32(const unsigned char *buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
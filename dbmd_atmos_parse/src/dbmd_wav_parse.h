@@ -0,0 +1,192 @@
+/****************************************************************************
+* Copyright (c) 2020, Dolby Laboratories Inc.
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted
+* provided that the following conditions are met:
+* 
+* 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+*    and the following disclaimer.
+* 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+*    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+*    promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DBMD_WAV_PARSE_H
+#define DBMD_WAV_PARSE_H
+
+#include <stdint.h>
+#include "dbmd_atmos_parse.h"
+#include "dbmd_axml.h"
+#include "dbmd_source.h"
+
+/* This defines the parse context used to scan a single ADM WAV file.
+ *  All state lives in the context so that any number of files may be
+ *  scanned concurrently, one context per thread.
+ */
+#define RF64_INDICATION 0xFFFFFFFFu
+#define MAX_DBMD_SIZE DBMD_MAX_PREFETCH /* Largest dbmd chunk held in the context, the size of the reader window */
+#define DBMD_TAIL_PROBE_SIZE DBMD_MAX_PREFETCH /* Bytes at the end of the input searched for the dbmd chunk */
+
+/* File name that selects standard input */
+#define DBMD_STDIN_NAME "-"
+
+/* WAV File Chunk Status Bit Masks */
+#define WAV_RIFF_HEADER_MASK 0x01
+#define WAV_WAVE_HEADER_MASK 0x02
+#define WAV_FMT_CHUNK_MASK 0x04
+#define WAV_DATA_CHUNK_MASK 0x08
+#define WAV_DBMD_CHUNK_MASK 0x10
+#define WAV_AXML_CHUNK_MASK 0x20
+#define WAV_DS64_CHUNK_MASK 0x40
+
+/* Required chunks for RIFF and RF64/BW64 files */
+#define WAV_RIFF_REQUIRED_MASK 0x3F
+#define WAV_RF64_REQUIRED_MASK 0x7F
+
+/* Input file access modes */
+typedef enum
+{
+	DBMD_IO_READ = 0,  /* Positioned reads (range requests for URLs), dbmd chunk copied into the context */
+	DBMD_IO_MMAP = 1,  /* File mapped into memory, dbmd chunk parsed in place */
+	DBMD_IO_STREAM = 2 /* Sequential reads only, for pipes and other non-seekable input */
+} dbmd_io_mode;
+
+/* Scan phases, timed when DBMDContext.timing is set */
+typedef enum
+{
+	DBMD_PHASE_OPEN = 0,      /* Opening the input */
+	DBMD_PHASE_WALK = 1,      /* Reading and walking the chunk headers */
+	DBMD_PHASE_DBMD_READ = 2, /* Reading the dbmd chunk */
+	DBMD_PHASE_CHECKSUM = 3,  /* Indexing the segments and verifying their checksums */
+	DBMD_PHASE_DECODE = 4,    /* Decoding the segments */
+	DBMD_PHASE_AXML = 5,      /* Reading and scanning the axml chunk */
+	DBMD_PHASE_OUTPUT = 6,    /* Rendering the result */
+	DBMD_NUM_PHASES = 7
+} dbmd_phase;
+
+/* Cost of the last scan */
+typedef struct
+{
+	uint64_t phase_ns[DBMD_NUM_PHASES]; /* Time spent per phase, in nanoseconds */
+	unsigned long seeks;                /* Number of reads not continuing the previous one */
+	unsigned long chunks_skipped;       /* Number of chunks jumped over without reading them */
+} DBMDScanStats;
+
+typedef struct
+{
+	dbmd_io_mode io_mode;               /* Input file access mode */
+	int timing;                         /* Time the phases of each scan */
+	int tail_probe;                     /* Look for the dbmd chunk at the end of the input before walking the chunks */
+	DBMDScanStats stats;                /* Cost of the last scan */
+	DBMDSource *source;                 /* Input file */
+	unsigned long read_count;           /* Number of reads issued by the last scan */
+	uint64_t bytes_read;                /* Number of bytes fetched by the last scan */
+	unsigned char status;               /* WAV file chunk status bits */
+	uint64_t dbmd_chunk_size;           /* Size of the dbmd chunk */
+	uint64_t dbmd_offset;               /* File offset of the dbmd chunk payload */
+	const char *dbmd_chunk;             /* dbmd chunk within the source, if mapped */
+	uint64_t axml_chunk_size;           /* Size of the axml chunk */
+	uint64_t axml_offset;               /* File offset of the axml chunk payload */
+	char dolby_metadata[MAX_DBMD_SIZE]; /* dbmd chunk buffer */
+	int streamed;                       /* Set when a dbmd chunk too large for the buffer was parsed as the
+	                                       scan passed it, as the input cannot go back to it */
+	int streamed_error;                 /* dbmd_parse() result of that parse */
+	int streamed_index_error;           /* dbmd_index() result of that parse */
+	int indexed;                        /* Set once the dbmd chunk segments are indexed */
+	DBMDSegmentIndex segments;          /* Segments of the dbmd chunk */
+	DBMetadata metadata;                /* Parsed Dolby Atmos metadata */
+	DBMDAxmlSummary adm;                /* Summary of the axml chunk, once scanned */
+} DBMDContext;
+
+/* Chunk walk states */
+#define DBMD_WALK_RIFF_HEADER 0
+#define DBMD_WALK_CHUNK_HEADER 1
+#define DBMD_WALK_DS64_CHUNK 2
+#define DBMD_WALK_DBMD_CHUNK 3
+#define DBMD_WALK_DBMD_SEGMENTS 4
+
+/* A chunk found by dbmd_scan_chunks() */
+typedef struct
+{
+	char id[4];                 /* Chunk ID */
+	uint64_t offset;            /* File offset of the chunk header */
+	uint64_t size;              /* Payload size, without the pad byte; from the ds64 chunk for the
+	                               data chunk of an RF64/BW64 file */
+} DBMDChunk;
+
+typedef struct
+{
+	DBMDChunk *chunks;          /* Chunks in file order */
+	size_t count;               /* Number of chunks */
+	size_t capacity;            /* Number of chunks allocated */
+} DBMDChunkList;
+
+/* Bytes of the input held in a buffer of DBMD_MAX_PREFETCH bytes. Small reads
+ *  of chunk headers are served from the window when possible; otherwise it is
+ *  refilled with a single read of at least the prefetch size, keeping any bytes
+ *  it already holds that are still needed. */
+typedef struct
+{
+	unsigned char *buf;         /* DBMD_MAX_PREFETCH bytes */
+	uint64_t offset;            /* Input offset of buf[0] */
+	size_t len;                 /* Number of valid bytes in buf */
+	uint64_t end;               /* Input offset following the last read */
+	unsigned long seeks;        /* Number of reads not starting at end */
+} DBMDWindow;
+
+/* Resumable chunk walk. The caller supplies the bytes each step asks for,
+ *  so that the reads of many files can be in flight at once. */
+#define DBMD_WALK_MORE 1 /* dbmd_walk_step() result: the bytes at walk.offset are needed */
+
+typedef struct
+{
+	int state;                  /* Walk state */
+	int in_place;               /* Point to the dbmd chunk in the supplied bytes rather than copy it */
+	int b_is_RF64_BW64;         /* File is RF64 or BW64 */
+	int b_ds64_present;         /* ds64 chunk found */
+	uint64_t pos;               /* Offset of the current chunk header */
+	uint64_t subchunk_size;     /* Size of the current chunk */
+	uint64_t data64_chunk_size; /* data chunk size from the ds64 chunk */
+	uint64_t offset;            /* Offset of the bytes needed by the next step */
+	size_t len;                 /* Number of bytes needed by the next step */
+	DBMDChunkList *chunks;      /* If set, every chunk is recorded and the walk goes on to the end */
+	int parse_passing;          /* Parse a dbmd chunk too large for the context as the walk passes it */
+	int index_full;             /* More segments passed than ctx->segments holds */
+	DBMDChunkParser parser;     /* Parse of the dbmd chunk being passed */
+	uint64_t tail_pos;          /* Offset of the dbmd chunk header found by the tail probe, 0 if none */
+} DBMDWalk;
+
+void dbmd_init(DBMDContext *ctx);
+int dbmd_open(DBMDContext *ctx, const char *filename);
+void dbmd_attach(DBMDContext *ctx, DBMDSource *source);
+int dbmd_scan(DBMDContext *ctx);
+int dbmd_scan_chunks(DBMDContext *ctx, DBMDChunkList *list);
+void dbmd_chunklist_free(DBMDChunkList *list);
+int dbmd_parse(DBMDContext *ctx);
+int dbmd_index(DBMDContext *ctx, int flags);
+int dbmd_decode(DBMDContext *ctx, int segment_id);
+int dbmd_scan_axml(DBMDContext *ctx);
+void dbmd_close(DBMDContext *ctx);
+void dbmd_free(DBMDContext *ctx);
+int dbmd_parse_file(DBMDContext *ctx, const char *filename);
+uint64_t dbmd_clock_ns(void);
+
+int parse_wav_header(DBMDSource *source, DBMDContext *ctx);
+void dbmd_walk_init(DBMDWalk *walk, DBMDContext *ctx, int in_place);
+int dbmd_walk_step(DBMDWalk *walk, DBMDContext *ctx, const unsigned char *data);
+void dbmd_window_init(DBMDWindow *window, unsigned char *buf, uint64_t end);
+const unsigned char *dbmd_window_find(const DBMDWindow *window, uint64_t offset, size_t len);
+size_t dbmd_window_refill(DBMDWindow *window, uint64_t offset, size_t len, size_t prefetch);
+
+#endif /* DBMD_WAV_PARSE_H */
@@ -34,458 +34,858 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#define _LARGEFILE_SOURCE
+#include <limits.h>
+#include <errno.h>
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include "dbmd_atmos_parse.h"
-#include "dbmd_text.h"
+#include "dbmd_wav_parse.h"
+#include "dbmd_output.h"
+#include "dbmd_batch.h"
+#include "dbmd_store.h"
+#include "dbmd_watch.h"
+#include "dbmd_server.h"
+#include "dbmd_stats.h"
+#include "dbmd_patch.h"
+#include "dbmd_remux.h"
 
 /* Global Defines */
 #define REV_STR "1.1"
-#define SIZE_LIMIT 0x40000000u
-#define RF64_INDICATION 0xFFFFFFFFu
-#define MAX_DBMD_SIZE 6144
-
-/* WAV File Chunk Status Bit Masks */
-#define WAV_RIFF_HEADER_MASK 0x01
-#define WAV_WAVE_HEADER_MASK 0x02
-#define WAV_FMT_CHUNK_MASK 0x04
-#define WAV_DATA_CHUNK_MASK 0x08
-#define WAV_DBMD_CHUNK_MASK 0x10
-#define WAV_AXML_CHUNK_MASK 0x20
-#define WAV_DS64_CHUNK_MASK 0x40
 
 /* Local function prototypes */
 void show_usage(void);
-int parse_wav_header(FILE *in_file);
-void display_dbmd_metadata(void);
-void display_dbmd_error(int error_code);
-
-/* Global variables */
-uint64_t dbmd_chunk_size = 0;
-char dolby_metadata[MAX_DBMD_SIZE];
-DBMetadata DolbyMetadata;
-unsigned char status;
+int query_store(int argc, char **argv);
+int patch_files(int argc, char **argv);
+int remux_file(int argc, char **argv);
+static int load_file(const char *filename, unsigned char **data, size_t *len);
+static int parse_count(const char *option, const char *value, size_t max, size_t *result);
+static int print_row(void *arg, const DBMDStoreRow *row);
+static void finish_stats(const DBMDBatchConfig *config, const char *stats_export, FILE *report);
 
 int main(int argc, char **argv)
 {
-	FILE *inFilePtr;
-	char *infilename;
-	int dbmd_error;
+	DBMDPathList paths;
+	DBMDBatchConfig config;
+	DBMDBatchSummary summary;
+	DBMDCache cache;
+	DBMDMemo memo;
+	DBMDStoreWriter store;
+	DBMDWatchConfig watch_config;
+	DBMDWatchSummary watch_summary;
+	DBMDServerConfig server_config;
+	DBMDServerStats server_stats;
+	DBMDRunStats run_stats;
+	const char *stats_export = NULL;
+	const char *server_path = NULL;
+	char **watch_dirs;
+	int watch = 0;
+	const char *files_from = NULL;
+	const char *cache_path = NULL;
+	const char *store_path = NULL;
+	int use_memo = 1;
+	FILE *list_file;
+	FILE *report;
+	int num_inputs = 0;
+	int show_help = 0;
+	size_t num_paths;
+	size_t count;
+	int i;
+
+	/* The query subcommand reads a results store instead of scanning */
+	if ( (argc > 1) && !strcmp(argv[1], "query") )
+		return query_store(argc - 2, argv + 2);
+
+	/* The patch subcommand edits files in place */
+	if ( (argc > 1) && !strcmp(argv[1], "patch") )
+		return patch_files(argc - 2, argv + 2);
+
+	/* The remux subcommand rewrites a file with new metadata chunks */
+	if ( (argc > 1) && !strcmp(argv[1], "remux") )
+		return remux_file(argc - 2, argv + 2);
+
+	config.num_jobs = 0;
+	config.show_names = 0;
+	config.io_mode = DBMD_IO_READ;
+	config.tail_probe = 0;
+	config.cache = NULL;
+	config.cache_verify = 0;
+	config.memo = NULL;
+	config.list_segments = 0;
+	config.scan_adm = 0;
+	config.format = DBMD_FORMAT_TEXT;
+	config.store = NULL;
+	config.engine = DBMD_ENGINE_THREADS;
+	config.queue_depth = 0;
+	config.stats = NULL;
+	config.show_stats = 0;
+	watch_config.debounce_ms = DBMD_WATCH_DEBOUNCE_MS;
+	watch_config.queue_limit = DBMD_WATCH_QUEUE_LIMIT;
+	server_config.num_workers = 0;
+	server_config.max_clients = DBMD_SERVER_MAX_CLIENTS;
+	server_config.queue_limit = DBMD_SERVER_QUEUE_LIMIT;
+	dbmd_pathlist_init(&paths);
+
+	/* In watch mode the inputs are directories to watch rather than to scan */
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--watch"))
+			watch = 1;
+	}
+	watch_dirs = malloc(argc * sizeof(char *));
+	if (!watch_dirs)
+	{
+		printf("\nError, out of memory!\n");
+		return 1;
+	}
 
+	/* Parse options, everything else is an input file or directory */
+	for (i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "-j", 2))
+		{
+			/* -j <n> or -j<n> */
+			if (parse_count("-j", argv[i][2] ? argv[i] + 2 : ((i + 1 < argc) ? argv[++i] : ""), INT_MAX, &count))
+				return 1;
+			config.num_jobs = (int)count;
+		}
+		else if (!strncmp(argv[i], "--jobs=", 7))
+		{
+			if (parse_count("--jobs", argv[i] + 7, INT_MAX, &count))
+				return 1;
+			config.num_jobs = (int)count;
+		}
+		else if (!strncmp(argv[i], "--files-from=", 13))
+		{
+			files_from = argv[i] + 13;
+		}
+		else if (!strcmp(argv[i], "--engine=threads"))
+		{
+			config.engine = DBMD_ENGINE_THREADS;
+		}
+		else if (!strcmp(argv[i], "--engine=uring"))
+		{
+			config.engine = DBMD_ENGINE_URING;
+		}
+		else if (!strncmp(argv[i], "--engine=", 9))
+		{
+			fprintf(stderr, "\nError, unknown scan engine %s!\n", argv[i] + 9);
+			return 1;
+		}
+		else if (!strncmp(argv[i], "--queue-depth=", 14))
+		{
+			if (parse_count("--queue-depth", argv[i] + 14, INT_MAX, &count))
+				return 1;
+			config.queue_depth = (int)count;
+		}
+		else if (!strcmp(argv[i], "--mmap"))
+		{
+			config.io_mode = DBMD_IO_MMAP;
+		}
+		else if (!strcmp(argv[i], "--stream"))
+		{
+			config.io_mode = DBMD_IO_STREAM;
+		}
+		else if (!strcmp(argv[i], "--tail-probe"))
+		{
+			config.tail_probe = 1;
+		}
+		else if (!strncmp(argv[i], "--cache=", 8))
+		{
+			cache_path = argv[i] + 8;
+		}
+		else if (!strcmp(argv[i], "--cache-verify"))
+		{
+			config.cache_verify = 1;
+		}
+		else if (!strcmp(argv[i], "--no-memo"))
+		{
+			use_memo = 0;
+		}
+		else if (!strcmp(argv[i], "--segments"))
+		{
+			config.list_segments = 1;
+		}
+		else if (!strcmp(argv[i], "--adm"))
+		{
+			config.scan_adm = 1;
+		}
+		else if (!strncmp(argv[i], "--store=", 8))
+		{
+			store_path = argv[i] + 8;
+		}
+		else if (!strcmp(argv[i], "--format=text"))
+		{
+			config.format = DBMD_FORMAT_TEXT;
+		}
+		else if (!strcmp(argv[i], "--format=ndjson"))
+		{
+			config.format = DBMD_FORMAT_NDJSON;
+		}
+		else if (!strcmp(argv[i], "--format=binary"))
+		{
+			config.format = DBMD_FORMAT_BINARY;
+		}
+		else if (!strncmp(argv[i], "--format=", 9))
+		{
+			fprintf(stderr, "\nError, unknown output format %s!\n", argv[i] + 9);
+			return 1;
+		}
+		else if (!strcmp(argv[i], "--watch"))
+		{
+			/* already seen */
+		}
+		else if (!strncmp(argv[i], "--debounce=", 11))
+		{
+			watch_config.debounce_ms = atoi(argv[i] + 11);
+		}
+		else if (!strncmp(argv[i], "--watch-queue=", 14))
+		{
+			if (parse_count("--watch-queue", argv[i] + 14, SIZE_MAX, &watch_config.queue_limit))
+				return 1;
+		}
+		else if (!strncmp(argv[i], "--server=", 9))
+		{
+			server_path = argv[i] + 9;
+		}
+		else if (!strncmp(argv[i], "--max-clients=", 14))
+		{
+			if (parse_count("--max-clients", argv[i] + 14, SIZE_MAX, &server_config.max_clients))
+				return 1;
+		}
+		else if (!strncmp(argv[i], "--server-queue=", 15))
+		{
+			if (parse_count("--server-queue", argv[i] + 15, SIZE_MAX, &server_config.queue_limit))
+				return 1;
+		}
+		else if (!strcmp(argv[i], "--stats"))
+		{
+			config.show_stats = 1;
+		}
+		else if (!strncmp(argv[i], "--stats-prom=", 13))
+		{
+			stats_export = argv[i] + 13;
+		}
+		else if ( !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") )
+		{
+			show_help = 1;
+		}
+		else if ( (argv[i][0] == '-') && argv[i][1] )
+		{
+			/* - alone is standard input */
+			fprintf(stderr, "\nError, unknown option %s!\n", argv[i]);
+			show_usage();
+			return 1;
+		}
+		else if (watch)
+		{
+			watch_dirs[num_inputs++] = argv[i];
+		}
+		else
+		{
+			/* Retrieve file name from command line input */
+			num_inputs++;
+			num_paths = paths.count;
+			if (dbmd_pathlist_add(&paths, argv[i]))
+			{
+				printf("\nError, out of memory!\n");
+				return 1;
+			}
 
+			/* A directory turns the run into a batch */
+			if ( (paths.count != num_paths + 1) || strcmp(paths.paths[num_paths], argv[i]) )
+				config.show_names = 1;
+		}
+	}
 
-	/*	Print banner */
-	printf("\nDolby Atmos DBMD Parser (Version %s)\n", REV_STR);
-	puts("Copyright (C) 2020, Dolby Laboratories Inc.");
+	/* Messages go to stderr when stdout carries machine-readable results */
+	report = (config.format == DBMD_FORMAT_TEXT) ? stdout : stderr;
 
-	/* Verify input arguments */
-	if (argc == 1)
+	/*	Print banner, unless the results are for a program to read */
+	if ( (config.format == DBMD_FORMAT_TEXT) || show_help || (num_inputs == 0 && !files_from && !server_path) )
+	{
+		printf("\nDolby Atmos DBMD Parser (Version %s)\n", REV_STR);
+		puts("Copyright (C) 2020, Dolby Laboratories Inc.");
+	}
+	if ( show_help || (num_inputs == 0 && !files_from && !server_path) )
 	{
 		show_usage();
+		return 0;
+	}
+	if ( (config.format == DBMD_FORMAT_BINARY) && config.list_segments )
+	{
+		fprintf(stderr, "\nError, --segments is not supported with --format=binary!\n");
+		return 1;
+	}
+	if ( config.scan_adm && (config.list_segments || cache_path || (config.format == DBMD_FORMAT_BINARY)) )
+	{
+		fprintf(stderr, "\nError, --adm is not supported with --segments, --cache or --format=binary!\n");
+		return 1;
 	}
 
-	/* Retrieve file name from command line input */
-	infilename = argv[1];
+	if ( watch && files_from )
+	{
+		fprintf(stderr, "\nError, --files-from is not supported with --watch!\n");
+		return 1;
+	}
+	if ( server_path && (num_inputs || files_from || watch) )
+	{
+		fprintf(stderr, "\nError, --server takes its input files from requests!\n");
+		return 1;
+	}
 
-	/* Open input file */
-	inFilePtr = fopen(infilename, "rb");
+	/* Read additional file names, one per line */
+	if (files_from)
+	{
+		list_file = strcmp(files_from, "-") ? fopen(files_from, "r") : stdin;
+		if (!list_file)
+		{
+			fprintf(report, "\nError opening file list!\n");
+			return 1;
+		}
+		num_inputs++;
+		if (dbmd_pathlist_read(&paths, list_file))
+		{
+			fprintf(report, "\nError, out of memory!\n");
+			return 1;
+		}
+		if (list_file != stdin)
+			fclose(list_file);
+	}
 
-	if (!inFilePtr)
+	/* Name each result unless a single file was given */
+	if ( (num_inputs > 1) || files_from )
+		config.show_names = 1;
+
+	if (cache_path)
 	{
-		printf("\nError opening input file!\n");
-		return 1;
+		if (dbmd_cache_open(&cache, cache_path))
+		{
+			fprintf(report, "\nError opening cache file!\n");
+			return 1;
+		}
+		config.cache = &cache;
 	}
 
-	/* Parse input file wave header */
-	if (parse_wav_header(inFilePtr))
+	/* Identical dbmd chunks are parsed once per run */
+	if ( use_memo && !config.list_segments )
 	{
-		/* Test if DBMD chunk was found */
-		if ( !(status & WAV_DBMD_CHUNK_MASK) || !dbmd_chunk_size )
+		if (dbmd_memo_init(&memo, 0, config.format == DBMD_FORMAT_TEXT))
 		{
-			printf("\nError, Dolby audio metadata chunk not found!\n");
+			fprintf(report, "\nError, out of memory!\n");
+			return 1;
 		}
+		config.memo = &memo;
+	}
 
-		/* Test if AXML chunk was found */
-		if ( !(status & WAV_AXML_CHUNK_MASK) )
+	if (store_path)
+	{
+		if (dbmd_store_open(&store, store_path))
 		{
-			printf("\nError, ADM XML chunk not found!\n");
-		}		
-		
-		printf("\nError, file not recognized as valid ADM WAV file!\n");
-		return 1;
+			fprintf(report, "\nError opening results store!\n");
+			return 1;
+		}
+		config.store = &store;
+	}
+
+	/* Scans are only timed when their cost is reported */
+	if ( config.show_stats || stats_export )
+	{
+		dbmd_stats_init(&run_stats, stats_export);
+		config.stats = &run_stats;
 	}
-	/* close file**/
-	fclose(inFilePtr);
 
-	/* If a DBMD chunk was found, parse it */
-	if ( (dbmd_error = parse_dbmd_metadata(dolby_metadata, (unsigned int)dbmd_chunk_size, &DolbyMetadata)) )
+#ifdef WIN32
+	if (config.format == DBMD_FORMAT_BINARY)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	fflush(stdout);
+	if (server_path)
+	{
+		server_config.num_workers = config.num_jobs;
+		if (dbmd_server_run(server_path, &config, &server_config, stderr, &server_stats))
+		{
+			fprintf(report, "\nError, cannot start the server!\n");
+			return 1;
+		}
+		if ( config.cache && dbmd_cache_close(config.cache) )
+			fprintf(report, "\nError writing cache file!\n");
+		if ( config.store && dbmd_store_close(config.store) )
+			fprintf(report, "\nError writing results store!\n");
+		fprintf(stderr, "\nServed %llu requests on %llu connections: %llu failed, %llu not understood, queue depth up to %lu\n",
+			(unsigned long long)server_stats.num_requests,
+			(unsigned long long)server_stats.num_connections,
+			(unsigned long long)server_stats.num_failed,
+			(unsigned long long)server_stats.num_bad_requests,
+			(unsigned long)server_stats.max_queue_depth);
+		if ( config.memo && config.memo->num_lookups )
+			fprintf(stderr, "%lu of %lu dbmd chunks answered from the memo (%.1f%% hit rate), %lu distinct\n",
+				config.memo->num_hits, config.memo->num_lookups,
+				100.0 * config.memo->num_hits / config.memo->num_lookups,
+				(unsigned long)config.memo->num_entries);
+		finish_stats(&config, stats_export, stderr);
+		if (config.memo)
+			dbmd_memo_free(config.memo);
+		free(watch_dirs);
+		return 0;
+	}
+	if (watch)
+	{
+		fprintf(stderr, "Watching %d director%s, press Ctrl-C to stop\n", num_inputs, (num_inputs == 1) ? "y" : "ies");
+		if (dbmd_watch_run(watch_dirs, num_inputs, &config, &watch_config, stdout, stderr, &watch_summary))
+		{
+			fprintf(report, "\nError, cannot watch the input directories!\n");
+			return 1;
+		}
+		summary = watch_summary.batch;
+		config.show_names = 1;
+	}
+	else if (dbmd_batch_run(&paths, &config, stdout, &summary))
 	{
-		/* parse dbmd error & display message */
-		display_dbmd_error(dbmd_error);
+		fprintf(report, "\nError, out of memory!\n");
 		return 1;
 	}
 
-	/* Display dbmd values for all programs */
-	display_dbmd_metadata();
+	if ( config.cache && dbmd_cache_close(config.cache) )
+		fprintf(report, "\nError writing cache file!\n");
+	if ( config.store && dbmd_store_close(config.store) )
+		fprintf(report, "\nError writing results store!\n");
 
-	return 0;
+	if (config.show_names)
+	{
+		fprintf(report, "\nScanned %lu files: %lu parsed, %lu failed, %lu reads issued, %llu bytes fetched\n",
+			(unsigned long)summary.num_files,
+			(unsigned long)summary.num_passed,
+			(unsigned long)summary.num_failed,
+			summary.num_reads,
+			(unsigned long long)summary.num_bytes);
+		if (config.cache)
+			fprintf(report, "%lu files answered from the cache\n", (unsigned long)summary.num_cached);
+		if ( config.memo && config.memo->num_lookups )
+			fprintf(report, "%lu of %lu dbmd chunks answered from the memo (%.1f%% hit rate), %lu distinct\n",
+				config.memo->num_hits, config.memo->num_lookups,
+				100.0 * config.memo->num_hits / config.memo->num_lookups,
+				(unsigned long)config.memo->num_entries);
+		if (watch)
+			fprintf(report, "%lu file events, %lu files parsed early on a full queue, %lu event queue overflows\n",
+				(unsigned long)watch_summary.num_events,
+				(unsigned long)watch_summary.num_forced,
+				(unsigned long)watch_summary.num_overflows);
+	}
+	finish_stats(&config, stats_export, report);
+
+	if (config.memo)
+		dbmd_memo_free(config.memo);
+	dbmd_pathlist_free(&paths);
+	free(watch_dirs);
+
+	return summary.num_failed ? 1 : 0;
 }
 
-void display_dbmd_metadata(void)
+void show_usage(void)
 {
-	unsigned int i;
-	int is_same_brm = 0;
-	int same_brm_count = 0;
-	atmos_dbmd_binaural_render_mode brm = ATMOS_DBMD_BINAURAL_RENDER_MODE_NOT_INDICATED;
+	puts("\nUsage: DBMD_ATMOS_PARSE [options] <input ADM WAV file or directory> ... \n");
+	puts("Use - as the input file name to read an ADM WAV file from standard input.");
+	puts("An http:// URL is read with HTTP range requests, fetching only the chunk headers.\n");
+	puts("Options:");
+	puts("   -j <n>, --jobs=<n>     Number of worker threads (default: one per CPU), also given as -j<n>");
+	puts("   --files-from=<file>    Read input file names from <file>, one per line (- for stdin)");
+	puts("   --engine=<engine>      Scan engine: threads (default) or uring (asynchronous opens and reads with io_uring)");
+	puts("   --queue-depth=<n>      With --engine=uring, number of files in flight (default: 256)");
+	puts("   --mmap                 Map input files into memory and parse the dbmd chunk in place");
+	puts("   --stream               Read input files sequentially, as for a pipe");
+	puts("   --tail-probe           Look for the dbmd chunk in the last 64 KB of each file before walking its chunks");
+	puts("   --segments             List the dbmd segments of each file without decoding them");
+	puts("   --adm                  Also scan the ADM XML chunk and check its track count against the dbmd object count");
+	puts("   --cache=<file>         Answer unchanged files from the scan cache in <file>, adding new results");
+	puts("   --cache-verify         With --cache, re-read the dbmd chunk and only skip the parse if it is unchanged");
+	puts("   --no-memo              Parse every dbmd chunk, even one identical to a chunk parsed earlier in the run");
+	puts("   --format=<format>      Result format: text (default), ndjson (one JSON object per line) or binary");
+	puts("   --store=<file>         Append the results to the results store in <file>");
+	puts("   --watch                Watch the input directories and parse each ADM WAV file once it is complete");
+	puts("   --debounce=<ms>        With --watch, wait until a file has been quiet for <ms> milliseconds (default: 200)");
+	puts("   --watch-queue=<n>      With --watch, maximum number of files waiting to be parsed (default: 4096)");
+	puts("   --server=<socket>      Answer parse requests on the Unix domain socket <socket> instead of scanning inputs");
+	puts("   --max-clients=<n>      With --server, maximum number of open connections (default: 256)");
+	puts("   --server-queue=<n>     With --server, maximum number of connections waiting for a worker (default: 1024)");
+	puts("   --stats                Show the time spent per phase and the I/O of each file, and latency percentiles for the run");
+	puts("   --stats-prom=<file>    Export the run statistics to <file> in the Prometheus text format, updated every second");
+	puts("\n       DBMD_ATMOS_PARSE query [--count] <store file> <condition> ...\n");
+	puts("Lists the files in a results store for which all conditions hold, for example");
+	puts("   warp_mode=loro  trim.7.1.4=manual  tool=\"Dolby Atmos Conversion Tool\"  tool_version<1.8");
+	puts("   objects>=100  binaural=bypass  error!=0");
+	puts("\n       DBMD_ATMOS_PARSE patch [--journal=<file>] [--dry-run] <edit> ... <input ADM WAV file or directory> ...\n");
+	puts("Rewrites metadata fields in place, writing only the changed bytes and segment checksums, for example");
+	puts("   warp_mode=loro  trim.7.1.4=auto  trim=manual  binaural=near  binaural.12=far");
+	puts("   --journal=<file>       Record each patch in <file> first, completing interrupted patches on the next run");
+	puts("   --dry-run              Show the changes without writing them");
+	puts("\n       DBMD_ATMOS_PARSE remux [--dbmd=<file>] [--axml=<file>] [--rf64] <input ADM WAV file> [<output file>]\n");
+	puts("Writes the file with the dbmd and/or axml chunk replaced by the contents of <file>, cloning the audio data");
+	puts("where the filesystem allows; without an output file the input is replaced");
+	puts("   --rf64                 Write an RF64 file even if it is smaller than 4 GB");
+	puts("");
+}
 
-	printf("\nDolby Audio Metadata Wave Chunk Found\n");
+/*******************************************************************************************
+int query_store(...)
+-Purpose:
+	Runs the query subcommand: prints the name of every file in a results store
+	that matches all conditions, or with --count only their number
+-Inputs:
+	int argc		-	Number of arguments following "query"
+	char **argv		-	Arguments following "query"
+-Returns:
+	int				-	0 if any file matches, 1 if none does, 2 on error
+********************************************************************************************/
+int query_store(int argc, char **argv)
+{
+	DBMDStore store;
+	DBMDStoreQuery query;
+	const char *store_path = NULL;
+	int count_only = 0;
+	size_t count;
+	int i;
+
+	query.num_conditions = 0;
+	for (i = 0; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--count"))
+		{
+			count_only = 1;
+		}
+		else if (!store_path)
+		{
+			store_path = argv[i];
+		}
+		else if (dbmd_store_condition(&query, argv[i]))
+		{
+			fprintf(stderr, "Error, invalid condition %s!\n", argv[i]);
+			return 2;
+		}
+	}
 
-	if (DolbyMetadata.DolbyAtmosSeg.segment_exists)
+	if (!store_path)
 	{
-		printf("\nDolby Atmos Metadata\n");
-		printf("   Created by: %s (%d.%d.%d)\n",
-			DolbyMetadata.DolbyAtmosSeg.content_creation_tool,
-			DolbyMetadata.DolbyAtmosSeg.content_creation_tool_version.major,
-			DolbyMetadata.DolbyAtmosSeg.content_creation_tool_version.minor,
-			DolbyMetadata.DolbyAtmosSeg.content_creation_tool_version.micro);
-		printf("   warp_mode: %s\n", warpmodetext[DolbyMetadata.DolbyAtmosSeg.warp_mode]);
+		show_usage();
+		return 2;
 	}
-	else
+	if (dbmd_store_map(&store, store_path))
 	{
-		printf("\nDolby Atmos Metdata\n");
-		printf("   Not present. This may indicate that this is not a valid Dolby Atmos ADM file.\n");
+		fprintf(stderr, "Error opening results store %s!\n", store_path);
+		return 2;
 	}
 
-	if (DolbyMetadata.DolbyAtmosSupSeg.segment_exists)
-	{
-		printf("\nDolby Atmos Supplemental Metadata\n");
+	count = dbmd_store_query(&store, &query, count_only ? NULL : print_row, stdout);
+	if (count_only)
+		printf("%lu\n", (unsigned long)count);
+	dbmd_store_unmap(&store);
+
+	return count ? 0 : 1;
+}
 
-		/* Determine if same brm is used for all objects */
-		for (i = 1; i < DolbyMetadata.DolbyAtmosSupSeg.object_count; i++)
+/*******************************************************************************************
+int patch_files(...)
+-Purpose:
+	Runs the patch subcommand: applies the edits given on the command line to
+	every input file in turn, optionally through a journal
+-Inputs:
+	int argc		-	Number of arguments following "patch"
+	char **argv		-	Arguments following "patch"
+-Returns:
+	int				-	0 if all files were patched, 1 if any failed, 2 on error
+********************************************************************************************/
+int patch_files(int argc, char **argv)
+{
+	DBMDPathList paths;
+	DBMDPatch patch;
+	DBMDPatchResult result;
+	DBMDJournal journal;
+	DBMDOutput out;
+	const char *journal_path = NULL;
+	unsigned long num_failed = 0;
+	int num_edits = 0;
+	int flags = 0;
+	int error;
+	size_t i;
+	int arg;
+
+	dbmd_patch_init(&patch);
+	dbmd_pathlist_init(&paths);
+	for (arg = 0; arg < argc; arg++)
+	{
+		if (!strncmp(argv[arg], "--journal=", 10))
 		{
-			if (DolbyMetadata.DolbyAtmosSupSeg.binaural_render_mode[i] == DolbyMetadata.DolbyAtmosSupSeg.binaural_render_mode[i-1])
-			{
-				same_brm_count = same_brm_count + 1;
-			}
+			journal_path = argv[arg] + 10;
 		}
-		if ((same_brm_count + 1) == DolbyMetadata.DolbyAtmosSupSeg.object_count)
+		else if (!strcmp(argv[arg], "--dry-run"))
 		{
-			is_same_brm = 1;
-			brm = DolbyMetadata.DolbyAtmosSupSeg.binaural_render_mode[0];
+			flags |= DBMD_PATCH_DRY_RUN;
 		}
-		else
+		else if (argv[arg][0] == '-')
 		{
-			is_same_brm = 0;
+			fprintf(stderr, "Error, unknown option %s!\n", argv[arg]);
+			dbmd_pathlist_free(&paths);
+			return 2;
 		}
-
-		if (is_same_brm == 1)
+		else if (strchr(argv[arg], '='))
 		{
-			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_BYPASS)
-			{
-				printf("   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tNo binauralization will be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
-			}
-			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_NEAR)
-			{
-				printf("   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tNear binaural render mode will be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
-			}
-			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_FAR)
-			{
-				printf("   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tFar binaural render mode will be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
-			}
-			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_MID)
+			if (dbmd_patch_edit(&patch, argv[arg]))
 			{
-				printf("   Headphone metadata present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tDefault binaural render mode will be applied.\n", binauralrendermodetext[brm]);
-			}
-			if (brm == ATMOS_DBMD_BINAURAL_RENDER_MODE_NOT_INDICATED)
-			{
-				printf("   Headphone metadata not present: \n   \tbinaural render mode: %s (all objects have identical value)\n   \tNo binaural render mode metadata present. Default binaural render mode metadata may be applied. \n   \tRecommend editing binaural render mode parameters.\n", binauralrendermodetext[brm]);
+				fprintf(stderr, "Error, invalid edit %s!\n", argv[arg]);
+				dbmd_pathlist_free(&paths);
+				return 2;
 			}
+			num_edits++;
 		}
-		else
+		else if (dbmd_pathlist_add(&paths, argv[arg]))
 		{
-			printf("   Headphone metadata present: \n   \tbinaural render mode: varied (objects have different values)\n");
+			fprintf(stderr, "\nError, out of memory!\n");
+			dbmd_pathlist_free(&paths);
+			return 2;
 		}
+	}
 
-		/* check trim metadata */
-		printf("   Trim Metadata:\n");
-		for (i = 0; i < NUM_TRIM_CONFIGS; i++)
+	if ( !num_edits || !paths.count )
+	{
+		show_usage();
+		dbmd_pathlist_free(&paths);
+		return 2;
+	}
+	if (journal_path)
+	{
+		if (dbmd_journal_open(&journal, journal_path))
 		{
-			printf("   \tTrim mode: %s, %s trims\n",
-				trimmodecfgtext[i],
-				trimtypetext[DolbyMetadata.DolbyAtmosSupSeg.trims[i].auto_trim]);
+			fprintf(stderr, "Error opening journal %s!\n", journal_path);
+			dbmd_pathlist_free(&paths);
+			return 2;
 		}
+		if (journal.num_recovered || journal.num_conflicts)
+			fprintf(stderr, "Completed %lu interrupted patches from the journal, %lu files changed since were left alone\n",
+				journal.num_recovered, journal.num_conflicts);
 	}
-	else
+
+	dbmd_output_init(&out);
+	for (i = 0; i < paths.count; i++)
 	{
-		printf("\nDolby Atmos Supplemental Metadata\n"); 
-		printf("   Headphone metadata not present. Default metadata will apply.\n");
-		printf("   Trim metadata not present. Default metadata will apply.\n");
+		error = dbmd_patch_file(paths.paths[i], &patch, journal_path ? &journal : NULL, flags, &result);
+		if (error == DB_ERR_OK)
+		{
+			if (!result.num_writes)
+				printf("%s: unchanged\n", paths.paths[i]);
+			else
+				printf("%s: %s %lu bytes in %lu segment%s with %lu write%s\n", paths.paths[i],
+					(flags & DBMD_PATCH_DRY_RUN) ? "would change" : "changed", result.num_bytes,
+					result.num_segments, (result.num_segments == 1) ? "" : "s",
+					result.num_writes, (result.num_writes == 1) ? "" : "s");
+			continue;
+		}
+
+		num_failed++;
+		dbmd_output_reset(&out);
+		if (error == DB_ERR_FILEOPEN)
+			dbmd_output_printf(&out, "Error, cannot open the file for writing!\n");
+		else if (error == DB_ERR_FILEWRITE)
+			dbmd_output_printf(&out, "Error writing the file or journal!\n");
+		else if (error > DB_ERR_FILEOPEN)
+			display_dbmd_error(&out, error);
+		else
+			dbmd_output_printf(&out, "Error, file not recognized as valid ADM WAV file!\n");
+		fprintf(stderr, "%s: ", paths.paths[i]);
+		if (dbmd_output_write(&out, stderr) != DB_ERR_OK)
+			fprintf(stderr, "\nError, out of memory!\n");
 	}
+	dbmd_output_free(&out);
 
-	printf("\n");
-}
+	if ( journal_path && dbmd_journal_close(&journal) )
+		fprintf(stderr, "\nError, a patch was left incomplete in the journal!\n");
+	dbmd_pathlist_free(&paths);
 
-void display_dbmd_error(int error_code)
-{
-	switch(error_code)
-	{
-		case DB_ERR_OK:
-			break;
-		case DB_ERR_NEWERVERSION:
-			printf("DBMD Error, unsupported DBMD version!\n");
-			break;
-		case DB_ERR_BADDASMSSYNC:
-			printf("DBMD Error, invalid Dolby Atmos Supplemental Metadata sync!\n");
-			break;
-		case DB_ERR_TOOMANYOBJS:
-			printf("DBMD Error, too many objects!\n");
-			break;
-		case DB_ERR_DASEGSZ:
-			printf("DBMD Error, unsupported segment size for Dolby Atmos!\n");
-			break;
-		case DB_ERR_DACHECKSUM:
-			printf("DBMD Error, checksum failure for Dolby Atmos segment!\n");
-			break;
-		case DB_ERR_DASCHECKSUM: 
-			printf("DBMD Error, checksum failure for Dolby Atmos Supplemental segment!\n");
-			break;
-	}
+	return num_failed ? 1 : 0;
 }
 
 /*******************************************************************************************
-int parse_wav_header(...)
+int remux_file(...)
 -Purpose:
-	Parses the input file wave header, if it exists
+	Runs the remux subcommand: writes a copy of the input with the dbmd and/or
+	axml chunk replaced, over the input unless an output file is given
 -Inputs:
-	FILE *in_file	-	input file pointer
+	int argc		-	Number of arguments following "remux"
+	char **argv		-	Arguments following "remux"
 -Returns:
-	int				-	error code
+	int				-	0 if the file was written, 1 if it failed, 2 on error
 ********************************************************************************************/
-int parse_wav_header(FILE *in_file)
+int remux_file(int argc, char **argv)
 {
-	char byte_buf[5] = "";
-	int b_is_RF64_BW64 = 0;
-	int b_ds64_present = 0;
-	uint64_t subchunk_size=0; 
-	uint64_t num_mini_chunks, mini_chunk_size, leftover_size, mchnk;
-	uint64_t data64_chunk_size = 0;
-	unsigned int riff_size_low = 0, riff_size_high = 0, data_size_low = 0, data_size_high = 0;
-	
-	if (in_file != NULL)
+	DBMDRemux remux;
+	DBMDRemuxResult result;
+	DBMDOutput out;
+	unsigned char *dbmd = NULL;
+	unsigned char *axml = NULL;
+	const char *input = NULL;
+	const char *output = NULL;
+	const char *unreadable = NULL;
+	int num_files = 0;
+	int error;
+	int arg;
+
+	memset(&remux, 0, sizeof(remux));
+	for (arg = 0; (arg < argc) && !unreadable; arg++)
 	{
-		status = 0;	         /* Initialize status variable */
-		dbmd_chunk_size = 0; /* Initialize dbmd chunk size */
-
-		/* Read in the first 4 header bytes of the file */
-		fread(byte_buf, 1, 4, in_file);
-
-		if ( !strcmp(byte_buf, "RIFF") || !strcmp(byte_buf, "RF64") || !strcmp(byte_buf, "BW64") )	/* if RIFF/RF64/BW64 bytes found */
-		{ 
-			if ( !strcmp(byte_buf, "RF64") || !strcmp(byte_buf, "BW64") )
-			{
-				/* Flag that file adheres to RF64/BW64 specification */
-				b_is_RF64_BW64 = 1; 
-			}
-		
-			status = status | WAV_RIFF_HEADER_MASK; /* update status */
-
-			fread(&subchunk_size, 1, 4, in_file);	    /* read in size of RIFF/RG64/BW64 chunk */
-			fread(byte_buf, 1, 4, in_file);		        /* read in next 4 bytes */
-
-			if (!strcmp(byte_buf,"WAVE"))		        /* if WAVE, continue */
-				status = status | WAV_WAVE_HEADER_MASK; /* update status */		
-			else								        /* else, error, exit */
-				return 1;
-
-			while(1)
-			{
-				if (fread(byte_buf, 1, 4, in_file) != 4)	/* read next subchunk ID */	
-					break;
-
-				subchunk_size = 0; /* reset subchunk_size value */
-				if (fread(&subchunk_size, 1, 4, in_file) != 4)	/* read subchunk size */
-					break;
+		if (!strncmp(argv[arg], "--dbmd=", 7))
+		{
+			if ( load_file(argv[arg] + 7, &dbmd, &remux.dbmd_len) || !remux.dbmd_len )
+				unreadable = argv[arg] + 7;
+			remux.dbmd = dbmd;
+		}
+		else if (!strncmp(argv[arg], "--axml=", 7))
+		{
+			if ( load_file(argv[arg] + 7, &axml, &remux.axml_len) || !remux.axml_len )
+				unreadable = argv[arg] + 7;
+			remux.axml = axml;
+		}
+		else if (!strcmp(argv[arg], "--rf64"))
+		{
+			remux.flags |= DBMD_REMUX_RF64;
+		}
+		else if (argv[arg][0] == '-')
+		{
+			fprintf(stderr, "Error, unknown option %s!\n", argv[arg]);
+			free(dbmd);
+			free(axml);
+			return 2;
+		}
+		else if (num_files++ == 0)
+		{
+			input = argv[arg];
+		}
+		else
+		{
+			output = argv[arg];
+		}
+	}
 
-				/* sanity check size */
-				if ((subchunk_size % 2) && (subchunk_size != RF64_INDICATION))
-				{
-					subchunk_size++;
-				}
-				if (subchunk_size == 0)
-					return 1;
+	if ( unreadable || !input || (num_files > 2) )
+	{
+		if (unreadable)
+			fprintf(stderr, "Error reading %s, or it is empty!\n", unreadable);
+		else
+			show_usage();
+		free(dbmd);
+		free(axml);
+		return 2;
+	}
 
+	error = dbmd_remux_file(input, output, &remux, &result);
+	free(dbmd);
+	free(axml);
+	if (error == DB_ERR_OK)
+	{
+		printf("%s: %llu bytes cloned, %llu copied, %llu written%s\n", output ? output : input,
+			(unsigned long long)result.bytes_cloned, (unsigned long long)result.bytes_copied,
+			(unsigned long long)result.bytes_written, result.promoted ? ", promoted to RF64" : "");
+		return 0;
+	}
 
-				/* Read in subchunk based on ID */
-				if (!strcmp(byte_buf, "ds64"))	/* DS64 Chunk for RF64/BW64 */
-				{
-					b_ds64_present = 1;                    /* flag presence of ds64 chunk */
-					status = status | WAV_DS64_CHUNK_MASK; /* update status */
+	dbmd_output_init(&out);
+	if (error == DB_ERR_FILEOPEN)
+		dbmd_output_printf(&out, "Error opening input file!\n");
+	else if (error == DB_ERR_FILEWRITE)
+		dbmd_output_printf(&out, "Error writing the output file!\n");
+	else if (error == DB_ERR_NOTSUPPORTED)
+		dbmd_output_printf(&out, "Error, only the data chunk may be larger than 4 GB!\n");
+	else if (error > DB_ERR_FILEOPEN)
+		display_dbmd_error(&out, error);
+	else
+		dbmd_output_printf(&out, "Error, file not recognized as valid ADM WAV file!\n");
+	fprintf(stderr, "%s: ", input);
+	if (dbmd_output_write(&out, stderr) != DB_ERR_OK)
+		fprintf(stderr, "\nError, out of memory!\n");
+	dbmd_output_free(&out);
 
-					if (subchunk_size < 16)
-						return 1;
+	return 1;
+}
 
-					/* read in riffSizeLow */
-					fread(&riff_size_low, 1, 4, in_file);
+/*******************************************************************************************
+static int load_file(...)
+-Purpose:
+	Reads a whole file into an allocated buffer
+********************************************************************************************/
+static int load_file(const char *filename, unsigned char **data, size_t *len)
+{
+	FILE *f;
+	long size;
 
-					/* read in riffSizeHigh */
-					fread(&riff_size_high, 1, 4, in_file);
+	f = fopen(filename, "rb");
+	if (!f)
+		return -1;
+	if ( fseek(f, 0, SEEK_END) || ((size = ftell(f)) < 0) || fseek(f, 0, SEEK_SET) )
+	{
+		fclose(f);
+		return -1;
+	}
 
-					/* read in dataSizeLow */
-					fread(&data_size_low, 1, 4, in_file);
+	free(*data);
+	*data = (unsigned char *)malloc(size ? (size_t)size : 1);
+	*len = (size_t)size;
+	if ( !*data || (fread(*data, 1, *len, f) != *len) )
+	{
+		fclose(f);
+		return -1;
+	}
 
-					/* read in dataSizeHigh */
-					fread(&data_size_high, 1, 4, in_file);
+	fclose(f);
+	return 0;
+}
 
-					/* combine riffSIzeLow and riffSizeHigh to form actual size */
-					data64_chunk_size = ((uint64_t)data_size_high << 32) | (uint64_t)data_size_low;
+/*******************************************************************************************
+static int parse_count(...)
+-Purpose:
+	Reads the positive whole number given for an option, reporting any other value
+********************************************************************************************/
+static int parse_count(const char *option, const char *value, size_t max, size_t *result)
+{
+	unsigned long long number;
+	char *end;
 
-					/* advance beyond remaining subchunk bytes */
-#ifdef WIN32
-					_fseeki64(in_file, subchunk_size - 16, SEEK_CUR);
-#else
-					fseek(in_file, subchunk_size - 16, SEEK_CUR);
-#endif 
-				}				
-				else if (!strcmp(byte_buf,"fmt "))	/* Format Chunk */
-				{
-					status = status | WAV_FMT_CHUNK_MASK; /* update status */
-					
-					/* advance beyond remaining subchunk bytes */
-#ifdef WIN32
-					_fseeki64(in_file, subchunk_size, SEEK_CUR);	
-#else
-					fseek(in_file, subchunk_size, SEEK_CUR);	
-#endif 
-				}
-				else if (!strcmp(byte_buf,"data")) 
-				{
-					status = status | WAV_DATA_CHUNK_MASK; /* update status */
-					
-					if ( (b_is_RF64_BW64 == 1) && (subchunk_size == RF64_INDICATION) )
-					{
-						subchunk_size = data64_chunk_size; /* rewrite size value using ds64 data size */
-					}
-
-					if (subchunk_size > SIZE_LIMIT)
-					{
-						/* divide large file into mini-chunks */
-						num_mini_chunks = subchunk_size / SIZE_LIMIT;
-						mini_chunk_size = subchunk_size / num_mini_chunks;
-						leftover_size = subchunk_size - (num_mini_chunks * mini_chunk_size);
-						for (mchnk = 0; mchnk < num_mini_chunks; mchnk++)
-						{
-#ifdef WIN32
-							_fseeki64(in_file, mini_chunk_size, SEEK_CUR);
-#else
-							fseek(in_file, mini_chunk_size, SEEK_CUR);
-#endif 
-						}
-					}
-					else
-					{
-						leftover_size = subchunk_size;
-					}
-
-					/* advance to end of data chunk */
-					if (leftover_size > 0)
-					{
-#ifdef WIN32
-						_fseeki64(in_file, leftover_size, SEEK_CUR);
-#else
-						fseek(in_file, leftover_size, SEEK_CUR);
-#endif 
-					}
-				}
-				else if (!strcmp(byte_buf,"dbmd"))	/* Dolby Audio Metadata Chunk */
-				{
-					status = status | WAV_DBMD_CHUNK_MASK; /* update status */
-					
-					/* Check if DBMD is too big */
-					if (subchunk_size > MAX_DBMD_SIZE)
-					{
-						return 1;
-					}
-
-					/* Read in the metadata chunk */
-					fread(dolby_metadata, 1, subchunk_size, in_file);
-
-					/* Save the chunk size */
-					dbmd_chunk_size = subchunk_size;
-				}
-				else if (!strcmp(byte_buf,"axml"))	/* ADM XML Chunk */
-				{
-					status = status | WAV_AXML_CHUNK_MASK; /* update status */
-
-					if (subchunk_size > SIZE_LIMIT)
-					{
-						/* divide large file into mini-chunks */
-						num_mini_chunks = subchunk_size / SIZE_LIMIT;
-						mini_chunk_size = subchunk_size / num_mini_chunks;
-						leftover_size = subchunk_size - (num_mini_chunks * mini_chunk_size);
-						for (mchnk = 0; mchnk < num_mini_chunks; mchnk++)
-						{
-#ifdef WIN32
-							_fseeki64(in_file, mini_chunk_size, SEEK_CUR);
-#else
-							fseek(in_file, mini_chunk_size, SEEK_CUR);
-#endif 
-						}
-					}
-					else
-					{
-						leftover_size = subchunk_size;
-					}
-
-					/* advance to end of axml chunk */
-					if (leftover_size > 0)
-					{
-#ifdef WIN32
-						_fseeki64(in_file, leftover_size, SEEK_CUR);
-#else
-						fseek(in_file, leftover_size, SEEK_CUR);
-#endif 
-					}
-				}				
-				else
-				{
-					/* advance beyond unsupported subchunks */
-#ifdef WIN32
-					_fseeki64(in_file, subchunk_size, SEEK_CUR);
-#else
-					fseek(in_file, subchunk_size, SEEK_CUR); 
-#endif 
-				}
-			}
-			
-			if ( (b_is_RF64_BW64 == 1) && (b_ds64_present == 1) )
-			{
-				/* if we received all necessary subchunks for RF64/BW64 large files */
-				if (status == 0x7F) 
-					return 0; 
-				else
-					return 1;
-			}
-			else 
-			{
-				/* if we received all necessary subchunks for RIFF files */
-				if (status == 0x3F)	/* if we received all necessary subchunks */
-					return 0;
-				else
-					return 1;
-			}
-		}
-		else /* if file does not begin with RIFF/RF64/BW64 bytes */
-		{
-			return 1;
-		}
+	errno = 0;
+	number = strtoull(value, &end, 10);
+	if ( (*value < '0') || (*value > '9') || *end || errno || !number || (number > max) )
+	{
+		fprintf(stderr, "\nError, %s needs a positive number, not \"%s\"!\n", option, value);
+		return -1;
 	}
 
+	*result = (size_t)number;
 	return 0;
 }
 
-void show_usage(void)
+/*******************************************************************************************
+static int print_row(...)
+-Purpose:
+	Query visit function printing the file name of a row
+********************************************************************************************/
+static int print_row(void *arg, const DBMDStoreRow *row)
 {
-	puts("\nUsage: DBMD_ATMOS_PARSE <input ADM WAV file name> \n");
+	fprintf((FILE *)arg, "%s\n", row->path);
+	return 0;
+}
 
-	exit(0);
-}
\ No newline at end of file
+/*******************************************************************************************
+static void finish_stats(...)
+-Purpose:
+	Reports and exports the run statistics at the end of a run, if enabled
+********************************************************************************************/
+static void finish_stats(const DBMDBatchConfig *config, const char *stats_export, FILE *report)
+{
+	if (!config->stats)
+		return;
+
+	if (config->show_stats)
+		dbmd_stats_report(config->stats, report);
+	if ( stats_export && dbmd_stats_export(config->stats, stats_export) )
+		fprintf(report, "\nError writing statistics file!\n");
+	dbmd_stats_free(config->stats);
+}
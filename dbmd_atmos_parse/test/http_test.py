@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2020, Dolby Laboratories Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification, are permitted
+# provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+#    and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+#    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+#    promote products derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+# PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+# ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+# OF THE POSSIBILITY OF SUCH DAMAGE.
+################################################################################
+#
+# Scans the sample files through a stand-in HTTP server on the loopback
+# interface and compares the results with those of the local files.
+#
+# usage: http_test.py <parser executable> <sample_files directory>
+#
+# The first path component of a URL selects how the server answers:
+#   range     206 responses on a kept-alive connection
+#   norange   200 responses with the whole file, which the reader streams
+#   drop      206 responses, closing the connection after each one while it
+#             is still announced as kept alive, so every reuse is retried
+#   badrange  206 responses whose Content-Range does not start at the offset
+# Requests at or past the end of a file are answered with 416 in every mode.
+
+import http.server
+import json
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+
+DB_ERR_FILEREAD = -21
+
+
+class StandInHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    root = None
+    counts = {}
+    lock = threading.Lock()
+
+    def log_message(self, *args):
+        pass
+
+    def setup(self):
+        super().setup()
+        self.count('connect')
+
+    def count(self, key):
+        with self.lock:
+            self.counts[key] = self.counts.get(key, 0) + 1
+
+    def do_GET(self):
+        parts = self.path.lstrip('/').split('/', 1)
+        path = os.path.join(self.root, parts[1]) if len(parts) == 2 else ''
+        mode = parts[0]
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+        with open(path, 'rb') as f:
+            data = f.read()
+        size = len(data)
+        match = re.match(r'bytes=(\d+)-(\d*)$', self.headers.get('Range', ''))
+
+        if (mode == 'norange') or not match:
+            self.count('200')
+            self.send_response(200)
+            self.send_header('Content-Length', str(size))
+            self.end_headers()
+            self.wfile.write(data)
+            return
+
+        first = int(match.group(1))
+        last = min(int(match.group(2)) if match.group(2) else size - 1, size - 1)
+        if first >= size:
+            self.count('416')
+            self.send_response(416)
+            self.send_header('Content-Range', 'bytes */%d' % size)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+
+        self.count('206')
+        shown = first + 1 if mode == 'badrange' else first
+        self.send_response(206)
+        self.send_header('Content-Range', 'bytes %d-%d/%d' % (shown, last, size))
+        self.send_header('Content-Length', str(last - first + 1))
+        self.end_headers()
+        self.wfile.write(data[first:last + 1])
+        if mode == 'drop':
+            self.count('drop')
+            self.close_connection = True
+
+
+class StandInServer(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+
+    def handle_error(self, request, client_address):
+        # the reader drops connections whose response it rejects
+        pass
+
+
+def scan(parser, inputs):
+    """Runs the parser on the inputs, returning its exit code and the NDJSON
+    results without the file names"""
+    proc = subprocess.run([parser, '--format=ndjson'] + inputs, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    results = []
+    for line in proc.stdout.decode().splitlines():
+        result = json.loads(line)
+        del result['file']
+        results.append(result)
+    return proc.returncode, results
+
+
+def without_axml(src, dst):
+    """Writes a copy of a WAV file without its axml chunk, whose chunk walk runs
+    to the end of the file"""
+    with open(src, 'rb') as f:
+        data = f.read()
+    out = bytearray(data[:12])
+    pos = 12
+    while pos + 8 <= len(data):
+        size = struct.unpack('<I', data[pos + 4:pos + 8])[0]
+        end = pos + 8 + size + (size & 1)
+        if data[pos:pos + 4] != b'axml':
+            out += data[pos:end]
+        pos = end
+    out[4:8] = struct.pack('<I', len(out) - 8)
+    with open(dst, 'wb') as f:
+        f.write(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('usage: http_test.py <parser executable> <sample_files directory>')
+        return 2
+    parser = os.path.abspath(sys.argv[1])
+    samples = os.path.abspath(sys.argv[2])
+    names = sorted(n for n in os.listdir(samples) if n.endswith('.wav'))
+
+    root = tempfile.mkdtemp(prefix='dbmd_http_test.')
+    try:
+        for name in names:
+            shutil.copy(os.path.join(samples, name), root)
+        without_axml(os.path.join(samples, names[0]), os.path.join(root, 'no_axml.wav'))
+        names.append('no_axml.wav')
+
+        StandInHandler.root = root
+        server = StandInServer(('127.0.0.1', 0), StandInHandler)
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        base = 'http://127.0.0.1:%d/' % server.server_address[1]
+
+        failures = 0
+        local_code, local = scan(parser, [os.path.join(root, n) for n in names])
+        if (len(local) != len(names)) or (local[-1]['error'] == 0):
+            print('FAIL local scan: %d results' % len(local))
+            failures += 1
+
+        for mode in ('range', 'norange', 'drop', 'badrange'):
+            StandInHandler.counts = {}
+            code, results = scan(parser, [base + mode + '/' + n for n in names])
+            counts = StandInHandler.counts
+            if mode == 'badrange':
+                ok = (code != 0) and (len(results) == len(names)) and all(r['error'] == DB_ERR_FILEREAD for r in results)
+            else:
+                ok = (code == local_code) and (results == local)
+            if mode == 'range':
+                ok = ok and (counts.get('416', 0) > 0)
+            if mode == 'norange':
+                ok = ok and (counts.get('200', 0) == len(names)) and not counts.get('206')
+            if mode == 'range':
+                ok = ok and (counts.get('connect', 0) == len(names))
+            if mode == 'drop':
+                ok = ok and (counts.get('connect', 0) == counts.get('206', 0) + counts.get('416', 0))
+            print('%s %-9s %s' % ('ok  ' if ok else 'FAIL', mode, ' '.join('%s:%d' % kv for kv in sorted(counts.items()))))
+            failures += not ok
+
+        server.shutdown()
+    finally:
+        shutil.rmtree(root)
+
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+################################################################################
+# Copyright (c) 2020, Dolby Laboratories Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification, are permitted
+# provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+#    and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+#    and the following disclaimer in the documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or
+#    promote products derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+# PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+# ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+# OF THE POSSIBILITY OF SUCH DAMAGE.
+################################################################################
+#
+# Completes patches from journals written by hand, as a patch interrupted
+# after its journal record and before or during its writes leaves them, and
+# compares the files with those patched without interruption. Also checks
+# that a patch waits for a lock held on the file by another process.
+#
+# usage: journal_test.py <parser executable> <sample_files directory>
+#
+# A journal is an 8 byte magic and a 32-bit version, followed by records of
+#
+#     u32 record length   u8 type   u64 sequence number   body   u64 FNV-1a hash
+#
+# as described in dbmd_patch.c. The writes of a record are the runs of bytes
+# that differ between a file and its patched copy.
+
+import fcntl
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+EDITS = ['warp_mode=pl2x', 'binaural=far', 'trim.5.1=auto']
+JOURNAL_PATCH = 1
+JOURNAL_DONE = 2
+
+
+def fnv1a64(data):
+    """The record hash, as dbmd_cache_hash() computes it"""
+    value = 0xCBF29CE484222325
+    for byte in data:
+        value = ((value ^ byte) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return value
+
+
+def record(rtype, sequence, body=b''):
+    """Returns a journal record with its length and hash"""
+    rec = struct.pack('<IBQ', 13 + len(body) + 8, rtype, sequence) + body
+    return rec + struct.pack('<Q', fnv1a64(rec))
+
+
+def patch_record(sequence, path, writes):
+    """Returns a patch record of (offset, old bytes, new bytes) writes"""
+    name = os.path.abspath(path).encode()
+    body = struct.pack('<H', len(name)) + name + struct.pack('<I', len(writes))
+    for offset, old, new in writes:
+        body += struct.pack('<QI', offset, len(old)) + old + new
+    return record(JOURNAL_PATCH, sequence, body)
+
+
+def diff_writes(old, new):
+    """Returns the runs of bytes that differ between two files"""
+    writes = []
+    pos = 0
+    while pos < len(old):
+        if old[pos] == new[pos]:
+            pos += 1
+            continue
+        end = pos
+        while (end < len(old)) and (old[end] != new[end]):
+            end += 1
+        writes.append((pos, old[pos:end], new[pos:end]))
+        pos = end
+    return writes
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def write(path, data, offset=0):
+    with open(path, 'r+b' if os.path.exists(path) else 'wb') as f:
+        f.seek(offset)
+        f.write(data)
+
+
+def recover(parser, journal, path):
+    """Opens a journal with a dry run patch of another file, returning the
+    numbers of patches completed and left alone"""
+    proc = subprocess.run([parser, 'patch', '--journal=' + journal, '--dry-run'] + EDITS + [path],
+                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    found = re.search(r'Completed (\d+) interrupted patches from the journal, (\d+) files', proc.stderr.decode())
+    if proc.returncode:
+        return None
+    return (int(found.group(1)), int(found.group(2))) if found else (0, 0)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('usage: journal_test.py <parser executable> <sample_files directory>')
+        return 2
+    parser = os.path.abspath(sys.argv[1])
+    samples = os.path.abspath(sys.argv[2])
+    names = sorted(n for n in os.listdir(samples) if n.endswith('.wav'))
+
+    root = tempfile.mkdtemp(prefix='dbmd_journal_test.')
+    try:
+        failures = 0
+        journal = os.path.join(root, 'patch.journal')
+        header = b'DBMDJRNL' + struct.pack('<I', 1)
+
+        for name in names:
+            original = read(os.path.join(samples, name))
+            expected = os.path.join(root, 'expected_' + name)
+            target = os.path.join(root, name)
+            write(expected, original)
+            subprocess.run([parser, 'patch'] + EDITS + [expected], stdout=subprocess.DEVNULL, check=True)
+            patched = read(expected)
+            writes = diff_writes(original, patched)
+            first = writes[0]
+
+            # (case, bytes written before the interruption, journal records, expected counts and contents)
+            cases = [
+                ('pending', [], [patch_record(0, target, writes)], (1, 0), patched),
+                ('partial', [first], [patch_record(0, target, writes)], (1, 0), patched),
+                ('done', [], [patch_record(0, target, writes), record(JOURNAL_DONE, 0)], (0, 0), original),
+                ('torn', [], [patch_record(0, target, writes)[:-1] + b'\0'], (0, 0), original),
+                ('changed', [(first[0], b'', bytes(b ^ 0xFF for b in first[2]))], [patch_record(0, target, writes)], (0, 1), None),
+            ]
+            for case, done, records, counts, contents in cases:
+                write(target, original)
+                for offset, old, new in done:
+                    write(target, new, offset)
+                before = read(target)
+                write(journal, header + b''.join(records))
+                result = recover(parser, journal, expected)
+                ok = (result == counts) and (read(target) == (before if contents is None else contents))
+                ok = ok and (read(journal) == header)
+                print('%s %-8s %s' % ('ok  ' if ok else 'FAIL', case, name))
+                failures += not ok
+
+            # a patch waits while another process holds a lock on the file
+            write(target, original)
+            with open(target, 'r+b') as f:
+                fcntl.lockf(f, fcntl.LOCK_EX)
+                proc = subprocess.Popen([parser, 'patch'] + EDITS + [target], stdout=subprocess.DEVNULL)
+                time.sleep(0.5)
+                waited = proc.poll() is None
+                fcntl.lockf(f, fcntl.LOCK_UN)
+            ok = waited and (proc.wait() == 0) and (read(target) == patched)
+            print('%s %-8s %s' % ('ok  ' if ok else 'FAIL', 'locked', name))
+            failures += not ok
+    finally:
+        shutil.rmtree(root)
+
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())